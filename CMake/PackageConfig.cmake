@@ -12,6 +12,16 @@ else()
   target_link_libraries(MVDTool INTERFACE sonata::sonata_shared)
 endif()
 
+# Same library, with the MPI_Comm overloads of MVD::open
+if(MVD_ENABLE_MPI)
+  add_library(MVDTool_mpi INTERFACE)
+  target_link_libraries(MVDTool_mpi INTERFACE MVDTool MPI::MPI_CXX)
+  target_compile_definitions(MVDTool_mpi INTERFACE -DMVDTOOL_USE_MPI)
+  set(MVDTOOL_EXPORTED_TARGETS MVDTool MVDTool_mpi)
+else()
+  set(MVDTOOL_EXPORTED_TARGETS MVDTool)
+endif()
+
 install(DIRECTORY ${PROJECT_SOURCE_DIR}/include/
         DESTINATION ${CMAKE_INSTALL_FULL_INCLUDEDIR})
 
@@ -31,7 +41,7 @@ if(MVD_INSTALL_DEV)  # E.g. Python installations dont need this
 install(EXPORT ${PROJECT_NAME}Targets FILE ${PROJECT_NAME}Targets.cmake
   DESTINATION share/${PROJECT_NAME}/CMake)
 
-install(TARGETS MVDTool EXPORT ${PROJECT_NAME}Targets
+install(TARGETS ${MVDTOOL_EXPORTED_TARGETS} EXPORT ${PROJECT_NAME}Targets
   INCLUDES DESTINATION include)
 
 export(EXPORT ${PROJECT_NAME}Targets
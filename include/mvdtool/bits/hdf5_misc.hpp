@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#ifdef MVDTOOL_USE_MPI
+#include <mpi.h>
+#endif
+
+#include <hdf5.h>
+#include <highfive/H5DataSet.hpp>
+#include <highfive/H5DataSpace.hpp>
+#include <highfive/H5DataType.hpp>
+#include <highfive/H5File.hpp>
+
+#include "../mvd_base.hpp"
+#include "../mvd_except.hpp"
+
+namespace MVD {
+namespace utils {
+
+///
+/// \brief Dataset transfer property list
+///
+/// Independent by default. Files opened with an MPI communicator on top of a
+/// parallel HDF5 use collective MPI-IO transfers, in which case every rank
+/// has to take part in each read, even with nothing to read
+///
+class TransferProps {
+public:
+    TransferProps() = default;
+
+    TransferProps(const TransferProps&) = delete;
+    TransferProps& operator=(const TransferProps&) = delete;
+
+    ~TransferProps() {
+        if (_id != H5P_DEFAULT) {
+            H5Pclose(_id);
+        }
+    }
+
+#ifdef H5_HAVE_PARALLEL
+    inline void setCollective() {
+        if (_id == H5P_DEFAULT) {
+            _id = H5Pcreate(H5P_DATASET_XFER);
+        }
+        if (_id < 0 || H5Pset_dxpl_mpio(_id, H5FD_MPIO_COLLECTIVE) < 0) {
+            throw MVDException("Unable to create a collective transfer property list");
+        }
+    }
+#endif
+
+    inline bool isCollective() const { return _id != H5P_DEFAULT; }
+    inline hid_t getId() const { return _id; }
+
+private:
+    hid_t _id = H5P_DEFAULT;
+};
+
+///
+/// \brief library_is_threadsafe
+/// \return whether the HDF5 library was built thread-safe, so that it can be
+/// called from several threads at once
+///
+inline bool library_is_threadsafe() {
+    hbool_t threadsafe = 0;
+    return H5is_library_threadsafe(&threadsafe) >= 0 && threadsafe;
+}
+
+///
+/// \brief read_ranges_into
+/// Reads the rows of sorted, non-overlapping [begin, end) `ranges` of a 1D or
+/// 2D dataset straight into caller memory, one after the other. Rows hold
+/// `width` values, taken from the dataset starting at `column`, and are
+/// written `stride` elements apart in `out`.
+///
+/// The ranges are selected as one union of hyperslabs and read by a single
+/// H5Dread, whatever their number. HDF5 converts from the stored type to T and
+/// scatters the values itself, no intermediate buffer is allocated. With
+/// collective transfer properties, every rank thus makes the same collective
+/// call for any shape of selection, the empty one included.
+///
+template <typename T>
+inline void read_ranges_into(const HighFive::DataSet& dataset,
+                             const Selection::Ranges& ranges,
+                             size_t column,
+                             size_t width,
+                             T* out,
+                             size_t stride,
+                             const TransferProps& xfer_props = TransferProps()) {
+    size_t count = 0;
+    for (const auto& range: ranges) {
+        count += range[1] - range[0];
+    }
+    if (count == 0 && !xfer_props.isCollective()) {
+        return;
+    }
+    if (stride < width) {
+        throw MVDException("Invalid stride " + std::to_string(stride) + " for rows of "
+                           + std::to_string(width) + " values");
+    }
+
+    const HighFive::DataSpace file_space = dataset.getSpace();
+    const bool is_1d = file_space.getNumberDimensions() == 1;
+    if (is_1d && (column != 0 || width != 1)) {
+        throw MVDException("Unable to read columns of a one dimensional dataset");
+    }
+    const HighFive::DataSpace mem_space(std::vector<size_t>{count, stride});
+    T dummy{};
+
+    bool selected = H5Sselect_none(file_space.getId()) >= 0 &&
+                    H5Sselect_none(mem_space.getId()) >= 0;
+    for (const auto& range: ranges) {
+        if (!selected) {
+            break;
+        }
+        const hsize_t start[2] = {range[0], column};
+        const hsize_t rows[2] = {range[1] - range[0], width};
+        selected = rows[0] == 0 ||
+                   H5Sselect_hyperslab(file_space.getId(), H5S_SELECT_OR, start, nullptr,
+                                       rows, nullptr) >= 0;
+    }
+    if (selected && count > 0) {
+        const hsize_t mem_start[2] = {0, 0};
+        const hsize_t mem_count[2] = {count, width};
+        selected = H5Sselect_hyperslab(mem_space.getId(), H5S_SELECT_SET, mem_start, nullptr,
+                                       mem_count, nullptr) >= 0;
+    }
+    if (!selected ||
+        H5Dread(dataset.getId(), HighFive::AtomicType<T>().getId(), mem_space.getId(),
+                file_space.getId(), xfer_props.getId(), (count == 0) ? &dummy : out) < 0) {
+        throw MVDException("Unable to read " + std::to_string(count) + " rows in "
+                           + std::to_string(ranges.size()) + " ranges");
+    }
+}
+
+///
+/// \brief read_hyperslab_into
+/// Reads `count` rows of a 1D or 2D dataset, starting at row `offset`, see
+/// read_ranges_into()
+///
+template <typename T>
+inline void read_hyperslab_into(const HighFive::DataSet& dataset,
+                                size_t offset,
+                                size_t count,
+                                size_t column,
+                                size_t width,
+                                T* out,
+                                size_t stride,
+                                const TransferProps& xfer_props = TransferProps()) {
+    Selection::Ranges ranges;
+    if (count > 0) {
+        ranges.push_back({offset, offset + count});
+    }
+    read_ranges_into(dataset, ranges, column, width, out, stride, xfer_props);
+}
+
+///
+/// \brief storage_chunk_rows
+/// \return the number of rows per chunk of a chunked dataset, 0 for the
+/// other layouts
+///
+inline size_t storage_chunk_rows(hid_t dataset) {
+    const hid_t plist = H5Dget_create_plist(dataset);
+    if (plist < 0) {
+        throw MVDException("Unable to get the creation properties of a dataset");
+    }
+    size_t rows = 0;
+    if (H5Pget_layout(plist) == H5D_CHUNKED) {
+        hsize_t dims[H5S_MAX_RANK];
+        if (H5Pget_chunk(plist, H5S_MAX_RANK, dims) > 0) {
+            rows = dims[0];
+        }
+    }
+    H5Pclose(plist);
+    return rows;
+}
+
+inline size_t storage_chunk_rows(const HighFive::DataSet& dataset) {
+    return storage_chunk_rows(dataset.getId());
+}
+
+///
+/// \brief dtype_name
+/// \return the name of a stored type, as used by Column::dtype, "other" for
+/// the types without a numeric or string equivalent
+///
+inline std::string dtype_name(hid_t type) {
+    switch (H5Tget_class(type)) {
+    case H5T_FLOAT:
+        return H5Tget_size(type) == 4 ? "float" : "double";
+    case H5T_STRING:
+        return "string";
+    case H5T_INTEGER:
+        return (H5Tget_sign(type) == H5T_SGN_NONE ? "uint" : "int") +
+               std::to_string(H5Tget_size(type) * 8) + "_t";
+    default:
+        return "other";
+    }
+}
+
+///
+/// \brief describe_dataset
+/// \return the type, extent and chunk layout of an open dataset
+///
+inline Column describe_dataset(hid_t dataset, std::string name) {
+    Column column;
+    column.name = std::move(name);
+
+    const hid_t type = H5Dget_type(dataset);
+    const hid_t space = H5Dget_space(dataset);
+    const int n_dims = (space < 0) ? -1 : H5Sget_simple_extent_ndims(space);
+    if (type >= 0) {
+        column.dtype = dtype_name(type);
+        H5Tclose(type);
+    }
+    if (n_dims > 0) {
+        std::vector<hsize_t> dims(static_cast<size_t>(n_dims));
+        H5Sget_simple_extent_dims(space, dims.data(), nullptr);
+        column.dims.assign(dims.begin(), dims.end());
+    }
+    if (space >= 0) {
+        H5Sclose(space);
+    }
+    if (type < 0 || n_dims < 0) {
+        throw MVDException("Unable to describe the dataset " + column.name);
+    }
+    column.chunk_rows = storage_chunk_rows(dataset);
+    return column;
+}
+
+///
+/// \brief describe_datasets
+/// Lists every dataset below `group`, recursively, in a single traversal
+/// \param prefix: prepended to the paths relative to `group`
+///
+inline std::vector<Column> describe_datasets(hid_t group, const std::string& prefix) {
+    struct Visit {
+        const std::string& prefix;
+        std::vector<Column> columns;
+        std::string error;
+    } visit{prefix, {}, {}};
+
+    const auto callback = [](hid_t location, const char* name, const H5L_info_t*, void* data) {
+        auto& v = *static_cast<Visit*>(data);
+        const hid_t object = H5Oopen(location, name, H5P_DEFAULT);
+        if (object < 0) {
+            v.error = name;
+            return -1;
+        }
+        herr_t status = 0;
+        try {
+            if (H5Iget_type(object) == H5I_DATASET) {
+                v.columns.push_back(describe_dataset(object, v.prefix + name));
+            }
+        } catch (const MVDException&) {
+            v.error = name;
+            status = -1;
+        }
+        H5Oclose(object);
+        return status;
+    };
+
+    if (H5Lvisit(group, H5_INDEX_NAME, H5_ITER_INC, callback, &visit) < 0) {
+        throw MVDException("Unable to list the datasets of " + prefix +
+                           (visit.error.empty() ? "" : ", failed on " + visit.error));
+    }
+    return std::move(visit.columns);
+}
+
+#ifdef MVDTOOL_USE_MPI
+///
+/// \brief open_parallel
+/// Opens a file read-only for all the ranks of `comm`. With a parallel HDF5,
+/// it goes through the MPI-IO driver, metadata is read collectively and
+/// `xfer_props` is switched to collective transfers. Otherwise every rank
+/// opens the file on its own, and reads stay independent
+///
+inline HighFive::File open_parallel(const std::string& filename,
+                                    MPI_Comm comm,
+                                    TransferProps& xfer_props) {
+#ifdef H5_HAVE_PARALLEL
+    HighFive::MPIOFileDriver driver(comm, MPI_INFO_NULL);
+    if (H5Pset_all_coll_metadata_ops(driver.getId(), true) < 0) {
+        throw MVDException("Unable to enable collective metadata reads for " + filename);
+    }
+    xfer_props.setCollective();
+    return HighFive::File(filename, HighFive::File::ReadOnly, driver);
+#else
+    (void) comm;
+    (void) xfer_props;
+    return HighFive::File(filename, HighFive::File::ReadOnly);
+#endif
+}
+#endif
+
+}  // namespace utils
+}  // namespace MVD
@@ -0,0 +1,459 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <bbp/sonata/nodes.h>
+
+#include "../multi_population.hpp"
+
+namespace MVD {
+
+inline MultiPopulationFile::MultiPopulationFile(const std::string& filename)
+    : MultiPopulationFile(std::vector<std::string>{filename}) {}
+
+inline MultiPopulationFile::MultiPopulationFile(const std::vector<std::string>& filenames)
+    : offsets_{0} {
+    for (const auto& filename: filenames) {
+        const bbp::sonata::NodeStorage storage(filename);
+        for (const auto& name: storage.populationNames()) {
+            populations_.push_back(std::make_unique<SonataFile>(filename, name));
+            names_.push_back(name);
+            offsets_.push_back(offsets_.back() + populations_.back()->size());
+        }
+    }
+    if (populations_.empty()) {
+        throw MVDException("Sonata files don't contain any population");
+    }
+}
+
+inline void MultiPopulationFile::openComboTsv(const std::string& filename) {
+    for (const auto& population: populations_) {
+        population->openComboTsv(filename);
+    }
+}
+
+inline const SonataFile& MultiPopulationFile::getPopulation(size_t index) const {
+    if (index >= populations_.size()) {
+        throw MVDException("Invalid population index " + std::to_string(index));
+    }
+    return *populations_[index];
+}
+
+inline std::pair<size_t, size_t> MultiPopulationFile::locate(size_t cell) const {
+    if (cell >= size()) {
+        throw MVDException("Cell " + std::to_string(cell) + " is out of bounds for "
+                           + std::to_string(size()) + " cells");
+    }
+    // Last population starting at or before the cell, skipping empty ones
+    const auto next = std::upper_bound(offsets_.begin(), offsets_.end(), cell);
+    const size_t index = static_cast<size_t>(next - offsets_.begin()) - 1;
+    return {index, cell - offsets_[index]};
+}
+
+// Range getters
+
+inline Positions MultiPopulationFile::getPositions(const Range& range) const {
+    return getPositions(Selection::fromRange(range, size()));
+}
+
+inline Rotations MultiPopulationFile::getRotations(const Range& range) const {
+    return getRotations(Selection::fromRange(range, size()));
+}
+
+inline void MultiPopulationFile::readPositions(const Range& range,
+                                               double* out,
+                                               size_t stride) const {
+    readPositions(Selection::fromRange(range, size()), out, stride);
+}
+
+inline void MultiPopulationFile::readRotations(const Range& range,
+                                               double* out,
+                                               size_t stride) const {
+    readRotations(Selection::fromRange(range, size()), out, stride);
+}
+
+inline bool MultiPopulationFile::hasRotations() const {
+    return std::any_of(populations_.begin(), populations_.end(), [](const auto& population) {
+        return population->hasRotations();
+    });
+}
+
+inline std::vector<std::string> MultiPopulationFile::getMorphologies(const Range& range) const {
+    return getMorphologies(Selection::fromRange(range, size()));
+}
+
+inline std::vector<std::string> MultiPopulationFile::getEtypes(const Range& range) const {
+    return getEtypes(Selection::fromRange(range, size()));
+}
+
+inline std::vector<std::string> MultiPopulationFile::getMtypes(const Range& range) const {
+    return getMtypes(Selection::fromRange(range, size()));
+}
+
+inline std::vector<std::string> MultiPopulationFile::getEmodels(const Range& range) const {
+    return getEmodels(Selection::fromRange(range, size()));
+}
+
+inline std::vector<std::string> MultiPopulationFile::getRegions(const Range& range) const {
+    return getRegions(Selection::fromRange(range, size()));
+}
+
+inline std::vector<std::string> MultiPopulationFile::getSynapseClass(const Range& range) const {
+    return getSynapseClass(Selection::fromRange(range, size()));
+}
+
+inline bool MultiPopulationFile::hasRegions() const {
+    return std::all_of(populations_.begin(), populations_.end(), [](const auto& population) {
+        return population->hasRegions();
+    });
+}
+
+inline bool MultiPopulationFile::concurrentReads() const {
+    return std::all_of(populations_.begin(), populations_.end(), [](const auto& population) {
+        return population->concurrentReads();
+    });
+}
+
+inline bool MultiPopulationFile::hasMiniFrequencies() const {
+    return std::all_of(populations_.begin(), populations_.end(), [](const auto& population) {
+        return population->hasMiniFrequencies();
+    });
+}
+
+inline std::vector<double> MultiPopulationFile::getExcMiniFrequencies(const Range& range) const {
+    return getExcMiniFrequencies(Selection::fromRange(range, size()));
+}
+
+inline std::vector<double> MultiPopulationFile::getInhMiniFrequencies(const Range& range) const {
+    return getInhMiniFrequencies(Selection::fromRange(range, size()));
+}
+
+inline bool MultiPopulationFile::hasCurrents() const {
+    return std::all_of(populations_.begin(), populations_.end(), [](const auto& population) {
+        return population->hasCurrents();
+    });
+}
+
+inline std::vector<double> MultiPopulationFile::getThresholdCurrents(const Range& range) const {
+    return getThresholdCurrents(Selection::fromRange(range, size()));
+}
+
+inline std::vector<double> MultiPopulationFile::getHoldingCurrents(const Range& range) const {
+    return getHoldingCurrents(Selection::fromRange(range, size()));
+}
+
+inline Categorical MultiPopulationFile::getCategoricalMorphologies(const Range& range) const {
+    return getCategoricalMorphologies(Selection::fromRange(range, size()));
+}
+
+inline Categorical MultiPopulationFile::getCategoricalEtypes(const Range& range) const {
+    return getCategoricalEtypes(Selection::fromRange(range, size()));
+}
+
+inline Categorical MultiPopulationFile::getCategoricalMtypes(const Range& range) const {
+    return getCategoricalMtypes(Selection::fromRange(range, size()));
+}
+
+inline Categorical MultiPopulationFile::getCategoricalRegions(const Range& range) const {
+    return getCategoricalRegions(Selection::fromRange(range, size()));
+}
+
+inline Categorical MultiPopulationFile::getCategoricalSynapseClass(const Range& range) const {
+    return getCategoricalSynapseClass(Selection::fromRange(range, size()));
+}
+
+inline std::vector<size_t> MultiPopulationFile::getIndexEtypes(const Range& range) const {
+    return getIndexEtypes(Selection::fromRange(range, size()));
+}
+
+inline std::vector<size_t> MultiPopulationFile::getIndexMtypes(const Range& range) const {
+    return getIndexMtypes(Selection::fromRange(range, size()));
+}
+
+inline std::vector<size_t> MultiPopulationFile::getIndexRegions(const Range& range) const {
+    return getIndexRegions(Selection::fromRange(range, size()));
+}
+
+inline std::vector<size_t> MultiPopulationFile::getIndexSynapseClass(const Range& range) const {
+    return getIndexSynapseClass(Selection::fromRange(range, size()));
+}
+
+inline std::vector<std::string> MultiPopulationFile::listAllEtypes() const {
+    return listAll(&SonataFile::listAllEtypes);
+}
+
+inline std::vector<std::string> MultiPopulationFile::listAllMtypes() const {
+    return listAll(&SonataFile::listAllMtypes);
+}
+
+inline std::vector<std::string> MultiPopulationFile::listAllEmodels() const {
+    return listAll(&SonataFile::listAllEmodels);
+}
+
+inline std::vector<std::string> MultiPopulationFile::listAllRegions() const {
+    return listAll(&SonataFile::listAllRegions);
+}
+
+inline std::vector<std::string> MultiPopulationFile::listAllSynapseClass() const {
+    return listAll(&SonataFile::listAllSynapseClass);
+}
+
+// Selection variants
+
+inline Positions MultiPopulationFile::getPositions(const Selection& selection) const {
+    Positions res(boost::extents[selection.flatSize()][3]);
+    readPositions(selection, res.data(), 3);
+    return res;
+}
+
+inline Rotations MultiPopulationFile::getRotations(const Selection& selection) const {
+    Rotations res(boost::extents[selection.flatSize()][4]);
+    readRotations(selection, res.data(), 4);
+    return res;
+}
+
+inline void MultiPopulationFile::readPositions(const Selection& selection,
+                                               double* out,
+                                               size_t stride) const {
+    forEachPopulation(selection, [=](const SonataFile& population,
+                                     const Selection& local,
+                                     size_t first_row) {
+        population.readPositions(local, out + first_row * stride, stride);
+    });
+}
+
+inline void MultiPopulationFile::readRotations(const Selection& selection,
+                                               double* out,
+                                               size_t stride) const {
+    forEachPopulation(selection, [=](const SonataFile& population,
+                                     const Selection& local,
+                                     size_t first_row) {
+        population.readRotations(local, out + first_row * stride, stride);
+    });
+}
+
+inline std::vector<std::string> MultiPopulationFile::getMorphologies(
+    const Selection& selection) const {
+    return concat<std::string>(selection, &SonataFile::getMorphologies);
+}
+
+inline std::vector<std::string> MultiPopulationFile::getEtypes(const Selection& selection) const {
+    return concat<std::string>(selection, &SonataFile::getEtypes);
+}
+
+inline std::vector<std::string> MultiPopulationFile::getMtypes(const Selection& selection) const {
+    return concat<std::string>(selection, &SonataFile::getMtypes);
+}
+
+inline std::vector<std::string> MultiPopulationFile::getEmodels(const Selection& selection) const {
+    return concat<std::string>(selection, &SonataFile::getEmodels);
+}
+
+inline std::vector<std::string> MultiPopulationFile::getRegions(const Selection& selection) const {
+    return concat<std::string>(selection, &SonataFile::getRegions);
+}
+
+inline std::vector<std::string> MultiPopulationFile::getSynapseClass(
+    const Selection& selection) const {
+    return concat<std::string>(selection, &SonataFile::getSynapseClass);
+}
+
+inline std::vector<double> MultiPopulationFile::getExcMiniFrequencies(
+    const Selection& selection) const {
+    return concat<double>(selection, &SonataFile::getExcMiniFrequencies);
+}
+
+inline std::vector<double> MultiPopulationFile::getInhMiniFrequencies(
+    const Selection& selection) const {
+    return concat<double>(selection, &SonataFile::getInhMiniFrequencies);
+}
+
+inline std::vector<double> MultiPopulationFile::getThresholdCurrents(
+    const Selection& selection) const {
+    return concat<double>(selection, &SonataFile::getThresholdCurrents);
+}
+
+inline std::vector<double> MultiPopulationFile::getHoldingCurrents(
+    const Selection& selection) const {
+    return concat<double>(selection, &SonataFile::getHoldingCurrents);
+}
+
+inline Categorical MultiPopulationFile::getCategoricalMorphologies(
+    const Selection& selection) const {
+    return concatCategorical(selection, &SonataFile::getCategoricalMorphologies);
+}
+
+inline Categorical MultiPopulationFile::getCategoricalEtypes(const Selection& selection) const {
+    return concatCategorical(selection, &SonataFile::getCategoricalEtypes);
+}
+
+inline Categorical MultiPopulationFile::getCategoricalMtypes(const Selection& selection) const {
+    return concatCategorical(selection, &SonataFile::getCategoricalMtypes);
+}
+
+inline Categorical MultiPopulationFile::getCategoricalRegions(const Selection& selection) const {
+    return concatCategorical(selection, &SonataFile::getCategoricalRegions);
+}
+
+inline Categorical MultiPopulationFile::getCategoricalSynapseClass(
+    const Selection& selection) const {
+    return concatCategorical(selection, &SonataFile::getCategoricalSynapseClass);
+}
+
+inline std::vector<size_t> MultiPopulationFile::getIndexEtypes(const Selection& selection) const {
+    return concatIndex(selection, &SonataFile::getIndexEtypes, &SonataFile::listAllEtypes);
+}
+
+inline std::vector<size_t> MultiPopulationFile::getIndexMtypes(const Selection& selection) const {
+    return concatIndex(selection, &SonataFile::getIndexMtypes, &SonataFile::listAllMtypes);
+}
+
+inline std::vector<size_t> MultiPopulationFile::getIndexRegions(const Selection& selection) const {
+    return concatIndex(selection, &SonataFile::getIndexRegions, &SonataFile::listAllRegions);
+}
+
+inline std::vector<size_t> MultiPopulationFile::getIndexSynapseClass(
+    const Selection& selection) const {
+    return concatIndex(selection, &SonataFile::getIndexSynapseClass,
+                       &SonataFile::listAllSynapseClass);
+}
+
+// Private
+
+template <typename FuncT>
+inline void MultiPopulationFile::forEachPopulation(const Selection& selection,
+                                                   const FuncT& f) const {
+    selection.checkBounds(size());
+    const auto& ranges = selection.ranges();
+    auto range = ranges.begin();
+    size_t first_row = 0;
+    for (size_t index = 0; index < populations_.size() && range != ranges.end(); ++index) {
+        const size_t first = offsets_[index];
+        const size_t last = offsets_[index + 1];
+        Selection::Ranges local;
+        size_t count = 0;
+        for (auto it = range; it != ranges.end() && (*it)[0] < last; ++it) {
+            const size_t begin = std::max((*it)[0], first);
+            const size_t end = std::min((*it)[1], last);
+            if (begin < end) {
+                local.push_back({begin - first, end - first});
+                count += end - begin;
+            }
+        }
+        // Ranges crossing into the next population are visited again
+        while (range != ranges.end() && (*range)[1] <= last) {
+            ++range;
+        }
+        if (count > 0) {
+            f(*populations_[index], Selection(local), first_row);
+            first_row += count;
+        }
+    }
+}
+
+template <typename T>
+inline std::vector<T> MultiPopulationFile::concat(const Selection& selection,
+                                                  Getter<T> getter) const {
+    std::vector<T> res;
+    res.reserve(selection.flatSize());
+    forEachPopulation(selection, [&](const SonataFile& population,
+                                     const Selection& local,
+                                     size_t) {
+        auto part = (population.*getter)(local);
+        std::move(part.begin(), part.end(), std::back_inserter(res));
+    });
+    return res;
+}
+
+inline Categorical MultiPopulationFile::concatCategorical(const Selection& selection,
+                                                          CategoricalGetter getter) const {
+    using code_type = Categorical::code_type;
+    auto dictionary = std::make_shared<Categorical::Dictionary>();
+    std::unordered_map<std::string, code_type> index;
+    std::vector<code_type> codes;
+    codes.reserve(selection.flatSize());
+    forEachPopulation(selection, [&](const SonataFile& population,
+                                     const Selection& local,
+                                     size_t) {
+        const Categorical part = (population.*getter)(local);
+        // Codes of the population dictionary in the merged one
+        std::vector<code_type> remap;
+        remap.reserve(part.dictionary().size());
+        for (const auto& value: part.dictionary()) {
+            auto it = index.emplace(value, static_cast<code_type>(dictionary->size())).first;
+            if (it->second == dictionary->size()) {
+                dictionary->push_back(value);
+            }
+            remap.push_back(it->second);
+        }
+        for (const auto code: part.codes()) {
+            codes.push_back(remap[code]);
+        }
+    });
+    return Categorical(std::move(codes), std::move(dictionary));
+}
+
+inline std::vector<size_t> MultiPopulationFile::concatIndex(const Selection& selection,
+                                                            Getter<size_t> getter,
+                                                            ListGetter list_getter) const {
+    std::unordered_map<std::string, size_t> index;
+    for (const auto& value: listAll(list_getter)) {
+        index.emplace(value, index.size());
+    }
+    std::vector<size_t> res;
+    res.reserve(selection.flatSize());
+    forEachPopulation(selection, [&](const SonataFile& population,
+                                     const Selection& local,
+                                     size_t) {
+        std::vector<size_t> remap;
+        for (const auto& value: (population.*list_getter)()) {
+            remap.push_back(index.at(value));
+        }
+        for (const auto i: (population.*getter)(local)) {
+            if (i >= remap.size()) {
+                throw MVDParserException("Invalid index reference " + std::to_string(i)
+                                         + " in an dataset of size "
+                                         + std::to_string(remap.size()));
+            }
+            res.push_back(remap[i]);
+        }
+    });
+    return res;
+}
+
+inline std::vector<std::string> MultiPopulationFile::listAll(ListGetter list_getter) const {
+    std::vector<std::string> res;
+    std::unordered_set<std::string> seen;
+    for (const auto& population: populations_) {
+        for (auto& value: ((*population).*list_getter)()) {
+            if (seen.insert(value).second) {
+                res.push_back(std::move(value));
+            }
+        }
+    }
+    return res;
+}
+
+}  // namespace MVD
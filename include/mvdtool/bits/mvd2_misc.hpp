@@ -18,75 +18,418 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
-#include <cstdio>
 #include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
 #include <boost/algorithm/string.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/math/constants/constants.hpp>
+#include <boost/utility/string_view.hpp>
 
 #include "../mvd2.hpp"
 #include "../mvd_except.hpp"
+#include "../utils.hpp"
 
 
 namespace MVD2{
 
 
 
+namespace detail {
+
+// Whitespace separating the fields of a line, as in scanf
+inline bool is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// The next field of [it, end), moving `it` past it
+inline boost::string_view next_field(const char*& it, const char* end) {
+    while (it != end && is_space(*it)) {
+        ++it;
+    }
+    const char* first = it;
+    while (it != end && !is_space(*it)) {
+        ++it;
+    }
+    return boost::string_view(first, size_t(it - first));
+}
+
+// Numbers must span their whole field
+inline bool parse_field(boost::string_view field, int& value) {
+    return !field.empty() && MVD::utils::scan_int(field.begin(), field.end(), value) == field.end();
+}
+
+inline bool parse_field(boost::string_view field, double& value) {
+    return !field.empty() &&
+           MVD::utils::scan_double(field.begin(), field.end(), value) == field.end();
+}
+
+// Single precision fields are rounded once, as sscanf("%f") did
+inline bool parse_field(boost::string_view field, float& value) {
+    return !field.empty() &&
+           MVD::utils::scan_float(field.begin(), field.end(), value) == field.end();
+}
+
+// Callbacks taking a boost::string_view are handed the line in the mapping
+template <typename Callback>
+inline auto call_line_parser(Callback& line_parser,
+                             DataSet type,
+                             boost::string_view line,
+                             boost::string_view,
+                             std::string&,
+                             int) -> decltype(line_parser(type, line)) {
+    return line_parser(type, line);
+}
+
+// Others get a C string of the raw line, newline included
+template <typename Callback>
+inline int call_line_parser(Callback& line_parser,
+                            DataSet type,
+                            boost::string_view,
+                            boost::string_view raw_line,
+                            std::string& buffer,
+                            long) {
+    buffer.assign(raw_line.data(), raw_line.size());
+    return line_parser(type, buffer.c_str());
+}
+
+// Binary index of a mvd2 file, in native byte order: header, sections,
+// neuron offsets and the absolute path of the mvd2 file
+constexpr char mvd2_index_magic[8] = {'M', 'V', 'D', '2', 'I', 'D', 'X', '\0'};
+constexpr uint32_t mvd2_index_version = 1;
+
+struct MVD2IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_sections;
+    MVD::utils::FileStamp source;
+    uint64_t n_neurons;
+    uint64_t path_size;
+    // Of everything after the header
+    uint64_t checksum;
+};
+
+struct MVD2IndexSection {
+    uint32_t type;
+    uint32_t padding;
+    uint64_t offset;
+    uint64_t n_lines;
+};
+
+static_assert(sizeof(MVD2IndexHeader) % sizeof(uint64_t) == 0, "Misaligned index sections");
+static_assert(sizeof(MVD2IndexSection) == 24, "Padded index sections");
+
+// The quaternion (x, y, z, w) of a rotation of `angle` degrees around y, as
+// written by the MVD3 converter
+template <typename Row>
+inline void rotation_quaternion(double angle, Row&& row) {
+    const double half_angle = angle * (boost::math::constants::pi<double>() / 180.) / 2;
+    row[0] = row[2] = 0;
+    row[1] = std::sin(half_angle);
+    row[3] = std::cos(half_angle);
+}
+
+// The cells of a selection in a column
+template <typename To, typename From>
+inline std::vector<To> slice(const std::vector<From>& column, const MVD::Selection& selection) {
+    selection.checkBounds(column.size());
+    std::vector<To> values;
+    values.reserve(selection.flatSize());
+    for (const auto& range: selection.ranges()) {
+        values.insert(values.end(), column.begin() + std::ptrdiff_t(range[0]),
+                      column.begin() + std::ptrdiff_t(range[1]));
+    }
+    return values;
+}
+
+template <typename T>
+inline std::vector<T> slice(const std::vector<T>& column, const MVD::Selection& selection) {
+    return slice<T, T>(column, selection);
+}
+
+
+// Strings to codes in order of first appearance, keyed on views of the
+// mapped file
+struct Encoding {
+    using code_type = NeuronColumns::code_type;
+
+    std::unordered_map<boost::string_view, code_type, boost::hash<boost::string_view>> codes;
+    std::vector<boost::string_view> names;
+
+    inline code_type operator()(boost::string_view value) {
+        const auto it = codes.emplace(value, code_type(names.size()));
+        if (it.second) {
+            names.push_back(value);
+        }
+        return it.first->second;
+    }
+
+    inline std::shared_ptr<const NeuronColumns::Dictionary> dictionary() const {
+        auto dictionary = std::make_shared<NeuronColumns::Dictionary>();
+        dictionary->reserve(names.size());
+        for (const auto& name: names) {
+            dictionary->emplace_back(name.data(), name.size());
+        }
+        return dictionary;
+    }
+};
+
+
+// The neurons of a chunk of lines, parsed by one thread. Names are encoded
+// in the chunk, then remapped when the chunk is appended
+struct NeuronChunk {
+    using code_type = NeuronColumns::code_type;
+
+    inline explicit NeuronChunk(size_t n_neurons) {
+        xyzr.reserve(4 * n_neurons);
+        for (auto* column: {&hypercolumns, &minicolumns, &layers}) {
+            column->reserve(n_neurons);
+        }
+        for (auto* column: {&morphologies, &me_combos, &mtypes, &etypes}) {
+            column->reserve(n_neurons);
+        }
+    }
+
+    inline void operator()(size_t, boost::string_view line) {
+        boost::string_view morphology, me_combo;
+        int database, hypercolumn, minicolumn, layer, mtype, etype;
+        parseNeuronLine(line, morphology, database, hypercolumn, minicolumn, layer, mtype, etype,
+                        _xyzr, me_combo);
+        if (mtype < 0 || etype < 0) {
+            throw MVDParserException("Negative mtype or etype in MVD2 neuron line :" +
+                                     line.to_string());
+        }
+        xyzr.insert(xyzr.end(), _xyzr.begin(), _xyzr.end());
+        hypercolumns.push_back(hypercolumn);
+        minicolumns.push_back(minicolumn);
+        layers.push_back(layer + 1);
+        morphologies.push_back(morphology_names(morphology));
+        me_combos.push_back(me_combo_names(me_combo));
+        mtypes.push_back(static_cast<code_type>(mtype));
+        etypes.push_back(static_cast<code_type>(etype));
+    }
+
+    std::vector<double> xyzr;
+    std::vector<int32_t> hypercolumns;
+    std::vector<int32_t> minicolumns;
+    std::vector<int32_t> layers;
+    std::vector<code_type> morphologies;
+    std::vector<code_type> me_combos;
+    std::vector<code_type> mtypes;
+    std::vector<code_type> etypes;
+    Encoding morphology_names;
+    Encoding me_combo_names;
+
+private:
+    std::vector<double> _xyzr;
+};
+
+
+// Builds NeuronColumns from the neuron chunks, appended in gid order, and
+// the lines of the other sections
+class ColumnLoader {
+public:
+    using code_type = NeuronColumns::code_type;
+
+    inline ColumnLoader(NeuronColumns& columns, size_t n_neurons)
+        : _columns(columns) {
+        _columns.xyzr.reserve(4 * n_neurons);
+        for (auto* column: {&_columns.hypercolumns, &_columns.minicolumns, &_columns.layers}) {
+            column->reserve(n_neurons);
+        }
+        for (auto* column: {&_columns.morphologies, &_columns.me_combos, &_columns.mtypes,
+                            &_columns.etypes}) {
+            column->reserve(n_neurons);
+        }
+    }
+
+    inline void append(const NeuronChunk& chunk) {
+        const auto concat = [](std::vector<int32_t>& column, const std::vector<int32_t>& values) {
+            column.insert(column.end(), values.begin(), values.end());
+        };
+        _columns.xyzr.insert(_columns.xyzr.end(), chunk.xyzr.begin(), chunk.xyzr.end());
+        concat(_columns.hypercolumns, chunk.hypercolumns);
+        concat(_columns.minicolumns, chunk.minicolumns);
+        concat(_columns.layers, chunk.layers);
+        remap(_columns.morphologies, chunk.morphologies, chunk.morphology_names, _morphologies);
+        remap(_columns.me_combos, chunk.me_combos, chunk.me_combo_names, _me_combos);
+        _columns.mtypes.insert(_columns.mtypes.end(), chunk.mtypes.begin(), chunk.mtypes.end());
+        _columns.etypes.insert(_columns.etypes.end(), chunk.etypes.begin(), chunk.etypes.end());
+    }
+
+    inline void operator()(DataSet type, boost::string_view line) {
+        switch (type) {
+        case MorphTypes: {
+            boost::string_view mtype, morph_class, synapse_class;
+            parseMorphTypeLine(line, mtype, morph_class, synapse_class);
+            _mtype_names.push_back(mtype);
+            _mtype_morph_class.push_back(_morph_classes(morph_class));
+            _mtype_synapse_class.push_back(_synapse_classes(synapse_class));
+            break;
+        }
+        case ElectroTypes: {
+            boost::string_view etype;
+            parseElectroTypeLine(line, etype);
+            _etype_names.push_back(etype);
+            break;
+        }
+        case CircuitSeeds: {
+            _columns.seeds.resize(3);
+            parseSeedInitLine(line, _columns.seeds[0], _columns.seeds[1], _columns.seeds[2]);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    // The types tables follow the neurons: their codes are checked at the end
+    inline void finish(const std::string& filename) {
+        const auto check = [&filename](const std::vector<code_type>& codes,
+                                       size_t n_types,
+                                       const char* section) {
+            for (const code_type code: codes) {
+                if (code >= n_types) {
+                    std::ostringstream ss;
+                    ss << "Invalid " << section << " index " << code << " in " << filename
+                       << ", which has " << n_types;
+                    throw MVDParserException(ss.str());
+                }
+            }
+        };
+        check(_columns.mtypes, _mtype_names.names.size(), "MorphTypes");
+        check(_columns.etypes, _etype_names.names.size(), "ElectroTypes");
+
+        _columns.morph_classes.resize(_columns.mtypes.size());
+        _columns.synapse_class.resize(_columns.mtypes.size());
+        for (size_t i = 0; i < _columns.mtypes.size(); ++i) {
+            _columns.morph_classes[i] = _mtype_morph_class[_columns.mtypes[i]];
+            _columns.synapse_class[i] = _mtype_synapse_class[_columns.mtypes[i]];
+        }
+        _columns.morphology_names = _morphologies.dictionary();
+        _columns.me_combo_names = _me_combos.dictionary();
+        _columns.mtype_names = _mtype_names.dictionary();
+        _columns.etype_names = _etype_names.dictionary();
+        _columns.morph_class_names = _morph_classes.dictionary();
+        _columns.synapse_class_names = _synapse_classes.dictionary();
+    }
+
+private:
+    // Section entries keep their duplicates, indices are positions
+    struct Table {
+        std::vector<boost::string_view> names;
+
+        inline void push_back(boost::string_view name) { names.push_back(name); }
+
+        inline std::shared_ptr<const NeuronColumns::Dictionary> dictionary() const {
+            return std::make_shared<const NeuronColumns::Dictionary>(names.begin(), names.end());
+        }
+    };
+
+    static inline void remap(std::vector<code_type>& column,
+                             const std::vector<code_type>& codes,
+                             const Encoding& chunk_names,
+                             Encoding& names) {
+        std::vector<code_type> chunk_to_column(chunk_names.names.size());
+        bool identity = true;
+        for (size_t i = 0; i < chunk_to_column.size(); ++i) {
+            chunk_to_column[i] = names(chunk_names.names[i]);
+            identity = identity && chunk_to_column[i] == i;
+        }
+        if (identity) {
+            column.insert(column.end(), codes.begin(), codes.end());
+            return;
+        }
+        for (const code_type code: codes) {
+            column.push_back(chunk_to_column[code]);
+        }
+    }
+
+    NeuronColumns& _columns;
+    Encoding _morphologies;
+    Encoding _me_combos;
+    Encoding _morph_classes;
+    Encoding _synapse_classes;
+    Table _mtype_names;
+    Table _etype_names;
+    std::vector<code_type> _mtype_morph_class;
+    std::vector<code_type> _mtype_synapse_class;
+};
+
+}  // namespace detail
+
+
 /// parse MVD2 file datatype section
-inline DataSet getDataType(const char* line, const DataSet & prev_datatype){
-    if (line[0] == '#') {
+inline DataSet getDataType(boost::string_view line, const DataSet & prev_datatype){
+    if (line.starts_with('#')) {
         return prev_datatype;
-    } else if (strncmp("Neurons Loaded", line + 0, 14) == 0) {
+    } else if (line.starts_with("Neurons Loaded")) {
         return NeuronLoaded;
-    } else if (strncmp("MicroBox Data", line + 0, 13) == 0) {
+    } else if (line.starts_with("MicroBox Data")) {
         return MicroBoxData;
-    } else if (strncmp("MiniColumnsPosition", line + 0, 19) == 0) {
+    } else if (line.starts_with("MiniColumnsPosition")) {
         return MiniColumnsPosition;
-    } else if (strncmp("CircuitSeeds", line + 0, 12) == 0) {
+    } else if (line.starts_with("CircuitSeeds")) {
         return CircuitSeeds;
-    } else if (strncmp("MorphTypes", line + 0, 10) == 0) {
+    } else if (line.starts_with("MorphTypes")) {
         return MorphTypes;
-    } else if (strncmp("ElectroTypes", line + 0, 12) == 0) {
+    } else if (line.starts_with("ElectroTypes")) {
         return ElectroTypes;
     }
     return prev_datatype;
 }
 
 /// SAX style parser for MVD2
-/// provided call back has to be with the signature bool (DataSet type, const char* line)
+/// provided call back has to be with the signature int (DataSet type, boost::string_view line)
+/// or int (DataSet type, const char* line)
 ///
 template <typename Callback>
 inline void MVD2File::parse(Callback & lineParser) const{
-    FILE *data;
-
-    //Look for the file
-    if ((data = fopen(_filename.c_str(), "r")) == NULL)
-        throw MVDParserException("Could not find the mvd file" + _filename + "...\n");
-
-    char line[1025] = {0};
+    const char* it = data().begin();
+    const char* const end = data().end();
 
     // drop header
-    if( fgets(line, 255, data) == NULL
-        || fgets(line, 255, data) == NULL){
-        throw MVDParserException("Invalid header parsing for " + _filename );
+    for (int i = 0; i < 2; ++i) {
+        if (it == end) {
+            throw MVDParserException("Invalid header parsing for " + _filename );
+        }
+        MVD::utils::next_line(it, end);
     }
 
     DataSet type = None;
     size_t count = 0;
-    while (fgets(line, 1024, data) != NULL) {
+    std::string buffer;
+    while (it != end) {
+        const char* const first = it;
+        boost::string_view line = MVD::utils::next_line(it, end);
+        const boost::string_view raw_line(first, size_t(it - first));
+        if (line.ends_with('\r')) {
+            line.remove_suffix(1);
+        }
+
         DataSet prev_type = type;
         if( (type=getDataType(line, prev_type)) != prev_type){
             count = 0;
         }
 
         if(count>0){
-            int res = lineParser(type, line);
+            int res = detail::call_line_parser(lineParser, type, line, raw_line, buffer, 0);
             if(res == 1) {
                 break;
             }
         }
         count++;
     }
-    fclose(data);
 }
 
 
@@ -95,70 +438,103 @@ inline void MVD2File::parse(Callback & lineParser) const{
 /// Raw parsers
 /////////////////////////////////////////
 
-// Precision force to float to maintain compability, need to switch to double in future
-inline void parseNeuronLine(const char* line, std::string & name, int& database, int &column, int &minicolumn, int &layer,
+template <typename T>
+inline void parseNeuronLine(boost::string_view line, boost::string_view & name, int& database, int &column, int &minicolumn, int &layer,
                      int &morphologytype, int &electrophysiology_type,
-                     std::vector<float> & xyzr, std::string & metype){
-    char name_str[1025] = "";
-    char metype_str[1024] = "?";
+                     std::vector<T> & xyzr, boost::string_view & metype){
+    const char* it = line.begin();
+    const char* const end = line.end();
+    int* const integers[] = {&database, &column, &minicolumn, &layer, &morphologytype, &electrophysiology_type};
 
     xyzr.resize(4);
-    if( sscanf(line, "%s %d %d %d %d %d %d %f %f %f %f %s", name_str,
-           &database, &column, &minicolumn, &layer, &morphologytype, &electrophysiology_type,
-            &xyzr[0], &xyzr[1], &xyzr[2], &xyzr[3], metype_str) != 12){
-        throw MVDParserException(std::string("Impossible to parse MVD2 neuron line :") + line);
+    name = detail::next_field(it, end);
+    bool valid = !name.empty();
+    for (int* integer: integers) {
+        valid = valid && detail::parse_field(detail::next_field(it, end), *integer);
+    }
+    for (T& coordinate: xyzr) {
+        valid = valid && detail::parse_field(detail::next_field(it, end), coordinate);
+    }
+    metype = detail::next_field(it, end);
+    if (!valid || metype.empty()) {
+        throw MVDParserException("Impossible to parse MVD2 neuron line :" + line.to_string());
     }
-
-    metype = metype_str;
-    name = name_str;
 }
 
 
 // Precision force to float to maintain compability, need to switch to double in future
 inline void parseNeuronLine(const char* line, std::string & name, int& database, int &column, int &minicolumn, int &layer,
                      int &morphologytype, int &electrophysiology_type,
-                     std::vector<double> & xyzr, std::string & metype){
-    char name_str[1025] = "";
-    char metype_str[1024] = "?";
+                     std::vector<float> & xyzr, std::string & metype){
+    boost::string_view name_view, metype_view;
+    parseNeuronLine(boost::string_view(line), name_view, database, column, minicolumn, layer,
+                    morphologytype, electrophysiology_type, xyzr, metype_view);
+    metype.assign(metype_view.data(), metype_view.size());
+    name.assign(name_view.data(), name_view.size());
+}
 
-    xyzr.resize(4);
-    if( sscanf(line, "%s %d %d %d %d %d %d %lf %lf %lf %lf %s", name_str,
-           &database, &column, &minicolumn, &layer, &morphologytype, &electrophysiology_type,
-            &xyzr[0], &xyzr[1], &xyzr[2], &xyzr[3], metype_str) != 12){
-        throw MVDParserException(std::string("Impossible to parse MVD2 neuron line :") + line);
-    }
 
-    metype = metype_str;
-    name = name_str;
+inline void parseNeuronLine(const char* line, std::string & name, int& database, int &column, int &minicolumn, int &layer,
+                     int &morphologytype, int &electrophysiology_type,
+                     std::vector<double> & xyzr, std::string & metype){
+    boost::string_view name_view, metype_view;
+    parseNeuronLine(boost::string_view(line), name_view, database, column, minicolumn, layer,
+                    morphologytype, electrophysiology_type, xyzr, metype_view);
+    metype.assign(metype_view.data(), metype_view.size());
+    name.assign(name_view.data(), name_view.size());
 }
 
 
-inline void parseSeedInitLine(const char *line, double &seed1, double &seed2, double &seed3){
+inline void parseSeedInitLine(boost::string_view line, double &seed1, double &seed2, double &seed3){
     // TODO: parsing into simple precision done for compatibility, change in future MVD3
-    float fseed1, fseed2, fseed3;
-    if(sscanf(line, "%f %f %f", &fseed1, &fseed2, &fseed3) != 3){
-        throw MVDParserException(std::string("Impossible to parse MVD2 Seed line :") + line);
+    const char* it = line.begin();
+    float fseeds[3];
+    for (float& seed: fseeds) {
+        if (!detail::parse_field(detail::next_field(it, line.end()), seed)) {
+            throw MVDParserException("Impossible to parse MVD2 Seed line :" + line.to_string());
+        }
     }
-    seed1 = fseed1; seed2 = fseed2; seed3 = fseed3;
+    seed1 = fseeds[0]; seed2 = fseeds[1]; seed3 = fseeds[2];
 }
 
 
-inline void parseMorphTypeLine(const char* line, std::string & name, std::string & name2, std::string & morphClass){
-    char name_1[1025] = {0}, name_2[1025] = {0}, name_3[1025] = {0};
-    if( sscanf(line, "%s %s %s", name_1, name_2, name_3) != 3){
-         throw MVDParserException(std::string("Impossible to parse MVD2 MorphType line :") + line);
+inline void parseMorphTypeLine(boost::string_view line, boost::string_view & name, boost::string_view & name2,
+                               boost::string_view & morphClass){
+    const char* it = line.begin();
+    name = detail::next_field(it, line.end());
+    name2 = detail::next_field(it, line.end());
+    morphClass = detail::next_field(it, line.end());
+    if (morphClass.empty()) {
+         throw MVDParserException("Impossible to parse MVD2 MorphType line :" + line.to_string());
     }
-    name = name_1;
-    name2 = name_2;
-    morphClass = name_3;
 }
 
 
-inline void parseElectroTypeLine(const char *line, std::string &electroType){
+inline void parseMorphTypeLine(const char* line, std::string & name, std::string & name2, std::string & morphClass){
+    boost::string_view name_1, name_2, name_3;
+    parseMorphTypeLine(boost::string_view(line), name_1, name_2, name_3);
+    name.assign(name_1.data(), name_1.size());
+    name2.assign(name_2.data(), name_2.size());
+    morphClass.assign(name_3.data(), name_3.size());
+}
+
+
+inline void parseElectroTypeLine(boost::string_view line, boost::string_view &electroType){
     // dummy parsing, no check needed for now
+    while (!line.empty() && detail::is_space(line.front())) {
+        line.remove_prefix(1);
+    }
+    while (!line.empty() && detail::is_space(line.back())) {
+        line.remove_suffix(1);
+    }
     electroType = line;
-    boost::trim(electroType);
+}
+
 
+inline void parseElectroTypeLine(const char *line, std::string &electroType){
+    boost::string_view view;
+    parseElectroTypeLine(boost::string_view(line), view);
+    electroType.assign(view.data(), view.size());
 }
 
 
@@ -172,16 +548,15 @@ inline Counter::Counter() :
         _nb_morpho_type(0)
     {    }
 
-inline int Counter::operator()(DataSet type, const char* line){
-    (void) line;
+inline int Counter::operator()(DataSet type, boost::string_view line){
     switch(type){
         case NeuronLoaded:{
             _nb_neuron +=1;
-            std::string morpho, metype;
+            boost::string_view morpho, metype;
             int trash;
             std::vector<float> pos;
             parseNeuronLine(line, morpho, trash, trash, trash, trash, trash, trash, pos, metype);
-            morphos.insert(morpho);
+            morphos.emplace(morpho.data(), morpho.size());
             break;
         }
         case MorphTypes:{
@@ -214,7 +589,7 @@ struct PositionData {
         _n_skipped(0)
     { }
 
-    inline int operator()(DataSet type, const char* line){
+    inline int operator()(DataSet type, boost::string_view line){
         // Only handle NeuronLoaded
         if( type != NeuronLoaded )
             return 0;
@@ -224,9 +599,9 @@ struct PositionData {
             return 1;
         }
 
-        std::string morpho, metype;
+        boost::string_view morpho, metype;
         int trash;
-        std::vector<double> pos;
+        std::vector<double> & pos = _xyzr;
         parseNeuronLine(line, morpho, trash, trash, trash, trash, trash, trash, pos, metype);
 
         if (_range.offset > _n_skipped) {
@@ -246,6 +621,7 @@ private:
     const MVD::Range _range;
     size_t _cur_neuron;
     size_t _n_skipped;
+    std::vector<double> _xyzr;
 };
 
 
@@ -257,7 +633,7 @@ struct RotationData {
         _n_skipped(0)
     { }
 
-    inline int operator()(DataSet type, const char* line){
+    inline int operator()(DataSet type, boost::string_view line){
         // Only handle NeuronLoaded
         if( type != NeuronLoaded )
             return 0;
@@ -267,9 +643,9 @@ struct RotationData {
             return 1;
         }
 
-        std::string morpho, metype;
+        boost::string_view morpho, metype;
         int trash;
-        std::vector<double> pos;
+        std::vector<double> & pos = _xyzr;
         parseNeuronLine(line, morpho, trash, trash, trash, trash, trash, trash, pos, metype);
 
         if (_range.offset > _n_skipped) {
@@ -289,63 +665,666 @@ private:
     const MVD::Range _range;
     size_t _cur_neuron;
     size_t _n_skipped;
+    std::vector<double> _xyzr;
 };
 
 
 
 
+/////////////////////////////////////////////////////////
+/// Class LineIndex members
+/////////////////////////////////////////////////////////
+
+inline size_t LineIndex::countLines(DataSet type) const {
+    size_t n_lines = 0;
+    for (const auto& section: sections) {
+        if (section.type == type) {
+            n_lines += section.n_lines;
+        }
+    }
+    return n_lines;
+}
+
+
 /////////////////////////////////////////////////////////
 /// Class MVD2File members
 /////////////////////////////////////////////////////////
 
+inline MVD2File MVD2File::openCached(const std::string & filename, const std::string & cache_dir) {
+    const std::string index_filename = indexFilename(filename, cache_dir);
+    MVD2File file(filename);
+    if (file.readIndex(index_filename)) {
+        return file;
+    }
+
+    file.getLineIndex();
+    try {
+        file.writeIndex(index_filename);
+    } catch (const MVDException&) {
+        // Without a writable index, the file is scanned again by the next jobs
+    }
+    return file;
+}
+
+
+inline std::string MVD2File::indexFilename(const std::string & filename, const std::string & cache_dir) {
+    if (cache_dir.empty()) {
+        return filename + ".index";
+    }
+    // Mvd2 files of the same name in different directories get their own index
+    const std::string path = MVD::utils::absolute_path(filename);
+    const std::string basename = path.substr(path.find_last_of('/') + 1);
+    std::ostringstream ss;
+    ss << cache_dir << '/' << basename << '.' << std::hex
+       << MVD::utils::checksum(path.data(), path.size()) << ".index";
+    return ss.str();
+}
+
+
+inline void MVD2File::writeIndex(const std::string & index_filename) const {
+    const LineIndex & index = getLineIndex();
+    detail::MVD2IndexHeader header{};
+    std::memcpy(header.magic, detail::mvd2_index_magic, sizeof(header.magic));
+    header.version = detail::mvd2_index_version;
+    if (!MVD::utils::file_stamp(_filename, header.source)) {
+        throw MVDException("Could not stat file " + _filename + ": " + std::strerror(errno));
+    }
+
+    std::vector<detail::MVD2IndexSection> sections(index.sections.size());
+    for (size_t i = 0; i < sections.size(); ++i) {
+        sections[i].type = static_cast<uint32_t>(index.sections[i].type);
+        sections[i].offset = index.sections[i].offset;
+        sections[i].n_lines = index.sections[i].n_lines;
+    }
+    const std::string path = MVD::utils::absolute_path(_filename);
+    header.n_sections = static_cast<uint32_t>(sections.size());
+    header.n_neurons = index.neurons.size();
+    header.path_size = path.size();
+
+    std::string body;
+    body.reserve(sections.size() * sizeof(detail::MVD2IndexSection) +
+                 index.neurons.size() * sizeof(uint64_t) + path.size());
+    body.append(reinterpret_cast<const char*>(sections.data()),
+                sections.size() * sizeof(detail::MVD2IndexSection));
+    body.append(reinterpret_cast<const char*>(index.neurons.data()),
+                index.neurons.size() * sizeof(uint64_t));
+    body.append(path);
+    header.checksum = MVD::utils::checksum(body.data(), body.size());
+
+    MVD::utils::replace_file(index_filename,
+                             {boost::string_view(reinterpret_cast<const char*>(&header),
+                                                 sizeof(header)),
+                              body});
+}
+
+
+inline const LineIndex & MVD2File::getLineIndex() const {
+    if (_index) {
+        return *_index;
+    }
+    const char* const begin = data().begin();
+    const char* const end = data().end();
+    const char* it = begin;
+
+    // drop header
+    for (int i = 0; i < 2; ++i) {
+        if (it == end) {
+            throw MVDParserException("Invalid header parsing for " + _filename );
+        }
+        MVD::utils::next_line(it, end);
+    }
+
+    // Same sections as parse(), without parsing the lines
+    auto index = std::make_shared<LineIndex>();
+    DataSet type = None;
+    while (it != end) {
+        const uint64_t offset = static_cast<uint64_t>(it - begin);
+        const boost::string_view line = MVD::utils::next_line(it, end);
+        DataSet prev_type = type;
+        if ((type = getDataType(line, prev_type)) != prev_type) {
+            index->sections.push_back({type, static_cast<uint64_t>(it - begin), 0});
+            continue;
+        }
+        if (index->sections.empty()) {
+            continue;
+        }
+        index->sections.back().n_lines += 1;
+        if (type == NeuronLoaded) {
+            index->neurons.push_back(offset);
+        }
+    }
+    _index = std::move(index);
+    return *_index;
+}
+
+
 inline size_t MVD2File::getNbNeuron() const {
-    init_counter();
-    return counter._nb_neuron;
+    return getLineIndex().neurons.size();
 }
 
 inline size_t MVD2File::getNbMorphoType() const {
-    init_counter();
-    return counter._nb_morpho_type;
+    return getLineIndex().countLines(MorphTypes);
 }
 
 inline size_t MVD2File::getNbMorpho() const {
-    init_counter();
-    return counter.morphos.size();
+    return getUniqueMorphologies().size();
 }
 
 inline size_t MVD2File::getNbColumns() const {
-    init_counter();
-    return counter._nb_columns;
+    return getLineIndex().countLines(MiniColumnsPosition);
 }
 
 inline std::set<std::string> & MVD2File::getUniqueMorphologies() const {
-    init_counter();
-    return counter.morphos;
+    if (_morphologies.empty()) {
+        forEachNeuron(MVD::Range::all(), getNbNeuron(), [this](size_t, boost::string_view line) {
+            const char* it = line.begin();
+            const boost::string_view morpho = detail::next_field(it, line.end());
+            _morphologies.emplace(morpho.data(), morpho.size());
+        });
+    }
+    return _morphologies;
 }
 
 
 inline MVD::Positions MVD2File::getPositions(const MVD::Range & range) const {
-    init_counter();
-    size_t count = (range.count>0 && range.count<counter._nb_neuron)? range.count : counter._nb_neuron;
-    MVD::Positions posi_buff(boost::extents[count][3]);
-    PositionData posi_data_reader(posi_buff, range);
-    parse(posi_data_reader);
+    if (_columns) {
+        return getPositions(selectRange(range));
+    }
+    const MVD::Selection selection = selectRange(range);
+    MVD::Positions posi_buff(boost::extents[selection.flatSize()][3]);
+    std::vector<double> pos;
+    forEachNeuron(range, selection.flatSize(), [&posi_buff, &pos](size_t i, boost::string_view line) {
+        boost::string_view morpho, metype;
+        int trash;
+        parseNeuronLine(line, morpho, trash, trash, trash, trash, trash, trash, pos, metype);
+        std::copy(pos.begin(), pos.begin()+3, posi_buff[i].begin());
+    });
     return posi_buff;
 }
 
 inline MVD::Rotations MVD2File::getRotations(const MVD::Range & range) const {
-    init_counter();
-    size_t count = (range.count>0 && range.count<counter._nb_neuron)? range.count : counter._nb_neuron;
-    MVD::Rotations rots_buff(boost::extents[count][1]);
-    RotationData rots_data_reader(rots_buff, range);
-    parse(rots_data_reader);
+    const std::vector<double> angles = getRotationAngles(range);
+    MVD::Rotations rots_buff(boost::extents[angles.size()][4]);
+    for (size_t i = 0; i < angles.size(); ++i) {
+        detail::rotation_quaternion(angles[i], rots_buff[i]);
+    }
     return rots_buff;
 }
 
+inline std::vector<double> MVD2File::getRotationAngles(const MVD::Range & range) const {
+    const MVD::Selection selection = selectRange(range);
+    std::vector<double> angles(selection.flatSize());
+    if (_columns) {
+        size_t i = 0;
+        for (const auto& r: selection.ranges()) {
+            for (size_t cell = r[0]; cell < r[1]; ++cell) {
+                angles[i++] = _columns->xyzr[4 * cell + 3];
+            }
+        }
+        return angles;
+    }
+    std::vector<double> pos;
+    forEachNeuron(range, angles.size(), [&angles, &pos](size_t i, boost::string_view line) {
+        boost::string_view morpho, metype;
+        int trash;
+        parseNeuronLine(line, morpho, trash, trash, trash, trash, trash, trash, pos, metype);
+        angles[i] = pos[3];
+    });
+    return angles;
+}
+
 
-inline void MVD2File::init_counter() const {
-    if(counter._nb_neuron == 0){
-        parse(counter);
+inline void MVD2File::openComboTsv(const std::string& filename) {
+    _tsv_file = std::make_shared<const TSV::TSVFile>(filename);
+}
+
+
+// Range getters, on the cells of the range up to the last neuron
+
+inline std::vector<std::string> MVD2File::getMorphologies(const MVD::Range& range) const {
+    return getMorphologies(selectRange(range));
+}
+
+inline std::vector<std::string> MVD2File::getEtypes(const MVD::Range& range) const {
+    return getEtypes(selectRange(range));
+}
+
+inline std::vector<std::string> MVD2File::getMtypes(const MVD::Range& range) const {
+    return getMtypes(selectRange(range));
+}
+
+inline std::vector<std::string> MVD2File::getEmodels(const MVD::Range& range) const {
+    return getEmodels(selectRange(range));
+}
+
+inline std::vector<std::string> MVD2File::getRegions(const MVD::Range& range) const {
+    return getRegions(selectRange(range));
+}
+
+inline std::vector<std::string> MVD2File::getSynapseClass(const MVD::Range& range) const {
+    return getSynapseClass(selectRange(range));
+}
+
+inline std::vector<std::string> MVD2File::getMECombos(const MVD::Range& range) const {
+    return getMECombos(selectRange(range));
+}
+
+inline std::vector<std::string> MVD2File::getLayers(const MVD::Range& range) const {
+    return getLayers(selectRange(range));
+}
+
+inline std::vector<int32_t> MVD2File::getHyperColumns(const MVD::Range& range) const {
+    return getHyperColumns(selectRange(range));
+}
+
+inline std::vector<int32_t> MVD2File::getMiniColumns(const MVD::Range& range) const {
+    return getMiniColumns(selectRange(range));
+}
+
+inline std::vector<double> MVD2File::getExcMiniFrequencies(const MVD::Range& range) const {
+    return getExcMiniFrequencies(selectRange(range));
+}
+
+inline std::vector<double> MVD2File::getInhMiniFrequencies(const MVD::Range& range) const {
+    return getInhMiniFrequencies(selectRange(range));
+}
+
+inline std::vector<double> MVD2File::getThresholdCurrents(const MVD::Range& range) const {
+    return getThresholdCurrents(selectRange(range));
+}
+
+inline std::vector<double> MVD2File::getHoldingCurrents(const MVD::Range& range) const {
+    return getHoldingCurrents(selectRange(range));
+}
+
+inline MVD::Categorical MVD2File::getCategoricalMorphologies(const MVD::Range& range) const {
+    return getCategoricalMorphologies(selectRange(range));
+}
+
+inline MVD::Categorical MVD2File::getCategoricalEtypes(const MVD::Range& range) const {
+    return getCategoricalEtypes(selectRange(range));
+}
+
+inline MVD::Categorical MVD2File::getCategoricalMtypes(const MVD::Range& range) const {
+    return getCategoricalMtypes(selectRange(range));
+}
+
+inline MVD::Categorical MVD2File::getCategoricalRegions(const MVD::Range& range) const {
+    return getCategoricalRegions(selectRange(range));
+}
+
+inline MVD::Categorical MVD2File::getCategoricalSynapseClass(const MVD::Range& range) const {
+    return getCategoricalSynapseClass(selectRange(range));
+}
+
+inline MVD::Categorical MVD2File::getCategoricalMECombos(const MVD::Range& range) const {
+    return getCategoricalMECombos(selectRange(range));
+}
+
+inline std::vector<size_t> MVD2File::getIndexMorphologies(const MVD::Range& range) const {
+    return getIndexMorphologies(selectRange(range));
+}
+
+inline std::vector<size_t> MVD2File::getIndexEtypes(const MVD::Range& range) const {
+    return getIndexEtypes(selectRange(range));
+}
+
+inline std::vector<size_t> MVD2File::getIndexMtypes(const MVD::Range& range) const {
+    return getIndexMtypes(selectRange(range));
+}
+
+inline std::vector<size_t> MVD2File::getIndexRegions(const MVD::Range& range) const {
+    return getIndexRegions(selectRange(range));
+}
+
+inline std::vector<size_t> MVD2File::getIndexSynapseClass(const MVD::Range& range) const {
+    return getIndexSynapseClass(selectRange(range));
+}
+
+
+// Selection getters, slices of the columns
+
+inline MVD::Positions MVD2File::getPositions(const MVD::Selection& selection) const {
+    const auto& xyzr = getColumns().xyzr;
+    selection.checkBounds(xyzr.size() / 4);
+    MVD::Positions positions(boost::extents[selection.flatSize()][3]);
+    size_t i = 0;
+    for (const auto& range: selection.ranges()) {
+        for (size_t cell = range[0]; cell < range[1]; ++cell, ++i) {
+            std::copy(&xyzr[4 * cell], &xyzr[4 * cell] + 3, positions[i].begin());
+        }
+    }
+    return positions;
+}
+
+inline MVD::Rotations MVD2File::getRotations(const MVD::Selection& selection) const {
+    const auto& xyzr = getColumns().xyzr;
+    selection.checkBounds(xyzr.size() / 4);
+    MVD::Rotations rotations(boost::extents[selection.flatSize()][4]);
+    size_t i = 0;
+    for (const auto& range: selection.ranges()) {
+        for (size_t cell = range[0]; cell < range[1]; ++cell, ++i) {
+            detail::rotation_quaternion(xyzr[4 * cell + 3], rotations[i]);
+        }
+    }
+    return rotations;
+}
+
+inline std::vector<std::string> MVD2File::getMorphologies(const MVD::Selection& selection) const {
+    return getCategoricalMorphologies(selection).values();
+}
+
+inline std::vector<std::string> MVD2File::getEtypes(const MVD::Selection& selection) const {
+    return getCategoricalEtypes(selection).values();
+}
+
+inline std::vector<std::string> MVD2File::getMtypes(const MVD::Selection& selection) const {
+    return getCategoricalMtypes(selection).values();
+}
+
+inline std::vector<std::string> MVD2File::getEmodels(const MVD::Selection& selection) const {
+    if (!_tsv_file) {
+        throw MVDException("No TSV file is opened with MVD2 to extract the emodels.");
+    }
+    return _tsv_file->getEmodels(getMECombos(selection), getMorphologies(selection));
+}
+
+inline std::vector<std::string> MVD2File::getRegions(const MVD::Selection& selection) const {
+    return getCategoricalRegions(selection).values();
+}
+
+inline std::vector<std::string> MVD2File::getSynapseClass(const MVD::Selection& selection) const {
+    return getCategoricalSynapseClass(selection).values();
+}
+
+inline std::vector<std::string> MVD2File::getMECombos(const MVD::Selection& selection) const {
+    return getCategoricalMECombos(selection).values();
+}
+
+inline std::vector<std::string> MVD2File::getLayers(const MVD::Selection& selection) const {
+    const auto layers = detail::slice(getColumns().layers, selection);
+    std::vector<std::string> res;
+    res.reserve(layers.size());
+    for (const int32_t layer: layers) {
+        res.push_back(std::to_string(layer));
+    }
+    return res;
+}
+
+inline std::vector<int32_t> MVD2File::getHyperColumns(const MVD::Selection& selection) const {
+    return detail::slice(getColumns().hypercolumns, selection);
+}
+
+inline std::vector<int32_t> MVD2File::getMiniColumns(const MVD::Selection& selection) const {
+    return detail::slice(getColumns().minicolumns, selection);
+}
+
+inline std::vector<double> MVD2File::getExcMiniFrequencies(const MVD::Selection&) const {
+    throw MVDException("MVD2 files have no mini frequencies");
+}
+
+inline std::vector<double> MVD2File::getInhMiniFrequencies(const MVD::Selection&) const {
+    throw MVDException("MVD2 files have no mini frequencies");
+}
+
+inline std::vector<double> MVD2File::getThresholdCurrents(const MVD::Selection& selection) const {
+    if (!_tsv_file) {
+        throw MVDException("No TSV file is opened with MVD2 to extract the threshold currents.");
+    }
+    return _tsv_file->getThresholdCurrents(getMECombos(selection), getMorphologies(selection));
+}
+
+inline std::vector<double> MVD2File::getHoldingCurrents(const MVD::Selection& selection) const {
+    if (!_tsv_file) {
+        throw MVDException("No TSV file is opened with MVD2 to extract the holding currents.");
+    }
+    return _tsv_file->getHoldingCurrents(getMECombos(selection), getMorphologies(selection));
+}
+
+inline MVD::Categorical MVD2File::getCategoricalMorphologies(const MVD::Selection& selection) const {
+    return MVD::Categorical(detail::slice(getColumns().morphologies, selection),
+                            getColumns().morphology_names);
+}
+
+inline MVD::Categorical MVD2File::getCategoricalEtypes(const MVD::Selection& selection) const {
+    return MVD::Categorical(detail::slice(getColumns().etypes, selection), getColumns().etype_names);
+}
+
+inline MVD::Categorical MVD2File::getCategoricalMtypes(const MVD::Selection& selection) const {
+    return MVD::Categorical(detail::slice(getColumns().mtypes, selection), getColumns().mtype_names);
+}
+
+inline MVD::Categorical MVD2File::getCategoricalRegions(const MVD::Selection&) const {
+    throw MVDException("MVD2 files have no regions");
+}
+
+inline MVD::Categorical MVD2File::getCategoricalSynapseClass(const MVD::Selection& selection) const {
+    return MVD::Categorical(detail::slice(getColumns().synapse_class, selection),
+                            getColumns().synapse_class_names);
+}
+
+inline MVD::Categorical MVD2File::getCategoricalMECombos(const MVD::Selection& selection) const {
+    return MVD::Categorical(detail::slice(getColumns().me_combos, selection),
+                            getColumns().me_combo_names);
+}
+
+inline std::vector<size_t> MVD2File::getIndexMorphologies(const MVD::Selection& selection) const {
+    return detail::slice<size_t>(getColumns().morphologies, selection);
+}
+
+inline std::vector<size_t> MVD2File::getIndexEtypes(const MVD::Selection& selection) const {
+    return detail::slice<size_t>(getColumns().etypes, selection);
+}
+
+inline std::vector<size_t> MVD2File::getIndexMtypes(const MVD::Selection& selection) const {
+    return detail::slice<size_t>(getColumns().mtypes, selection);
+}
+
+inline std::vector<size_t> MVD2File::getIndexRegions(const MVD::Selection&) const {
+    throw MVDException("MVD2 files have no regions");
+}
+
+inline std::vector<size_t> MVD2File::getIndexSynapseClass(const MVD::Selection& selection) const {
+    return detail::slice<size_t>(getColumns().synapse_class, selection);
+}
+
+
+inline MVD::CellBatch MVD2File::read(const MVD::Selection& selection, unsigned columns) const {
+    return MVD::File::read(selection, columns & ~unsigned(MVD::CellColumn::Regions));
+}
+
+
+inline std::vector<std::string> MVD2File::listAllMorphologies() const {
+    return *getColumns().morphology_names;
+}
+
+inline std::vector<std::string> MVD2File::listAllEtypes() const {
+    return *getColumns().etype_names;
+}
+
+inline std::vector<std::string> MVD2File::listAllMtypes() const {
+    return *getColumns().mtype_names;
+}
+
+inline std::vector<std::string> MVD2File::listAllEmodels() const {
+    if (!_tsv_file) {
+        throw MVDException("No TSV file is opened with MVD2 to extract all the emodels.");
+    }
+    std::vector<std::string> emodels;
+    for (const TSV::MEComboEntry& entry: _tsv_file->getAll()) {
+        emodels.push_back(entry.eModel.to_string());
+    }
+    MVD::utils::vector_remove_dups(emodels);
+    return emodels;
+}
+
+inline std::vector<std::string> MVD2File::listAllRegions() const {
+    throw MVDException("MVD2 files have no regions");
+}
+
+inline std::vector<std::string> MVD2File::listAllSynapseClass() const {
+    return *getColumns().synapse_class_names;
+}
+
+inline std::vector<double> MVD2File::getCircuitSeeds() const {
+    return getColumns().seeds;
+}
+
+
+inline const NeuronColumns & MVD2File::getColumns() const {
+    if (_columns) {
+        return *_columns;
+    }
+    const size_t n_neurons = getNbNeuron();
+    const size_t n_chunks = std::max(size_t(1), std::min(_parse_workers, n_neurons));
+    const auto parse_chunk = [this, n_neurons, n_chunks](size_t chunk_id) {
+        const size_t first = n_neurons * chunk_id / n_chunks;
+        const size_t count = n_neurons * (chunk_id + 1) / n_chunks - first;
+        detail::NeuronChunk chunk(count);
+        forEachNeuron(MVD::Range(first, count), count, std::ref(chunk));
+        return chunk;
+    };
+
+    // Chunks are views of the mapping: data() is opened before the workers
+    data();
+    std::vector<std::future<detail::NeuronChunk>> pending;
+    for (size_t chunk_id = 1; chunk_id < n_chunks; ++chunk_id) {
+        pending.push_back(std::async(std::launch::async, parse_chunk, chunk_id));
+    }
+
+    auto columns = std::make_shared<NeuronColumns>();
+    detail::ColumnLoader loader(*columns, n_neurons);
+    loader.append(parse_chunk(0));
+    for (auto& chunk: pending) {
+        loader.append(chunk.get());
+    }
+    for (const DataSet type: {CircuitSeeds, MorphTypes, ElectroTypes}) {
+        forEachSectionLine(type, [&loader, type](boost::string_view line) {
+            loader(type, line);
+        });
+    }
+    loader.finish(_filename);
+    _columns = std::move(columns);
+    return *_columns;
+}
+
+
+inline void MVD2File::setParseWorkers(size_t n_workers) {
+    _parse_workers = (n_workers == 0) ? std::max(1u, std::thread::hardware_concurrency())
+                                      : n_workers;
+}
+
+
+inline MVD::Selection MVD2File::selectRange(const MVD::Range & range) const {
+    const size_t n_neurons = getNbNeuron();
+    const size_t first = std::min(range.offset, n_neurons);
+    return MVD::Selection({{first, std::min(range.calculate_end(n_neurons), n_neurons)}});
+}
+
+
+inline const MVD::utils::MappedFile & MVD2File::data() const {
+    if (!_data) {
+        try {
+            _data = std::make_shared<const MVD::utils::MappedFile>(_filename);
+        } catch (const MVDException&) {
+            throw MVDParserException("Could not find the mvd file" + _filename + "...\n");
+        }
+    }
+    return *_data;
+}
+
+
+inline bool MVD2File::readIndex(const std::string & index_filename) {
+    std::unique_ptr<MVD::utils::MappedFile> image;
+    try {
+        image.reset(new MVD::utils::MappedFile(index_filename));
+    } catch (const MVDException&) {
+        return false;
+    }
+    detail::MVD2IndexHeader header;
+    if (image->size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, image->begin(), sizeof(header));
+
+    // Stale: written by another version, or before the mvd2 file was modified
+    MVD::utils::FileStamp source;
+    if (std::memcmp(header.magic, detail::mvd2_index_magic, sizeof(header.magic)) != 0 ||
+        header.version != detail::mvd2_index_version ||
+        !MVD::utils::file_stamp(_filename, source) || !(header.source == source)) {
+        return false;
+    }
+
+    // Corrupt: truncated, or with other contents than written
+    const size_t body_size = image->size() - sizeof(header);
+    const char* const body = image->begin() + sizeof(header);
+    if (header.n_neurons > body_size / sizeof(uint64_t) || header.path_size > body_size ||
+        header.n_sections * sizeof(detail::MVD2IndexSection) +
+                header.n_neurons * sizeof(uint64_t) + header.path_size !=
+            body_size ||
+        MVD::utils::checksum(body, body_size) != header.checksum) {
+        return false;
+    }
+    const char* const neurons = body + header.n_sections * sizeof(detail::MVD2IndexSection);
+    const char* const path = neurons + header.n_neurons * sizeof(uint64_t);
+    if (boost::string_view(path, header.path_size) != MVD::utils::absolute_path(_filename)) {
+        return false;
+    }
+
+    auto index = std::make_shared<LineIndex>();
+    index->sections.resize(header.n_sections);
+    for (size_t i = 0; i < index->sections.size(); ++i) {
+        detail::MVD2IndexSection section;
+        std::memcpy(&section, body + i * sizeof(section), sizeof(section));
+        if (section.type > ElectroTypes || section.offset > source.size) {
+            return false;
+        }
+        index->sections[i] = {static_cast<DataSet>(section.type), section.offset, section.n_lines};
+    }
+    index->neurons.resize(header.n_neurons);
+    std::memcpy(index->neurons.data(), neurons, index->neurons.size() * sizeof(uint64_t));
+    for (const uint64_t offset: index->neurons) {
+        if (offset >= source.size) {
+            return false;
+        }
+    }
+    _index = std::move(index);
+    return true;
+}
+
+
+template <typename Function>
+inline void MVD2File::forEachNeuron(const MVD::Range & range, size_t count, const Function & f) const {
+    const auto & neurons = getLineIndex().neurons;
+    const char* const end = data().end();
+    const size_t first = std::min(range.offset, neurons.size());
+    const size_t last = first + std::min(count, neurons.size() - first);
+    for (size_t i = first; i < last; ++i) {
+        const char* it = data().begin() + neurons[i];
+        boost::string_view line = MVD::utils::next_line(it, end);
+        if (line.ends_with('\r')) {
+            line.remove_suffix(1);
+        }
+        f(i - first, line);
+    }
+}
+
+
+template <typename Function>
+inline void MVD2File::forEachSectionLine(DataSet type, const Function & f) const {
+    const char* const end = data().end();
+    for (const auto & section: getLineIndex().sections) {
+        if (section.type != type) {
+            continue;
+        }
+        const char* it = data().begin() + section.offset;
+        for (uint64_t i = 0; i < section.n_lines; ++i) {
+            boost::string_view line = MVD::utils::next_line(it, end);
+            if (line.ends_with('\r')) {
+                line.remove_suffix(1);
+            }
+            f(line);
+        }
     }
 }
 
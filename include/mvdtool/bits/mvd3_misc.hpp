@@ -19,9 +19,16 @@
 #pragma once
 
 #include <algorithm>
+#include <boost/functional/hash.hpp>
 #include <boost/lexical_cast.hpp>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <iterator>
 #include <set>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 #include <highfive/H5DataSet.hpp>
@@ -29,69 +36,120 @@
 #include "../mvd3.hpp"
 #include "../mvd_except.hpp"
 #include "../utils.hpp"
+#include "hdf5_misc.hpp"
 
 namespace {
 
-template <typename T>
-inline std::vector<T> get_data_for_selection(const HighFive::DataSet& dataset,
-                                             const MVD3::Range& range) {
-    std::vector<T> data_values;
-    const size_t n_elem = dataset.getSpace().getDimensions()[0];
+// Sparse selections whose runs are shorter than this on average are read with
+// a single point selection, longer runs with one hyperslab each
+constexpr size_t MIN_HYPERSLAB_RUN = 64;
 
-    dataset.select({range.offset}, {range.adjust_count(n_elem)}).read(data_values);
-    return data_values;
+// Library lookups read the whole table once the references span at least
+// 3/4 of it, or outnumber its entries, and only the referenced entries when
+// fewer than one entry in LIBRARY_POINT_SPARSITY of the span is referenced
+constexpr size_t LIBRARY_FULL_TABLE_NUM = 3;
+constexpr size_t LIBRARY_FULL_TABLE_DEN = 4;
+constexpr size_t LIBRARY_POINT_SPARSITY = 8;
+
+inline bool use_point_selection(const MVD::Selection& selection) {
+    const size_t n_ranges = selection.ranges().size();
+    return n_ranges > 1 && selection.flatSize() < MIN_HYPERSLAB_RUN * n_ranges;
 }
 
+// Reads a whole selection with a single call. Numeric values are read in
+// place with the file transfer properties: under collective transfers, every
+// rank makes this same call whatever the shape of its selection
 template <typename T>
-inline std::vector<T> resolve_index(const HighFive::DataSet& index,
-                                    const MVD3::Range& range,
-                                    const HighFive::DataSet& data) {
-    std::vector<T> values, result;
-    std::vector<size_t> references = get_data_for_selection<size_t>(index, range);
-    const size_t n_elem = data.getSpace().getDimensions()[0];
-
-    size_t first = n_elem;
-    size_t last = 0;
-    for (auto i: references) {
-        if (i >= n_elem) {
-            std::ostringstream ss;
-            ss << "Invalid index reference " << i << " in an dataset of size " << n_elem;
-            throw MVDParserException(ss.str());
-        }
-        first = std::min(first, i);
-        last = std::max(last, i);
+inline void read_single_call(const MVD3::DataSetInfo& info,
+                             const MVD::Selection& selection,
+                             const MVD::utils::TransferProps& xfer_props,
+                             std::vector<T>& data_values,
+                             std::true_type /* is_arithmetic */) {
+    data_values.resize(selection.flatSize());
+    MVD::utils::read_ranges_into(info.dataset, selection.ranges(), 0, 1,
+                                 data_values.data(), 1, xfer_props);
+}
+
+// Strings are read by HighFive, independently, for one range at most
+template <typename T>
+inline void read_single_call(const MVD3::DataSetInfo& info,
+                             const MVD::Selection& selection,
+                             const MVD::utils::TransferProps&,
+                             std::vector<T>& data_values,
+                             std::false_type /* is_arithmetic */) {
+    if (!selection.empty()) {
+        const auto& range = selection.ranges()[0];
+        info.dataset.select({range[0]}, {range[1] - range[0]}).read(data_values);
     }
+}
 
-    if (first == 0 && last == n_elem - 1) {
-        data.read(values);
+template <typename T>
+inline std::vector<T> get_data_for_selection(const MVD3::DataSetInfo& info,
+                                             const MVD::Selection& selection,
+                                             const MVD::utils::TransferProps& xfer_props) {
+    std::vector<T> data_values;
+    selection.checkBounds(info.dims[0]);
+    const auto& ranges = selection.ranges();
+    // The choice of a collective read may not depend on the selection of a rank
+    const bool collective = xfer_props.isCollective() && std::is_arithmetic<T>::value;
+
+    if (ranges.size() <= 1 || collective) {
+        read_single_call(info, selection, xfer_props, data_values, std::is_arithmetic<T>());
+    } else if (use_point_selection(selection)) {
+        info.dataset.select(HighFive::ElementSet(selection.flatten())).read(data_values);
     } else {
-        data.select({first}, {last - first + 1}).read(values);
+        data_values.reserve(selection.flatSize());
+        std::vector<T> chunk;
+        for (const auto& range: ranges) {
+            info.dataset.select({range[0]}, {range[1] - range[0]}).read(chunk);
+            std::move(chunk.begin(), chunk.end(), std::back_inserter(data_values));
+        }
     }
+    return data_values;
+}
 
-    result.reserve(references.size());
-
-    for (auto i: references) {
-        result.push_back(values[i - first]);
+// Reads the [N][width] rows of a 2D dataset (positions, rotations) into `rows`
+inline void read_rows_for_selection(const MVD3::DataSetInfo& info,
+                                    const MVD::Selection& selection,
+                                    size_t width,
+                                    const MVD::utils::TransferProps& xfer_props,
+                                    boost::multi_array<double, 2>& rows) {
+    selection.checkBounds(info.dims[0]);
+    const auto& ranges = selection.ranges();
+
+    rows.resize(boost::extents[selection.flatSize()][width]);
+    // The choice of a collective read may not depend on the selection of a rank
+    if (ranges.size() <= 1 || xfer_props.isCollective()) {
+        MVD::utils::read_ranges_into(info.dataset, ranges, 0, width, rows.data(), width,
+                                     xfer_props);
+    } else if (use_point_selection(selection)) {
+        std::vector<size_t> coordinates;
+        coordinates.reserve(2 * width * rows.shape()[0]);
+        for (const auto index: selection.flatten()) {
+            for (size_t column = 0; column < width; ++column) {
+                coordinates.push_back(index);
+                coordinates.push_back(column);
+            }
+        }
+        std::vector<double> values;
+        info.dataset.select(HighFive::ElementSet(coordinates)).read(values);
+        std::copy(values.begin(), values.end(), rows.data());
+    } else {
+        double* out = rows.data();
+        for (const auto& range: ranges) {
+            const size_t count = range[1] - range[0];
+            MVD::utils::read_hyperslab_into(info.dataset, range[0], count, 0, width, out, width);
+            out += count * width;
+        }
     }
-    return result;
 }
 
-template <typename T, typename FuncT>
-std::vector<T> tsv_get_chunked(const MVD3::MVD3File& mvd,
-                               const FuncT& f,
-                               const MVD3::Range& range) {
-    const size_t CHUNK_SIZE = 256;
-    std::vector<T> output;
-    const size_t total_size = mvd.getNbNeuron();
-    const size_t end = range.calculate_end(total_size);
-    output.reserve(range.adjust_count(total_size));
+// Neurons whose library indices are read at once to join them with the TSV
+constexpr size_t tsv_join_chunk_size = 1 << 16;
 
-    for (auto index = range.offset; index < end; index += CHUNK_SIZE) {
-        const MVD::Range subrange(index, std::min(CHUNK_SIZE, end - index));
-        auto chunk = f(mvd.getMECombos(subrange), mvd.getMorphologies(subrange));
-        std::move(chunk.begin(), chunk.end(), std::back_inserter(output));
-    }
-    return output;
+// Key of a pair of library indices in the TSV join table
+inline uint64_t tsv_join_key(size_t me_combo, size_t morphology) {
+    return (uint64_t(me_combo) << 32) | uint64_t(morphology);
 }
 
 // Use constexpr char[] as const std::string is initialized too late for
@@ -124,13 +182,23 @@ constexpr char did_lib_data_mecombo[] = "/library/me_combo";
 constexpr char did_lib_data_regions[] = "/library/region";
 constexpr char did_lib_data_syn_class[] = "/library/synapse_class";
 
-constexpr char did_lib_NONE[] = "";
-const MVD::Range range_ALL(0, 0);
-
 // circuit
 constexpr char did_lib_circuit_seeds[] = "/circuit/seeds";
 
-using vec_string = std::vector<std::string>;
+// Every dataset of the file, by absolute path. The cell properties indexing
+// a library table of the same name are enumerations
+inline MVD::Schema read_schema(const HighFive::File& file) {
+    constexpr char properties[] = "/cells/properties/";
+    auto columns = MVD::utils::describe_datasets(file.getId(), "/");
+    const MVD::Schema names(columns);
+    for (auto& column: columns) {
+        if (boost::starts_with(column.name, properties)) {
+            const auto property = column.name.substr(sizeof(properties) - 1);
+            column.enumeration = names.has(std::string("/library/") + property);
+        }
+    }
+    return MVD::Schema(std::move(columns));
+}
 
 } // namespace
 
@@ -139,130 +207,241 @@ namespace MVD3 {
 
 using namespace MVD::utils;
 
+namespace detail {
+
+// A neuron missing from the TSV join table, by its library indices
+struct TSVJoinMiss {
+    size_t position;
+    size_t me_combo;
+    size_t morphology;
+};
+
+}  // namespace detail
+
 
 inline MVD3File::MVD3File(const std::string& str)
     : _filename(str)
     , _hdf5_file(str)
-    , _nb_neurons(0) {}
+    , _schema(read_schema(_hdf5_file)) {}
+
+
+#ifdef MVDTOOL_USE_MPI
+inline MVD3File::MVD3File(const std::string& str, MPI_Comm comm)
+    : _filename(str)
+    , _hdf5_file(MVD::utils::open_parallel(str, comm, _xfer_props))
+    , _schema(read_schema(_hdf5_file)) {}
+#endif
 
 
 inline void MVD3File::openComboTsv(const std::string& filename) {
     _tsv_file = std::make_unique<TSV::TSVFile>(filename, TSVColumn::ComboName);
+    joinTSVEntries();
 }
 
 
-inline size_t MVD3File::getNbNeuron() const {
-    if (_nb_neurons == 0) {
-        try {
-            std::vector<size_t> dims =
-                _hdf5_file.getDataSet(did_cells_positions).getSpace().getDimensions();
-            if (dims.size() < 1) {
-                throw MVDParserException("Invalid Dataset dimension in MVD3 file");
-            }
-            (const_cast<size_t&>(_nb_neurons)) = dims[0];  // cache number of neurons in MVD3 file
-                                                           // itself
-        } catch (HighFive::Exception& e) {
-            std::ostringstream ss;
-            ss << "Unable to parse " << _filename << " " << e.what();
-            throw MVDParserException(ss.str());
+inline void MVD3File::openComboTsv(const std::string& filename, const std::string& cache_dir) {
+    _tsv_file = std::make_unique<TSV::TSVFile>(
+        TSV::TSVFile::openCached(filename, cache_dir, TSVColumn::ComboName));
+    joinTSVEntries();
+}
+
+
+inline void MVD3File::joinTSVEntries() {
+    _tsv_entries = _tsv_file->getAll();
+    _tsv_join.clear();
+
+    // Library index of each name, the first one of duplicated names
+    using NameIndex = std::unordered_map<boost::string_view, size_t, boost::hash<boost::string_view>>;
+    const auto index_names = [this](const std::string& did_lib, NameIndex& index) {
+        const auto library = getLibrary(did_lib);
+        index.reserve(library->size());
+        for (size_t i = 0; i < library->size(); ++i) {
+            index.emplace((*library)[i], i);
         }
+        return library;
+    };
+    NameIndex combos, morphologies;
+    // The libraries are cached: the views of their names stay valid
+    const auto combo_library = index_names(did_lib_data_mecombo, combos);
+    const auto morphology_library = index_names(did_lib_data_morpho, morphologies);
+
+    _tsv_join.reserve(_tsv_entries.size());
+    for (size_t row = 0; row < _tsv_entries.size(); ++row) {
+        const TSV::MEComboEntry& entry = _tsv_entries[row];
+        const auto combo = combos.find(entry.comboName);
+        const auto morphology = morphologies.find(entry.morphologyName);
+        if (combo != combos.end() && morphology != morphologies.end()) {
+            _tsv_join.emplace(tsv_join_key(combo->second, morphology->second), row);
+        }
+    }
+}
+
+
+inline size_t MVD3File::getNbNeuron() const {
+    const MVD::Column* positions = _schema.find(did_cells_positions);
+    if (positions == nullptr || positions->dims.empty()) {
+        throw MVDParserException("Unable to parse " + _filename +
+                                 " no valid /cells/positions dataset");
     }
-    return _nb_neurons;
+    return positions->dims[0];
 }
 
 
 inline Positions MVD3File::getPositions(const Range& range) const {
-    Positions res;
-    HighFive::DataSet set = _hdf5_file.getDataSet(did_cells_positions);
-    const auto size = set.getSpace().getDimensions()[0];
-    set.select({range.offset, 0}, {range.adjust_count(size), 3}).read(res);
-    return res;
+    return getPositions(selectRange(range));
 }
 
 
 inline Rotations MVD3File::getRotations(const Range& range) const {
-    Rotations res;
-    HighFive::DataSet set = _hdf5_file.getDataSet(did_cells_rotations);
-    const auto size = set.getSpace().getDimensions()[0];
-    set.select({range.offset, 0}, {range.adjust_count(size), 4}).read(res);
-    return res;
+    return getRotations(selectRange(range));
+}
+
+
+inline void MVD3File::readPositions(const Range& range, double* out, size_t stride) const {
+    readInto(did_cells_positions, range, 3, out, stride);
+}
+
+
+inline void MVD3File::readRotations(const Range& range, double* out, size_t stride) const {
+    readInto(did_cells_rotations, range, 4, out, stride);
+}
+
+
+template <typename T>
+inline void MVD3File::readAttribute(const std::string& name,
+                                    const Range& range,
+                                    T* out,
+                                    size_t stride) const {
+    const std::string did = "/cells/properties/" + name;
+    if (!_schema.has(did)) {
+        throw MVDException("No such cell property in MVD3 file: " + name);
+    }
+    readInto(did, range, 1, out, stride);
+}
+
+
+inline MVD::TypedColumn MVD3File::getTypedAttribute(const std::string& name,
+                                                    const Range& range) const {
+    return getTypedAttribute(name, selectRange(range));
+}
+
+
+inline MVD::TypedColumn MVD3File::getTypedAttribute(const std::string& name,
+                                                    const MVD::Selection& selection) const {
+    const std::string did = "/cells/properties/" + name;
+    const MVD::Column* column = _schema.find(did);
+    if (column == nullptr) {
+        throw MVDException("No such cell property in MVD3 file: " + name);
+    }
+    if (column->dtype == "string") {
+        return MVD::TypedColumn(getDataFromMVD<std::string>(did, selection));
+    }
+    return dispatch_numeric(column->dtype, [&](auto tag) {
+        using T = typename decltype(tag)::type;
+        return MVD::TypedColumn(getDataFromMVD<T>(did, selection));
+    });
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalAttribute(const std::string& name,
+                                                         const Range& range) const {
+    return getCategoricalAttribute(name, selectRange(range));
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalAttribute(
+    const std::string& name,
+    const MVD::Selection& selection) const {
+    const std::string did = "/cells/properties/" + name;
+    const MVD::Column* column = _schema.find(did);
+    if (column != nullptr && column->enumeration) {
+        return getCategoricalFromMVD(did, "/library/" + name, selection);
+    }
+    if (column != nullptr && column->dtype == "string") {
+        return MVD::Categorical::fromValues(getDataFromMVD<std::string>(did, selection));
+    }
+    throw MVDException("No such string cell property in MVD3 file: " + name);
+}
+
+
+inline size_t MVD3File::storageChunkSize() const {
+    return _schema.get(did_cells_positions).chunk_rows;
+}
+
+inline bool MVD3File::concurrentReads() const {
+    return !_xfer_props.isCollective() && MVD::utils::library_is_threadsafe();
+}
+
+
+inline const MVD::Schema& MVD3File::getSchema() const {
+    return _schema;
 }
 
 
 inline bool MVD3File::hasRotations() const {
-    return _hdf5_file.exist(did_cells_rotations);
+    return _schema.has(did_cells_rotations);
 }
 
 
 inline std::vector<std::string> MVD3File::getMorphologies(const Range& range) const {
-    return getDataFromMVD(did_cells_index_morpho, did_lib_data_morpho, range);
+    return getMorphologies(selectRange(range));
 }
 
 
 inline std::vector<std::string> MVD3File::getEtypes(const Range& range) const {
-    return getDataFromTSVorMVD(
-        did_cells_index_etypes, did_lib_data_etypes, TSVColumn::EType, range);
+    return getEtypes(selectRange(range));
 }
 
 
 inline std::vector<std::string> MVD3File::getEmodels(const Range& range) const {
-    return getDataFromTSV(TSVColumn::EModel, range);
+    return getEmodels(selectRange(range));
 }
 
 
 inline std::vector<std::string> MVD3File::getMtypes(const Range& range) const {
-    return getDataFromTSVorMVD(
-        did_cells_index_mtypes, did_lib_data_mtypes, TSVColumn::FullMType, range);
+    return getMtypes(selectRange(range));
 }
 
 
 inline std::vector<std::string> MVD3File::getMECombos(const Range& range) const {
-    return getDataFromMVD(did_cells_index_mecombo, did_lib_data_mecombo, range);
+    return getMECombos(selectRange(range));
 }
 
 
 inline std::vector<std::string> MVD3File::getRegions(const Range& range) const {
-    return getDataFromMVD(did_cells_index_regions, did_lib_data_regions, range);
+    return getRegions(selectRange(range));
 }
 
 
 inline std::vector<int32_t> MVD3File::getHyperColumns(const Range& range) const {
-    return getDataFromMVD<int32_t>(did_cells_hypercolumn, did_lib_NONE, range);
+    return getHyperColumns(selectRange(range));
 }
 
 
 inline std::vector<int32_t> MVD3File::getMiniColumns(const Range& range) const {
-    return getDataFromMVD<int32_t>(did_cells_minicolmun, did_lib_NONE, range);
+    return getMiniColumns(selectRange(range));
 }
 
 
 inline std::vector<std::string> MVD3File::getLayers(const Range& range) const {
-    const auto raw_data = _hdf5_file.getDataSet(did_cells_layer);
-    HighFive::DataType dset_type = raw_data.getDataType();
-    if (dset_type == HighFive::AtomicType<std::string>())
-        return getDataFromMVD<std::string>(did_cells_layer, did_lib_NONE, range);
-    else {
-        auto vec_int = getDataFromMVD<int32_t>(did_cells_layer, did_lib_NONE, range);
-        std::vector<std::string> res;
-        std::transform(std::begin(vec_int),
-                       std::end(vec_int),
-                       std::back_inserter(res),
-                       [](double d) { return boost::lexical_cast<std::string>(d); });
-        return res;
-    }
+    return getLayers(selectRange(range));
+}
+
+inline bool MVD3File::hasRegions() const {
+    return _schema.has(did_cells_index_regions);
 }
 
 inline bool MVD3File::hasMiniFrequencies() const {
-    return _hdf5_file.exist(did_cells_exc_mini_freq) && _hdf5_file.exist(did_cells_inh_mini_freq);
+    return _schema.has(did_cells_exc_mini_freq) && _schema.has(did_cells_inh_mini_freq);
 }
 
 inline std::vector<double> MVD3File::getExcMiniFrequencies(const Range& range) const {
-    return getDataFromMVD<double>(did_cells_exc_mini_freq, did_lib_NONE, range);
+    return getExcMiniFrequencies(selectRange(range));
 }
 
 
 inline std::vector<double> MVD3File::getInhMiniFrequencies(const Range& range) const {
-    return getDataFromMVD<double>(did_cells_inh_mini_freq, did_lib_NONE, range);
+    return getInhMiniFrequencies(selectRange(range));
 }
 
 
@@ -272,61 +451,276 @@ inline bool MVD3File::hasCurrents() const {
 
 
 inline std::vector<double> MVD3File::getThresholdCurrents(const Range& range) const {
-    return getDataFromTSV<double>(TSVColumn::ThresholdCurrent, range);
+    return getThresholdCurrents(selectRange(range));
 }
 
 
 inline std::vector<double> MVD3File::getHoldingCurrents(const Range& range) const {
-   return getDataFromTSV<double>(TSVColumn::HoldingCurrent, range);
+    return getHoldingCurrents(selectRange(range));
 }
 
 
 inline std::vector<std::string> MVD3File::getSynapseClass(const Range& range) const {
-    return getDataFromMVD(did_cells_index_synapse_class, did_lib_data_syn_class, range);
+    return getSynapseClass(selectRange(range));
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalMorphologies(const Range& range) const {
+    return getCategoricalMorphologies(selectRange(range));
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalEtypes(const Range& range) const {
+    return getCategoricalEtypes(selectRange(range));
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalMtypes(const Range& range) const {
+    return getCategoricalMtypes(selectRange(range));
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalRegions(const Range& range) const {
+    return getCategoricalRegions(selectRange(range));
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalSynapseClass(const Range& range) const {
+    return getCategoricalSynapseClass(selectRange(range));
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalMECombos(const Range& range) const {
+    return getCategoricalMECombos(selectRange(range));
 }
 
 
 inline std::vector<size_t> MVD3File::getIndexMorphologies(const Range& range) const {
-    return getDataFromMVD<size_t>(did_cells_index_morpho, did_lib_NONE, range);
+    return getIndexMorphologies(selectRange(range));
 }
 
 
 inline std::vector<size_t> MVD3File::getIndexEtypes(const Range& range) const {
-    return getDataFromMVD<size_t>(did_cells_index_etypes, did_lib_NONE, range);
+    return getIndexEtypes(selectRange(range));
 }
 
 inline std::vector<size_t> MVD3File::getIndexMtypes(const Range& range) const {
-    return getDataFromMVD<size_t>(did_cells_index_mtypes, did_lib_NONE, range);
+    return getIndexMtypes(selectRange(range));
 }
 
 inline std::vector<size_t> MVD3File::getIndexRegions(const Range& range) const {
-    return getDataFromMVD<size_t>(did_cells_index_regions, did_lib_NONE, range);
+    return getIndexRegions(selectRange(range));
 }
 
 inline std::vector<size_t> MVD3File::getIndexSynapseClass(const Range& range) const {
-    return getDataFromMVD<size_t>(did_cells_index_synapse_class, did_lib_NONE, range);
+    return getIndexSynapseClass(selectRange(range));
+}
+
+// Selection variants
+
+inline Positions MVD3File::getPositions(const MVD::Selection& selection) const {
+    Positions res;
+    read_rows_for_selection(getDataSetInfo(did_cells_positions), selection, 3, _xfer_props, res);
+    return res;
+}
+
+
+inline Rotations MVD3File::getRotations(const MVD::Selection& selection) const {
+    Rotations res;
+    read_rows_for_selection(getDataSetInfo(did_cells_rotations), selection, 4, _xfer_props, res);
+    return res;
+}
+
+
+inline std::vector<std::string> MVD3File::getMorphologies(const MVD::Selection& selection) const {
+    return getDataFromMVD(did_cells_index_morpho, did_lib_data_morpho, selection);
+}
+
+
+inline std::vector<std::string> MVD3File::getEtypes(const MVD::Selection& selection) const {
+    return getDataFromTSVorMVD(
+        did_cells_index_etypes, did_lib_data_etypes, TSVColumn::EType, selection);
+}
+
+
+inline std::vector<std::string> MVD3File::getEmodels(const MVD::Selection& selection) const {
+    return getDataFromTSV(TSVColumn::EModel, selection);
+}
+
+
+inline std::vector<std::string> MVD3File::getMtypes(const MVD::Selection& selection) const {
+    return getDataFromTSVorMVD(
+        did_cells_index_mtypes, did_lib_data_mtypes, TSVColumn::FullMType, selection);
+}
+
+
+inline std::vector<std::string> MVD3File::getMECombos(const MVD::Selection& selection) const {
+    return getDataFromMVD(did_cells_index_mecombo, did_lib_data_mecombo, selection);
+}
+
+
+inline std::vector<std::string> MVD3File::getRegions(const MVD::Selection& selection) const {
+    return getCategoricalRegions(selection).values();
+}
+
+
+inline std::vector<int32_t> MVD3File::getHyperColumns(const MVD::Selection& selection) const {
+    return getDataFromMVD<int32_t>(did_cells_hypercolumn, selection);
+}
+
+
+inline std::vector<int32_t> MVD3File::getMiniColumns(const MVD::Selection& selection) const {
+    return getDataFromMVD<int32_t>(did_cells_minicolmun, selection);
+}
+
+
+inline std::vector<std::string> MVD3File::getLayers(const MVD::Selection& selection) const {
+    if (_schema.get(did_cells_layer).dtype == "string")
+        return getDataFromMVD<std::string>(did_cells_layer, selection);
+    else {
+        auto vec_int = getDataFromMVD<int32_t>(did_cells_layer, selection);
+        std::vector<std::string> res;
+        std::transform(std::begin(vec_int),
+                       std::end(vec_int),
+                       std::back_inserter(res),
+                       [](double d) { return boost::lexical_cast<std::string>(d); });
+        return res;
+    }
+}
+
+
+inline std::vector<double> MVD3File::getExcMiniFrequencies(const MVD::Selection& selection) const {
+    return getDataFromMVD<double>(did_cells_exc_mini_freq, selection);
+}
+
+
+inline std::vector<double> MVD3File::getInhMiniFrequencies(const MVD::Selection& selection) const {
+    return getDataFromMVD<double>(did_cells_inh_mini_freq, selection);
+}
+
+
+inline std::vector<double> MVD3File::getThresholdCurrents(const MVD::Selection& selection) const {
+    return getDataFromTSV<double>(TSVColumn::ThresholdCurrent, selection);
+}
+
+
+inline std::vector<double> MVD3File::getHoldingCurrents(const MVD::Selection& selection) const {
+    return getDataFromTSV<double>(TSVColumn::HoldingCurrent, selection);
+}
+
+
+inline std::vector<std::string> MVD3File::getSynapseClass(const MVD::Selection& selection) const {
+    return getCategoricalSynapseClass(selection).values();
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalMorphologies(
+    const MVD::Selection& selection) const {
+    return getCategoricalFromMVD(did_cells_index_morpho, did_lib_data_morpho, selection);
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalEtypes(const MVD::Selection& selection) const {
+    return getCategoricalFromTSVorMVD(
+        did_cells_index_etypes, did_lib_data_etypes, TSVColumn::EType, selection);
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalMtypes(const MVD::Selection& selection) const {
+    return getCategoricalFromTSVorMVD(
+        did_cells_index_mtypes, did_lib_data_mtypes, TSVColumn::FullMType, selection);
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalRegions(const MVD::Selection& selection) const {
+    return getCategoricalFromMVD(did_cells_index_regions, did_lib_data_regions, selection);
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalSynapseClass(
+    const MVD::Selection& selection) const {
+    return getCategoricalFromMVD(
+        did_cells_index_synapse_class, did_lib_data_syn_class, selection);
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalMECombos(const MVD::Selection& selection) const {
+    return getCategoricalFromMVD(did_cells_index_mecombo, did_lib_data_mecombo, selection);
+}
+
+
+inline std::vector<size_t> MVD3File::getIndexMorphologies(const MVD::Selection& selection) const {
+    return getDataFromMVD<size_t>(did_cells_index_morpho, selection);
+}
+
+
+inline std::vector<size_t> MVD3File::getIndexEtypes(const MVD::Selection& selection) const {
+    return getDataFromMVD<size_t>(did_cells_index_etypes, selection);
+}
+
+inline std::vector<size_t> MVD3File::getIndexMtypes(const MVD::Selection& selection) const {
+    return getDataFromMVD<size_t>(did_cells_index_mtypes, selection);
+}
+
+inline std::vector<size_t> MVD3File::getIndexRegions(const MVD::Selection& selection) const {
+    return getDataFromMVD<size_t>(did_cells_index_regions, selection);
+}
+
+inline std::vector<size_t> MVD3File::getIndexSynapseClass(const MVD::Selection& selection) const {
+    return getDataFromMVD<size_t>(did_cells_index_synapse_class, selection);
+}
+
+
+inline MVD::CellBatch MVD3File::read(const MVD::Selection& selection, unsigned columns) const {
+    MVD::CellBatch batch;
+    batch.selection = selection;
+
+    if (columns & MVD::CellColumn::Positions) {
+        read_rows_for_selection(
+            getDataSetInfo(did_cells_positions), selection, 3, _xfer_props, batch.positions);
+    }
+    if ((columns & MVD::CellColumn::Rotations) && hasRotations()) {
+        read_rows_for_selection(
+            getDataSetInfo(did_cells_rotations), selection, 4, _xfer_props, batch.rotations);
+    }
+    if (columns & MVD::CellColumn::Morphologies) {
+        batch.morphologies = getCategoricalMorphologies(selection);
+    }
+    if (columns & MVD::CellColumn::Etypes) {
+        batch.etypes = getCategoricalEtypes(selection);
+    }
+    if (columns & MVD::CellColumn::Mtypes) {
+        batch.mtypes = getCategoricalMtypes(selection);
+    }
+    if (columns & MVD::CellColumn::Regions) {
+        batch.regions = getCategoricalRegions(selection);
+    }
+    if (columns & MVD::CellColumn::SynapseClass) {
+        batch.synapse_class = getCategoricalSynapseClass(selection);
+    }
+    return batch;
 }
 
 // list ALL group
 
 inline std::vector<std::string> MVD3File::listAllMorphologies() const {
-    return getDataFromMVD(did_lib_data_morpho, did_lib_NONE, range_ALL);
+    return *getLibrary(did_lib_data_morpho);
 }
 
 inline std::vector<std::string> MVD3File::listAllEtypes() const {
-    return getDataFromMVD(did_lib_data_etypes, did_lib_NONE, range_ALL);
+    return *getLibrary(did_lib_data_etypes);
 }
 
 inline std::vector<std::string> MVD3File::listAllMtypes() const {
-    return getDataFromMVD(did_lib_data_mtypes, did_lib_NONE, range_ALL);
+    return *getLibrary(did_lib_data_mtypes);
 }
 
 inline std::vector<std::string> MVD3File::listAllRegions() const {
-    return getDataFromMVD(did_lib_data_regions, did_lib_NONE, range_ALL);
+    return *getLibrary(did_lib_data_regions);
 }
 
 inline std::vector<std::string> MVD3File::listAllSynapseClass() const {
-    return getDataFromMVD(did_lib_data_syn_class, did_lib_NONE, range_ALL);
+    return *getLibrary(did_lib_data_syn_class);
 }
 
 // Emodels are only avail within TSV
@@ -338,18 +732,23 @@ inline std::vector<std::string> MVD3File::listAllEmodels() const {
     const auto all_entries = _tsv_file->getAll();
     emodels.reserve(all_entries.size());
     for (const TSV::MEComboEntry& entry : all_entries) {
-        emodels.push_back(entry.eModel);
+        emodels.push_back(entry.eModel.to_string());
     }
     vector_remove_dups(emodels);
     return emodels;
 }
 
 
+inline LibraryGatherStats MVD3File::getLibraryGatherStats() const {
+    std::lock_guard<std::mutex> lock(_libraries_mutex);
+    return _library_stats;
+}
+
+
 inline std::vector<double> MVD3File::getCircuitSeeds() const {
     std::vector<double> seeds;
 
-    HighFive::DataSet seeds_dataset = _hdf5_file.getDataSet(did_lib_circuit_seeds);
-    seeds_dataset.read(seeds);
+    getDataSetInfo(did_lib_circuit_seeds).dataset.read(seeds);
     if (seeds.size() < 4) {
         throw MVDParserException(
             "Invalid MVD3 /circuit/seeds size, MVD3 should provide at least 4 seeds");
@@ -359,55 +758,304 @@ inline std::vector<double> MVD3File::getCircuitSeeds() const {
 
 
 inline TSV::TSVFile::vector_ref MVD3File::getTSVInfo(const Range& range) const {
+    return getTSVInfo(selectRange(range));
+}
+
+
+inline TSV::TSVFile::vector_ref MVD3File::getTSVInfo(const MVD::Selection& selection) const {
     if(!_tsv_file) {
         throw MVDException("No TSV file is opened with MVD3. Unable to get the TSVInfo");
     }
-    const auto& f = [&](const vec_string& combos, const vec_string& morphos) {
-        return  _tsv_file->get(combos, morphos);
-    };
-    using T = std::reference_wrapper<const TSV::MEComboEntry>;
-    return tsv_get_chunked<T>(*this, f, range);
+    std::vector<const TSV::MEComboEntry*> joined(selection.flatSize());
+    joinTSV(selection, [&joined](size_t i, const TSV::MEComboEntry& entry) {
+        joined[i] = &entry;
+    });
+    TSV::TSVFile::vector_ref entries;
+    entries.reserve(joined.size());
+    for (const auto* entry: joined) {
+        entries.push_back(*entry);
+    }
+    return entries;
+}
+
+
+inline TSV::MEComboColumns MVD3File::getTSVColumns(const Range& range, unsigned columns) const {
+    return getTSVColumns(selectRange(range), columns);
+}
+
+
+inline TSV::MEComboColumns MVD3File::getTSVColumns(const MVD::Selection& selection,
+                                                  unsigned columns) const {
+    if (!_tsv_file) {
+        throw MVDException("No TSV file is opened with MVD3. Unable to get the TSV columns");
+    }
+    TSV::MEComboColumns values;
+    TSV::TSVFile::resizeColumns(values, selection.flatSize(), columns);
+    joinTSV(selection, [&values, columns](size_t i, const TSV::MEComboEntry& entry) {
+        TSV::TSVFile::setColumns(values, i, entry, columns);
+    });
+    return values;
+}
+
+
+inline void MVD3File::setTSVWorkers(size_t n_workers) {
+    _tsv_workers = (n_workers == 0) ? std::max(1u, std::thread::hardware_concurrency())
+                                    : n_workers;
 }
 
 
 
 // Protected
 
+inline const DataSetInfo& MVD3File::getDataSetInfo(const std::string& did) const {
+    std::lock_guard<std::mutex> lock(_datasets_mutex);
+    auto it = _datasets.find(did);
+    if (it == _datasets.end()) {
+        HighFive::DataSet dataset = _hdf5_file.getDataSet(did);
+        // unordered_map nodes are stable, references stay valid on insertion
+        it = _datasets.emplace(did, DataSetInfo{dataset, _schema.get(did).dims}).first;
+    }
+    return it->second;
+}
+
+
+template <typename T>
+inline void MVD3File::readInto(const std::string& did,
+                               const Range& range,
+                               size_t width,
+                               T* out,
+                               size_t stride) const {
+    static_assert(std::is_arithmetic<T>::value, "Only numeric datasets can be read in place");
+    const auto selection = selectRange(range);
+    const size_t offset = selection.empty() ? 0 : selection.ranges().front()[0];
+    read_hyperslab_into(getDataSetInfo(did).dataset, offset, selection.flatSize(),
+                        0, width, out, stride, _xfer_props);
+}
+
+
+inline MVD::Selection MVD3File::selectRange(const Range& range) const {
+    return MVD::Selection::fromRange(range, getNbNeuron());
+}
+
+
+inline std::shared_ptr<const MVD3File::Library> MVD3File::getLibrary(
+    const std::string& did_lib) const {
+    std::lock_guard<std::mutex> lock(_libraries_mutex);
+    auto it = _libraries.find(did_lib);
+    if (it == _libraries.end()) {
+        auto values = std::make_shared<Library>();
+        getDataSetInfo(did_lib).dataset.read(*values);
+        it = _libraries.emplace(did_lib, std::move(values)).first;
+    }
+    return it->second;
+}
+
+
+inline std::vector<std::string> MVD3File::resolveIndex(
+    const std::string& did_lib,
+    const std::vector<size_t>& references) const {
+    const size_t n_elem = getDataSetInfo(did_lib).dims[0];
+    for (const auto i: references) {
+        if (i >= n_elem) {
+            std::ostringstream ss;
+            ss << "Invalid index reference " << i << " in an dataset of size " << n_elem;
+            throw MVDParserException(ss.str());
+        }
+    }
+
+    std::shared_ptr<const Library> library;
+    {
+        std::lock_guard<std::mutex> lock(_libraries_mutex);
+        auto it = _libraries.find(did_lib);
+        if (it != _libraries.end()) {
+            library = it->second;
+            ++_library_stats.cached;
+        }
+    }
+
+    std::vector<std::string> result;
+    result.reserve(references.size());
+    if (library) {
+        for (const auto i: references) {
+            result.push_back((*library)[i]);
+        }
+        return result;
+    }
+
+    std::vector<size_t> unique_refs(references);
+    std::sort(unique_refs.begin(), unique_refs.end());
+    unique_refs.erase(std::unique(unique_refs.begin(), unique_refs.end()), unique_refs.end());
+    if (unique_refs.empty()) {
+        return result;
+    }
+    const size_t first = unique_refs.front();
+    const size_t span = unique_refs.back() - first + 1;
+
+    if (span * LIBRARY_FULL_TABLE_DEN >= n_elem * LIBRARY_FULL_TABLE_NUM ||
+        references.size() >= n_elem) {
+        library = getLibrary(did_lib);
+        {
+            std::lock_guard<std::mutex> lock(_libraries_mutex);
+            ++_library_stats.full_table;
+        }
+        for (const auto i: references) {
+            result.push_back((*library)[i]);
+        }
+    } else if (unique_refs.size() * LIBRARY_POINT_SPARSITY < span) {
+        std::vector<std::string> values;
+        getDataSetInfo(did_lib).dataset.select(HighFive::ElementSet(unique_refs)).read(values);
+        {
+            std::lock_guard<std::mutex> lock(_libraries_mutex);
+            ++_library_stats.points;
+        }
+        for (const auto i: references) {
+            const auto pos = std::lower_bound(unique_refs.begin(), unique_refs.end(), i);
+            result.push_back(values[size_t(pos - unique_refs.begin())]);
+        }
+    } else {
+        std::vector<std::string> values;
+        getDataSetInfo(did_lib).dataset.select({first}, {span}).read(values);
+        {
+            std::lock_guard<std::mutex> lock(_libraries_mutex);
+            ++_library_stats.span;
+        }
+        for (const auto i: references) {
+            result.push_back(values[i - first]);
+        }
+    }
+    return result;
+}
+
+
 template <typename T>
 inline std::vector<T> MVD3File::getDataFromTSV(const TSVColumn& col,
-                                               const Range& range) const {
+                                               const MVD::Selection& selection) const {
     if (!_tsv_file) {
         throw MVDException("No TSV file is opened with MVD3. Unable to extract col #"
                            + std::to_string(col));
     }
-    const auto& f = [&](const vec_string& combos, const vec_string& morphos) {
-       return  _tsv_file->getField<T>(combos, morphos, col);
+    std::vector<T> values(selection.flatSize());
+    joinTSV(selection, [&values, &col](size_t i, const TSV::MEComboEntry& entry) {
+        values[i] = TSV::TSVFile::getValue<T>(entry, col);
+    });
+    return values;
+}
+
+
+template <typename Gather>
+inline void MVD3File::joinTSV(const MVD::Selection& selection, const Gather& gather) const {
+    // Joins the neurons [offset, offset + size) of the selection, returning
+    // those missing from the join table
+    const auto join = [this, &gather](size_t offset,
+                                      const std::vector<size_t>& combos,
+                                      const std::vector<size_t>& morphologies) {
+        std::vector<detail::TSVJoinMiss> misses;
+        for (size_t i = 0; i < combos.size(); ++i) {
+            const auto row = _tsv_join.find(tsv_join_key(combos[i], morphologies[i]));
+            if (row != _tsv_join.end()) {
+                gather(offset + i, _tsv_entries[row->second].get());
+            } else {
+                misses.push_back({offset + i, combos[i], morphologies[i]});
+            }
+        }
+        return misses;
+    };
+
+    // HDF5 is only read from this thread, one chunk ahead of the joins
+    std::vector<detail::TSVJoinMiss> misses;
+    std::deque<std::future<std::vector<detail::TSVJoinMiss>>> pending;
+    const auto collect = [&misses, &pending]() {
+        const auto chunk_misses = pending.front().get();
+        pending.pop_front();
+        misses.insert(misses.end(), chunk_misses.begin(), chunk_misses.end());
     };
-    return tsv_get_chunked<T>(*this, f, range);
+
+    // The number of chunks depends on the size of the selection of each rank:
+    // the library indices are read independently, never collectively
+    const MVD::utils::TransferProps independent;
+    const auto& combo_info = getDataSetInfo(did_cells_index_mecombo);
+    const auto& morphology_info = getDataSetInfo(did_cells_index_morpho);
+
+    size_t offset = 0;
+    MVD::utils::for_each_chunk(selection, tsv_join_chunk_size, [&](const MVD::Selection& chunk) {
+        auto combos = get_data_for_selection<size_t>(combo_info, chunk, independent);
+        auto morphologies = get_data_for_selection<size_t>(morphology_info, chunk, independent);
+        const size_t size = combos.size();
+        if (_tsv_workers <= 1) {
+            const auto chunk_misses = join(offset, combos, morphologies);
+            misses.insert(misses.end(), chunk_misses.begin(), chunk_misses.end());
+        } else {
+            while (pending.size() >= _tsv_workers) {
+                collect();
+            }
+            pending.push_back(std::async(std::launch::async,
+                                         [join, offset, combos = std::move(combos),
+                                          morphologies = std::move(morphologies)]() {
+                                             return join(offset, combos, morphologies);
+                                         }));
+        }
+        offset += size;
+    });
+    while (!pending.empty()) {
+        collect();
+    }
+
+    // Names duplicated in a library are only joined on their first index:
+    // the others are looked up by name, which also throws the TSVException
+    // of the cells missing from the TSV file
+    for (const auto& miss: misses) {
+        gather(miss.position,
+               _tsv_file->get(resolveIndex(did_lib_data_mecombo, {miss.me_combo}),
+                              resolveIndex(did_lib_data_morpho, {miss.morphology}))[0]
+                   .get());
+    }
 }
 
 
 template <typename T>
 inline std::vector<T> MVD3File::getDataFromMVD(const std::string& did_ds,
-                                               const std::string& did_lib,
-                                               const Range& range) const {
-    const auto raw_data = _hdf5_file.getDataSet(did_ds);
-    if (did_lib.empty()) {
-        return get_data_for_selection<T>(raw_data, range);
+                                               const MVD::Selection& selection) const {
+    return get_data_for_selection<T>(getDataSetInfo(did_ds), selection, _xfer_props);
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalFromMVD(const std::string& did_ds,
+                                                       const std::string& did_lib,
+                                                       const MVD::Selection& selection) const {
+    using code_type = MVD::Categorical::code_type;
+    return MVD::Categorical(get_data_for_selection<code_type>(getDataSetInfo(did_ds), selection, _xfer_props),
+                            getLibrary(did_lib));
+}
+
+
+inline MVD::Categorical MVD3File::getCategoricalFromTSVorMVD(
+    const std::string& did_ds,
+    const std::string& did_lib,
+    const TSVColumn& col,
+    const MVD::Selection& selection) const {
+    if (_tsv_file) {
+        return MVD::Categorical::fromValues(getDataFromTSV(col, selection));
     }
-    return resolve_index<T>(raw_data, range, _hdf5_file.getDataSet(did_lib));
+    return getCategoricalFromMVD(did_ds, did_lib, selection);
 }
 
 
-template <typename T>
-inline std::vector<T> MVD3File::getDataFromTSVorMVD(const std::string& did_ds,
-                                                    const std::string& did_lib,
-                                                    const TSVColumn& col,
-                                                    const Range& range) const {
+inline std::vector<std::string> MVD3File::getDataFromMVD(const std::string& did_ds,
+                                                         const std::string& did_lib,
+                                                         const MVD::Selection& selection) const {
+    return resolveIndex(did_lib, getDataFromMVD<size_t>(did_ds, selection));
+}
+
+
+inline std::vector<std::string> MVD3File::getDataFromTSVorMVD(
+    const std::string& did_ds,
+    const std::string& did_lib,
+    const TSVColumn& col,
+    const MVD::Selection& selection) const {
     if (_tsv_file) {
-        return getDataFromTSV<T>(col, range);
+        return getDataFromTSV(col, selection);
     }
-    return getDataFromMVD<T>(did_ds, did_lib, range);
+    return getDataFromMVD(did_ds, did_lib, selection);
 }
 
 
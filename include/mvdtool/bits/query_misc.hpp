@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <boost/variant.hpp>
+
+#include "../query.hpp"
+
+namespace MVD {
+
+namespace {
+
+using CategoricalGetter = Categorical (File::*)(const Selection&) const;
+
+inline CategoricalGetter query_categorical_getter(const std::string& column) {
+    if (column == "morphology") return &File::getCategoricalMorphologies;
+    if (column == "etype") return &File::getCategoricalEtypes;
+    if (column == "mtype") return &File::getCategoricalMtypes;
+    if (column == "region") return &File::getCategoricalRegions;
+    if (column == "synapse_class") return &File::getCategoricalSynapseClass;
+    return nullptr;
+}
+
+// Bounds [low, high] of the interval [min, max] in the stored type T, rounded
+// inward for integers. Returns false when no value of T lies in the interval
+template <typename T>
+inline bool typed_interval(double min, double max, T& low, T& high,
+                           std::true_type /* is_integral */) {
+    const double lowest = static_cast<double>(std::numeric_limits<T>::lowest());
+    // 2^digits is exact as a double, and one past the largest value of T
+    const double upper = std::ldexp(1., std::numeric_limits<T>::digits);
+    min = std::ceil(min);
+    max = std::floor(max);
+    if (!(min <= max) || min >= upper || max < lowest) {
+        return false;
+    }
+    low = (min <= lowest) ? std::numeric_limits<T>::lowest() : static_cast<T>(min);
+    high = (max >= upper) ? std::numeric_limits<T>::max() : static_cast<T>(max);
+    return true;
+}
+
+template <typename T>
+inline bool typed_interval(double min, double max, T& low, T& high,
+                           std::false_type /* is_integral */) {
+    // Out of range bounds saturate to infinities, NaN bounds match nothing
+    const auto narrow = [](double value) {
+        const double limit = static_cast<double>(std::numeric_limits<T>::max());
+        if (value > limit) {
+            return std::numeric_limits<T>::infinity();
+        }
+        if (value < -limit) {
+            return -std::numeric_limits<T>::infinity();
+        }
+        return static_cast<T>(value);
+    };
+    low = narrow(min);
+    high = narrow(max);
+    return true;
+}
+
+// Branch free loops over contiguous values, so that the compiler vectorizes them.
+// Values are compared in their stored type
+template <typename T>
+inline void mask_interval(const T* values,
+                          size_t size,
+                          size_t stride,
+                          double min,
+                          double max,
+                          uint8_t* mask) {
+    T low, high;
+    if (!typed_interval(min, max, low, high, std::is_integral<T>())) {
+        std::fill(mask, mask + size, uint8_t(0));
+        return;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        const T value = values[i * stride];
+        mask[i] &= static_cast<uint8_t>((value >= low) & (value <= high));
+    }
+}
+
+inline void mask_codes(const std::vector<Categorical::code_type>& codes,
+                       const std::vector<uint8_t>& accept,
+                       uint8_t* mask) {
+    const size_t size = codes.size();
+    for (size_t i = 0; i < size; ++i) {
+        mask[i] &= accept[codes[i]];
+    }
+}
+
+class IntervalMask : public boost::static_visitor<void> {
+public:
+    IntervalMask(const std::string& column, double min, double max, uint8_t* mask)
+        : column_(column), min_(min), max_(max), mask_(mask) {}
+
+    template <typename T>
+    void operator()(const std::vector<T>& values) const {
+        mask_interval(values.data(), values.size(), 1, min_, max_, mask_);
+    }
+
+    void operator()(const std::vector<std::string>&) const {
+        throw MVDException("Numeric predicate on string column: " + column_);
+    }
+
+private:
+    const std::string& column_;
+    double min_;
+    double max_;
+    uint8_t* mask_;
+};
+
+}  // namespace
+
+
+inline Query::Query(size_t chunk_size)
+    : chunk_size_(chunk_size) {
+    if (chunk_size == 0) {
+        throw MVDException("Invalid chunk size: 0");
+    }
+}
+
+inline Query& Query::in(const std::string& column, std::vector<std::string> values) {
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    predicates_.push_back({column, true, std::move(values), 0., 0.});
+    return *this;
+}
+
+inline Query& Query::equals(const std::string& column, const std::string& value) {
+    return in(column, {value});
+}
+
+inline Query& Query::equals(const std::string& column, double value) {
+    return between(column, value, value);
+}
+
+inline Query& Query::between(const std::string& column, double min, double max) {
+    predicates_.push_back({column, false, {}, min, max});
+    return *this;
+}
+
+inline Selection Query::select(const File& file) const {
+    return select(file, Selection::fromRange(Range::all(), file.size()));
+}
+
+inline Selection Query::select(const File& file, const Selection& cells) const {
+    cells.checkBounds(file.size());
+
+    const size_t chunk_size = utils::align_chunk_size(chunk_size_, file.storageChunkSize());
+
+    std::vector<CodeFilter> code_filters(predicates_.size());
+    std::vector<uint8_t> mask;
+    Selection::Ranges matches;
+
+    utils::for_each_chunk(cells, chunk_size, [&](const Selection& chunk) {
+        mask.assign(chunk.flatSize(), 1);
+        for (size_t i = 0; i < predicates_.size(); ++i) {
+            filter(file, predicates_[i], chunk, code_filters[i], mask);
+            // Later columns are not read for chunks without candidates
+            if (std::find(mask.begin(), mask.end(), 1) == mask.end()) {
+                return;
+            }
+        }
+
+        const uint8_t* flag = mask.data();
+        for (const auto& range: chunk.ranges()) {
+            for (size_t cell = range[0]; cell < range[1]; ++cell, ++flag) {
+                if (!*flag) {
+                    continue;
+                }
+                if (!matches.empty() && matches.back()[1] == cell) {
+                    ++matches.back()[1];
+                } else {
+                    matches.push_back({cell, cell + 1});
+                }
+            }
+        }
+    });
+    return Selection(matches);
+}
+
+inline void Query::filter(const File& file,
+                          const Predicate& predicate,
+                          const Selection& chunk,
+                          CodeFilter& codes,
+                          std::vector<uint8_t>& mask) {
+    const std::string& column = predicate.column;
+
+    if (predicate.categorical) {
+        const auto getter = query_categorical_getter(column);
+        const Categorical values = getter ? (file.*getter)(chunk)
+                                          : file.getCategoricalAttribute(column, chunk);
+        // Backends share the dictionary between reads: the literals are only
+        // resolved again for columns encoded on the fly
+        if (codes.dictionary != values.sharedDictionary()) {
+            codes.dictionary = values.sharedDictionary();
+            const auto& dictionary = *codes.dictionary;
+            codes.accept.resize(dictionary.size());
+            for (size_t i = 0; i < dictionary.size(); ++i) {
+                codes.accept[i] = std::binary_search(predicate.values.begin(),
+                                                     predicate.values.end(),
+                                                     dictionary[i]);
+            }
+        }
+        mask_codes(values.codes(), codes.accept, mask.data());
+        return;
+    }
+
+    // Positions are only read as a whole from 2D datasets, as in MVD3: a
+    // backend storing one column per axis, as SONATA, reads the tested one
+    const bool axis = column == "x" || column == "y" || column == "z";
+    if (axis && !file.getSchema().has(column)) {
+        const Positions positions = file.getPositions(chunk);
+        mask_interval(positions.data() + (column[0] - 'x'),
+                      mask.size(),
+                      3,
+                      predicate.min,
+                      predicate.max,
+                      mask.data());
+        return;
+    }
+
+    const TypedColumn values = file.getTypedAttribute(column, chunk);
+    boost::apply_visitor(IntervalMask(column, predicate.min, predicate.max, mask.data()),
+                         values.values());
+}
+
+}  // namespace MVD
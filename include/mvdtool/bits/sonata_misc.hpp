@@ -18,7 +18,10 @@
  */
 #pragma once
 
+#include <array>
+#include <cmath>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include <boost/math/quaternion.hpp>
@@ -27,6 +30,7 @@
 
 #include "../sonata.hpp"
 #include "../utils.hpp"
+#include "hdf5_misc.hpp"
 
 namespace {
 
@@ -52,9 +56,9 @@ constexpr char did_threshold_current[] = "threshold_current";
 constexpr char did_holding_current[] = "holding_current";
 constexpr char did_model_template[] = "model_template";
 
-inline auto select(const MVD::Range& range, size_t size) {
-    return sonata::Selection({{range.offset, range.calculate_end(size)}});
-}
+// Schema names of the datasets below the attribute group
+constexpr char library_prefix[] = "@library/";
+constexpr char dynamics_prefix[] = "dynamics_params/";
 
 
 inline decltype(auto) open_population(const std::string &filename, std::string pop_name) {
@@ -78,6 +82,103 @@ inline decltype(auto) open_population(const std::string &filename, std::string p
 }
 
 
+using Quaternion = boost::math::quaternion<double>;
+
+// Composes the rotation of `n` cells from their angles around z, then y, then
+// x, and writes the (x, y, z, w) quaternions `stride` doubles apart. There is
+// one instantiation per set of axes, to keep the loop body branch free. The
+// quaternion products are the same as when composing cell by cell, so the
+// results are identical
+template <bool UseX, bool UseY, bool UseZ>
+inline void compose_angular_rotations_kernel(size_t n,
+                                             const double* angles_x,
+                                             const double* angles_y,
+                                             const double* angles_z,
+                                             double* out,
+                                             size_t stride) {
+    for (size_t i = 0; i < n; ++i, out += stride) {
+        Quaternion rot{1., 0., 0., 0.};
+        if (UseZ) {
+            const double halfangle = angles_z[i] * .5;
+            rot *= Quaternion{std::cos(halfangle), 0., 0., std::sin(halfangle)};
+        }
+        if (UseY) {
+            const double halfangle = angles_y[i] * .5;
+            rot *= Quaternion{std::cos(halfangle), 0., std::sin(halfangle), 0.};
+        }
+        if (UseX) {
+            const double halfangle = angles_x[i] * .5;
+            rot *= Quaternion{std::cos(halfangle), std::sin(halfangle), 0., 0.};
+        }
+        out[0] = rot.R_component_2();
+        out[1] = rot.R_component_3();
+        out[2] = rot.R_component_4();
+        out[3] = rot.R_component_1();
+    }
+}
+
+// Angle columns are nullptr for the axes without rotation
+inline void compose_angular_rotations(size_t n,
+                                      const double* angles_x,
+                                      const double* angles_y,
+                                      const double* angles_z,
+                                      double* out,
+                                      size_t stride) {
+    using Kernel = void (*)(size_t, const double*, const double*, const double*, double*, size_t);
+    static constexpr Kernel kernels[8] = {
+        compose_angular_rotations_kernel<false, false, false>,
+        compose_angular_rotations_kernel<false, false, true>,
+        compose_angular_rotations_kernel<false, true, false>,
+        compose_angular_rotations_kernel<false, true, true>,
+        compose_angular_rotations_kernel<true, false, false>,
+        compose_angular_rotations_kernel<true, false, true>,
+        compose_angular_rotations_kernel<true, true, false>,
+        compose_angular_rotations_kernel<true, true, true>,
+    };
+    const size_t kernel = (angles_x != nullptr ? 4 : 0) + (angles_y != nullptr ? 2 : 0) +
+                          (angles_z != nullptr ? 1 : 0);
+    kernels[kernel](n, angles_x, angles_y, angles_z, out, stride);
+}
+
+
+inline bool has_quaternions(const MVD::Schema& schema) {
+    return schema.has("orientation_x") && schema.has("orientation_y") &&
+           schema.has("orientation_z") && schema.has("orientation_w");
+}
+
+
+inline bool has_angles(const MVD::Schema& schema) {
+    return schema.has("rotation_angle_xaxis") || schema.has("rotation_angle_yaxis") ||
+           schema.has("rotation_angle_zaxis");
+}
+
+
+// Every dataset of the attribute group, by path relative to it: the attributes
+// themselves, "@library/<name>" and "dynamics_params/<name>". Attributes with
+// a library table are enumerations
+inline MVD::Schema read_schema(const HighFive::File& file, const std::string& group_path) {
+    const hid_t group = H5Gopen2(file.getId(), group_path.c_str(), H5P_DEFAULT);
+    if (group < 0) {
+        throw MVDException("Unable to open the attribute group " + group_path);
+    }
+    std::vector<MVD::Column> columns;
+    try {
+        columns = describe_datasets(group, "");
+    } catch (...) {
+        H5Gclose(group);
+        throw;
+    }
+    H5Gclose(group);
+
+    const MVD::Schema names(columns);
+    for (auto& column: columns) {
+        column.enumeration = column.name.find('/') == std::string::npos &&
+                             names.has(library_prefix + column.name);
+    }
+    return MVD::Schema(std::move(columns));
+}
+
+
 // In case the enumeration is not available, get all values and drop duplicates in order
 inline std::vector<std::string> listAllValues(const sonata::NodePopulation* pop,
                                               const std::string& did) {
@@ -96,184 +197,454 @@ inline std::vector<std::string> listAllValues(const sonata::NodePopulation* pop,
 
 namespace MVD {
 
-using namespace bbp::sonata;
-
 inline SonataFile::SonataFile(const std::string &filename, const std::string &pop_name)
-        : pop_(open_population(filename, pop_name)), size_(pop_->size()) {}
+        : pop_(open_population(filename, pop_name))
+        , size_(pop_->size())
+        , h5_file_(filename)
+        , attributes_path_("/nodes/" + pop_->name() + "/0/")
+        , schema_(read_schema(h5_file_, attributes_path_)) {}
+
+#ifdef MVDTOOL_USE_MPI
+inline SonataFile::SonataFile(const std::string& filename,
+                              MPI_Comm comm,
+                              const std::string& pop_name)
+        : pop_(open_population(filename, pop_name))
+        , size_(pop_->size())
+        , h5_file_(utils::open_parallel(filename, comm, xfer_props_))
+        , attributes_path_("/nodes/" + pop_->name() + "/0/")
+        , schema_(read_schema(h5_file_, attributes_path_)) {}
+#endif
 
 inline void SonataFile::openComboTsv(const std::string&) {}
 
-inline Positions SonataFile::getPositions(const Range &range) const {
-    const auto adjusted_count = range.adjust_count(size_);
-    Positions res{boost::extents[adjusted_count][3]};
+inline Positions SonataFile::getPositions(const Range& range) const {
+    return getPositions(Selection::fromRange(range, size_));
+}
 
-    auto xs = pop_->getAttribute<double>("x", select(range, size_));
-    auto ys = pop_->getAttribute<double>("y", select(range, size_));
-    auto zs = pop_->getAttribute<double>("z", select(range, size_));
+inline Rotations SonataFile::getRotations(const Range& range) const {
+    return getRotations(Selection::fromRange(range, size_));
+}
 
-    // No direct slicing write access from std::vector
-    for (size_t i = 0; i < adjusted_count; ++i) {
-        res[i][0] = xs[i];
-        res[i][1] = ys[i];
-        res[i][2] = zs[i];
-    }
+inline Rotations SonataFile::getQuaternionRotations(const Range& range) const {
+    const auto selection = Selection::fromRange(range, size_);
+    Rotations res(boost::extents[selection.flatSize()][4]);
+    readQuaternionRotations(selection, res.data(), 4);
+    return res;
+}
 
+inline Rotations SonataFile::getAngularRotations(const Range &range) const {
+    const auto selection = Selection::fromRange(range, size_);
+    Rotations res(boost::extents[selection.flatSize()][4]);
+    readAngularRotations(selection, res.data(), 4);
     return res;
 }
 
-inline Rotations SonataFile::getQuaternionRotations(const Range &range) const {
-    const auto adjusted_count = range.adjust_count(size_);
-    Positions res{boost::extents[adjusted_count][4]};
+inline size_t SonataFile::storageChunkSize() const {
+    const Column* x = findAttribute("x");
+    return x == nullptr ? 0 : x->chunk_rows;
+}
 
-    auto xs = pop_->getAttribute<double>("orientation_x", select(range, size_));
-    auto ys = pop_->getAttribute<double>("orientation_y", select(range, size_));
-    auto zs = pop_->getAttribute<double>("orientation_z", select(range, size_));
-    auto ws = pop_->getAttribute<double>("orientation_w", select(range, size_));
+inline bool SonataFile::concurrentReads() const {
+    return !xfer_props_.isCollective() && library_is_threadsafe();
+}
 
-    // No direct slicing write access from std::vector
-    for (size_t i = 0; i < adjusted_count; ++i) {
-        res[i][0] = xs[i];
-        res[i][1] = ys[i];
-        res[i][2] = zs[i];
-        res[i][3] = ws[i];
-    }
+inline const Schema& SonataFile::getSchema() const {
+    return schema_;
+}
 
-    return res;
+inline void SonataFile::readPositions(const Range& range, double* out, size_t stride) const {
+    readPositions(Selection::fromRange(range, size_), out, stride);
 }
 
-inline Rotations SonataFile::getAngularRotations(const Range &range) const {
-    using Quaternion = boost::math::quaternion<double>;
+inline void SonataFile::readRotations(const Range& range, double* out, size_t stride) const {
+    readRotations(Selection::fromRange(range, size_), out, stride);
+}
 
-    const auto adjusted_count = range.adjust_count(size_);
-    Positions res{boost::extents[adjusted_count][4]};
+inline bool SonataFile::hasRotations() const {
+    return has_quaternions(schema_) or has_angles(schema_);
+}
 
-    const auto attrs = pop_->attributeNames();
-    const bool use_x = attrs.count("rotation_angle_xaxis") > 0;
-    const bool use_y = attrs.count("rotation_angle_yaxis") > 0;
-    const bool use_z = attrs.count("rotation_angle_zaxis") > 0;
+inline std::vector<std::string> SonataFile::getMorphologies(const Range& range) const {
+    return getMorphologies(Selection::fromRange(range, size_));
+}
 
-    for (size_t i = 0; i < adjusted_count; ++i) {
-        Quaternion rot{1., 0., 0., 0.};
-        Range r{range.offset + i, 1};
+inline std::vector<std::string> SonataFile::getEtypes(const Range& range) const {
+    return getEtypes(Selection::fromRange(range, size_));
+}
 
-        if (use_z) {
-            auto halfangle = pop_->getAttribute<double>("rotation_angle_zaxis", select(r, size_))[0] * .5;
-            rot *= Quaternion{cos(halfangle), 0., 0., sin(halfangle)};
-        }
-        if (use_y) {
-            auto halfangle = pop_->getAttribute<double>("rotation_angle_yaxis", select(r, size_))[0] * .5;
-            rot *= Quaternion{cos(halfangle), 0., sin(halfangle), 0.};
-        }
-        if (use_x) {
-            auto halfangle = pop_->getAttribute<double>("rotation_angle_xaxis", select(r, size_))[0] * .5;
-            rot *= Quaternion{cos(halfangle), sin(halfangle), 0., 0.};
-        }
-        res[i][0] = rot.R_component_2();
-        res[i][1] = rot.R_component_3();
-        res[i][2] = rot.R_component_4();
-        res[i][3] = rot.R_component_1();
-    }
+inline std::vector<std::string> SonataFile::getMtypes(const Range& range) const {
+    return getMtypes(Selection::fromRange(range, size_));
+}
 
-    return res;
+inline std::vector<std::string> SonataFile::getEmodels(const Range& range) const {
+    return getEmodels(Selection::fromRange(range, size_));
 }
 
-inline Rotations SonataFile::getRotations(const Range& range) const{
-    const auto attrs = pop_->attributeNames();
-    const bool quat = (attrs.count("orientation_x") +
-                       attrs.count("orientation_y") +
-                       attrs.count("orientation_z") +
-                       attrs.count("orientation_w")) == 4;
+inline std::vector<std::string> SonataFile::getLayers(const Range& range) const {
+    return getLayers(Selection::fromRange(range, size_));
+}
 
-    if (quat) {
-        return getQuaternionRotations(range);
-    }
-    return getAngularRotations(range);
+inline std::vector<std::string> SonataFile::getRegions(const Range& range) const {
+    return getRegions(Selection::fromRange(range, size_));
 }
 
-inline bool SonataFile::hasRotations() const {
-    const auto attrs = pop_->attributeNames();
-    const bool quat = (attrs.count("orientation_x") +
-                       attrs.count("orientation_y") +
-                       attrs.count("orientation_z") +
-                       attrs.count("orientation_w")) == 4;
-    const bool angle = (attrs.count("rotation_angle_xaxis") +
-                        attrs.count("rotation_angle_yaxis") +
-                        attrs.count("rotation_angle_zaxis")) > 0;
-    return quat or angle;
+inline std::vector<std::string> SonataFile::getSynapseClass(const Range& range) const {
+    return getSynapseClass(Selection::fromRange(range, size_));
+}
+
+inline bool SonataFile::hasRegions() const {
+    return hasAttribute(did_regions);
 }
 
-inline std::vector<std::string> SonataFile::getMorphologies(const Range& range) const{
-    return pop_->getAttribute<std::string>(did_morpho, select(range, size_));
+inline bool SonataFile::hasMiniFrequencies() const {
+    return hasAttribute(did_exc_mini_freq) && hasAttribute(did_inh_mini_freq);
 }
 
-inline std::vector<std::string> SonataFile::getEtypes(const Range& range) const{
-    return pop_->getAttribute<std::string>(did_etypes, select(range, size_));
+inline std::vector<double> SonataFile::getExcMiniFrequencies(const Range& range) const {
+    return getExcMiniFrequencies(Selection::fromRange(range, size_));
 }
 
-inline std::vector<std::string> SonataFile::getMtypes(const Range& range) const{
-    return pop_->getAttribute<std::string>(did_mtypes, select(range, size_));
+inline std::vector<double> SonataFile::getInhMiniFrequencies(const Range& range) const {
+    return getInhMiniFrequencies(Selection::fromRange(range, size_));
 }
 
-inline std::vector<std::string> SonataFile::getLayers(const Range& range) const{
-    return pop_->getAttribute<std::string>(did_layer, select(range, size_));
+inline bool SonataFile::hasCurrents() const {
+    return hasDynamicsAttribute(did_threshold_current) && hasDynamicsAttribute(did_holding_current);
 }
 
-inline bool SonataFile::hasMiniFrequencies() const {
-    const auto attrs = pop_->attributeNames();
-    return attrs.count(did_exc_mini_freq) && attrs.count(did_inh_mini_freq);
+inline std::vector<double> SonataFile::getThresholdCurrents(const Range& range) const {
+    return getThresholdCurrents(Selection::fromRange(range, size_));
+}
+
+inline std::vector<double> SonataFile::getHoldingCurrents(const Range& range) const {
+    return getHoldingCurrents(Selection::fromRange(range, size_));
+}
+
+inline Categorical SonataFile::getCategoricalMorphologies(const Range& range) const {
+    return getCategoricalMorphologies(Selection::fromRange(range, size_));
+}
+
+inline Categorical SonataFile::getCategoricalEtypes(const Range& range) const {
+    return getCategoricalEtypes(Selection::fromRange(range, size_));
+}
+
+inline Categorical SonataFile::getCategoricalMtypes(const Range& range) const {
+    return getCategoricalMtypes(Selection::fromRange(range, size_));
+}
+
+inline Categorical SonataFile::getCategoricalRegions(const Range& range) const {
+    return getCategoricalRegions(Selection::fromRange(range, size_));
+}
+
+inline Categorical SonataFile::getCategoricalSynapseClass(const Range& range) const {
+    return getCategoricalSynapseClass(Selection::fromRange(range, size_));
+}
+
+inline Categorical SonataFile::getCategoricalAttribute(const std::string& name,
+                                                       const Range& range) const {
+    return getCategoricalAttribute(name, Selection::fromRange(range, size_));
+}
+
+inline std::vector<size_t> SonataFile::getIndexEtypes(const Range& range) const {
+    return getIndexEtypes(Selection::fromRange(range, size_));
+}
+
+inline std::vector<size_t> SonataFile::getIndexMtypes(const Range& range) const {
+    return getIndexMtypes(Selection::fromRange(range, size_));
+}
+
+inline std::vector<size_t> SonataFile::getIndexRegions(const Range& range) const {
+    return getIndexRegions(Selection::fromRange(range, size_));
+}
+
+inline std::vector<size_t> SonataFile::getIndexSynapseClass(const Range& range) const {
+    return getIndexSynapseClass(Selection::fromRange(range, size_));
+}
+
+// Selection variants
+
+inline Positions SonataFile::getPositions(const Selection& selection) const {
+    Positions res(boost::extents[selection.flatSize()][3]);
+    readPositions(selection, res.data(), 3);
+    return res;
 }
 
-inline std::vector<double> SonataFile::getExcMiniFrequencies(const Range& range) const{
-    return pop_->getAttribute<double>(did_exc_mini_freq, select(range, size_));
+inline Rotations SonataFile::getRotations(const Selection& selection) const {
+    Rotations res(boost::extents[selection.flatSize()][4]);
+    readRotations(selection, res.data(), 4);
+    return res;
+}
+
+inline void SonataFile::readPositions(const Selection& selection,
+                                      double* out,
+                                      size_t stride) const {
+    if (stride < 3) {
+        throw MVDException("Invalid stride " + std::to_string(stride) + " for positions");
+    }
+    readColumn("x", selection, out, stride);
+    readColumn("y", selection, out + 1, stride);
+    readColumn("z", selection, out + 2, stride);
+}
+
+inline void SonataFile::readRotations(const Selection& selection,
+                                      double* out,
+                                      size_t stride) const {
+    if (has_quaternions(schema_)) {
+        readQuaternionRotations(selection, out, stride);
+    } else {
+        readAngularRotations(selection, out, stride);
+    }
 }
 
-inline std::vector<double> SonataFile::getInhMiniFrequencies(const Range& range) const{
-    return pop_->getAttribute<double>(did_inh_mini_freq, select(range, size_));
+inline std::vector<std::string> SonataFile::getMorphologies(const Selection& selection) const {
+    return getStringAttribute(did_morpho, toSonata(selection));
 }
 
-inline std::vector<std::string> SonataFile::getEmodels(const Range& range) const{
-    auto model_tpl = pop_->getAttribute<std::string>(did_emodel, select(range, size_));
+inline std::vector<std::string> SonataFile::getEtypes(const Selection& selection) const {
+    return getStringAttribute(did_etypes, toSonata(selection));
+}
+
+inline std::vector<std::string> SonataFile::getMtypes(const Selection& selection) const {
+    return getStringAttribute(did_mtypes, toSonata(selection));
+}
+
+inline std::vector<std::string> SonataFile::getEmodels(const Selection& selection) const {
+    auto model_tpl = getStringAttribute(did_emodel, toSonata(selection));
     for (auto& model : model_tpl) {
         model = model.substr(model.find(':') + 1);
     }
     return model_tpl;
 }
 
-inline std::vector<std::string> SonataFile::getRegions(const Range & range) const{
-    return pop_->getAttribute<std::string>(did_regions, select(range, size_));
+inline std::vector<std::string> SonataFile::getLayers(const Selection& selection) const {
+    return getStringAttribute(did_layer, toSonata(selection));
 }
 
-inline std::vector<std::string> SonataFile::getSynapseClass(const Range & range) const{
-    return pop_->getAttribute<std::string>(did_synapse_class, select(range, size_));
+inline std::vector<std::string> SonataFile::getRegions(const Selection& selection) const {
+    return getStringAttribute(did_regions, toSonata(selection));
 }
 
-inline bool SonataFile::hasCurrents() const {
-    const auto& dynAttrs = pop_->dynamicsAttributeNames();
-    return dynAttrs.count(did_threshold_current) && dynAttrs.count(did_holding_current);
+inline std::vector<std::string> SonataFile::getSynapseClass(const Selection& selection) const {
+    return getStringAttribute(did_synapse_class, toSonata(selection));
 }
 
-inline std::vector<double> SonataFile::getThresholdCurrents(const Range& range) const {
-    return pop_->getDynamicsAttribute<double>(did_threshold_current, select(range, size_));
+inline std::vector<double> SonataFile::getExcMiniFrequencies(const Selection& selection) const {
+    return pop_->getAttribute<double>(did_exc_mini_freq, toSonata(selection));
 }
 
-inline std::vector<double> SonataFile::getHoldingCurrents(const Range& range) const {
-    return pop_->getDynamicsAttribute<double>(did_holding_current, select(range, size_));
+inline std::vector<double> SonataFile::getInhMiniFrequencies(const Selection& selection) const {
+    return pop_->getAttribute<double>(did_inh_mini_freq, toSonata(selection));
+}
+
+inline std::vector<double> SonataFile::getThresholdCurrents(const Selection& selection) const {
+    return pop_->getDynamicsAttribute<double>(did_threshold_current, toSonata(selection));
+}
+
+inline std::vector<double> SonataFile::getHoldingCurrents(const Selection& selection) const {
+    return pop_->getDynamicsAttribute<double>(did_holding_current, toSonata(selection));
+}
+
+inline Categorical SonataFile::getCategoricalMorphologies(const Selection& selection) const {
+    return readCategorical(did_morpho, toSonata(selection));
+}
+
+inline Categorical SonataFile::getCategoricalEtypes(const Selection& selection) const {
+    return readCategorical(did_etypes, toSonata(selection));
+}
+
+inline Categorical SonataFile::getCategoricalMtypes(const Selection& selection) const {
+    return readCategorical(did_mtypes, toSonata(selection));
 }
 
-inline std::vector<size_t> SonataFile::getIndexEtypes(const Range &range) const{
-    return pop_->getAttribute<size_t>(did_etypes, select(range, size_));
+inline Categorical SonataFile::getCategoricalRegions(const Selection& selection) const {
+    return readCategorical(did_regions, toSonata(selection));
 }
 
-inline std::vector<size_t> SonataFile::getIndexMtypes(const Range &range) const{
-    return pop_->getAttribute<size_t>(did_mtypes, select(range, size_));
+inline Categorical SonataFile::getCategoricalSynapseClass(const Selection& selection) const {
+    return readCategorical(did_synapse_class, toSonata(selection));
 }
 
-inline std::vector<size_t> SonataFile::getIndexRegions(const Range &range) const{
-    return pop_->getAttribute<size_t>(did_regions, select(range, size_));
+inline Categorical SonataFile::getCategoricalAttribute(const std::string& name,
+                                                       const Selection& selection) const {
+    return readCategorical(name, toSonata(selection));
+}
+
+inline std::vector<size_t> SonataFile::getIndexEtypes(const Selection& selection) const {
+    return pop_->getAttribute<size_t>(did_etypes, toSonata(selection));
+}
+
+inline std::vector<size_t> SonataFile::getIndexMtypes(const Selection& selection) const {
+    return pop_->getAttribute<size_t>(did_mtypes, toSonata(selection));
+}
+
+inline std::vector<size_t> SonataFile::getIndexRegions(const Selection& selection) const {
+    return pop_->getAttribute<size_t>(did_regions, toSonata(selection));
+}
+
+inline std::vector<size_t> SonataFile::getIndexSynapseClass(const Selection& selection) const {
+    return pop_->getAttribute<size_t>(did_synapse_class, toSonata(selection));
+}
+
+inline CellBatch SonataFile::read(const Selection& selection, unsigned columns) const {
+    CellBatch batch;
+    batch.selection = selection;
+    const auto sonata_selection = toSonata(selection);
+
+    if (columns & CellColumn::Positions) {
+        batch.positions.resize(boost::extents[selection.flatSize()][3]);
+        readPositions(selection, batch.positions.data(), 3);
+    }
+    if (columns & CellColumn::Rotations) {
+        if (has_quaternions(schema_)) {
+            batch.rotations.resize(boost::extents[selection.flatSize()][4]);
+            readQuaternionRotations(selection, batch.rotations.data(), 4);
+        } else if (has_angles(schema_)) {
+            batch.rotations.resize(boost::extents[selection.flatSize()][4]);
+            readAngularRotations(selection, batch.rotations.data(), 4);
+        }
+    }
+    if (columns & CellColumn::Morphologies) {
+        batch.morphologies = readCategorical(did_morpho, sonata_selection);
+    }
+    if (columns & CellColumn::Etypes) {
+        batch.etypes = readCategorical(did_etypes, sonata_selection);
+    }
+    if (columns & CellColumn::Mtypes) {
+        batch.mtypes = readCategorical(did_mtypes, sonata_selection);
+    }
+    if (columns & CellColumn::Regions) {
+        batch.regions = readCategorical(did_regions, sonata_selection);
+    }
+    if (columns & CellColumn::SynapseClass) {
+        batch.synapse_class = readCategorical(did_synapse_class, sonata_selection);
+    }
+    return batch;
+}
+
+// Private
+
+inline const Column* SonataFile::findAttribute(const std::string& name) const {
+    return name.find('/') == std::string::npos ? schema_.find(name) : nullptr;
 }
 
-inline std::vector<size_t> SonataFile::getIndexSynapseClass(const Range &range) const{
-    return pop_->getAttribute<size_t>(did_synapse_class, select(range, size_));
+inline const Column* SonataFile::findDynamicsAttribute(const std::string& name) const {
+    return name.find('/') == std::string::npos ? schema_.find(dynamics_prefix + name) : nullptr;
+}
+
+inline bbp::sonata::Selection SonataFile::toSonata(const Selection& selection) const {
+    selection.checkBounds(size_);
+    bbp::sonata::Selection::Ranges ranges;
+    ranges.reserve(selection.ranges().size());
+    for (const auto& range: selection.ranges()) {
+        ranges.push_back({range[0], range[1]});
+    }
+    return bbp::sonata::Selection(ranges);
+}
+
+template <typename T>
+inline void SonataFile::readColumn(const std::string& name,
+                                   const Selection& selection,
+                                   T* out,
+                                   size_t stride) const {
+    if (findAttribute(name) == nullptr) {
+        throw MVDException("No such attribute: " + name);
+    }
+    readDataset(attributes_path_ + name, selection, out, stride);
+}
+
+template <typename T>
+inline void SonataFile::readDataset(const std::string& path,
+                                    const Selection& selection,
+                                    T* out,
+                                    size_t stride) const {
+    static_assert(std::is_arithmetic<T>::value, "Only numeric attributes can be read in place");
+    selection.checkBounds(size_);
+    const auto dataset = h5_file_.getDataSet(path);
+    const auto& ranges = selection.ranges();
+    // A parallel file is read with one collective call whatever the shape of
+    // the selection, so that every rank takes part in it. Otherwise sparse
+    // selections are read one range at a time
+    if (ranges.size() <= 1 || xfer_props_.isCollective()) {
+        read_ranges_into(dataset, ranges, 0, 1, out, stride, xfer_props_);
+        return;
+    }
+    for (const auto& range: ranges) {
+        const size_t count = range[1] - range[0];
+        read_hyperslab_into(dataset, range[0], count, 0, 1, out, stride);
+        out += count * stride;
+    }
+}
+
+inline void SonataFile::readQuaternionRotations(const Selection& selection,
+                                                double* out,
+                                                size_t stride) const {
+    if (stride < 4) {
+        throw MVDException("Invalid stride " + std::to_string(stride) + " for rotations");
+    }
+    readColumn("orientation_x", selection, out, stride);
+    readColumn("orientation_y", selection, out + 1, stride);
+    readColumn("orientation_z", selection, out + 2, stride);
+    readColumn("orientation_w", selection, out + 3, stride);
+}
+
+inline void SonataFile::readAngularRotations(const Selection& selection,
+                                             double* out,
+                                             size_t stride) const {
+    if (stride < 4) {
+        throw MVDException("Invalid stride " + std::to_string(stride) + " for rotations");
+    }
+    selection.checkBounds(size_);
+    const size_t count = selection.flatSize();
+
+    // One bulk read per axis, the missing ones are skipped by the kernel
+    const std::array<const char*, 3> names = {
+        "rotation_angle_xaxis", "rotation_angle_yaxis", "rotation_angle_zaxis"};
+    std::array<std::vector<double>, 3> angles;
+    std::array<const double*, 3> columns = {nullptr, nullptr, nullptr};
+    for (size_t axis = 0; axis < 3; ++axis) {
+        if (findAttribute(names[axis]) != nullptr) {
+            angles[axis].resize(count);
+            readColumn(names[axis], selection, angles[axis].data(), 1);
+            columns[axis] = angles[axis].data();
+        }
+    }
+    compose_angular_rotations(count, columns[0], columns[1], columns[2], out, stride);
+}
+
+inline Categorical SonataFile::readCategorical(const std::string& name,
+                                               const bbp::sonata::Selection& selection) const {
+    auto library = getEnumerationLibrary(name);
+    if (!library) {
+        return Categorical::fromValues(pop_->getAttribute<std::string>(name, selection));
+    }
+    return Categorical(pop_->getEnumeration<Categorical::code_type>(name, selection),
+                       std::move(library));
+}
+
+inline std::shared_ptr<const Categorical::Dictionary> SonataFile::getEnumerationLibrary(
+    const std::string& name) const {
+    std::lock_guard<std::mutex> lock(libraries_mutex_);
+    auto it = libraries_.find(name);
+    if (it == libraries_.end()) {
+        std::shared_ptr<const Categorical::Dictionary> library;
+        const Column* column = findAttribute(name);
+        if (column != nullptr && column->enumeration) {
+            library = std::make_shared<Categorical::Dictionary>(pop_->enumerationValues(name));
+        }
+        it = libraries_.emplace(name, std::move(library)).first;
+    }
+    return it->second;
+}
+
+// Enumerations are decoded against the cached @library table instead of
+// having libsonata re-read it on every call
+inline std::vector<std::string> SonataFile::getStringAttribute(
+    const std::string& name,
+    const bbp::sonata::Selection& selection) const {
+    if (!getEnumerationLibrary(name)) {
+        return pop_->getAttribute<std::string>(name, selection);
+    }
+    return readCategorical(name, selection).values();
 }
 
 inline std::vector<std::string> SonataFile::listAllEtypes() const{
@@ -301,28 +672,71 @@ inline std::vector<std::string> SonataFile::listAllSynapseClass() const{
 }
 
 inline bool SonataFile::hasAttribute(const std::string& name) const {
-    const auto attrs = pop_->attributeNames();
-    return attrs.count(name);
+    return findAttribute(name) != nullptr;
 }
 
 inline bool SonataFile::hasDynamicsAttribute(const std::string& name) const {
-    const auto dynAttrs = pop_->dynamicsAttributeNames();
-    return dynAttrs.count(name);
+    return findDynamicsAttribute(name) != nullptr;
 }
 
 inline std::string SonataFile::getAttributeDataType(const std::string& name) const {
-    if (hasDynamicsAttribute(name)) {
-        return pop_->_dynamicsAttributeDataType(name);
+    const Column* column = findDynamicsAttribute(name);
+    if (column == nullptr) {
+        column = findAttribute(name);
+    }
+    if (column == nullptr) {
+        throw MVDException("No such attribute: " + name);
     }
-    return pop_->_attributeDataType(name);
+    return column->dtype;
 }
 
 template <typename T>
 inline std::vector<T> SonataFile::getAttribute(const std::string& name, const Range& range) const {
+    return getAttribute<T>(name, Selection::fromRange(range, size_));
+}
+
+template <typename T>
+inline void SonataFile::readAttribute(const std::string& name,
+                                      const Range& range,
+                                      T* out,
+                                      size_t stride) const {
+    readColumn(name, Selection::fromRange(range, size_), out, stride);
+}
+
+inline TypedColumn SonataFile::getTypedAttribute(const std::string& name,
+                                                 const Range& range) const {
+    return getTypedAttribute(name, Selection::fromRange(range, size_));
+}
+
+inline TypedColumn SonataFile::getTypedAttribute(const std::string& name,
+                                                 const Selection& selection) const {
+    std::string path = attributes_path_ + dynamics_prefix + name;
+    const Column* column = findDynamicsAttribute(name);
+    if (column == nullptr) {
+        path = attributes_path_ + name;
+        column = findAttribute(name);
+    }
+    if (column == nullptr) {
+        throw MVDException("No such attribute: " + name);
+    }
+    if (column->dtype == "string") {
+        return TypedColumn(getAttribute<std::string>(name, selection));
+    }
+    return dispatch_numeric(column->dtype, [&](auto tag) {
+        using T = typename decltype(tag)::type;
+        std::vector<T> values(selection.flatSize());
+        readDataset(path, selection, values.data(), 1);
+        return TypedColumn(std::move(values));
+    });
+}
+
+template <typename T>
+inline std::vector<T> SonataFile::getAttribute(const std::string& name,
+                                               const Selection& selection) const {
     if (hasDynamicsAttribute(name)) {
-        return pop_->getDynamicsAttribute<T>(name, select(range, size_));
+        return pop_->getDynamicsAttribute<T>(name, toSonata(selection));
     }
-    return pop_->getAttribute<T>(name, select(range, size_));
+    return pop_->getAttribute<T>(name, toSonata(selection));
 }
 
 }
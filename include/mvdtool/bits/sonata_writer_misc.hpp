@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <highfive/H5DataSpace.hpp>
+#include <highfive/H5PropertyList.hpp>
+
+#include "../sonata_writer.hpp"
+
+namespace MVD {
+
+inline SonataWriter::SonataWriter(const std::string& filename,
+                                  size_t n_cells,
+                                  const std::string& population,
+                                  unsigned compression,
+                                  size_t chunk_size)
+    : file_(filename, HighFive::File::OpenOrCreate)
+    , population_path_("/nodes/" + population + "/")
+    , attributes_path_(population_path_ + "0/")
+    , n_cells_(n_cells)
+    , compression_(compression)
+    , chunk_size_(chunk_size) {
+    if (chunk_size == 0) {
+        throw MVDException("Invalid chunk size: 0");
+    }
+    if (compression > 9) {
+        throw MVDException("Invalid compression level " + std::to_string(compression));
+    }
+    file_.createGroup(attributes_path_);
+
+    // All the cells belong to the attribute group 0, without node type
+    const std::string did_type_id = population_path_ + "node_type_id";
+    const std::string did_group_id = population_path_ + "node_group_id";
+    const std::string did_group_index = population_path_ + "node_group_index";
+    dataset(did_type_id, HighFive::AtomicType<int64_t>());
+    dataset(did_group_id, HighFive::AtomicType<uint64_t>());
+    dataset(did_group_index, HighFive::AtomicType<uint64_t>());
+    for (size_t offset = 0; offset < n_cells; offset += chunk_size) {
+        const size_t count = std::min(chunk_size, n_cells - offset);
+        std::vector<uint64_t> index(count);
+        std::iota(index.begin(), index.end(), offset);
+        writeRows(did_group_index, index, offset);
+        writeRows(did_group_id, std::vector<uint64_t>(count, 0), offset);
+        writeRows(did_type_id, std::vector<int64_t>(count, -1), offset);
+    }
+}
+
+inline SonataWriter::~SonataWriter() {
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+template <typename T>
+inline void SonataWriter::writeAttribute(const std::string& name,
+                                         const std::vector<T>& values,
+                                         size_t offset) {
+    writeRows(attributes_path_ + name, values, offset);
+}
+
+template <typename T>
+inline void SonataWriter::writeDynamicsAttribute(const std::string& name,
+                                                 const std::vector<T>& values,
+                                                 size_t offset) {
+    writeRows(attributes_path_ + dynamics_prefix + name, values, offset);
+}
+
+inline void SonataWriter::writeEnumeration(const std::string& name,
+                                           const Categorical& values,
+                                           size_t offset) {
+    using code_type = Categorical::code_type;
+    checkRows(values.size(), offset);
+
+    // Backends share the dictionary between reads, so the table is usually
+    // only looked up for the first block
+    Enumeration& enumeration = enumerations_[name];
+    if (enumeration.dictionary != values.sharedDictionary()) {
+        enumeration.dictionary = values.sharedDictionary();
+        const auto& dictionary = *enumeration.dictionary;
+        enumeration.remap.resize(dictionary.size());
+        for (size_t i = 0; i < dictionary.size(); ++i) {
+            const auto code = static_cast<code_type>(enumeration.values.size());
+            const auto it = enumeration.index.emplace(dictionary[i], code);
+            if (it.second) {
+                enumeration.values.push_back(dictionary[i]);
+            }
+            enumeration.remap[i] = it.first->second;
+        }
+    }
+
+    const auto& codes = values.codes();
+    std::vector<code_type> remapped(codes.size());
+    for (size_t i = 0; i < codes.size(); ++i) {
+        remapped[i] = enumeration.remap[codes[i]];
+    }
+    writeRows(attributes_path_ + name, remapped, offset);
+}
+
+inline void SonataWriter::writePositions(const Positions& positions, size_t offset) {
+    writeColumn("x", positions, 0, offset);
+    writeColumn("y", positions, 1, offset);
+    writeColumn("z", positions, 2, offset);
+}
+
+inline void SonataWriter::writeRotations(const Rotations& rotations, size_t offset) {
+    writeColumn("orientation_x", rotations, 0, offset);
+    writeColumn("orientation_y", rotations, 1, offset);
+    writeColumn("orientation_z", rotations, 2, offset);
+    writeColumn("orientation_w", rotations, 3, offset);
+}
+
+inline void SonataWriter::close() {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    for (const auto& enumeration: enumerations_) {
+        file_.createDataSet(attributes_path_ + library_prefix + enumeration.first,
+                            enumeration.second.values);
+    }
+    file_.flush();
+}
+
+// Private
+
+inline HighFive::DataSet& SonataWriter::dataset(const std::string& path,
+                                                const HighFive::DataType& type) {
+    auto it = datasets_.find(path);
+    if (it == datasets_.end()) {
+        // Chunks can not be larger than a fixed size dataset
+        HighFive::DataSetCreateProps props;
+        if (n_cells_ > 0) {
+            props.add(HighFive::Chunking(std::vector<hsize_t>{std::min(chunk_size_, n_cells_)}));
+            if (compression_ > 0) {
+                props.add(HighFive::Shuffle());
+                props.add(HighFive::Deflate(compression_));
+            }
+        }
+        const HighFive::DataSpace space(std::vector<size_t>{n_cells_});
+        it = datasets_.emplace(path, file_.createDataSet(path, space, type, props)).first;
+    }
+    return it->second;
+}
+
+template <typename T>
+inline void SonataWriter::writeRows(const std::string& path,
+                                    const std::vector<T>& values,
+                                    size_t offset) {
+    checkRows(values.size(), offset);
+    auto& ds = dataset(path, HighFive::AtomicType<T>());
+    if (!values.empty()) {
+        ds.select({offset}, {values.size()}).write(values);
+    }
+}
+
+inline void SonataWriter::writeColumn(const std::string& name,
+                                      const boost::multi_array<double, 2>& rows,
+                                      size_t column,
+                                      size_t offset) {
+    const size_t n_rows = rows.shape()[0];
+    const size_t width = rows.shape()[1];
+    if (column >= width) {
+        throw MVDException("Invalid array width " + std::to_string(width) + " for " + name);
+    }
+    std::vector<double> values(n_rows);
+    const double* row = rows.data() + column;
+    for (size_t i = 0; i < n_rows; ++i, row += width) {
+        values[i] = *row;
+    }
+    writeRows(attributes_path_ + name, values, offset);
+}
+
+inline void SonataWriter::checkRows(size_t count, size_t offset) const {
+    if (closed_) {
+        throw MVDException("SonataWriter is closed");
+    }
+    if (offset + count > n_cells_) {
+        std::ostringstream ss;
+        ss << "Cells up to " << offset + count << " are out of bounds for a population of size "
+           << n_cells_;
+        throw MVDException(ss.str());
+    }
+}
+
+
+inline size_t writeSonata(const File& source,
+                          const std::string& filename,
+                          const std::string& population,
+                          const Range& range,
+                          size_t stride,
+                          unsigned compression,
+                          size_t chunk_size) {
+    if (stride == 0) {
+        throw MVDException("Invalid stride: 0");
+    }
+    const Selection cells = Selection::fromRange(range, source.size());
+    cells.checkBounds(source.size());
+    const size_t first = range.offset;
+    const size_t n_cells = (cells.flatSize() + stride - 1) / stride;
+
+    SonataWriter writer(filename, n_cells, population, compression, chunk_size);
+    const bool rotations = source.hasRotations();
+    const bool regions = source.hasRegions();
+    const bool frequencies = source.hasMiniFrequencies();
+    const bool currents = source.hasCurrents();
+
+    for (size_t offset = 0; offset < n_cells; offset += chunk_size) {
+        const size_t count = std::min(chunk_size, n_cells - offset);
+        // Strided cells are read as a sparse selection, to bound the memory
+        Selection::Ranges ranges;
+        if (stride == 1) {
+            ranges.push_back({first + offset, first + offset + count});
+        } else {
+            ranges.reserve(count);
+            for (size_t i = offset; i < offset + count; ++i) {
+                ranges.push_back({first + i * stride, first + i * stride + 1});
+            }
+        }
+        const Selection chunk(ranges);
+
+        writer.writePositions(source.getPositions(chunk), offset);
+        if (rotations) {
+            writer.writeRotations(source.getRotations(chunk), offset);
+        }
+        writer.writeEnumeration(did_morpho, source.getCategoricalMorphologies(chunk), offset);
+        writer.writeEnumeration(did_etypes, source.getCategoricalEtypes(chunk), offset);
+        writer.writeEnumeration(did_mtypes, source.getCategoricalMtypes(chunk), offset);
+        if (regions) {
+            writer.writeEnumeration(did_regions, source.getCategoricalRegions(chunk), offset);
+        }
+        writer.writeEnumeration(did_synapse_class,
+                                source.getCategoricalSynapseClass(chunk),
+                                offset);
+        if (frequencies) {
+            writer.writeAttribute(did_exc_mini_freq, source.getExcMiniFrequencies(chunk), offset);
+            writer.writeAttribute(did_inh_mini_freq, source.getInhMiniFrequencies(chunk), offset);
+        }
+        if (currents) {
+            writer.writeDynamicsAttribute(did_threshold_current,
+                                          source.getThresholdCurrents(chunk),
+                                          offset);
+            writer.writeDynamicsAttribute(did_holding_current,
+                                          source.getHoldingCurrents(chunk),
+                                          offset);
+        }
+    }
+    writer.close();
+    return n_cells;
+}
+
+}  // namespace MVD
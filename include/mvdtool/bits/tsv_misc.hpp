@@ -18,38 +18,251 @@
  */
 #pragma once
 
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <regex>
+#include <limits>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <unordered_map>
+#include <vector>
 
+
+#include <boost/functional/hash.hpp>
 #include <boost/range/combine.hpp>
+#include <boost/utility/string_view.hpp>
 
 #include "../mvd_except.hpp"
+#include "../utils.hpp"
 
 
 namespace TSV {
 
 namespace detail {
 
-inline std::vector<std::string> split(const std::string& s, char delim) {
-    std::stringstream ss;
-    std::vector<std::string> elems;
-    ss.str(s);
-    std::string item;
-    while (std::getline(ss, item, delim)) {
-        elems.push_back(item);
+constexpr size_t tsv_max_fields = 8;
+using TSVFields = std::array<boost::string_view, tsv_max_fields>;
+
+constexpr boost::string_view MEComboEntry::*const tsv_string_fields[] = {
+    &MEComboEntry::morphologyName,
+    &MEComboEntry::layer,
+    &MEComboEntry::fullMType,
+    &MEComboEntry::eType,
+    &MEComboEntry::eModel,
+    &MEComboEntry::comboName};
+
+// Splits a line on tabs, after trimming its leading and trailing tabs. The
+// first fields are stored in `fields`, all of them are counted
+inline size_t split_fields(boost::string_view line, TSVFields& fields) {
+    const size_t first = line.find_first_not_of('\t');
+    if (first == boost::string_view::npos) {
+        return 0;
+    }
+    line = line.substr(first, line.find_last_not_of('\t') + 1 - first);
+
+    size_t n_fields = 0;
+    const char* it = line.data();
+    const char* const end = it + line.size();
+    while (true) {
+        const char* tab = static_cast<const char*>(std::memchr(it, '\t', size_t(end - it)));
+        const char* field_end = (tab == nullptr) ? end : tab;
+        if (n_fields < tsv_max_fields) {
+            fields[n_fields] = boost::string_view(it, size_t(field_end - it));
+        }
+        ++n_fields;
+        if (tab == nullptr) {
+            return n_fields;
+        }
+        it = tab + 1;
+    }
+}
+
+// class EntryIndex
+
+inline EntryIndex::EntryIndex(MEComboEntry::Column column)
+    : _column(column) {
+    if (column > MEComboEntry::ComboName) {
+        throw TSVException("Entries can not be looked up by column " + std::to_string(column)
+                           + ", which is not a string column");
+    }
+    _key = tsv_string_fields[column];
+}
+
+
+inline void EntryIndex::reserve(const std::vector<MEComboEntry>& entries, size_t n_entries) {
+    // At most 3/4 of the slots are used, to keep the probes short
+    size_t n_slots = 16;
+    while (n_slots * 3 < n_entries * 4) {
+        n_slots *= 2;
+    }
+    if (n_slots <= _slots.size()) {
+        return;
+    }
+    std::vector<uint32_t> slots(n_slots, 0);
+    _slots.swap(slots);
+    for (const uint32_t position: slots) {
+        if (position != 0) {
+            const MEComboEntry& entry = entries[position - 1];
+            _slots[slot(entries, entry.*_key, entry.morphologyName)] = position;
+        }
+    }
+}
+
+
+inline bool EntryIndex::insert(const std::vector<MEComboEntry>& entries, size_t position) {
+    if (position >= std::numeric_limits<uint32_t>::max()) {
+        throw TSVException("Too many entries in a tsv file: " + std::to_string(position));
+    }
+    reserve(entries, _size + 1);
+    const MEComboEntry& entry = entries[position];
+    const size_t i = slot(entries, entry.*_key, entry.morphologyName);
+    if (_slots[i] != 0) {
+        return false;
+    }
+    _slots[i] = static_cast<uint32_t>(position + 1);
+    ++_size;
+    return true;
+}
+
+
+inline size_t EntryIndex::find(const std::vector<MEComboEntry>& entries,
+                               boost::string_view key,
+                               boost::string_view morphology) const {
+    if (_slots.empty()) {
+        return npos;
+    }
+    const uint32_t position = _slots[slot(entries, key, morphology)];
+    return (position == 0) ? size_t(npos) : size_t(position - 1);
+}
+
+
+inline bool EntryIndex::assign(const uint32_t* slots, size_t n_slots, size_t n_entries) {
+    // Probes end on an empty slot: a full table is not valid
+    if ((n_slots & (n_slots - 1)) != 0 || (n_slots <= n_entries && n_slots != 0)) {
+        return false;
+    }
+    size_t size = 0;
+    for (size_t i = 0; i < n_slots; ++i) {
+        if (slots[i] > n_entries) {
+            return false;
+        }
+        size += (slots[i] != 0);
+    }
+    if (size != n_entries) {
+        return false;
+    }
+    _slots.assign(slots, slots + n_slots);
+    _size = size;
+    return true;
+}
+
+
+inline size_t EntryIndex::hash(boost::string_view key, boost::string_view morphology) {
+    size_t seed = boost::hash_range(key.begin(), key.end());
+    boost::hash_combine(seed, boost::hash_range(morphology.begin(), morphology.end()));
+    return seed;
+}
+
+
+inline size_t EntryIndex::slot(const std::vector<MEComboEntry>& entries,
+                               boost::string_view key,
+                               boost::string_view morphology) const {
+    // Linear probing, from the slot of the hash to the first empty or matching one
+    const size_t mask = _slots.size() - 1;
+    for (size_t i = hash(key, morphology) & mask;; i = (i + 1) & mask) {
+        const uint32_t position = _slots[i];
+        if (position == 0) {
+            return i;
+        }
+        const MEComboEntry& entry = entries[position - 1];
+        if (entry.*_key == key && entry.morphologyName == morphology) {
+            return i;
+        }
     }
-    return elems;
 }
 
-inline TSVFile::unordered_pair_map readTSVFile(const std::string& filename,
-                                               const MEComboEntry::Column& column) {
-    TSVFile::unordered_pair_map combo_entries;
-    std::ifstream file(filename);
-    std::string line;
+
+// The string columns of `values`, in the order of tsv_string_fields
+inline std::array<std::vector<std::string>*, 6> tsv_string_columns(MEComboColumns& values) {
+    return {{&values.morphologyNames,
+             &values.layers,
+             &values.fullMTypes,
+             &values.eTypes,
+             &values.eModels,
+             &values.comboNames}};
+}
+
+
+// Binary cache of a parsed tsv file, in native byte order:
+// header, rows, index slots, strings and the absolute path of the tsv file
+constexpr char tsv_cache_magic[8] = {'M', 'V', 'D', 'T', 'S', 'V', 'C', '\0'};
+constexpr uint32_t tsv_cache_version = 1;
+constexpr size_t tsv_n_string_fields = 6;
+
+struct TSVCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t column;
+    // Hash of fixed keys: the slots are only valid for the same hash function
+    uint64_t hash_probe;
+    uint64_t source_size;
+    int64_t source_mtime;
+    int64_t source_mtime_nsec;
+    uint64_t n_entries;
+    uint64_t n_slots;
+    uint64_t strings_size;
+    uint64_t path_size;
+    // Of everything after the header
+    uint64_t checksum;
+};
+
+struct TSVCacheRow {
+    uint32_t offsets[tsv_n_string_fields];
+    uint32_t sizes[tsv_n_string_fields];
+    double threshold_current;
+    double holding_current;
+};
+
+static_assert(sizeof(TSVCacheHeader) % sizeof(uint64_t) == 0, "Misaligned cache rows");
+static_assert(sizeof(TSVCacheRow) == 64, "Padded cache rows");
+
+inline uint64_t tsv_cache_hash_probe() {
+    return EntryIndex::hash("me_combo", "morphology");
+}
+
+// Size and modification time of the tsv file the cache was written for
+inline bool tsv_source_stat(const std::string& filename, TSVCacheHeader& header) {
+    MVD::utils::FileStamp stamp;
+    if (!MVD::utils::file_stamp(filename, stamp)) {
+        return false;
+    }
+    header.source_size = stamp.size;
+    header.source_mtime = stamp.mtime;
+    header.source_mtime_nsec = stamp.mtime_nsec;
+    return true;
+}
+
+
+// Reads the entries of `filename` into `strings` and `entries`, the first
+// of the duplicated keys of `index` only
+inline void readTSVFile(const std::string& filename,
+                        MVD::utils::StringArena& strings,
+                        std::vector<MEComboEntry>& entries,
+                        EntryIndex& index) {
+    std::unique_ptr<MVD::utils::MappedFile> file;
+    try {
+        file.reset(new MVD::utils::MappedFile(filename));
+    } catch (const MVDException& e) {
+        throw TSVParserException(e.what());
+    }
+    const char* it = file->begin();
+    const char* const end = file->end();
+
+    TSVFields fields;
     int line_index = 0;
 
     auto ensure_correct_n_fields = [&](size_t found_fields){
@@ -62,38 +275,50 @@ inline TSVFile::unordered_pair_map readTSVFile(const std::string& filename,
         }
     };
 
-    // Read Header (field names)
-    std::getline(file, line);
-    // remove leading and trailing tabs
-    line = std::regex_replace(line, std::regex("^\t+|\t+$"), "");
-    ensure_correct_n_fields(split(line, '\t').size());
+    auto parse_current = [&](const boost::string_view& field) {
+        double value;
+        if (!MVD::utils::parse_double(field.begin(), field.end(), value)) {
+            std::ostringstream ss;
+            ss << "Error in " << filename << " line " << line_index << ": "
+               << "Invalid current " << field << std::endl;
+            throw TSVParserException(ss.str());
+        }
+        return value;
+    };
 
-    while (std::getline(file, line)) {
+    // Read Header (field names)
+    const boost::string_view header = MVD::utils::next_line(it, end);
+    ensure_correct_n_fields(split_fields(header, fields));
+    // Entries are about as long as the header: size the table without a
+    // counting pass
+    const size_t expected_entries = file->size() / (header.size() + 1);
+    entries.reserve(expected_entries);
+    index.reserve(entries, expected_entries);
+
+    while (it != end) {
         line_index++;
-        // remove leading and trailing tabs
-        line = std::regex_replace(line, std::regex("^\t+|\t+$"), "");
-        auto line_info = split(line, '\t');
-        ensure_correct_n_fields(line_info.size());
-
-        auto morph_name = line_info[MEComboEntry::MorphologyName];
-        combo_entries.insert(
-            {{line_info[column], morph_name},
-             MEComboEntry{// rvalue gets moved
-                          morph_name,
-                          line_info[MEComboEntry::Layer],
-                          line_info[MEComboEntry::FullMType],
-                          line_info[MEComboEntry::EType],
-                          line_info[MEComboEntry::EModel],
-                          line_info[MEComboEntry::ComboName],
-                          (line_info.size() == 8)
-                              ? std::stod(line_info[MEComboEntry::ThresholdCurrent])
-                              : .0,
-                          (line_info.size() == 8)
-                              ? std::stod(line_info[MEComboEntry::HoldingCurrent])
-                              : .0}});
-    }
-
-    return combo_entries;
+        const size_t n_fields = split_fields(MVD::utils::next_line(it, end), fields);
+        ensure_correct_n_fields(n_fields);
+
+        // Morphologies and combos are mostly unique: they are stored without
+        // the cost of a lookup
+        const bool has_currents = (n_fields == 8);
+        const MEComboEntry entry{
+            strings.store(fields[MEComboEntry::MorphologyName]),
+            strings.intern(fields[MEComboEntry::Layer]),
+            strings.intern(fields[MEComboEntry::FullMType]),
+            strings.intern(fields[MEComboEntry::EType]),
+            strings.intern(fields[MEComboEntry::EModel]),
+            strings.store(fields[MEComboEntry::ComboName]),
+            has_currents ? parse_current(fields[MEComboEntry::ThresholdCurrent]) : .0,
+            has_currents ? parse_current(fields[MEComboEntry::HoldingCurrent]) : .0};
+
+        entries.push_back(entry);
+        if (!index.insert(entries, entries.size() - 1)) {
+            entries.pop_back();
+        }
+    }
+    entries.shrink_to_fit();
 }
 
 }  // namespace detail
@@ -104,7 +329,7 @@ using namespace detail;
 
 // class MEComboEntry
 template <>
-inline std::string MEComboEntry::get<std::string>(const Column col_id) const {
+inline boost::string_view MEComboEntry::get<boost::string_view>(const Column col_id) const {
     switch (col_id) {
     case MorphologyName:
         return morphologyName;
@@ -124,6 +349,11 @@ inline std::string MEComboEntry::get<std::string>(const Column col_id) const {
     }
 }
 
+template <>
+inline std::string MEComboEntry::get<std::string>(const Column col_id) const {
+    return get<boost::string_view>(col_id).to_string();
+}
+
 template <>
 inline double MEComboEntry::get<double>(const Column col_id) const {
     switch (col_id) {
@@ -151,22 +381,185 @@ inline std::ostream& operator<<(std::ostream& os, MEComboEntry const& MEComboEnt
 // class TSVFile
 
 inline TSVFile::TSVFile(const std::string& filename)
-    : _filename(filename)
-    , tsvFileInfo(readTSVFile(filename, MEComboEntry::ComboName)) {}
+    : TSVFile(filename, MEComboEntry::ComboName) {}
 
 
 inline TSVFile::TSVFile(const std::string& filename, const MEComboEntry::Column& column)
     : _filename(filename)
-    , tsvFileInfo(readTSVFile(filename, column)) {}
+    , _index(column) {
+    auto strings = std::make_shared<MVD::utils::StringArena>();
+    readTSVFile(filename, *strings, _entries, _index);
+    _strings = std::move(strings);
+}
 
 
-inline TSVFile::vector_ref TSVFile::getAll() const {
-    TSVFile::vector_ref entries;
-    entries.reserve(tsvFileInfo.size());
-    for (const auto& it_infos: tsvFileInfo) {
-        entries.push_back(it_infos.second);
+inline TSVFile TSVFile::openCached(const std::string& filename,
+                                   const std::string& cache_dir,
+                                   const MEComboEntry::Column& column) {
+    const std::string cache_filename = cacheFilename(filename, cache_dir);
+    TSVFile file;
+    file._filename = filename;
+    file._index = EntryIndex(column);
+    if (file.readCache(cache_filename)) {
+        return file;
     }
-    return entries;
+
+    file = TSVFile(filename, column);
+    try {
+        file.writeCache(cache_filename);
+    } catch (const TSVException&) {
+        // Without a writable cache, the file is parsed again by the next jobs
+    }
+    return file;
+}
+
+
+inline std::string TSVFile::cacheFilename(const std::string& filename,
+                                          const std::string& cache_dir) {
+    if (cache_dir.empty()) {
+        return filename + ".cache";
+    }
+    // Tsv files of the same name in different directories get their own cache
+    const std::string path = MVD::utils::absolute_path(filename);
+    const std::string basename = path.substr(path.find_last_of('/') + 1);
+    std::ostringstream ss;
+    ss << cache_dir << '/' << basename << '.' << std::hex
+       << MVD::utils::checksum(path.data(), path.size()) << ".cache";
+    return ss.str();
+}
+
+
+inline void TSVFile::writeCache(const std::string& cache_filename) const {
+    TSVCacheHeader header{};
+    std::memcpy(header.magic, tsv_cache_magic, sizeof(header.magic));
+    header.version = tsv_cache_version;
+    header.column = static_cast<uint32_t>(_index.column());
+    header.hash_probe = tsv_cache_hash_probe();
+    if (!tsv_source_stat(_filename, header)) {
+        throw TSVException("Could not stat file " + _filename + ": " + std::strerror(errno));
+    }
+
+    // Interned strings are viewed by several entries and written once
+    std::vector<TSVCacheRow> rows(_entries.size());
+    std::string strings;
+    std::unordered_map<const char*, uint32_t> offsets;
+    for (size_t i = 0; i < _entries.size(); ++i) {
+        rows[i].threshold_current = _entries[i].thresholdCurrent;
+        rows[i].holding_current = _entries[i].holdingCurrent;
+        for (size_t field = 0; field < tsv_n_string_fields; ++field) {
+            const boost::string_view value = _entries[i].*tsv_string_fields[field];
+            const auto offset = offsets.emplace(value.data(), uint32_t(strings.size()));
+            if (offset.second) {
+                strings.append(value.data(), value.size());
+            }
+            rows[i].offsets[field] = offset.first->second;
+            rows[i].sizes[field] = static_cast<uint32_t>(value.size());
+        }
+        if (strings.size() > std::numeric_limits<uint32_t>::max()) {
+            throw TSVException("Strings of " + _filename + " are too large for a cache");
+        }
+    }
+    const std::string path = MVD::utils::absolute_path(_filename);
+    const auto& slots = _index.slots();
+    header.n_entries = rows.size();
+    header.n_slots = slots.size();
+    header.strings_size = strings.size();
+    header.path_size = path.size();
+
+    std::string body;
+    body.reserve(rows.size() * sizeof(TSVCacheRow) + slots.size() * sizeof(uint32_t) +
+                 strings.size() + path.size());
+    body.append(reinterpret_cast<const char*>(rows.data()), rows.size() * sizeof(TSVCacheRow));
+    body.append(reinterpret_cast<const char*>(slots.data()), slots.size() * sizeof(uint32_t));
+    body.append(strings);
+    body.append(path);
+    header.checksum = MVD::utils::checksum(body.data(), body.size());
+
+    try {
+        MVD::utils::replace_file(cache_filename,
+                                 {boost::string_view(reinterpret_cast<const char*>(&header),
+                                                     sizeof(header)),
+                                  body});
+    } catch (const MVDException& e) {
+        throw TSVException(std::string("Could not write tsv cache: ") + e.what());
+    }
+}
+
+
+inline bool TSVFile::readCache(const std::string& cache_filename) {
+    std::shared_ptr<MVD::utils::MappedFile> cache;
+    try {
+        cache = std::make_shared<MVD::utils::MappedFile>(cache_filename);
+    } catch (const MVDException&) {
+        return false;
+    }
+    TSVCacheHeader header;
+    if (cache->size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, cache->begin(), sizeof(header));
+
+    // Stale: written by another version, for another key, or before the tsv
+    // file was modified
+    TSVCacheHeader source{};
+    if (std::memcmp(header.magic, tsv_cache_magic, sizeof(header.magic)) != 0 ||
+        header.version != tsv_cache_version ||
+        header.column != static_cast<uint32_t>(_index.column()) ||
+        header.hash_probe != tsv_cache_hash_probe() || !tsv_source_stat(_filename, source) ||
+        header.source_size != source.source_size || header.source_mtime != source.source_mtime ||
+        header.source_mtime_nsec != source.source_mtime_nsec) {
+        return false;
+    }
+
+    // Corrupt: truncated, or with other contents than written
+    const size_t body_size = cache->size() - sizeof(header);
+    const char* const body = cache->begin() + sizeof(header);
+    const uint64_t max_rows = body_size / sizeof(TSVCacheRow);
+    const uint64_t max_slots = body_size / sizeof(uint32_t);
+    if (header.n_entries > max_rows || header.n_slots > max_slots ||
+        header.strings_size > body_size || header.path_size > body_size ||
+        header.n_entries * sizeof(TSVCacheRow) + header.n_slots * sizeof(uint32_t) +
+                header.strings_size + header.path_size !=
+            body_size ||
+        MVD::utils::checksum(body, body_size) != header.checksum) {
+        return false;
+    }
+    const char* const slots = body + header.n_entries * sizeof(TSVCacheRow);
+    const char* const strings = slots + header.n_slots * sizeof(uint32_t);
+    const boost::string_view path(strings + header.strings_size, header.path_size);
+    if (path != MVD::utils::absolute_path(_filename)) {
+        return false;
+    }
+
+    std::vector<MEComboEntry> entries(header.n_entries);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        TSVCacheRow row;
+        std::memcpy(&row, body + i * sizeof(TSVCacheRow), sizeof(row));
+        for (size_t field = 0; field < tsv_n_string_fields; ++field) {
+            if (uint64_t(row.offsets[field]) + row.sizes[field] > header.strings_size) {
+                return false;
+            }
+            entries[i].*tsv_string_fields[field] =
+                boost::string_view(strings + row.offsets[field], row.sizes[field]);
+        }
+        entries[i].thresholdCurrent = row.threshold_current;
+        entries[i].holdingCurrent = row.holding_current;
+    }
+    // The slots are only 4 bytes aligned in the mapping by construction
+    std::vector<uint32_t> table(header.n_slots);
+    std::memcpy(table.data(), slots, table.size() * sizeof(uint32_t));
+    if (!_index.assign(table.data(), table.size(), entries.size())) {
+        return false;
+    }
+
+    _entries = std::move(entries);
+    _strings = std::move(cache);
+    return true;
+}
+
+
+inline TSVFile::vector_ref TSVFile::getAll() const {
+    return TSVFile::vector_ref(_entries.begin(), _entries.end());
 }
 
 
@@ -175,14 +568,15 @@ inline TSVFile::vector_ref TSVFile::get(const std::vector<std::string>& me_combo
     TSVFile::vector_ref entries;
     entries.reserve(me_combos.size());
     for (const auto& mecombo_tuple: boost::combine(me_combos, morphologies)) {
-        auto metype = tsvFileInfo.find(std::make_pair(boost::get<0>(mecombo_tuple),
-                                                      boost::get<1>(mecombo_tuple)));
-        if (metype != tsvFileInfo.end()) {
-            entries.push_back(metype->second);
+        const std::string& me_combo = boost::get<0>(mecombo_tuple);
+        const std::string& morphology = boost::get<1>(mecombo_tuple);
+        const size_t position = _index.find(_entries, me_combo, morphology);
+        if (position != EntryIndex::npos) {
+            entries.push_back(_entries[position]);
         } else {
             std::ostringstream ss;
-            ss << "me_combo " << boost::get<0>(mecombo_tuple) << " or morphology "
-               << boost::get<1>(mecombo_tuple) << " not found in " << _filename << std::endl;
+            ss << "me_combo " << me_combo << " or morphology " << morphology << " not found in "
+               << _filename << std::endl;
             throw TSVException(ss.str());
         }
     }
@@ -194,12 +588,72 @@ template <typename T>
 inline std::vector<T> TSVFile::getField(const std::vector<std::string>& me_combos,
                                         const std::vector<std::string>& morphologies,
                                         const MEComboEntry::Column& column) const {
-    std::vector<T> entries;
-    entries.reserve(me_combos.size());
-    for (const MEComboEntry& item: get(me_combos, morphologies)) {
-        entries.push_back(item.get<T>(column));
+    return getField<T>(get(me_combos, morphologies), column);
+}
+
+
+template <typename T>
+inline std::vector<T> TSVFile::getField(const vector_ref& entries,
+                                        const MEComboEntry::Column& column) const {
+    std::vector<T> values;
+    values.reserve(entries.size());
+    for (const MEComboEntry& item: entries) {
+        values.push_back(item.get<T>(column));
+    }
+    return values;
+}
+
+
+inline MEComboColumns TSVFile::getColumns(const std::vector<std::string>& me_combos,
+                                          const std::vector<std::string>& morphologies,
+                                          unsigned columns) const {
+    return getColumns(get(me_combos, morphologies), columns);
+}
+
+
+inline MEComboColumns TSVFile::getColumns(const vector_ref& entries, unsigned columns) const {
+    MEComboColumns values;
+    resizeColumns(values, entries.size(), columns);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        setColumns(values, i, entries[i], columns);
+    }
+    return values;
+}
+
+
+inline void TSVFile::resizeColumns(MEComboColumns& values, size_t size, unsigned columns) {
+    const auto strings = tsv_string_columns(values);
+    for (size_t field = 0; field < tsv_n_string_fields; ++field) {
+        if (columns & (1u << field)) {
+            strings[field]->resize(size);
+        }
+    }
+    if (columns & ColumnMask::ThresholdCurrent) {
+        values.thresholdCurrents.resize(size);
+    }
+    if (columns & ColumnMask::HoldingCurrent) {
+        values.holdingCurrents.resize(size);
+    }
+}
+
+
+inline void TSVFile::setColumns(MEComboColumns& values,
+                                size_t position,
+                                const MEComboEntry& entry,
+                                unsigned columns) {
+    const auto strings = tsv_string_columns(values);
+    for (size_t field = 0; field < tsv_n_string_fields; ++field) {
+        if (columns & (1u << field)) {
+            const boost::string_view value = entry.*tsv_string_fields[field];
+            (*strings[field])[position].assign(value.data(), value.size());
+        }
+    }
+    if (columns & ColumnMask::ThresholdCurrent) {
+        values.thresholdCurrents[position] = entry.thresholdCurrent;
+    }
+    if (columns & ColumnMask::HoldingCurrent) {
+        values.holdingCurrents[position] = entry.holdingCurrent;
     }
-    return entries;
 }
 
 
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mvd_base.hpp"
+#include "sonata.hpp"
+
+namespace MVD {
+
+
+///
+/// \brief The MultiPopulationFile class
+///
+/// All the node populations of one or several Sonata files, seen as a single
+/// circuit. Cells are numbered in one global index space: population after
+/// population, in the order of the files, then of the population names in
+/// each file. Reads spanning several populations are split into one bulk read
+/// per population, all written into the same output.
+///
+/// Index getters and listAll* refer to the union of the population values,
+/// in order of first appearance. Dictionaries of categorical results are
+/// merged the same way.
+///
+class MultiPopulationFile : public File {
+public:
+    ///
+    /// \brief MultiPopulationFile
+    /// Opens every population of `filename`
+    /// throw MVDException if the file has no population
+    ///
+    explicit MultiPopulationFile(const std::string& filename);
+
+    ///
+    /// \brief MultiPopulationFile
+    /// Opens every population of each file, files keep their order in the
+    /// global index space
+    /// throw MVDException if the files have no population
+    ///
+    explicit MultiPopulationFile(const std::vector<std::string>& filenames);
+
+    void openComboTsv(const std::string& filename) override;
+
+    ///
+    /// \brief getNbNeuron
+    /// \return the number of cells of all the populations
+    ///
+    size_t getNbNeuron() const noexcept override { return offsets_.back(); }
+
+    // Populations
+    // ===========
+
+    size_t getNbPopulations() const noexcept { return populations_.size(); }
+
+    ///
+    /// \brief getPopulationNames
+    /// \return the name of each population, in global index order. The same
+    /// name may appear once per file
+    ///
+    const std::vector<std::string>& getPopulationNames() const noexcept { return names_; }
+
+    ///
+    /// \brief getPopulationOffsets
+    /// \return the global index of the first cell of each population, followed
+    /// by the total number of cells
+    ///
+    const std::vector<size_t>& getPopulationOffsets() const noexcept { return offsets_; }
+
+    ///
+    /// \brief getPopulation
+    /// \return the population at `index`, read with its own local cell ids
+    ///
+    const SonataFile& getPopulation(size_t index) const;
+
+    ///
+    /// \brief locate
+    /// \return the population index and the local id of a global cell id
+    /// throw MVDException if the cell is out of bounds
+    ///
+    std::pair<size_t, size_t> locate(size_t cell) const;
+
+    // Range getters
+    // =============
+
+    Positions getPositions(const Range& range = Range::all()) const override;
+    Rotations getRotations(const Range& range = Range::all()) const override;
+
+    ///
+    /// \brief readPositions, readRotations
+    /// Each population writes its part of the range straight into `out`
+    ///
+    void readPositions(const Range& range, double* out, size_t stride = 3) const override;
+    void readRotations(const Range& range, double* out, size_t stride = 4) const override;
+
+    ///
+    /// \brief hasRotations
+    /// \return whether any population is rotated. Cells of the populations
+    /// without rotations get the identity quaternion
+    ///
+    bool hasRotations() const override;
+
+    ///
+    /// \brief concurrentReads
+    /// \return whether every population reads concurrently
+    ///
+    bool concurrentReads() const override;
+
+    std::vector<std::string> getMorphologies(const Range& range = Range::all()) const override;
+    std::vector<std::string> getEtypes(const Range& range = Range::all()) const override;
+    std::vector<std::string> getMtypes(const Range& range = Range::all()) const override;
+    std::vector<std::string> getEmodels(const Range& range = Range::all()) const override;
+    std::vector<std::string> getRegions(const Range& range = Range::all()) const override;
+    std::vector<std::string> getSynapseClass(const Range& range = Range::all()) const override;
+
+    ///
+    /// \brief hasRegions, hasMiniFrequencies, hasCurrents
+    /// \return whether every population has the attributes
+    ///
+    bool hasRegions() const override;
+    bool hasMiniFrequencies() const override;
+    std::vector<double> getExcMiniFrequencies(const Range& range = Range::all()) const override;
+    std::vector<double> getInhMiniFrequencies(const Range& range = Range::all()) const override;
+
+    bool hasCurrents() const override;
+    std::vector<double> getThresholdCurrents(const Range& range = Range::all()) const override;
+    std::vector<double> getHoldingCurrents(const Range& range = Range::all()) const override;
+
+    Categorical getCategoricalMorphologies(const Range& range = Range::all()) const override;
+    Categorical getCategoricalEtypes(const Range& range = Range::all()) const override;
+    Categorical getCategoricalMtypes(const Range& range = Range::all()) const override;
+    Categorical getCategoricalRegions(const Range& range = Range::all()) const override;
+    Categorical getCategoricalSynapseClass(const Range& range = Range::all()) const override;
+
+    std::vector<size_t> getIndexEtypes(const Range& range = Range::all()) const override;
+    std::vector<size_t> getIndexMtypes(const Range& range = Range::all()) const override;
+    std::vector<size_t> getIndexRegions(const Range& range = Range::all()) const override;
+    std::vector<size_t> getIndexSynapseClass(const Range& range = Range::all()) const override;
+
+    std::vector<std::string> listAllEtypes() const override;
+    std::vector<std::string> listAllMtypes() const override;
+    std::vector<std::string> listAllEmodels() const override;
+    std::vector<std::string> listAllRegions() const override;
+    std::vector<std::string> listAllSynapseClass() const override;
+
+    // Selection variants
+    // ==================
+
+    Positions getPositions(const Selection& selection) const override;
+    Rotations getRotations(const Selection& selection) const override;
+    std::vector<std::string> getMorphologies(const Selection& selection) const override;
+    std::vector<std::string> getEtypes(const Selection& selection) const override;
+    std::vector<std::string> getMtypes(const Selection& selection) const override;
+    std::vector<std::string> getEmodels(const Selection& selection) const override;
+    std::vector<std::string> getRegions(const Selection& selection) const override;
+    std::vector<std::string> getSynapseClass(const Selection& selection) const override;
+    std::vector<double> getExcMiniFrequencies(const Selection& selection) const override;
+    std::vector<double> getInhMiniFrequencies(const Selection& selection) const override;
+    std::vector<double> getThresholdCurrents(const Selection& selection) const override;
+    std::vector<double> getHoldingCurrents(const Selection& selection) const override;
+
+    Categorical getCategoricalMorphologies(const Selection& selection) const override;
+    Categorical getCategoricalEtypes(const Selection& selection) const override;
+    Categorical getCategoricalMtypes(const Selection& selection) const override;
+    Categorical getCategoricalRegions(const Selection& selection) const override;
+    Categorical getCategoricalSynapseClass(const Selection& selection) const override;
+
+    std::vector<size_t> getIndexEtypes(const Selection& selection) const override;
+    std::vector<size_t> getIndexMtypes(const Selection& selection) const override;
+    std::vector<size_t> getIndexRegions(const Selection& selection) const override;
+    std::vector<size_t> getIndexSynapseClass(const Selection& selection) const override;
+
+    void readPositions(const Selection& selection, double* out, size_t stride = 3) const;
+    void readRotations(const Selection& selection, double* out, size_t stride = 4) const;
+
+private:
+    template <typename T>
+    using Getter = std::vector<T> (SonataFile::*)(const Selection&) const;
+    using CategoricalGetter = Categorical (SonataFile::*)(const Selection&) const;
+    using ListGetter = std::vector<std::string> (SonataFile::*)() const;
+
+    ///
+    /// \brief forEachPopulation
+    /// Calls f(population, local_selection, first_row) for each population
+    /// with selected cells, in order. first_row is the position of the first
+    /// of these cells in the result of the whole selection
+    /// throw MVDException if the selection is out of bounds
+    ///
+    template <typename FuncT>
+    void forEachPopulation(const Selection& selection, const FuncT& f) const;
+
+    template <typename T>
+    std::vector<T> concat(const Selection& selection, Getter<T> getter) const;
+
+    Categorical concatCategorical(const Selection& selection, CategoricalGetter getter) const;
+
+    std::vector<size_t> concatIndex(const Selection& selection,
+                                    Getter<size_t> getter,
+                                    ListGetter list_getter) const;
+
+    std::vector<std::string> listAll(ListGetter list_getter) const;
+
+    std::vector<std::unique_ptr<SonataFile>> populations_;
+    std::vector<std::string> names_;
+    std::vector<size_t> offsets_;
+};
+
+}  // namespace MVD
+
+#include "bits/multi_population_misc.hpp"
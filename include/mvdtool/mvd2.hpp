@@ -18,14 +18,20 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
 
+#include <boost/utility/string_view.hpp>
+
 #include "mvd_base.hpp"
+#include "tsv.hpp"
+#include "utils.hpp"
 
 ///
 /// MVD2 parsing / helper functions
@@ -52,7 +58,7 @@ enum DataSet {
 ///
 struct Counter {
     Counter();
-    int operator()(DataSet type, const char* line);
+    int operator()(DataSet type, boost::string_view line);
 
     size_t _nb_columns;
     size_t _nb_neuron;
@@ -61,12 +67,108 @@ struct Counter {
 };
 
 
-class MVD2File : public MVD::MVDFile{
+///
+/// \brief The LineIndex struct
+/// Byte offsets into a MVD2 file, built in a single pass: the data lines of
+/// each section, and the line of each neuron
+///
+struct LineIndex {
+    struct Section {
+        DataSet type;
+        uint64_t offset;    // of the first data line
+        uint64_t n_lines;
+    };
+
+    std::vector<Section> sections;
+    std::vector<uint64_t> neurons;
+
+    /// number of data lines in the sections of `type`
+    size_t countLines(DataSet type) const;
+};
+
+
+///
+/// \brief The neurons of a MVD2 file in memory, one column per field, with
+/// the strings dictionary-encoded in order of first appearance
+///
+struct NeuronColumns {
+    using code_type = MVD::Categorical::code_type;
+    using Dictionary = MVD::Categorical::Dictionary;
+
+    /// x, y, z and the rotation angle around y of each neuron
+    std::vector<double> xyzr;
+    std::vector<int32_t> hypercolumns;
+    std::vector<int32_t> minicolumns;
+    /// 1 based, as converted to MVD3
+    std::vector<int32_t> layers;
+    std::vector<code_type> morphologies;
+    std::vector<code_type> me_combos;
+    /// indices of the MorphTypes and ElectroTypes sections
+    std::vector<code_type> mtypes;
+    std::vector<code_type> etypes;
+    /// second and third fields of the MorphTypes entry of each neuron
+    std::vector<code_type> morph_classes;
+    std::vector<code_type> synapse_class;
+
+    std::shared_ptr<const Dictionary> morphology_names;
+    std::shared_ptr<const Dictionary> me_combo_names;
+    std::shared_ptr<const Dictionary> mtype_names;
+    std::shared_ptr<const Dictionary> etype_names;
+    std::shared_ptr<const Dictionary> morph_class_names;
+    std::shared_ptr<const Dictionary> synapse_class_names;
+    std::vector<double> seeds;
+};
+
+
+///
+/// \brief The MVD2File class
+///
+/// Reads the legacy MVD2 text format. The neurons are loaded in memory, one
+/// column per field, by the first getter needing more than positions or
+/// rotations; all the getters are then slices of these columns. Until
+/// then, positions and rotations of ranges are parsed from their lines
+/// through the line index
+///
+class MVD2File : public MVD::File{
 public:
     inline MVD2File(const std::string & filename) :
         _filename(filename)
     {    }
 
+    ///
+    /// \brief openCached
+    /// \param cache_dir directory of the index, next to the mvd2 file if empty
+    ///
+    /// Open a MVD2 file with the line index saved by a previous job: a valid
+    /// index is read instead of scanning the file. A missing, stale or corrupt
+    /// index is written again after scanning, when the directory can be
+    /// written to
+    /// throw MVDParserException if the mvd2 file can not be read
+    ///
+    static MVD2File openCached(const std::string & filename, const std::string & cache_dir = "");
+
+    ///
+    /// \brief indexFilename
+    /// \return the index of 'filename' in 'cache_dir', named after the
+    /// absolute path of the mvd2 file, or next to the mvd2 file if 'cache_dir' is empty
+    ///
+    static std::string indexFilename(const std::string & filename, const std::string & cache_dir = "");
+
+    ///
+    /// \brief writeIndex
+    /// Saves the line index to 'index_filename', with the size and
+    /// modification time of the mvd2 file. The index is replaced atomically
+    /// throw MVDException if the index can not be written
+    ///
+    void writeIndex(const std::string & index_filename) const;
+
+    ///
+    /// \brief getLineIndex
+    /// \return the offsets of the sections and neuron lines, scanning the
+    /// file on first use
+    ///
+    const LineIndex & getLineIndex() const;
+
     ///
     /// \brief getNbMorpho
     /// \return number of morphologies in MVD file
@@ -79,7 +181,7 @@ public:
     /// \brief getNbNeuron
     /// \return number of neurons in this MVD file
     ///
-    size_t getNbNeuron() const;
+    size_t getNbNeuron() const override;
 
     ///
     /// \brief getNbColumns
@@ -96,18 +198,161 @@ public:
     /// \return a double vector of size [N][3] with the position (x,y,z) coordinates
     ///  of each selected neurons ( all by default )
     ///
-    MVD::Positions getPositions(const MVD::Range & range = MVD::Range::all()) const;
+    MVD::Positions getPositions(const MVD::Range & range = MVD::Range::all()) const override;
 
 
     ///
     /// \brief Rotations
-    /// \return a double vector of size N with the rotations
-    /// of each selected neurons ( all by default )
+    /// \return a double vector of size [N][4] with the rotation quaternion
+    /// (x, y, z, w) of each selected neurons ( all by default ), as converted to MVD3
+    ///
+    MVD::Rotations getRotations(const MVD::Range & range = MVD::Range::all()) const override;
+
     ///
-    MVD::Rotations getRotations(const MVD::Range & range = MVD::Range::all()) const;
+    /// \brief getRotationAngles
+    /// \return the rotation angles around the y axis, in degrees, as stored in MVD2
+    ///
+    std::vector<double> getRotationAngles(const MVD::Range & range = MVD::Range::all()) const;
 
+    ///
+    /// \brief openComboTsv
+    /// Opens the mecombo file of the circuit, for the emodels and currents
+    /// of the neurons, looked up by me_combo and morphology names
+    ///
+    void openComboTsv(const std::string& filename) override;
 
+    inline bool hasRotations() const override { return true; }
+    inline bool hasRegions() const override { return false; }
+    inline bool hasMiniFrequencies() const override { return false; }
+    inline bool hasCurrents() const override { return static_cast<bool>(_tsv_file); }
 
+    ///
+    /// \brief String getters
+    /// Etypes and mtypes are the entries of the ElectroTypes and MorphTypes
+    /// sections, the synapse class of a neuron is the one of its mtype
+    /// throw MVDException for regions and mini frequencies, which MVD2 files
+    /// do not have, and for emodels and currents when no TSV file is opened
+    ///
+    std::vector<std::string> getMorphologies(const MVD::Range& range = MVD::Range::all()) const override;
+    std::vector<std::string> getEtypes(const MVD::Range& range = MVD::Range::all()) const override;
+    std::vector<std::string> getMtypes(const MVD::Range& range = MVD::Range::all()) const override;
+    std::vector<std::string> getEmodels(const MVD::Range& range = MVD::Range::all()) const override;
+    std::vector<std::string> getRegions(const MVD::Range& range = MVD::Range::all()) const override;
+    std::vector<std::string> getSynapseClass(const MVD::Range& range = MVD::Range::all()) const override;
+    std::vector<std::string> getMECombos(const MVD::Range& range = MVD::Range::all()) const;
+
+    ///
+    /// \brief getLayers
+    /// \return the layers, 1 based as converted to MVD3
+    ///
+    std::vector<std::string> getLayers(const MVD::Range& range = MVD::Range::all()) const;
+    std::vector<int32_t> getHyperColumns(const MVD::Range& range = MVD::Range::all()) const;
+    std::vector<int32_t> getMiniColumns(const MVD::Range& range = MVD::Range::all()) const;
+
+    std::vector<double> getExcMiniFrequencies(const MVD::Range& range = MVD::Range::all()) const override;
+    std::vector<double> getInhMiniFrequencies(const MVD::Range& range = MVD::Range::all()) const override;
+    std::vector<double> getThresholdCurrents(const MVD::Range& range = MVD::Range::all()) const override;
+    std::vector<double> getHoldingCurrents(const MVD::Range& range = MVD::Range::all()) const override;
+
+    MVD::Categorical getCategoricalMorphologies(const MVD::Range& range = MVD::Range::all()) const override;
+    MVD::Categorical getCategoricalEtypes(const MVD::Range& range = MVD::Range::all()) const override;
+    MVD::Categorical getCategoricalMtypes(const MVD::Range& range = MVD::Range::all()) const override;
+    MVD::Categorical getCategoricalRegions(const MVD::Range& range = MVD::Range::all()) const override;
+    MVD::Categorical getCategoricalSynapseClass(const MVD::Range& range = MVD::Range::all()) const override;
+    MVD::Categorical getCategoricalMECombos(const MVD::Range& range = MVD::Range::all()) const;
+
+    std::vector<size_t> getIndexMorphologies(const MVD::Range& range = MVD::Range::all()) const;
+    std::vector<size_t> getIndexEtypes(const MVD::Range& range = MVD::Range::all()) const override;
+    std::vector<size_t> getIndexMtypes(const MVD::Range& range = MVD::Range::all()) const override;
+    std::vector<size_t> getIndexRegions(const MVD::Range& range = MVD::Range::all()) const override;
+    std::vector<size_t> getIndexSynapseClass(const MVD::Range& range = MVD::Range::all()) const override;
+
+    ///
+    /// \brief Selection variants of the getters, slicing the loaded columns
+    /// throw MVDException if the selection is out of bounds
+    ///
+    MVD::Positions getPositions(const MVD::Selection& selection) const override;
+    MVD::Rotations getRotations(const MVD::Selection& selection) const override;
+    std::vector<std::string> getMorphologies(const MVD::Selection& selection) const override;
+    std::vector<std::string> getEtypes(const MVD::Selection& selection) const override;
+    std::vector<std::string> getMtypes(const MVD::Selection& selection) const override;
+    std::vector<std::string> getEmodels(const MVD::Selection& selection) const override;
+    std::vector<std::string> getRegions(const MVD::Selection& selection) const override;
+    std::vector<std::string> getSynapseClass(const MVD::Selection& selection) const override;
+    std::vector<std::string> getMECombos(const MVD::Selection& selection) const;
+    std::vector<std::string> getLayers(const MVD::Selection& selection) const;
+    std::vector<int32_t> getHyperColumns(const MVD::Selection& selection) const;
+    std::vector<int32_t> getMiniColumns(const MVD::Selection& selection) const;
+    std::vector<double> getExcMiniFrequencies(const MVD::Selection& selection) const override;
+    std::vector<double> getInhMiniFrequencies(const MVD::Selection& selection) const override;
+    std::vector<double> getThresholdCurrents(const MVD::Selection& selection) const override;
+    std::vector<double> getHoldingCurrents(const MVD::Selection& selection) const override;
+
+    MVD::Categorical getCategoricalMorphologies(const MVD::Selection& selection) const override;
+    MVD::Categorical getCategoricalEtypes(const MVD::Selection& selection) const override;
+    MVD::Categorical getCategoricalMtypes(const MVD::Selection& selection) const override;
+    MVD::Categorical getCategoricalRegions(const MVD::Selection& selection) const override;
+    MVD::Categorical getCategoricalSynapseClass(const MVD::Selection& selection) const override;
+    MVD::Categorical getCategoricalMECombos(const MVD::Selection& selection) const;
+
+    std::vector<size_t> getIndexMorphologies(const MVD::Selection& selection) const;
+    std::vector<size_t> getIndexEtypes(const MVD::Selection& selection) const override;
+    std::vector<size_t> getIndexMtypes(const MVD::Selection& selection) const override;
+    std::vector<size_t> getIndexRegions(const MVD::Selection& selection) const override;
+    std::vector<size_t> getIndexSynapseClass(const MVD::Selection& selection) const override;
+
+    ///
+    /// \brief read
+    /// Same as MVD::File::read, regions are left empty
+    ///
+    using MVD::File::read;
+    MVD::CellBatch read(const MVD::Selection& selection,
+                        unsigned columns = MVD::CellColumn::All) const override;
+
+    std::vector<std::string> listAllMorphologies() const;
+    std::vector<std::string> listAllEtypes() const override;
+    std::vector<std::string> listAllMtypes() const override;
+    std::vector<std::string> listAllEmodels() const override;
+    std::vector<std::string> listAllRegions() const override;
+    std::vector<std::string> listAllSynapseClass() const override;
+
+    ///
+    /// \brief getCircuitSeeds
+    /// \return the three seeds of the CircuitSeeds section
+    ///
+    std::vector<double> getCircuitSeeds() const;
+
+    ///
+    /// \brief getColumns
+    /// \return all the neurons, loaded on first use. The neuron section is
+    /// split at line boundaries into one chunk per parse worker, parsed
+    /// concurrently and concatenated in gid order; the other sections are
+    /// read on the calling thread
+    /// throw MVDParserException if a line is invalid or a neuron refers to a
+    /// missing MorphTypes or ElectroTypes entry
+    ///
+    const NeuronColumns & getColumns() const;
+
+    ///
+    /// \brief setParseWorkers
+    /// \param n_workers: threads parsing the neuron section when the columns
+    /// are loaded, 0 for one per hardware thread. The default, 1, parses on
+    /// the calling thread
+    ///
+    void setParseWorkers(size_t n_workers);
+
+    inline size_t getParseWorkers() const { return _parse_workers; }
+
+
+    ///
+    /// \brief parse
+    /// SAX style parser: calls line_parser(type, line) for each line of the
+    /// sections of the file, until it returns 1. Lines are viewed in a memory
+    /// mapping of the file, without their newline, when line_parser takes a
+    /// boost::string_view. They are copied to a C string, newline included,
+    /// when it takes a const char*. Lines have no length limit
+    /// throw MVDParserException if the file can not be read or has no header
+    ///
     template <typename Callback>
     void parse(Callback & line_parser) const;
 
@@ -115,11 +360,31 @@ public:
 private:
     std::string _filename;
 
-    // Counter is a kind of cache for the totals
-    // We set counter to mutable to allow all reader methods to be const
-    // It can be safely reconstructed without affecting bahvior, only performance
-    mutable Counter counter;
-    void init_counter() const;
+    // The mapping and line index are a kind of cache of the file
+    // We set them mutable to allow all reader methods to be const
+    // They can be safely reconstructed without affecting bahvior, only performance
+    mutable std::shared_ptr<const MVD::utils::MappedFile> _data;
+    mutable std::shared_ptr<const LineIndex> _index;
+    mutable std::set<std::string> _morphologies;
+    mutable std::shared_ptr<const NeuronColumns> _columns;
+    std::shared_ptr<const TSV::TSVFile> _tsv_file;
+    size_t _parse_workers = 1;
+
+    // The cells of a range, up to the last neuron
+    MVD::Selection selectRange(const MVD::Range & range) const;
+
+    const MVD::utils::MappedFile & data() const;
+
+    // Reads a valid index of the file
+    bool readIndex(const std::string & index_filename);
+
+    // Calls f(i, line) for the neurons [range.offset, range.offset + count)
+    template <typename Function>
+    void forEachNeuron(const MVD::Range & range, size_t count, const Function & f) const;
+
+    // Calls f(line) for the data lines of the sections of `type`
+    template <typename Function>
+    void forEachSectionLine(DataSet type, const Function & f) const;
 };
 
 
@@ -134,14 +399,23 @@ void parseNeuronLine(const char* line, std::string & name, int& database, int &c
                      int &morphologytype, int &electrophysiology_type,
                      std::vector<float> & xyzr, std::string & metype);
 
+/// same, with names viewed in the line, positions and rotation in T precision
+template <typename T>
+void parseNeuronLine(boost::string_view line, boost::string_view & name, int& database, int &column, int &minicolumn, int &layer,
+                     int &morphologytype, int &electrophysiology_type,
+                     std::vector<T> & xyzr, boost::string_view & metype);
+
 /// parse a line identified as random seed initializer (CircuitSeeds)
-void parseSeedInitLine(const char *line, double &seed1, double &seed2, double &seed3);
+void parseSeedInitLine(boost::string_view line, double &seed1, double &seed2, double &seed3);
 
 /// parse a line identified as en cell electrical type (ElectroTypes)
 void parseElectroTypeLine(const char *line, std::string &electroType);
+void parseElectroTypeLine(boost::string_view line, boost::string_view &electroType);
 
 /// parse a line identified as morph type (MorphType)
 void parseMorphTypeLine(const char* line, std::string & name, std::string & name2, std::string & morphClass);
+void parseMorphTypeLine(boost::string_view line, boost::string_view & name, boost::string_view & name2,
+                        boost::string_view & morphClass);
 
 }
 
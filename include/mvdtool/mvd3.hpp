@@ -22,12 +22,15 @@
 #define H5_USE_BOOST
 #endif
 
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 #include <highfive/H5File.hpp>
 
 #include "mvd_base.hpp"
 #include "tsv.hpp"
+#include "bits/hdf5_misc.hpp"
 
 namespace MVD3 {
 
@@ -37,6 +40,31 @@ typedef MVD::Rotations Rotations;
 typedef MVD::Range Range;
 
 
+///
+/// \brief The DataSetInfo struct
+///
+/// An opened dataset of a MVD3 file, together with its extent
+///
+struct DataSetInfo {
+    HighFive::DataSet dataset;
+    std::vector<size_t> dims;
+};
+
+
+///
+/// \brief The LibraryGatherStats struct
+///
+/// How the library values of the string getters were looked up, one count
+/// per call. See MVD3File::getLibraryGatherStats()
+///
+struct LibraryGatherStats {
+    size_t cached = 0;      // decoded from a library table already in memory
+    size_t full_table = 0;  // whole table read, and kept for later calls
+    size_t span = 0;        // contiguous span between the lowest and highest reference
+    size_t points = 0;      // point selection of the referenced entries only
+};
+
+
 ///
 /// \brief The MVD3File class
 ///
@@ -54,6 +82,20 @@ public:
     ///
     MVD3File(const std::string & filename);
 
+#ifdef MVDTOOL_USE_MPI
+    ///
+    /// \brief MVD3File
+    /// \param filename
+    /// \param comm: the ranks opening the file together
+    ///
+    /// Open an MVD3 file for all the ranks of 'comm'. With a parallel HDF5,
+    /// metadata is read collectively, and the numeric reads are collective
+    /// MPI-IO reads: every rank must call them, each with its own selection
+    /// of any shape (see MVD::balancedBlock), possibly empty
+    ///
+    MVD3File(const std::string& filename, MPI_Comm comm);
+#endif
+
     ///
     /// \brief readMEComboEntry Open an TSV file format at 'filename' path
     /// \param filename
@@ -61,6 +103,14 @@ public:
     ///
     void openComboTsv(const std::string& filename) override;
 
+    ///
+    /// \brief openComboTsv Open an TSV file format at 'filename' path
+    /// through its binary cache in 'cache_dir', next to the TSV file if empty
+    /// (see TSV::TSVFile::openCached)
+    /// \throw TSVException in case of error
+    ///
+    void openComboTsv(const std::string& filename, const std::string& cache_dir);
+
     ///
     /// \brief getNbNeuron
     /// \return total number of neurons contained in the receipe
@@ -83,6 +133,74 @@ public:
     ///
     Rotations getRotations(const Range & range = Range::all()) const override;
 
+    ///
+    /// \brief readPositions
+    /// Reads the positions of the range straight into `out`, without intermediate copies
+    ///
+    void readPositions(const Range& range, double* out, size_t stride = 3) const override;
+
+    ///
+    /// \brief readRotations
+    /// Reads the rotations of the range straight into `out`, without intermediate copies
+    ///
+    void readRotations(const Range& range, double* out, size_t stride = 4) const override;
+
+    ///
+    /// \brief readAttribute
+    /// Reads a numeric cell property straight into caller memory, converted to T
+    /// \param name: name of the dataset in /cells/properties, e.g. "hypercolumn"
+    /// \param out: receives the value of each neuron of the range, `stride` elements apart
+    ///
+    template <typename T>
+    void readAttribute(const std::string& name,
+                       const Range& range,
+                       T* out,
+                       size_t stride = 1) const;
+
+    ///
+    /// \brief getTypedAttribute
+    /// \param name: name of the dataset in /cells/properties, e.g. "hypercolumn"
+    /// \return the values of the cell property in their stored type
+    /// throw MVDException if there is no such property
+    ///
+    MVD::TypedColumn getTypedAttribute(const std::string& name,
+                                       const Range& range = Range::all()) const;
+    MVD::TypedColumn getTypedAttribute(const std::string& name,
+                                       const MVD::Selection& selection) const override;
+
+    ///
+    /// \brief getCategoricalAttribute
+    /// \param name: name of the dataset in /cells/properties
+    /// \return the codes of an enumerated property into its /library table.
+    /// String properties are encoded on the fly
+    /// throw MVDException if there is no such string property
+    ///
+    MVD::Categorical getCategoricalAttribute(const std::string& name,
+                                             const Range& range = Range::all()) const;
+    MVD::Categorical getCategoricalAttribute(const std::string& name,
+                                             const MVD::Selection& selection) const override;
+
+    ///
+    /// \brief storageChunkSize
+    /// \return the number of neurons per HDF5 chunk of the positions, 0 if
+    /// they are stored contiguously
+    ///
+    size_t storageChunkSize() const override;
+
+    ///
+    /// \brief concurrentReads
+    /// \return false for a thread-unsafe HDF5 library or collective reads
+    ///
+    bool concurrentReads() const override;
+
+    ///
+    /// \brief getSchema
+    /// \return every dataset of the file, by absolute path, e.g.
+    /// "/cells/positions". Cell properties stored as indices into the
+    /// /library table of the same name are enumerations
+    ///
+    const MVD::Schema& getSchema() const override;
+
     ///
     /// \brief hasRotations
     /// \return if the current file has a rotational dataset
@@ -145,6 +263,11 @@ public:
     ///
     std::vector<std::string> getSynapseClass(const Range & range = Range::all()) const override;
 
+    ///
+    /// \brief Checks whether the region property is available
+    ///
+    bool hasRegions() const override;
+
     ///
     /// \brief Checks whether exc_mini_frequency and inh_mini_frequency are available
     /// \return bool whether the two mini frequency properties are available
@@ -163,6 +286,46 @@ public:
     ///
     std::vector<double> getInhMiniFrequencies(const Range & range = Range::all()) const override;
 
+    // dictionary-encoded infos
+
+    ///
+    /// \brief getCategoricalMorphologies
+    /// \return morphology codes of each neuron, into the /library/morphology dictionary
+    ///
+    MVD::Categorical getCategoricalMorphologies(const Range& range = Range::all()) const override;
+
+    ///
+    /// \brief getCategoricalEtypes
+    /// \return etype codes of each neuron, into the /library/etype dictionary
+    /// (or into the distinct TSV values when a TSV file is opened)
+    ///
+    MVD::Categorical getCategoricalEtypes(const Range& range = Range::all()) const override;
+
+    ///
+    /// \brief getCategoricalMtypes
+    /// \return mtype codes of each neuron, into the /library/mtype dictionary
+    /// (or into the distinct TSV values when a TSV file is opened)
+    ///
+    MVD::Categorical getCategoricalMtypes(const Range& range = Range::all()) const override;
+
+    ///
+    /// \brief getCategoricalRegions
+    /// \return region codes of each neuron, into the /library/region dictionary
+    ///
+    MVD::Categorical getCategoricalRegions(const Range& range = Range::all()) const override;
+
+    ///
+    /// \brief getCategoricalSynapseClass
+    /// \return synapse class codes of each neuron, into the /library/synapse_class dictionary
+    ///
+    MVD::Categorical getCategoricalSynapseClass(const Range& range = Range::all()) const override;
+
+    ///
+    /// \brief getCategoricalMECombos
+    /// \return me_combo codes of each neuron, into the /library/me_combo dictionary
+    ///
+    MVD::Categorical getCategoricalMECombos(const Range& range = Range::all()) const;
+
     // index related infos
 
     ///
@@ -276,6 +439,12 @@ public:
     ///
     std::vector<double> getCircuitSeeds() const;
 
+    ///
+    /// \brief getLibraryGatherStats
+    /// \return how many string lookups used each library read strategy so far
+    ///
+    LibraryGatherStats getLibraryGatherStats() const;
+
 
     // tsv structs
 
@@ -285,30 +454,194 @@ public:
     std::vector<std::reference_wrapper<const TSV::MEComboEntry>>
         getTSVInfo(const Range& range = Range::all()) const;
 
+    ///
+    /// \brief getTSVColumns
+    /// \param columns: mask of TSV::ColumnMask values
+    /// \return the requested TSV columns of the cells, joining each cell with
+    /// its TSV entry once for all the columns
+    /// \throw MVDException if no TSV file is opened
+    ///
+    TSV::MEComboColumns getTSVColumns(const Range& range = Range::all(),
+                                      unsigned columns = TSV::ColumnMask::All) const;
+
+    ///
+    /// \brief setTSVWorkers
+    /// \param n_workers: threads joining the cells with their TSV entries,
+    /// 0 for one per hardware thread. The default, 1, joins on the calling thread
+    ///
+    void setTSVWorkers(size_t n_workers);
+
+    inline size_t getTSVWorkers() const { return _tsv_workers; }
+
+
+    // Selection variants
+    // ==================
+    // Same as the Range getters above, for a sorted set of cells. A single
+    // range is read as one hyperslab, sparse selections with short runs as
+    // one point selection and long runs as one hyperslab each
+
+    Positions getPositions(const MVD::Selection& selection) const override;
+    Rotations getRotations(const MVD::Selection& selection) const override;
+    std::vector<std::string> getMorphologies(const MVD::Selection& selection) const override;
+    std::vector<std::string> getEtypes(const MVD::Selection& selection) const override;
+    std::vector<std::string> getMtypes(const MVD::Selection& selection) const override;
+    std::vector<std::string> getEmodels(const MVD::Selection& selection) const override;
+    std::vector<std::string> getRegions(const MVD::Selection& selection) const override;
+    std::vector<std::string> getSynapseClass(const MVD::Selection& selection) const override;
+    std::vector<std::string> getMECombos(const MVD::Selection& selection) const;
+    std::vector<std::string> getLayers(const MVD::Selection& selection) const;
+    std::vector<int32_t> getHyperColumns(const MVD::Selection& selection) const;
+    std::vector<int32_t> getMiniColumns(const MVD::Selection& selection) const;
+    std::vector<double> getExcMiniFrequencies(const MVD::Selection& selection) const override;
+    std::vector<double> getInhMiniFrequencies(const MVD::Selection& selection) const override;
+    std::vector<double> getThresholdCurrents(const MVD::Selection& selection) const override;
+    std::vector<double> getHoldingCurrents(const MVD::Selection& selection) const override;
+
+    MVD::Categorical getCategoricalMorphologies(const MVD::Selection& selection) const override;
+    MVD::Categorical getCategoricalEtypes(const MVD::Selection& selection) const override;
+    MVD::Categorical getCategoricalMtypes(const MVD::Selection& selection) const override;
+    MVD::Categorical getCategoricalRegions(const MVD::Selection& selection) const override;
+    MVD::Categorical getCategoricalSynapseClass(const MVD::Selection& selection) const override;
+    MVD::Categorical getCategoricalMECombos(const MVD::Selection& selection) const;
+
+    std::vector<size_t> getIndexMorphologies(const MVD::Selection& selection) const;
+    std::vector<size_t> getIndexEtypes(const MVD::Selection& selection) const override;
+    std::vector<size_t> getIndexMtypes(const MVD::Selection& selection) const override;
+    std::vector<size_t> getIndexRegions(const MVD::Selection& selection) const override;
+    std::vector<size_t> getIndexSynapseClass(const MVD::Selection& selection) const override;
+
+    std::vector<std::reference_wrapper<const TSV::MEComboEntry>>
+        getTSVInfo(const MVD::Selection& selection) const;
+    TSV::MEComboColumns getTSVColumns(const MVD::Selection& selection,
+                                      unsigned columns = TSV::ColumnMask::All) const;
+
+    ///
+    /// \brief read several columns for the same cells in one call
+    ///
+    /// Positions and rotations are read in place into the batch and string
+    /// columns are read as library codes
+    ///
+    using MVD::File::read;
+    MVD::CellBatch read(const MVD::Selection& selection,
+                        unsigned columns = MVD::CellColumn::All) const override;
+
 
 protected:
     using TSVColumn = TSV::MEComboEntry::Column;
 
+    ///
+    /// \brief getDataSetInfo
+    /// \param did: path of the dataset in the MVD3 file
+    /// \return the cached dataset handle and extent. The dataset is
+    /// opened on first use, any later call reuses it
+    ///
+    const DataSetInfo& getDataSetInfo(const std::string& did) const;
+
+    ///
+    /// \brief selectRange
+    /// \return the selection of a Range, resolved against the number of neurons
+    ///
+    MVD::Selection selectRange(const Range& range) const;
+
+    ///
+    /// \brief readInto
+    /// Reads `width` columns of a dataset for the neurons of the range into
+    /// `out`, one row every `stride` elements
+    ///
+    template <typename T>
+    void readInto(const std::string& did,
+                  const Range& range,
+                  size_t width,
+                  T* out,
+                  size_t stride) const;
+
     template <typename T = std::string>
     std::vector<T> getDataFromTSV(const TSVColumn& col,
-                                  const Range& range) const;
+                                  const MVD::Selection& selection) const;
 
-    template <typename T = std::string>
+    // Builds the join table of the opened TSV file
+    void joinTSVEntries();
+
+    ///
+    /// \brief joinTSV
+    /// Calls gather(i, entry) with the TSV entry of the i-th neuron of the
+    /// selection, joined on the library indices of its me_combo and
+    /// morphology. The indices are read on the calling thread, the chunks
+    /// read are joined and gathered on up to getTSVWorkers() threads meanwhile:
+    /// gather must only write to the output of the neuron i
+    /// throw TSVException if a neuron has no entry in the TSV file
+    ///
+    template <typename Gather>
+    void joinTSV(const MVD::Selection& selection, const Gather& gather) const;
+
+    using Library = MVD::Categorical::Dictionary;
+
+    ///
+    /// \brief getLibrary
+    /// \param did_lib: path of a /library dataset
+    /// \return the decoded library table. It is read on first use and shared
+    /// by all later calls
+    ///
+    std::shared_ptr<const Library> getLibrary(const std::string& did_lib) const;
+
+    ///
+    /// \brief resolveIndex
+    /// \param did_lib: path of a /library dataset
+    /// \param references: library indices
+    /// \return the library value of each reference
+    ///
+    /// Uses the cached table when there is one. Otherwise it reads either the
+    /// whole table, which is then cached, the span between the lowest and the
+    /// highest reference, or only the referenced entries, depending on how
+    /// sparse the references are
+    ///
+    std::vector<std::string> resolveIndex(const std::string& did_lib,
+                                          const std::vector<size_t>& references) const;
+
+    template <typename T>
     std::vector<T> getDataFromMVD(const std::string& field,
-                                  const std::string& library,
-                                  const Range& range) const;
+                                  const MVD::Selection& selection) const;
 
-    template <typename T = std::string>
-    std::vector<T> getDataFromTSVorMVD(const std::string& field,
-                                       const std::string& library,
-                                       const TSVColumn& col,
-                                       const Range& range) const;
+    MVD::Categorical getCategoricalFromMVD(const std::string& field,
+                                           const std::string& library,
+                                           const MVD::Selection& selection) const;
+
+    MVD::Categorical getCategoricalFromTSVorMVD(const std::string& field,
+                                                const std::string& library,
+                                                const TSVColumn& col,
+                                                const MVD::Selection& selection) const;
+
+    std::vector<std::string> getDataFromMVD(const std::string& field,
+                                            const std::string& library,
+                                            const MVD::Selection& selection) const;
+
+    std::vector<std::string> getDataFromTSVorMVD(const std::string& field,
+                                                 const std::string& library,
+                                                 const TSVColumn& col,
+                                                 const MVD::Selection& selection) const;
 
 private:
     std::string _filename;
+    // Declared before the file: opening it in parallel sets the transfer mode
+    MVD::utils::TransferProps _xfer_props;
     HighFive::File _hdf5_file;
+    MVD::Schema _schema;
     std::unique_ptr<TSV::TSVFile> _tsv_file;
-    size_t _nb_neurons;
+    // The TSV entries, and the position among them of the entry of each pair
+    // of (me_combo, morphology) library indices. Built by joinTSVEntries()
+    TSV::TSVFile::vector_ref _tsv_entries;
+    std::unordered_map<uint64_t, size_t> _tsv_join;
+    size_t _tsv_workers = 1;
+
+    // Opened datasets, indexed by path. Filled lazily by getDataSetInfo()
+    // and guarded by a mutex so that const readers can share the file
+    mutable std::mutex _datasets_mutex;
+    mutable std::unordered_map<std::string, DataSetInfo> _datasets;
+
+    // Decoded /library tables, indexed by path. Filled lazily by getLibrary()
+    mutable std::mutex _libraries_mutex;
+    mutable std::unordered_map<std::string, std::shared_ptr<const Library>> _libraries;
+    mutable LibraryGatherStats _library_stats;
 
 };
 
@@ -18,15 +18,24 @@
  */
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <algorithm>
 #include <boost/multi_array.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/integer.hpp>
+#include <boost/variant.hpp>
 
 #include "mvd_except.hpp"
 #include "tsv.hpp"
+#include "utils.hpp"
 
 namespace MVD {
 
@@ -57,6 +66,556 @@ public:
 };
 
 
+///
+/// \brief The Selection class
+///
+/// A sorted set of cells, stored as non-overlapping [begin, end) ranges in
+/// increasing order. Unlike Range it can describe sparse gid lists, which the
+/// backends read without touching the cells in between.
+///
+class Selection {
+public:
+    typedef std::array<size_t, 2> Bounds;
+    typedef std::vector<Bounds> Ranges;
+
+    ///
+    /// \brief Selection
+    /// \param ranges: [begin, end) pairs, sorted and non-overlapping. Empty
+    /// ranges are dropped and adjacent ones merged
+    /// throw MVDException if a range is reversed, unsorted or overlapping
+    ///
+    inline explicit Selection(const Ranges& ranges = Ranges()) {
+        for (const auto& range: ranges) {
+            if (range[0] > range[1]) {
+                throw MVDException("Invalid selection range: begin is past end");
+            }
+            if (range[0] == range[1]) {
+                continue;
+            }
+            if (!_ranges.empty() && range[0] < _ranges.back()[1]) {
+                throw MVDException("Selection ranges must be sorted and non-overlapping");
+            }
+            if (!_ranges.empty() && range[0] == _ranges.back()[1]) {
+                _ranges.back()[1] = range[1];
+            } else {
+                _ranges.push_back(range);
+            }
+        }
+    }
+
+    ///
+    /// \brief fromRange
+    /// \return the selection of a Range, resolved against the number of cells
+    ///
+    inline static Selection fromRange(const Range& range, size_t size) {
+        return Selection({{range.offset, range.calculate_end(size)}});
+    }
+
+    ///
+    /// \brief fromIndices
+    /// \return the selection of a strictly increasing list of cell indices.
+    /// Consecutive indices are merged into ranges
+    /// throw MVDException if the indices are not strictly increasing
+    ///
+    template <typename Iterator>
+    inline static Selection fromIndices(Iterator first, Iterator last) {
+        Ranges ranges;
+        for (; first != last; ++first) {
+            const size_t index = *first;
+            if (!ranges.empty() && index < ranges.back()[1]) {
+                throw MVDException("Selection indices must be strictly increasing");
+            }
+            if (!ranges.empty() && index == ranges.back()[1]) {
+                ++ranges.back()[1];
+            } else {
+                ranges.push_back({index, index + 1});
+            }
+        }
+        return Selection(ranges);
+    }
+
+    inline static Selection fromIndices(const std::vector<size_t>& indices) {
+        return fromIndices(indices.begin(), indices.end());
+    }
+
+    inline const Ranges& ranges() const { return _ranges; }
+    inline bool empty() const { return _ranges.empty(); }
+
+    ///
+    /// \brief flatSize
+    /// \return the number of selected cells
+    ///
+    inline size_t flatSize() const {
+        size_t size = 0;
+        for (const auto& range: _ranges) {
+            size += range[1] - range[0];
+        }
+        return size;
+    }
+
+    ///
+    /// \brief flatten
+    /// \return the selected cell indices, in increasing order
+    ///
+    inline std::vector<size_t> flatten() const {
+        std::vector<size_t> indices;
+        indices.reserve(flatSize());
+        for (const auto& range: _ranges) {
+            for (size_t i = range[0]; i < range[1]; ++i) {
+                indices.push_back(i);
+            }
+        }
+        return indices;
+    }
+
+    ///
+    /// \brief checkBounds
+    /// throw MVDException if the selection goes past `size` cells
+    ///
+    inline void checkBounds(size_t size) const {
+        if (!_ranges.empty() && _ranges.back()[1] > size) {
+            std::ostringstream ss;
+            ss << "Selection up to cell " << _ranges.back()[1]
+               << " is out of bounds for a dataset of size " << size;
+            throw MVDException(ss.str());
+        }
+    }
+
+private:
+    Ranges _ranges;
+};
+
+
+///
+/// \brief balancedBlock
+/// \return the contiguous block of cells owned by `rank` when `n_cells` cells
+/// are split between `n_ranks` ranks. Block sizes differ by one cell at most,
+/// the first ranks getting the larger ones. Blocks may be empty
+/// throw MVDException if rank is not lower than n_ranks
+///
+inline Selection balancedBlock(size_t n_cells, size_t rank, size_t n_ranks) {
+    if (rank >= n_ranks) {
+        throw MVDException("Invalid rank " + std::to_string(rank) + " for "
+                           + std::to_string(n_ranks) + " ranks");
+    }
+    const size_t block_size = n_cells / n_ranks;
+    const size_t remainder = n_cells % n_ranks;
+    const size_t begin = rank * block_size + std::min(rank, remainder);
+    const size_t end = begin + block_size + (rank < remainder ? 1 : 0);
+    return Selection({{begin, end}});
+}
+
+
+namespace utils {
+
+// Concatenates the results of a Range getter over each range of a selection
+template <typename T, typename FuncT>
+inline std::vector<T> gather_ranges(const Selection& selection, const FuncT& f) {
+    std::vector<T> output;
+    output.reserve(selection.flatSize());
+    for (const auto& range: selection.ranges()) {
+        auto chunk = f(Range(range[0], range[1] - range[0]));
+        std::move(chunk.begin(), chunk.end(), std::back_inserter(output));
+    }
+    return output;
+}
+
+// Rounds chunk_size down to whole storage chunks, so that no HDF5 chunk is
+// read twice, and never above the requested size: requests smaller than one
+// storage chunk, or datasets without chunks (storage_chunk 0), are kept as is
+inline size_t align_chunk_size(size_t chunk_size, size_t storage_chunk) {
+    if (storage_chunk == 0 || chunk_size < storage_chunk) {
+        return chunk_size;
+    }
+    return chunk_size / storage_chunk * storage_chunk;
+}
+
+// Calls f on consecutive sub-selections of at most chunk_size cells
+template <typename FuncT>
+inline void for_each_chunk(const Selection& selection, size_t chunk_size, const FuncT& f) {
+    Selection::Ranges chunk;
+    size_t chunk_count = 0;
+    for (const auto& range: selection.ranges()) {
+        for (size_t begin = range[0]; begin < range[1];) {
+            const size_t end = std::min(range[1], begin + chunk_size - chunk_count);
+            chunk.push_back({begin, end});
+            chunk_count += end - begin;
+            begin = end;
+            if (chunk_count == chunk_size) {
+                f(Selection(chunk));
+                chunk.clear();
+                chunk_count = 0;
+            }
+        }
+    }
+    if (!chunk.empty()) {
+        f(Selection(chunk));
+    }
+}
+
+// Same as gather_ranges, for the [N][width] arrays of positions and rotations
+template <typename FuncT>
+inline boost::multi_array<double, 2> gather_rows(const Selection& selection,
+                                                 size_t width,
+                                                 const FuncT& f) {
+    boost::multi_array<double, 2> output(boost::extents[selection.flatSize()][width]);
+    double* out = output.data();
+    for (const auto& range: selection.ranges()) {
+        const auto chunk = f(Range(range[0], range[1] - range[0]));
+        out = std::copy(chunk.data(), chunk.data() + chunk.num_elements(), out);
+    }
+    return output;
+}
+
+}  // namespace utils
+
+
+///
+/// \brief The Categorical class
+///
+/// A dictionary-encoded string column: one integer code per cell, indexing
+/// a dictionary of distinct values. Results read from the same file share
+/// their dictionary, so codes can be compared across calls.
+///
+class Categorical {
+public:
+    typedef uint32_t code_type;
+    typedef std::vector<std::string> Dictionary;
+
+    enum : code_type { npos = static_cast<code_type>(-1) };
+
+    inline Categorical() : _dictionary(std::make_shared<Dictionary>()) {}
+
+    ///
+    /// \brief Categorical
+    /// \param codes one code per cell
+    /// \param dictionary the values referenced by the codes
+    /// throw MVDParserException if a code is out of the dictionary bounds
+    ///
+    inline Categorical(std::vector<code_type> codes, std::shared_ptr<const Dictionary> dictionary)
+        : _codes(std::move(codes))
+        , _dictionary(std::move(dictionary)) {
+        const size_t n_elem = _dictionary->size();
+        for (auto i: _codes) {
+            if (i >= n_elem) {
+                std::ostringstream ss;
+                ss << "Invalid index reference " << i << " in an dataset of size " << n_elem;
+                throw MVDParserException(ss.str());
+            }
+        }
+    }
+
+    ///
+    /// \brief fromValues dictionary-encodes a vector of strings
+    /// Codes are assigned in order of first appearance
+    ///
+    inline static Categorical fromValues(const std::vector<std::string>& values) {
+        auto dictionary = std::make_shared<Dictionary>();
+        std::unordered_map<std::string, code_type> index;
+        std::vector<code_type> codes;
+        codes.reserve(values.size());
+        for (const auto& value: values) {
+            auto it = index.emplace(value, static_cast<code_type>(dictionary->size())).first;
+            if (it->second == dictionary->size()) {
+                dictionary->push_back(value);
+            }
+            codes.push_back(it->second);
+        }
+        return Categorical(std::move(codes), std::move(dictionary));
+    }
+
+    inline size_t size() const { return _codes.size(); }
+    inline const std::vector<code_type>& codes() const { return _codes; }
+    inline const Dictionary& dictionary() const { return *_dictionary; }
+    inline const std::shared_ptr<const Dictionary>& sharedDictionary() const { return _dictionary; }
+    inline const std::string& operator[](size_t i) const { return (*_dictionary)[_codes[i]]; }
+
+    ///
+    /// \brief code
+    /// \return the code of `value` in the dictionary, or npos if not present
+    ///
+    inline code_type code(const std::string& value) const {
+        const auto it = std::find(_dictionary->begin(), _dictionary->end(), value);
+        return it == _dictionary->end() ? npos
+                                        : static_cast<code_type>(it - _dictionary->begin());
+    }
+
+    ///
+    /// \brief values
+    /// \return the decoded column, one string per cell
+    ///
+    inline std::vector<std::string> values() const {
+        std::vector<std::string> result;
+        result.reserve(_codes.size());
+        for (auto i: _codes) {
+            result.push_back((*_dictionary)[i]);
+        }
+        return result;
+    }
+
+private:
+    std::vector<code_type> _codes;
+    std::shared_ptr<const Dictionary> _dictionary;
+};
+
+
+///
+/// \brief The Column struct
+///
+/// Storage description of one dataset of a circuit file
+///
+struct Column {
+    std::string name;
+    /// stored type: "int8_t" ... "uint64_t", "float", "double" or "string"
+    std::string dtype;
+    std::vector<size_t> dims;
+    /// rows per HDF5 chunk, 0 if the dataset is not chunked
+    size_t chunk_rows = 0;
+    /// whether the values are indices into a library of strings
+    bool enumeration = false;
+
+    inline size_t rows() const { return dims.empty() ? 0 : dims[0]; }
+};
+
+
+///
+/// \brief The Schema class
+///
+/// Immutable list of the columns of a file, taken once when it is opened.
+/// Capability checks and read dispatch use it instead of querying HDF5,
+/// and tools can plan their reads from it. Column names are backend
+/// specific, see MVD3File::getSchema() and SonataFile::getSchema()
+///
+class Schema {
+public:
+    inline Schema() = default;
+
+    inline explicit Schema(std::vector<Column> columns)
+        : _columns(std::move(columns)) {
+        std::sort(_columns.begin(), _columns.end(), [](const Column& a, const Column& b) {
+            return a.name < b.name;
+        });
+    }
+
+    /// \return the columns, sorted by name
+    inline const std::vector<Column>& columns() const { return _columns; }
+    inline size_t size() const { return _columns.size(); }
+
+    ///
+    /// \brief find
+    /// \return the column called `name`, or nullptr if there is none
+    ///
+    inline const Column* find(const std::string& name) const {
+        const auto it = std::lower_bound(_columns.begin(), _columns.end(), name,
+                                         [](const Column& c, const std::string& n) {
+                                             return c.name < n;
+                                         });
+        return (it != _columns.end() && it->name == name) ? &*it : nullptr;
+    }
+
+    inline bool has(const std::string& name) const { return find(name) != nullptr; }
+
+    ///
+    /// \brief get
+    /// throw MVDException if there is no column called `name`
+    ///
+    inline const Column& get(const std::string& name) const {
+        const Column* column = find(name);
+        if (column == nullptr) {
+            throw MVDException("No such column: " + name);
+        }
+        return *column;
+    }
+
+private:
+    std::vector<Column> _columns;
+};
+
+
+namespace utils {
+
+/// Column::dtype of a C++ type
+template <typename T> inline const char* dtype_of();
+template <> inline const char* dtype_of<int8_t>() { return "int8_t"; }
+template <> inline const char* dtype_of<uint8_t>() { return "uint8_t"; }
+template <> inline const char* dtype_of<int16_t>() { return "int16_t"; }
+template <> inline const char* dtype_of<uint16_t>() { return "uint16_t"; }
+template <> inline const char* dtype_of<int32_t>() { return "int32_t"; }
+template <> inline const char* dtype_of<uint32_t>() { return "uint32_t"; }
+template <> inline const char* dtype_of<int64_t>() { return "int64_t"; }
+template <> inline const char* dtype_of<uint64_t>() { return "uint64_t"; }
+template <> inline const char* dtype_of<float>() { return "float"; }
+template <> inline const char* dtype_of<double>() { return "double"; }
+template <> inline const char* dtype_of<std::string>() { return "string"; }
+
+template <typename T>
+struct type_tag {
+    typedef T type;
+};
+
+///
+/// \brief dispatch_numeric
+/// Calls f(type_tag<T>()) with the numeric type T named by `dtype`
+/// throw MVDException if `dtype` is not numeric
+///
+template <typename FuncT>
+inline auto dispatch_numeric(const std::string& dtype, const FuncT& f)
+    -> decltype(f(type_tag<double>())) {
+    if (dtype == "int8_t") return f(type_tag<int8_t>());
+    if (dtype == "uint8_t") return f(type_tag<uint8_t>());
+    if (dtype == "int16_t") return f(type_tag<int16_t>());
+    if (dtype == "uint16_t") return f(type_tag<uint16_t>());
+    if (dtype == "int32_t") return f(type_tag<int32_t>());
+    if (dtype == "uint32_t") return f(type_tag<uint32_t>());
+    if (dtype == "int64_t") return f(type_tag<int64_t>());
+    if (dtype == "uint64_t") return f(type_tag<uint64_t>());
+    if (dtype == "float") return f(type_tag<float>());
+    if (dtype == "double") return f(type_tag<double>());
+    throw MVDException("Unsupported numeric type: " + dtype);
+}
+
+}  // namespace utils
+
+
+///
+/// \brief The TypedColumn class
+///
+/// Values of a column in the type they are stored with, named by dtype() as
+/// in Column::dtype. Nothing is widened: a uint8_t column takes one byte
+/// per cell
+///
+class TypedColumn {
+public:
+    typedef boost::variant<std::vector<int8_t>, std::vector<uint8_t>,
+                           std::vector<int16_t>, std::vector<uint16_t>,
+                           std::vector<int32_t>, std::vector<uint32_t>,
+                           std::vector<int64_t>, std::vector<uint64_t>,
+                           std::vector<float>, std::vector<double>,
+                           std::vector<std::string>> Values;
+
+    template <typename T>
+    inline explicit TypedColumn(std::vector<T> values)
+        : _dtype(utils::dtype_of<T>())
+        , _values(std::move(values)) {}
+
+    inline const std::string& dtype() const { return _dtype; }
+
+    inline size_t size() const {
+        return boost::apply_visitor([](const auto& values) { return values.size(); }, _values);
+    }
+
+    ///
+    /// \brief values
+    /// \return the variant holding the vector, for boost::apply_visitor
+    ///
+    inline const Values& values() const { return _values; }
+    inline Values& values() { return _values; }
+
+    template <typename T>
+    inline bool holds() const {
+        return boost::get<std::vector<T>>(&_values) != nullptr;
+    }
+
+    ///
+    /// \brief get
+    /// \return the values, when they are stored as T
+    /// throw MVDException for any other T
+    ///
+    template <typename T>
+    inline const std::vector<T>& get() const {
+        const auto* values = boost::get<std::vector<T>>(&_values);
+        if (values == nullptr) {
+            throw MVDException("Column of type " + _dtype + " accessed as "
+                               + utils::dtype_of<T>());
+        }
+        return *values;
+    }
+
+    template <typename T>
+    inline std::vector<T>& get() {
+        return const_cast<std::vector<T>&>(static_cast<const TypedColumn&>(*this).get<T>());
+    }
+
+private:
+    std::string _dtype;
+    Values _values;
+};
+
+
+namespace CellColumn {
+///
+/// \brief Columns of a CellBatch, combined as a bit mask
+///
+enum CellColumn : unsigned {
+    None = 0,
+    Positions = 1 << 0,
+    Rotations = 1 << 1,
+    Morphologies = 1 << 2,
+    Etypes = 1 << 3,
+    Mtypes = 1 << 4,
+    Regions = 1 << 5,
+    SynapseClass = 1 << 6,
+    All = (1 << 7) - 1
+};
+}
+
+
+///
+/// \brief The CellBatch struct
+///
+/// Struct-of-arrays holding several columns for the same range of cells.
+/// Columns that were not requested are left empty.
+///
+struct CellBatch {
+    Selection selection;
+    MVD::Positions positions;
+    MVD::Rotations rotations;
+    Categorical morphologies;
+    Categorical etypes;
+    Categorical mtypes;
+    Categorical regions;
+    Categorical synapse_class;
+
+    CellBatch() = default;
+    CellBatch(const CellBatch&) = default;
+    CellBatch(CellBatch&&) = default;
+
+    // boost::multi_array only assigns between equal shapes
+    inline CellBatch& operator=(const CellBatch& other) {
+        if (this != &other) {
+            selection = other.selection;
+            utils::multi_array_assign(positions, other.positions);
+            utils::multi_array_assign(rotations, other.rotations);
+            morphologies = other.morphologies;
+            etypes = other.etypes;
+            mtypes = other.mtypes;
+            regions = other.regions;
+            synapse_class = other.synapse_class;
+        }
+        return *this;
+    }
+
+    inline CellBatch& operator=(CellBatch&& other) {
+        if (this != &other) {
+            selection = std::move(other.selection);
+            utils::multi_array_assign(positions, other.positions);
+            utils::multi_array_assign(rotations, other.rotations);
+            morphologies = std::move(other.morphologies);
+            etypes = std::move(other.etypes);
+            mtypes = std::move(other.mtypes);
+            regions = std::move(other.regions);
+            synapse_class = std::move(other.synapse_class);
+        }
+        return *this;
+    }
+
+    inline size_t size() const { return selection.flatSize(); }
+};
+
+
+class CellChunks;
+
+
 class MVDFile {
 public:
     inline MVDFile() {}
@@ -89,6 +648,11 @@ public:
     virtual std::vector<std::string> getRegions(const Range& range = Range::all()) const = 0;
     virtual std::vector<std::string> getSynapseClass(const Range& range = Range::all()) const = 0;
 
+    /// \return whether the cells have a region, true unless a backend says otherwise
+    virtual bool hasRegions() const {
+        return true;
+    }
+
     virtual bool hasMiniFrequencies() const = 0;
     virtual std::vector<double> getExcMiniFrequencies(const Range & range = Range::all()) const = 0;
     virtual std::vector<double> getInhMiniFrequencies(const Range & range = Range::all()) const = 0;
@@ -97,19 +661,366 @@ public:
     virtual std::vector<double> getThresholdCurrents(const Range& range = Range::all()) const = 0;
     virtual std::vector<double> getHoldingCurrents(const Range& range = Range::all()) const = 0;
 
+    ///
+    /// \brief Dictionary-encoded variants of the string getters
+    ///
+    /// The default implementations encode the output of the string getters,
+    /// backends override them to read the codes natively
+    ///
+    virtual Categorical getCategoricalMorphologies(const Range& range = Range::all()) const {
+        return Categorical::fromValues(getMorphologies(range));
+    }
+    virtual Categorical getCategoricalEtypes(const Range& range = Range::all()) const {
+        return Categorical::fromValues(getEtypes(range));
+    }
+    virtual Categorical getCategoricalMtypes(const Range& range = Range::all()) const {
+        return Categorical::fromValues(getMtypes(range));
+    }
+    virtual Categorical getCategoricalRegions(const Range& range = Range::all()) const {
+        return Categorical::fromValues(getRegions(range));
+    }
+    virtual Categorical getCategoricalSynapseClass(const Range& range = Range::all()) const {
+        return Categorical::fromValues(getSynapseClass(range));
+    }
+
     virtual std::vector<size_t> getIndexEtypes(const Range& range = Range::all()) const = 0;
     virtual std::vector<size_t> getIndexMtypes(const Range& range = Range::all()) const = 0;
     virtual std::vector<size_t> getIndexRegions(const Range& range = Range::all()) const = 0;
     virtual std::vector<size_t> getIndexSynapseClass(const Range& range = Range::all()) const = 0;
 
+    ///
+    /// \brief Selection variants of the getters
+    ///
+    /// The default implementations call the Range getters once per range of
+    /// the selection and concatenate the results, backends override them to
+    /// read the whole selection at once
+    ///
+    using MVDFile::getPositions;
+    using MVDFile::getRotations;
+
+    virtual Positions getPositions(const Selection& selection) const {
+        return utils::gather_rows(selection, 3, [this](const Range& r) {
+            return getPositions(r);
+        });
+    }
+    virtual Rotations getRotations(const Selection& selection) const {
+        return utils::gather_rows(selection, 4, [this](const Range& r) {
+            return getRotations(r);
+        });
+    }
+    virtual std::vector<std::string> getMorphologies(const Selection& selection) const {
+        return gather<std::string>(selection, &File::getMorphologies);
+    }
+    virtual std::vector<std::string> getEtypes(const Selection& selection) const {
+        return gather<std::string>(selection, &File::getEtypes);
+    }
+    virtual std::vector<std::string> getMtypes(const Selection& selection) const {
+        return gather<std::string>(selection, &File::getMtypes);
+    }
+    virtual std::vector<std::string> getEmodels(const Selection& selection) const {
+        return gather<std::string>(selection, &File::getEmodels);
+    }
+    virtual std::vector<std::string> getRegions(const Selection& selection) const {
+        return gather<std::string>(selection, &File::getRegions);
+    }
+    virtual std::vector<std::string> getSynapseClass(const Selection& selection) const {
+        return gather<std::string>(selection, &File::getSynapseClass);
+    }
+    virtual std::vector<double> getExcMiniFrequencies(const Selection& selection) const {
+        return gather<double>(selection, &File::getExcMiniFrequencies);
+    }
+    virtual std::vector<double> getInhMiniFrequencies(const Selection& selection) const {
+        return gather<double>(selection, &File::getInhMiniFrequencies);
+    }
+    virtual std::vector<double> getThresholdCurrents(const Selection& selection) const {
+        return gather<double>(selection, &File::getThresholdCurrents);
+    }
+    virtual std::vector<double> getHoldingCurrents(const Selection& selection) const {
+        return gather<double>(selection, &File::getHoldingCurrents);
+    }
+    virtual Categorical getCategoricalMorphologies(const Selection& selection) const {
+        return Categorical::fromValues(getMorphologies(selection));
+    }
+    virtual Categorical getCategoricalEtypes(const Selection& selection) const {
+        return Categorical::fromValues(getEtypes(selection));
+    }
+    virtual Categorical getCategoricalMtypes(const Selection& selection) const {
+        return Categorical::fromValues(getMtypes(selection));
+    }
+    virtual Categorical getCategoricalRegions(const Selection& selection) const {
+        return Categorical::fromValues(getRegions(selection));
+    }
+    virtual Categorical getCategoricalSynapseClass(const Selection& selection) const {
+        return Categorical::fromValues(getSynapseClass(selection));
+    }
+    virtual std::vector<size_t> getIndexEtypes(const Selection& selection) const {
+        return gather<size_t>(selection, &File::getIndexEtypes);
+    }
+    virtual std::vector<size_t> getIndexMtypes(const Selection& selection) const {
+        return gather<size_t>(selection, &File::getIndexMtypes);
+    }
+    virtual std::vector<size_t> getIndexRegions(const Selection& selection) const {
+        return gather<size_t>(selection, &File::getIndexRegions);
+    }
+    virtual std::vector<size_t> getIndexSynapseClass(const Selection& selection) const {
+        return gather<size_t>(selection, &File::getIndexSynapseClass);
+    }
+
+    ///
+    /// \brief read several columns for the same cells in one call
+    /// \param range: selection range, resolved once for all the columns
+    /// \param columns: mask of CellColumn values
+    /// \return a CellBatch. Rotations are left empty when the file has none
+    ///
+    CellBatch read(const Range& range = Range::all(),
+                   unsigned columns = CellColumn::All) const {
+        return read(Selection::fromRange(range, size()), columns);
+    }
+
+    virtual CellBatch read(const Selection& selection,
+                           unsigned columns = CellColumn::All) const {
+        CellBatch batch;
+        batch.selection = selection;
+        if (columns & CellColumn::Positions) {
+            utils::multi_array_assign(batch.positions, getPositions(selection));
+        }
+        if ((columns & CellColumn::Rotations) && hasRotations()) {
+            utils::multi_array_assign(batch.rotations, getRotations(selection));
+        }
+        if (columns & CellColumn::Morphologies) {
+            batch.morphologies = getCategoricalMorphologies(selection);
+        }
+        if (columns & CellColumn::Etypes) {
+            batch.etypes = getCategoricalEtypes(selection);
+        }
+        if (columns & CellColumn::Mtypes) {
+            batch.mtypes = getCategoricalMtypes(selection);
+        }
+        if (columns & CellColumn::Regions) {
+            batch.regions = getCategoricalRegions(selection);
+        }
+        if (columns & CellColumn::SynapseClass) {
+            batch.synapse_class = getCategoricalSynapseClass(selection);
+        }
+        return batch;
+    }
+
+    ///
+    /// \brief read positions straight into caller memory
+    /// \param out: receives x, y, z for each cell of the range
+    /// \param stride: distance between two cells in `out`, in doubles (at least 3)
+    ///
+    /// The default implementation copies the output of getPositions, backends
+    /// override it to read without intermediate allocation
+    ///
+    virtual void readPositions(const Range& range, double* out, size_t stride = 3) const {
+        utils::copy_rows(getPositions(range), out, stride);
+    }
+
+    ///
+    /// \brief read rotations straight into caller memory
+    /// \param out: receives the x, y, z, w quaternion of each cell of the range
+    /// \param stride: distance between two cells in `out`, in doubles (at least 4)
+    ///
+    virtual void readRotations(const Range& range, double* out, size_t stride = 4) const {
+        utils::copy_rows(getRotations(range), out, stride);
+    }
+
+    ///
+    /// \brief storageChunkSize
+    /// \return the number of cells per HDF5 chunk of the cell datasets, or 0
+    /// if they are not chunked
+    ///
+    virtual size_t storageChunkSize() const {
+        return 0;
+    }
+
+    ///
+    /// \brief concurrentReads
+    /// \return whether read() may run on a background thread while the calling
+    /// thread carries on, with any other HDF5 or MPI call of the process
+    ///
+    virtual bool concurrentReads() const {
+        return true;
+    }
+
+    ///
+    /// \brief getSchema
+    /// \return the columns of the file, as found when it was opened. Files
+    /// that do not describe their storage return an empty schema
+    ///
+    virtual const Schema& getSchema() const {
+        static const Schema empty;
+        return empty;
+    }
+
+    ///
+    /// \brief getTypedAttribute
+    /// \return the values of a backend specific attribute, in their stored type
+    /// throw MVDException if the file has no such attribute
+    ///
+    virtual TypedColumn getTypedAttribute(const std::string& name,
+                                          const Selection& selection) const {
+        (void) selection;
+        throw MVDException("No such attribute: " + name);
+    }
+
+    ///
+    /// \brief getCategoricalAttribute
+    /// \return the codes of a backend specific string attribute
+    /// throw MVDException if the file has no such string attribute
+    ///
+    virtual Categorical getCategoricalAttribute(const std::string& name,
+                                                const Selection& selection) const {
+        (void) selection;
+        throw MVDException("No such string attribute: " + name);
+    }
+
+    ///
+    /// \brief chunks
+    /// Streams all the cells, `chunk_size` at a time. When concurrentReads()
+    /// holds, the next chunk is read on a background thread while the current
+    /// one is processed, so the file must not be used otherwise until the
+    /// iteration is over. Otherwise, e.g. with a thread-unsafe HDF5 library or
+    /// collective MPI-IO reads, each chunk is read on the calling thread when
+    /// the iteration reaches it
+    /// \param chunk_size: cells per chunk, rounded down to a multiple of
+    /// storageChunkSize() when the datasets are chunked and it spans at
+    /// least one storage chunk
+    /// \param columns: mask of CellColumn values
+    /// \return a single pass range of CellBatch
+    ///
+    CellChunks chunks(size_t chunk_size, unsigned columns = CellColumn::All) const;
+
     virtual std::vector<std::string> listAllEtypes() const = 0;
     virtual std::vector<std::string> listAllMtypes() const = 0;
     virtual std::vector<std::string> listAllEmodels() const = 0;
     virtual std::vector<std::string> listAllRegions() const = 0;
     virtual std::vector<std::string> listAllSynapseClass() const = 0;
+
+private:
+    template <typename T>
+    using RangeGetter = std::vector<T> (File::*)(const Range&) const;
+
+    template <typename T>
+    inline std::vector<T> gather(const Selection& selection, RangeGetter<T> getter) const {
+        return utils::gather_ranges<T>(selection, [this, getter](const Range& r) {
+            return (this->*getter)(r);
+        });
+    }
 };
 
 
+///
+/// \brief The CellChunks class
+///
+/// Single pass range over consecutive CellBatch of a file, see File::chunks().
+/// While a chunk is being processed, the next one is already read by a
+/// background task if the file allows it, see File::concurrentReads(). Read
+/// errors are rethrown when advancing to that chunk.
+///
+class CellChunks {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = CellBatch;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const CellBatch*;
+        using reference = const CellBatch&;
+
+        inline explicit iterator(CellChunks* chunks = nullptr) : _chunks(chunks) {}
+
+        inline reference operator*() const { return *_chunks->_current; }
+        inline pointer operator->() const { return _chunks->_current.get(); }
+
+        inline iterator& operator++() {
+            if (!_chunks->advance()) {
+                _chunks = nullptr;
+            }
+            return *this;
+        }
+
+        inline bool operator==(const iterator& other) const { return _chunks == other._chunks; }
+        inline bool operator!=(const iterator& other) const { return _chunks != other._chunks; }
+
+    private:
+        CellChunks* _chunks;
+    };
+
+    inline CellChunks(const File& file, size_t chunk_size, unsigned columns)
+        : _file(&file)
+        , _columns(columns)
+        , _n_cells(file.size())
+        , _policy(file.concurrentReads() ? std::launch::async : std::launch::deferred) {
+        if (chunk_size == 0) {
+            throw MVDException("Invalid chunk size: 0");
+        }
+        _chunk_size = utils::align_chunk_size(chunk_size, file.storageChunkSize());
+        prefetch();
+    }
+
+    inline iterator begin() {
+        if (!_started) {
+            _started = true;
+            advance();
+        }
+        return iterator(_has_current ? this : nullptr);
+    }
+
+    inline iterator end() { return iterator(); }
+
+    /// \return the number of cells per chunk, after alignment
+    inline size_t chunkSize() const { return _chunk_size; }
+
+    /// \return the number of chunks
+    inline size_t size() const { return (_n_cells + _chunk_size - 1) / _chunk_size; }
+
+private:
+    // Moves to the prefetched chunk and starts reading the following one
+    inline bool advance() {
+        _has_current = _next.valid();
+        if (!_has_current) {
+            return false;
+        }
+        _current = _next.get();
+        prefetch();
+        return true;
+    }
+
+    inline void prefetch() {
+        if (_offset >= _n_cells) {
+            return;
+        }
+        const size_t count = std::min(_chunk_size, _n_cells - _offset);
+        const Selection selection({{_offset, _offset + count}});
+        _offset += count;
+        const File* file = _file;
+        const unsigned columns = _columns;
+        // Batches are handed over by pointer: CellBatch moves copy their arrays
+        _next = std::async(_policy, [file, selection, columns]() {
+            return std::unique_ptr<CellBatch>(new CellBatch(file->read(selection, columns)));
+        });
+    }
+
+    const File* _file;
+    unsigned _columns;
+    size_t _n_cells;
+    std::launch _policy;
+    size_t _chunk_size = 0;
+    size_t _offset = 0;
+    bool _started = false;
+    bool _has_current = false;
+    std::unique_ptr<CellBatch> _current;
+    std::future<std::unique_ptr<CellBatch>> _next;
+};
+
+
+inline CellChunks File::chunks(size_t chunk_size, unsigned columns) const {
+    return CellChunks(*this, chunk_size, columns);
+}
+
+
 
 inline MVDType::MVDType _mvd_format(const std::string & filename) {
     using boost::algorithm::ends_with;
@@ -20,7 +20,10 @@
 
 #include "mvd2.hpp"
 #include "mvd3.hpp"
+#include "multi_population.hpp"
+#include "query.hpp"
 #include "sonata.hpp"
+#include "sonata_writer.hpp"
 
 
 namespace MVD {
@@ -62,7 +65,8 @@ inline std::shared_ptr<File> open(const std::string& filename,
     std::shared_ptr<File> mvdfile;
     switch (_mvd_format(filename)) {
     case MVDType::MVD2:
-        throw std::runtime_error("MVD2 not supported in the new MVD API");
+        mvdfile.reset(new MVD2::MVD2File(filename));
+        break;
     case MVDType::MVD3:
         mvdfile.reset(new MVD3::MVD3File(filename));
         mvdfile->size();  // triggers struct initialization
@@ -75,4 +79,41 @@ inline std::shared_ptr<File> open(const std::string& filename,
 }
 
 
+#ifdef MVDTOOL_USE_MPI
+///
+/// \brief open
+///
+/// Opens a file for all the ranks of a communicator. Every rank of `comm`
+/// must call it. With a parallel HDF5, metadata is read collectively and the
+/// numeric reads are collective MPI-IO reads, whatever the shape of the
+/// selection of each rank: ranks typically read their own block of cells,
+/// given by balancedBlock()
+///
+/// \param filename the path of the file to open
+/// \param comm the communicator of the ranks reading the file
+/// \param population population parameter
+/// \return a shared pointer to a mvd::File object
+///
+inline std::shared_ptr<File> open(const std::string& filename,
+                                  MPI_Comm comm,
+                                  const std::string& population="") {
+    std::shared_ptr<File> mvdfile;
+    switch (_mvd_format(filename)) {
+    case MVDType::MVD2:
+        // Text files are parsed by every rank
+        mvdfile.reset(new MVD2::MVD2File(filename));
+        break;
+    case MVDType::MVD3:
+        mvdfile.reset(new MVD3::MVD3File(filename, comm));
+        mvdfile->size();  // triggers struct initialization, on every rank
+        break;
+    default:
+        mvdfile.reset(new SonataFile(filename, comm, population));
+        break;
+    }
+    return mvdfile;
+}
+#endif
+
+
 }  // namespace MVD
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mvd_base.hpp"
+
+namespace MVD {
+
+
+///
+/// \brief The Query class
+///
+/// A conjunction of predicates on the columns of a File, evaluated chunk by
+/// chunk without decoding strings:
+///
+///     Query().in("mtype", {"L5_TTPC1", "L5_TTPC2"})
+///            .equals("region", "S1HL")
+///            .equals("layer", 5)
+///            .select(file);
+///
+/// String predicates apply to "morphology", "etype", "mtype", "region" and
+/// "synapse_class", and to the categorical attributes of the backend. Their
+/// literals are resolved to dictionary codes once per dictionary, then each
+/// cell only costs a table lookup on its code.
+///
+/// Numeric predicates apply to the "x", "y" and "z" positions and to the
+/// typed attributes of the backend, compared in their stored type: the bounds
+/// are converted to it, rounded inward for integers. Enumerated attributes
+/// compare their codes.
+///
+class Query {
+public:
+    enum : size_t { DEFAULT_CHUNK_SIZE = 1 << 16 };
+
+    ///
+    /// \brief Query
+    /// \param chunk_size: cells read per column at a time, rounded down to a
+    /// multiple of File::storageChunkSize() when the datasets are chunked and
+    /// it spans at least one storage chunk
+    /// throw MVDException if chunk_size is 0
+    ///
+    explicit Query(size_t chunk_size = DEFAULT_CHUNK_SIZE);
+
+    ///
+    /// \brief in
+    /// Keeps the cells whose `column` value is one of `values`
+    ///
+    Query& in(const std::string& column, std::vector<std::string> values);
+
+    ///
+    /// \brief equals
+    /// Keeps the cells whose `column` value is `value`
+    ///
+    Query& equals(const std::string& column, const std::string& value);
+    Query& equals(const std::string& column, double value);
+
+    ///
+    /// \brief between
+    /// Keeps the cells whose `column` value is within [min, max]
+    ///
+    Query& between(const std::string& column, double min, double max);
+
+    ///
+    /// \brief select
+    /// \return the cells of `cells` matching all the predicates, in increasing order
+    /// throw MVDException if a column does not exist or has the wrong kind
+    ///
+    Selection select(const File& file, const Selection& cells) const;
+    Selection select(const File& file) const;
+
+    inline size_t chunkSize() const { return chunk_size_; }
+    inline size_t size() const { return predicates_.size(); }
+
+private:
+    struct Predicate {
+        std::string column;
+        bool categorical;
+        // sorted literals of a string predicate
+        std::vector<std::string> values;
+        // bounds of a numeric predicate
+        double min;
+        double max;
+    };
+
+    // Per predicate flags of the dictionary codes, valid for one dictionary
+    struct CodeFilter {
+        std::shared_ptr<const Categorical::Dictionary> dictionary;
+        std::vector<uint8_t> accept;
+    };
+
+    ///
+    /// \brief filter
+    /// Clears the `mask` flags of the `chunk` cells failing `predicate`
+    ///
+    static void filter(const File& file,
+                       const Predicate& predicate,
+                       const Selection& chunk,
+                       CodeFilter& codes,
+                       std::vector<uint8_t>& mask);
+
+    size_t chunk_size_;
+    std::vector<Predicate> predicates_;
+};
+
+
+}  // namespace MVD
+
+#include "bits/query_misc.hpp"
@@ -22,14 +22,18 @@
 #define H5_USE_BOOST
 #endif
 
-#include <string>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
 #include <highfive/H5File.hpp>
 
 #include <bbp/sonata/nodes.h>
 
 #include "mvd_base.hpp"
+#include "bits/hdf5_misc.hpp"
 
 namespace MVD {
 
@@ -56,6 +60,20 @@ public:
     ///
     SonataFile(const std::string& filename, const std::string& pop_name = "");
 
+#ifdef MVDTOOL_USE_MPI
+    ///
+    /// \brief SonataFile
+    /// \param comm: the ranks opening the file together
+    ///
+    /// Open a population for all the ranks of 'comm'. With a parallel HDF5,
+    /// the numeric attributes (positions, rotations, readAttribute) are read
+    /// with collective MPI-IO: every rank must call them, each with its own
+    /// selection of any shape (see MVD::balancedBlock), possibly empty.
+    /// String attributes are read through libsonata, independently
+    ///
+    SonataFile(const std::string& filename, MPI_Comm comm, const std::string& pop_name = "");
+#endif
+
 
     ///
     /// \brief openComboTsv
@@ -104,6 +122,41 @@ public:
     ///
     Rotations getAngularRotations(const Range & range = Range::all()) const;
 
+    ///
+    /// \brief storageChunkSize
+    /// \return the number of cells per HDF5 chunk of the x attribute, 0 if it
+    /// is stored contiguously or missing
+    ///
+    size_t storageChunkSize() const override;
+
+    ///
+    /// \brief concurrentReads
+    /// \return false for a thread-unsafe HDF5 library or collective reads
+    ///
+    bool concurrentReads() const override;
+
+    ///
+    /// \brief getSchema
+    /// \return every dataset of the population attribute group, by path
+    /// relative to it: the attributes, "@library/<name>" tables and
+    /// "dynamics_params/<name>" attributes. Attributes with a library table
+    /// are enumerations
+    ///
+    const Schema& getSchema() const override;
+
+    ///
+    /// \brief readPositions
+    /// Reads the x, y and z attributes straight into `out`, without intermediate copies
+    ///
+    void readPositions(const Range& range, double* out, size_t stride = 3) const override;
+
+    ///
+    /// \brief readRotations
+    /// Reads the orientation attributes straight into `out`. Angular rotations
+    /// are converted to quaternions while being written
+    ///
+    void readRotations(const Range& range, double* out, size_t stride = 4) const override;
+
     ///
     /// \brief hasRotations
     /// \return if the current file has a rotational dataset
@@ -143,6 +196,11 @@ public:
     ///
     std::vector<std::string> getLayers(const Range & range = Range::all()) const;
 
+    ///
+    /// \brief Checks whether the region property is available
+    ///
+    bool hasRegions() const override;
+
     ///
     /// \brief Checks whether exc_mini_frequency and inh_mini_frequency are available
     /// \return bool whether the two mini frequency properties are available
@@ -191,6 +249,47 @@ public:
     ///
     std::vector<double> getHoldingCurrents(const Range& range = Range::all()) const override;
 
+    // dictionary-encoded infos
+
+    ///
+    /// \brief getCategoricalMorphologies
+    /// \return morphology codes of each neuron, with the @library enumeration as
+    /// dictionary when the attribute is stored as one
+    ///
+    Categorical getCategoricalMorphologies(const Range& range = Range::all()) const override;
+
+    ///
+    /// \brief getCategoricalEtypes
+    /// \return etype codes of each neuron
+    ///
+    Categorical getCategoricalEtypes(const Range& range = Range::all()) const override;
+
+    ///
+    /// \brief getCategoricalMtypes
+    /// \return mtype codes of each neuron
+    ///
+    Categorical getCategoricalMtypes(const Range& range = Range::all()) const override;
+
+    ///
+    /// \brief getCategoricalRegions
+    /// \return region codes of each neuron
+    ///
+    Categorical getCategoricalRegions(const Range& range = Range::all()) const override;
+
+    ///
+    /// \brief getCategoricalSynapseClass
+    /// \return synapse class codes of each neuron
+    ///
+    Categorical getCategoricalSynapseClass(const Range& range = Range::all()) const override;
+
+    ///
+    /// \brief getCategoricalAttribute
+    /// \return the codes of a string attribute. Enumerations are read as codes
+    /// into their @library table, plain string attributes are encoded on the fly
+    ///
+    Categorical getCategoricalAttribute(const std::string& name,
+                                        const Range& range = Range::all()) const;
+
     // index related infos
 
     ///
@@ -286,10 +385,144 @@ public:
     template <typename T>
     std::vector<T> getAttribute(const std::string& name, const Range& range = Range::all()) const;
 
+    ///
+    /// \brief readAttribute
+    /// Reads a numeric attribute straight into caller memory, converted to T
+    /// \param out: receives the value of each cell of the range, `stride` elements apart
+    ///
+    template <typename T>
+    void readAttribute(const std::string& name,
+                       const Range& range,
+                       T* out,
+                       size_t stride = 1) const;
+
+
+    // Selection variants
+    // ==================
+    // Same as the Range getters above, for a sorted set of cells. The ranges
+    // are passed as one multi-range selection to libsonata
+
+    Positions getPositions(const Selection& selection) const override;
+    Rotations getRotations(const Selection& selection) const override;
+    std::vector<std::string> getMorphologies(const Selection& selection) const override;
+    std::vector<std::string> getEtypes(const Selection& selection) const override;
+    std::vector<std::string> getMtypes(const Selection& selection) const override;
+    std::vector<std::string> getEmodels(const Selection& selection) const override;
+    std::vector<std::string> getLayers(const Selection& selection) const;
+    std::vector<std::string> getRegions(const Selection& selection) const override;
+    std::vector<std::string> getSynapseClass(const Selection& selection) const override;
+    std::vector<double> getExcMiniFrequencies(const Selection& selection) const override;
+    std::vector<double> getInhMiniFrequencies(const Selection& selection) const override;
+    std::vector<double> getThresholdCurrents(const Selection& selection) const override;
+    std::vector<double> getHoldingCurrents(const Selection& selection) const override;
+
+    Categorical getCategoricalMorphologies(const Selection& selection) const override;
+    Categorical getCategoricalEtypes(const Selection& selection) const override;
+    Categorical getCategoricalMtypes(const Selection& selection) const override;
+    Categorical getCategoricalRegions(const Selection& selection) const override;
+    Categorical getCategoricalSynapseClass(const Selection& selection) const override;
+    Categorical getCategoricalAttribute(const std::string& name,
+                                        const Selection& selection) const override;
+
+    std::vector<size_t> getIndexEtypes(const Selection& selection) const override;
+    std::vector<size_t> getIndexMtypes(const Selection& selection) const override;
+    std::vector<size_t> getIndexRegions(const Selection& selection) const override;
+    std::vector<size_t> getIndexSynapseClass(const Selection& selection) const override;
+
+    template <typename T>
+    std::vector<T> getAttribute(const std::string& name, const Selection& selection) const;
+
+    ///
+    /// \brief getTypedAttribute
+    /// \return the values of an attribute, or of a dynamics attribute, in
+    /// their stored type. Enumerations are returned as their stored codes
+    /// throw MVDException if there is no such attribute
+    ///
+    TypedColumn getTypedAttribute(const std::string& name,
+                                  const Range& range = Range::all()) const;
+    TypedColumn getTypedAttribute(const std::string& name,
+                                  const Selection& selection) const override;
+
+    ///
+    /// \brief readPositions, readRotations
+    /// Read into caller memory, one row per selected cell, `stride` doubles apart
+    ///
+    using File::readPositions;
+    using File::readRotations;
+    void readPositions(const Selection& selection, double* out, size_t stride = 3) const;
+    void readRotations(const Selection& selection, double* out, size_t stride = 4) const;
+
+    ///
+    /// \brief read several columns for the same cells in one call
+    ///
+    /// The node selection and the attribute listing are computed once and
+    /// shared by all the requested columns
+    ///
+    using File::read;
+    CellBatch read(const Selection& selection,
+                   unsigned columns = CellColumn::All) const override;
+
 private:
+    ///
+    /// \brief getEnumerationLibrary
+    /// \return the @library table of an enumeration attribute, read once and
+    /// shared by all later calls, or nullptr if the attribute is not an enumeration
+    ///
+    std::shared_ptr<const Categorical::Dictionary> getEnumerationLibrary(
+        const std::string& name) const;
+
+    ///
+    /// \brief toSonata
+    /// \return the libsonata selection of the same cells
+    /// throw MVDException if the selection is out of the population bounds
+    ///
+    bbp::sonata::Selection toSonata(const Selection& selection) const;
+
+    ///
+    /// \brief findAttribute, findDynamicsAttribute
+    /// \return the schema column of an attribute, nullptr if there is none
+    ///
+    const Column* findAttribute(const std::string& name) const;
+    const Column* findDynamicsAttribute(const std::string& name) const;
+
+    std::vector<std::string> getStringAttribute(const std::string& name,
+                                                const bbp::sonata::Selection& selection) const;
+
+    ///
+    /// \brief readColumn
+    /// Reads a numeric attribute for the selected cells into `out`, `stride` elements apart,
+    /// directly from the HDF5 dataset
+    ///
+    template <typename T>
+    void readColumn(const std::string& name,
+                    const Selection& selection,
+                    T* out,
+                    size_t stride) const;
+
+    template <typename T>
+    void readDataset(const std::string& path,
+                     const Selection& selection,
+                     T* out,
+                     size_t stride) const;
+
+    void readQuaternionRotations(const Selection& selection, double* out, size_t stride) const;
+    void readAngularRotations(const Selection& selection, double* out, size_t stride) const;
+    Categorical readCategorical(const std::string& name,
+                                const bbp::sonata::Selection& selection) const;
+
     std::unique_ptr<bbp::sonata::NodePopulation> pop_;
     size_t size_;
 
+    // The attributes of the population, read directly when no conversion is needed
+    MVD::utils::TransferProps xfer_props_;
+    HighFive::File h5_file_;
+    std::string attributes_path_;
+    Schema schema_;
+
+    mutable std::mutex libraries_mutex_;
+    mutable std::unordered_map<std::string, std::shared_ptr<const Categorical::Dictionary>>
+        libraries_;
+
 };
 
 }
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <highfive/H5DataSet.hpp>
+#include <highfive/H5File.hpp>
+
+#include "mvd_base.hpp"
+#include "sonata.hpp"
+
+namespace MVD {
+
+
+///
+/// \brief The SonataWriter class
+///
+/// Writes one node population of a Sonata file, column by column. Each call
+/// writes the values of a block of cells into chunked datasets, optionally
+/// compressed, so that a whole circuit never has to be held in memory.
+///
+/// Enumerations are written as codes into an @library table, merged across
+/// the blocks; the tables are written by close(). Columns left unwritten
+/// for some cells keep the HDF5 fill value.
+///
+class SonataWriter {
+public:
+    enum : size_t { DEFAULT_CHUNK_SIZE = 1 << 16 };
+
+    ///
+    /// \brief SonataWriter
+    /// Adds the population `population` of `n_cells` cells to `filename`,
+    /// which is created if it does not exist
+    /// \param compression: deflate level of the datasets, 0 to not compress
+    /// \param chunk_size: cells per HDF5 chunk
+    /// throw MVDException if chunk_size is 0 or compression is over 9,
+    /// HighFive::Exception if the population already exists
+    ///
+    SonataWriter(const std::string& filename,
+                 size_t n_cells,
+                 const std::string& population = "default",
+                 unsigned compression = 0,
+                 size_t chunk_size = DEFAULT_CHUNK_SIZE);
+
+    SonataWriter(const SonataWriter&) = delete;
+    SonataWriter& operator=(const SonataWriter&) = delete;
+
+    ///
+    /// \brief ~SonataWriter
+    /// Closes the writer, errors are ignored: call close() to get them
+    ///
+    ~SonataWriter();
+
+    inline size_t size() const { return n_cells_; }
+    inline size_t chunkSize() const { return chunk_size_; }
+
+    ///
+    /// \brief writeAttribute
+    /// Writes the values of the cells [offset, offset + values.size()) of a
+    /// numeric or string attribute
+    /// throw MVDException if the cells are out of bounds or the writer is closed
+    ///
+    template <typename T>
+    void writeAttribute(const std::string& name,
+                        const std::vector<T>& values,
+                        size_t offset = 0);
+
+    ///
+    /// \brief writeDynamicsAttribute
+    /// Same as writeAttribute, into the dynamics_params group
+    ///
+    template <typename T>
+    void writeDynamicsAttribute(const std::string& name,
+                                const std::vector<T>& values,
+                                size_t offset = 0);
+
+    ///
+    /// \brief writeEnumeration
+    /// Writes the codes of the cells [offset, offset + values.size()), into
+    /// the @library table of `name`. The dictionary of `values` may change
+    /// between calls: codes are remapped to the table
+    ///
+    void writeEnumeration(const std::string& name,
+                          const Categorical& values,
+                          size_t offset = 0);
+
+    ///
+    /// \brief writePositions, writeRotations
+    /// Write the x, y, z and orientation_x, y, z, w attributes of the cells
+    /// [offset, offset + rows)
+    ///
+    void writePositions(const Positions& positions, size_t offset = 0);
+    void writeRotations(const Rotations& rotations, size_t offset = 0);
+
+    ///
+    /// \brief close
+    /// Writes the @library tables and flushes the file. Further writes throw
+    ///
+    void close();
+
+private:
+    // Chunked dataset of n_cells_ rows, created on first use
+    HighFive::DataSet& dataset(const std::string& path, const HighFive::DataType& type);
+
+    template <typename T>
+    void writeRows(const std::string& path, const std::vector<T>& values, size_t offset);
+
+    void writeColumn(const std::string& name,
+                     const boost::multi_array<double, 2>& rows,
+                     size_t column,
+                     size_t offset);
+
+    void checkRows(size_t count, size_t offset) const;
+
+    struct Enumeration {
+        std::vector<std::string> values;
+        std::unordered_map<std::string, Categorical::code_type> index;
+        // last dictionary written, with its codes in `values`
+        std::shared_ptr<const Categorical::Dictionary> dictionary;
+        std::vector<Categorical::code_type> remap;
+    };
+
+    HighFive::File file_;
+    std::string population_path_;
+    std::string attributes_path_;
+    size_t n_cells_;
+    unsigned compression_;
+    size_t chunk_size_;
+    bool closed_ = false;
+    std::unordered_map<std::string, HighFive::DataSet> datasets_;
+    std::map<std::string, Enumeration> enumerations_;
+};
+
+
+///
+/// \brief writeSonata
+/// Copies the cells of `source` into a new population, `chunk_size` cells at
+/// a time: positions, the categorical columns as enumerations, and rotations,
+/// regions, mini frequencies and currents when present
+/// \param range: cells of `source` to copy from
+/// \param stride: copies every stride-th cell of the range
+/// \return the number of cells written
+/// throw MVDException if stride is 0 or the range is out of bounds
+///
+size_t writeSonata(const File& source,
+                   const std::string& filename,
+                   const std::string& population = "default",
+                   const Range& range = Range::all(),
+                   size_t stride = 1,
+                   unsigned compression = 0,
+                   size_t chunk_size = SonataWriter::DEFAULT_CHUNK_SIZE);
+
+
+}  // namespace MVD
+
+#include "bits/sonata_writer_misc.hpp"
@@ -22,11 +22,15 @@
 #define H5_USE_BOOST
 #endif
 
+#include <memory>
+#include <cstdint>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 #include <boost/integer.hpp>
+#include <boost/utility/string_view.hpp>
+
+#include "utils.hpp"
 
 
 namespace MVD3 {
@@ -44,15 +48,17 @@ class TSVFile;  // Fwd decl
 ///
 /// \brief The MEComboEntry class
 ///
-/// Includes all the information of a mecombo entry of the tsv file
+/// Includes all the information of a mecombo entry of the tsv file. The
+/// strings are views of the TSVFile they were read from, valid as long as
+/// the file or one of its copies
 ///
 struct MEComboEntry {
-    std::string morphologyName;
-    std::string layer;
-    std::string fullMType;
-    std::string eType;
-    std::string eModel;
-    std::string comboName;
+    boost::string_view morphologyName;
+    boost::string_view layer;
+    boost::string_view fullMType;
+    boost::string_view eType;
+    boost::string_view eModel;
+    boost::string_view comboName;
     double thresholdCurrent;
     double holdingCurrent;
 
@@ -79,11 +85,125 @@ struct MEComboEntry {
 };
 
 
+namespace ColumnMask {
+///
+/// \brief Columns of a tsv file, combined as a bit mask
+///
+enum ColumnMask : unsigned {
+    None = 0,
+    MorphologyName = 1 << MEComboEntry::MorphologyName,
+    Layer = 1 << MEComboEntry::Layer,
+    FullMType = 1 << MEComboEntry::FullMType,
+    EType = 1 << MEComboEntry::EType,
+    EModel = 1 << MEComboEntry::EModel,
+    ComboName = 1 << MEComboEntry::ComboName,
+    ThresholdCurrent = 1 << MEComboEntry::ThresholdCurrent,
+    HoldingCurrent = 1 << MEComboEntry::HoldingCurrent,
+    All = (1 << 8) - 1
+};
+}
+
+
+///
+/// \brief The MEComboColumns struct
+///
+/// Struct-of-arrays holding several tsv columns for the same neurons.
+/// Columns that were not requested are left empty.
+///
+struct MEComboColumns {
+    std::vector<std::string> morphologyNames;
+    std::vector<std::string> layers;
+    std::vector<std::string> fullMTypes;
+    std::vector<std::string> eTypes;
+    std::vector<std::string> eModels;
+    std::vector<std::string> comboNames;
+    std::vector<double> thresholdCurrents;
+    std::vector<double> holdingCurrents;
+};
+
+
+namespace detail {
+
+///
+/// \brief The EntryIndex class
+///
+/// Open addressing table of the positions of the entries of a TSVFile, by
+/// their key column and morphology. A slot takes 4 bytes where a hash map
+/// allocates a node, holding both keys, for each entry
+///
+class EntryIndex {
+  public:
+    enum : size_t { npos = size_t(-1) };
+
+    ///
+    /// \param column string column the entries are looked up by, with their morphology
+    /// throw TSVException if the column is not a string column
+    ///
+    explicit EntryIndex(MEComboEntry::Column column = MEComboEntry::ComboName);
+
+    ///
+    /// \brief reserve
+    /// Makes room for `n_entries` without growing the table again. The
+    /// indexed entries are stored in `entries`
+    ///
+    void reserve(const std::vector<MEComboEntry>& entries, size_t n_entries);
+
+    ///
+    /// \brief insert
+    /// Adds entries[position], unless an entry with the same keys is indexed
+    /// \return whether the entry was added
+    ///
+    bool insert(const std::vector<MEComboEntry>& entries, size_t position);
+
+    ///
+    /// \brief find
+    /// \return the position in `entries` of the entry with the given keys, or npos
+    ///
+    size_t find(const std::vector<MEComboEntry>& entries,
+                boost::string_view key,
+                boost::string_view morphology) const;
+
+    inline MEComboEntry::Column column() const { return _column; }
+
+    ///
+    /// \brief slots
+    /// The table, empty slots are 0 and the others the entry positions plus one
+    ///
+    inline const std::vector<uint32_t>& slots() const { return _slots; }
+
+    ///
+    /// \brief assign
+    /// Restores a table saved from slots(), for `n_entries` entries
+    /// \return false, leaving the index unchanged, if the table is not valid
+    ///
+    bool assign(const uint32_t* slots, size_t n_slots, size_t n_entries);
+
+    static size_t hash(boost::string_view key, boost::string_view morphology);
+
+  private:
+
+    // Slot of the entry with the given keys, or the empty slot to store it into
+    size_t slot(const std::vector<MEComboEntry>& entries,
+                boost::string_view key,
+                boost::string_view morphology) const;
+
+    MEComboEntry::Column _column;
+    boost::string_view MEComboEntry::*_key;
+    // Entry positions plus one, 0 for empty slots; the size is a power of two
+    std::vector<uint32_t> _slots;
+    size_t _size = 0;
+};
+
+}  // namespace detail
+
+
 ///
 /// \brief The TSVFile class
 ///
 /// Represent a tsv me combo file. Reads the information from the mecombo_emodel.tsv file
-/// and saves them in a vector of MEComboEntry objects.
+/// and saves them in a vector of MEComboEntry objects. The strings of all the
+/// entries are held once in a shared arena, the repeated layers, mtypes,
+/// etypes and emodels are interned.
 ///
 class TSVFile {
   protected:
@@ -93,6 +213,25 @@ class TSVFile {
                             const std::vector<std::string>& morphologies,
                             const MEComboEntry::Column& col_id) const;
 
+    template <typename T>
+    std::vector<T> getField(const std::vector<std::reference_wrapper<const MEComboEntry>>& entries,
+                            const MEComboEntry::Column& col_id) const;
+
+    MEComboColumns getColumns(const std::vector<std::reference_wrapper<const MEComboEntry>>& entries,
+                              unsigned columns) const;
+
+    template <typename T>
+    static inline T getValue(const MEComboEntry& entry, const MEComboEntry::Column& col_id) {
+        return entry.get<T>(col_id);
+    }
+
+    // Sizes the requested columns for `size` entries, then sets those of one entry
+    static void resizeColumns(MEComboColumns& values, size_t size, unsigned columns);
+    static void setColumns(MEComboColumns& values,
+                           size_t position,
+                           const MEComboEntry& entry,
+                           unsigned columns);
+
   public:
     ///
     /// \brief TSVFile
@@ -107,17 +246,50 @@ class TSVFile {
     /// \brief TSVFile
     /// \param filename tsv file name
     ///
-    /// Open and read a tsv file format at 'filename' path
+    /// Open and read a tsv file format at 'filename' path, whose entries are
+    /// looked up by the string column 'column' and their morphology
     /// throw TSVException, or HighFive::Exception in case of error
     ///
     TSVFile(const std::string& filename, const MEComboEntry::Column& column);
 
+    ///
+    /// \brief openCached
+    /// \param filename tsv file name
+    /// \param cache_dir directory of the cache, next to the tsv file if empty
+    ///
+    /// Open a tsv file through its binary cache: a valid cache is memory
+    /// mapped instead of parsing the text. A missing, stale or corrupt cache
+    /// is written again after parsing, when the directory can be written to
+    /// throw TSVException in case of error with the tsv file
+    ///
+    static TSVFile openCached(const std::string& filename,
+                              const std::string& cache_dir = "",
+                              const MEComboEntry::Column& column = MEComboEntry::ComboName);
+
+    ///
+    /// \brief cacheFilename
+    /// \return the cache of 'filename' in 'cache_dir', named after the
+    /// absolute path of the tsv file, or next to the tsv file if 'cache_dir' is empty
+    ///
+    static std::string cacheFilename(const std::string& filename,
+                                     const std::string& cache_dir = "");
+
+    ///
+    /// \brief writeCache
+    /// Saves the parsed file to 'cache_filename': the strings, fixed width
+    /// rows and the index, with the size and modification time of the tsv
+    /// file. The cache is replaced atomically
+    /// throw TSVException if the cache can not be written
+    ///
+    void writeCache(const std::string& cache_filename) const;
+
     using vector_ref = std::vector<std::reference_wrapper<const MEComboEntry>>;
 
     ///
     /// \brief TSVFile
     ///
-    /// Get all the me types defined in the tsv file
+    /// Get all the me types defined in the tsv file, in file order. The first
+    /// of duplicated entries is kept
     ///
     vector_ref getAll() const;
 
@@ -129,11 +301,26 @@ class TSVFile {
     /// Get the info included in the tsv file for the neuron types
     /// with the me_combos and morphology names requested
     /// throw TSVException, if me_combo or morphology don't match
-    /// an entry in tsvFileInfo
+    /// an entry of the file
     ///
     vector_ref get(const std::vector<std::string>& me_combos,
                    const std::vector<std::string>& morphologies) const;
 
+    ///
+    /// \brief getColumns
+    /// \param me_combo me_combo strings of the neurons me types
+    /// \param morphology morphology names of the neurons me types
+    /// \param columns: mask of ColumnMask values
+    ///
+    /// Get several columns of the tsv file for the neuron types with the
+    /// me_combos and morphology names requested, looking each of them up once
+    /// throw TSVException, if me_combo or morphology don't match
+    /// an entry of the file
+    ///
+    MEComboColumns getColumns(const std::vector<std::string>& me_combos,
+                              const std::vector<std::string>& morphologies,
+                              unsigned columns = ColumnMask::All) const;
+
     ///
     /// \brief TSVFile
     /// \param me_combo me_combo strings of the neurons me types
@@ -142,7 +329,7 @@ class TSVFile {
     /// Get the info included in the tsv file for the neuron types
     /// with the me_combos and morphology names requested
     /// throw TSVException, if me_combo or morphology don't match
-    /// an entry in tsvFileInfo
+    /// an entry of the file
     ///
     inline std::vector<std::string> getLayers(const std::vector<std::string>& me_combos,
                                               const std::vector<std::string>& morphologies) const {
@@ -157,7 +344,7 @@ class TSVFile {
     /// Get the info included in the tsv file for the neuron types
     /// with the me_combos and morphology names requested
     /// throw TSVException, if me_combo or morphology don't match
-    /// an entry in tsvFileInfo
+    /// an entry of the file
     ///
     inline std::vector<std::string> getMtypes(const std::vector<std::string>& me_combos,
                                        const std::vector<std::string>& morphologies) const {
@@ -172,7 +359,7 @@ class TSVFile {
     /// Get the info included in the tsv file for the neuron types
     /// with the me_combos and morphology names requested
     /// throw TSVException, if me_combo or morphology don't match
-    /// an entry in tsvFileInfo
+    /// an entry of the file
     ///
     inline std::vector<std::string> getEtypes(const std::vector<std::string>& me_combos,
                                        const std::vector<std::string>& morphologies) const {
@@ -187,7 +374,7 @@ class TSVFile {
     /// Get the info included in the tsv file for the neuron types
     /// with the me_combos and morphology names requested
     /// throw TSVException, if me_combo or morphology don't match
-    /// an entry in tsvFileInfo
+    /// an entry of the file
     ///
     inline std::vector<std::string> getEmodels(const std::vector<std::string>& me_combos,
                                         const std::vector<std::string>& morphologies) const {
@@ -202,7 +389,7 @@ class TSVFile {
     /// Get the info included in the tsv file for the neuron types
     /// with the me_combos and morphology names requested
     /// throw TSVException, if me_combo or morphology don't match
-    /// an entry in tsvFileInfo
+    /// an entry of the file
     ///
     inline std::vector<double> getThresholdCurrents(const std::vector<std::string>& me_combos,
                                              const std::vector<std::string>& morphologies) const {
@@ -217,7 +404,7 @@ class TSVFile {
     /// Get the info included in the tsv file for the neuron types
     /// with the me_combos and morphology names requested
     /// throw TSVException, if me_combo or morphology don't match
-    /// an entry in tsvFileInfo
+    /// an entry of the file
     ///
     inline std::vector<double> getHoldingCurrents(const std::vector<std::string>& me_combos,
                                            const std::vector<std::string>& morphologies) const {
@@ -225,19 +412,18 @@ class TSVFile {
     }
 
 
-    struct pair_hash {
-        template <class T1, class T2>
-        inline std::size_t operator()(const std::pair<T1, T2>& pair) const {
-            return std::hash<T1>()(pair.first) ^ std::hash<T2>()(pair.second);
-        }
-    };
-    using unordered_pair_map =
-        std::unordered_map<std::pair<std::string, std::string>, MEComboEntry, pair_hash>;
+  private:
+    TSVFile() = default;
 
+    // Views the entries and index of a valid cache of the file
+    bool readCache(const std::string& cache_filename);
 
-  private:
     std::string _filename;
-    const unordered_pair_map tsvFileInfo;
+    // Owner of the strings, a StringArena or the mapping of a cache. Shared
+    // with the copies of the file, whose entries view the same strings
+    std::shared_ptr<const void> _strings;
+    std::vector<MEComboEntry> _entries;
+    detail::EntryIndex _index;
 
 };
 
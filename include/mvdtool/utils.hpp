@@ -18,10 +18,34 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
 #include <string>
 #include <unordered_set>
 #include <vector>
 
+#include <fcntl.h>
+#include <locale.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+
+#include <boost/functional/hash.hpp>
+#include <boost/multi_array.hpp>
+#include <boost/utility/string_view.hpp>
+
+#include "mvd_except.hpp"
+
 namespace MVD {
 namespace utils {
 
@@ -36,5 +60,440 @@ inline void vector_remove_dups(std::vector<T>& vec) {
     vec.resize(pos);
 }
 
+// boost::multi_array assignment requires matching shapes: resize the destination first
+template <typename T, std::size_t N>
+inline void multi_array_assign(boost::multi_array<T, N>& dst, const boost::multi_array<T, N>& src) {
+    const std::vector<std::size_t> extents(src.shape(), src.shape() + N);
+    dst.resize(extents);
+    dst = src;
+}
+
+// Copies the rows of `src` to `out`, `stride` elements apart
+template <typename T>
+inline void copy_rows(const boost::multi_array<T, 2>& src, T* out, std::size_t stride) {
+    const std::size_t width = src.shape()[1];
+    if (stride < width) {
+        throw MVDException("Invalid stride " + std::to_string(stride) + " for rows of "
+                           + std::to_string(width) + " values");
+    }
+    for (std::size_t i = 0; i < src.shape()[0]; ++i, out += stride) {
+        std::copy(src[i].begin(), src[i].end(), out);
+    }
+}
+
+
+///
+/// \brief The MappedFile class
+///
+/// Read-only memory mapping of a whole file, for parsers making a single
+/// pass over its text
+///
+class MappedFile {
+public:
+    ///
+    /// \brief MappedFile
+    /// throw MVDException if the file can not be opened or mapped
+    ///
+    inline explicit MappedFile(const std::string& filename) {
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw MVDException("Could not open file " + filename + ": " + std::strerror(errno));
+        }
+        struct stat info;
+        if (::fstat(fd, &info) < 0) {
+            const int error = errno;
+            ::close(fd);
+            throw MVDException("Could not stat file " + filename + ": " + std::strerror(error));
+        }
+        _size = static_cast<std::size_t>(info.st_size);
+        // Empty files can not be mapped
+        if (_size > 0) {
+            void* data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                const int error = errno;
+                ::close(fd);
+                throw MVDException("Could not map file " + filename + ": " + std::strerror(error));
+            }
+            ::madvise(data, _size, MADV_SEQUENTIAL);
+            _data = static_cast<const char*>(data);
+        }
+        ::close(fd);
+    }
+
+    inline ~MappedFile() {
+        if (_data != nullptr) {
+            ::munmap(const_cast<char*>(_data), _size);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    inline const char* begin() const { return _data; }
+    inline const char* end() const { return _data + _size; }
+    inline std::size_t size() const { return _size; }
+
+private:
+    const char* _data = nullptr;
+    std::size_t _size = 0;
+};
+
+
+///
+/// \brief The FileStamp struct
+/// Size and modification time of a file, which a cache derived from its
+/// contents is checked against
+///
+struct FileStamp {
+    std::uint64_t size;
+    std::int64_t mtime;
+    std::int64_t mtime_nsec;
+};
+
+inline bool operator==(const FileStamp& a, const FileStamp& b) {
+    return a.size == b.size && a.mtime == b.mtime && a.mtime_nsec == b.mtime_nsec;
+}
+
+///
+/// \brief file_stamp
+/// \return false if `filename` can not be stat-ed
+///
+inline bool file_stamp(const std::string& filename, FileStamp& stamp) {
+    struct stat info;
+    if (::stat(filename.c_str(), &info) != 0) {
+        return false;
+    }
+    stamp.size = static_cast<std::uint64_t>(info.st_size);
+    stamp.mtime = static_cast<std::int64_t>(info.st_mtime);
+#ifdef __APPLE__
+    stamp.mtime_nsec = static_cast<std::int64_t>(info.st_mtimespec.tv_nsec);
+#else
+    stamp.mtime_nsec = static_cast<std::int64_t>(info.st_mtim.tv_nsec);
+#endif
+    return true;
+}
+
+///
+/// \brief absolute_path
+/// \return the canonical path of `filename`, unchanged if it does not exist
+///
+inline std::string absolute_path(const std::string& filename) {
+    std::unique_ptr<char, decltype(&std::free)> path(::realpath(filename.c_str(), nullptr),
+                                                     &std::free);
+    return path ? std::string(path.get()) : filename;
+}
+
+///
+/// \brief checksum
+/// FNV-1a over 8 byte words, to detect corrupt caches
+///
+inline std::uint64_t checksum(const char* data, std::size_t size) {
+    std::uint64_t hash = 14695981039346656037ULL;
+    std::size_t i = 0;
+    for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ std::uint8_t(data[i])) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+///
+/// \brief replace_file
+/// Writes `parts` aside and renames them to `filename`: concurrent readers
+/// map either the old or the new file
+/// throw MVDException if the file can not be written
+///
+inline void replace_file(const std::string& filename,
+                         const std::vector<boost::string_view>& parts) {
+    const std::string tmp_filename = filename + ".tmp" + std::to_string(::getpid());
+    {
+        std::ofstream out(tmp_filename, std::ios::binary | std::ios::trunc);
+        for (const auto& part: parts) {
+            out.write(part.data(), static_cast<std::streamsize>(part.size()));
+        }
+        out.close();
+        if (!out) {
+            std::remove(tmp_filename.c_str());
+            throw MVDException("Could not write " + filename);
+        }
+    }
+    if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        const int error = errno;
+        std::remove(tmp_filename.c_str());
+        throw MVDException("Could not write " + filename + ": " + std::strerror(error));
+    }
+}
+
+
+///
+/// \brief next_line
+/// \return the line starting at `it`, without its newline, like std::getline.
+/// `it` is moved to the start of the next line
+///
+inline boost::string_view next_line(const char*& it, const char* end) {
+    const char* first = it;
+    const char* newline = static_cast<const char*>(std::memchr(it, '\n', std::size_t(end - it)));
+    if (newline == nullptr) {
+        it = end;
+        return boost::string_view(first, std::size_t(end - first));
+    }
+    it = newline + 1;
+    return boost::string_view(first, std::size_t(newline - first));
+}
+
+
+///
+/// \brief c_locale
+/// \return the "C" locale, to parse numbers whatever LC_NUMERIC is set to
+///
+inline locale_t c_locale() {
+    static const locale_t locale = newlocale(LC_ALL_MASK, "C", static_cast<locale_t>(0));
+    if (locale == static_cast<locale_t>(0)) {
+        throw MVDException("Could not create the C locale");
+    }
+    return locale;
+}
+
+
+namespace detail {
+
+// Largest decimal mantissas and powers of ten that are exact in each type:
+// a single operation on them rounds correctly
+template <typename T>
+struct exact_decimal;
+
+template <>
+struct exact_decimal<double> {
+    static constexpr int max_digits = 15;
+    static constexpr int max_exponent = 22;
+};
+
+template <>
+struct exact_decimal<float> {
+    static constexpr int max_digits = 7;
+    static constexpr int max_exponent = 10;
+};
+
+inline double strto_c(const char* str, char** end, double) {
+    return strtod_l(str, end, c_locale());
+}
+
+inline float strto_c(const char* str, char** end, float) {
+    return strtof_l(str, end, c_locale());
+}
+
+template <typename T>
+inline const char* scan_number(const char* first, const char* last, T& value) {
+    static const double powers_of_ten[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                           1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                           1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+
+    const char* p = first;
+    while (p != last && (*p == ' ' || (*p >= '\t' && *p <= '\r'))) {
+        ++p;
+    }
+    const bool negative = (p != last && *p == '-');
+    if (p != last && (*p == '-' || *p == '+')) {
+        ++p;
+    }
+
+    std::uint64_t mantissa = 0;
+    int n_digits = 0;
+    int exponent = 0;
+    for (; p != last && is_digit(*p); ++p, ++n_digits) {
+        mantissa = mantissa * 10 + std::uint64_t(*p - '0');
+    }
+    bool inline_parse = !(p != last && (*p == 'x' || *p == 'X'));
+    if (p != last && *p == '.') {
+        for (++p; p != last && is_digit(*p); ++p, ++n_digits, --exponent) {
+            mantissa = mantissa * 10 + std::uint64_t(*p - '0');
+        }
+    }
+    inline_parse = inline_parse && n_digits > 0 && n_digits <= exact_decimal<T>::max_digits;
+    if (inline_parse && p != last && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        const bool negative_exponent = (q != last && *q == '-');
+        if (q != last && (*q == '-' || *q == '+')) {
+            ++q;
+        }
+        int e = 0;
+        const char* exponent_digits = q;
+        for (; q != last && is_digit(*q) && e < 1000; ++q) {
+            e = e * 10 + (*q - '0');
+        }
+        // An incomplete exponent is left out of the number
+        if (q != exponent_digits) {
+            exponent += negative_exponent ? -e : e;
+            p = q;
+        }
+        inline_parse = !(q != last && is_digit(*q));
+    }
+
+    const int max_exponent = exact_decimal<T>::max_exponent;
+    if (inline_parse && exponent >= -max_exponent && exponent <= max_exponent) {
+        const T digits = T(mantissa);
+        const T power = T(powers_of_ten[exponent < 0 ? -exponent : exponent]);
+        const T magnitude = (exponent < 0) ? digits / power : digits * power;
+        value = negative ? -magnitude : magnitude;
+        return p;
+    }
+
+    const std::string text(first, last);
+    char* end = nullptr;
+    errno = 0;
+    value = strto_c(text.c_str(), &end, T());
+    if (end == text.c_str() || errno == ERANGE) {
+        return nullptr;
+    }
+    return first + (end - text.c_str());
+}
+
+}  // namespace detail
+
+
+///
+/// \brief scan_double
+/// Parses the number at the start of [first, last) as std::strtod does in the
+/// "C" locale, whatever the current one: leading spaces are skipped. Plain
+/// decimal numbers that are exactly representable are parsed inline, anything
+/// else (long mantissas, large exponents, hexadecimal, inf, nan) by strtod_l
+/// \return the end of the number, nullptr if no number could be parsed or
+/// it is out of range
+///
+inline const char* scan_double(const char* first, const char* last, double& value) {
+    return detail::scan_number(first, last, value);
+}
+
+
+///
+/// \brief scan_float
+/// Same as scan_double, but rounds the number once, straight to single
+/// precision, as std::strtof does
+///
+inline const char* scan_float(const char* first, const char* last, float& value) {
+    return detail::scan_number(first, last, value);
+}
+
+
+///
+/// \brief parse_double
+/// Parses the number at the start of [first, last) as std::stod does:
+/// leading spaces are skipped and trailing characters ignored
+/// \return false if no number could be parsed or it is out of range
+///
+inline bool parse_double(const char* first, const char* last, double& value) {
+    return scan_double(first, last, value) != nullptr;
+}
+
+
+///
+/// \brief scan_int
+/// Parses the decimal integer at the start of [first, last), with an
+/// optional sign, after skipping leading spaces
+/// \return the end of the integer, nullptr if there are no digits or it
+/// does not fit in an int
+///
+inline const char* scan_int(const char* first, const char* last, int& value) {
+    const char* p = first;
+    while (p != last && (*p == ' ' || (*p >= '\t' && *p <= '\r'))) {
+        ++p;
+    }
+    const bool negative = (p != last && *p == '-');
+    if (p != last && (*p == '-' || *p == '+')) {
+        ++p;
+    }
+    const char* const digits = p;
+    std::int64_t magnitude = 0;
+    for (; p != last && *p >= '0' && *p <= '9'; ++p) {
+        magnitude = magnitude * 10 + (*p - '0');
+        if (magnitude > std::int64_t(INT_MAX) + 1) {
+            return nullptr;
+        }
+    }
+    if (p == digits || (!negative && magnitude > INT_MAX)) {
+        return nullptr;
+    }
+    value = static_cast<int>(negative ? -magnitude : magnitude);
+    return p;
+}
+
+
+///
+/// \brief The StringArena class
+///
+/// Owns strings in large blocks of characters rather than one allocation
+/// each. Views returned by the arena stay valid for its lifetime
+///
+class StringArena {
+public:
+    enum : std::size_t { BLOCK_SIZE = 1 << 16 };
+
+    StringArena() = default;
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    ///
+    /// \brief store
+    /// \return a copy of `value` owned by the arena
+    ///
+    inline boost::string_view store(boost::string_view value) {
+        if (value.empty()) {
+            return boost::string_view();
+        }
+        if (value.size() > _left) {
+            // Strings larger than a block get a block of their own, so that
+            // the current block is not wasted
+            const std::size_t size = std::max<std::size_t>(value.size(), BLOCK_SIZE);
+            _blocks.emplace_back(new char[size]);
+            _capacity += size;
+            if (size > BLOCK_SIZE) {
+                std::memcpy(_blocks.back().get(), value.data(), value.size());
+                _size += value.size();
+                return boost::string_view(_blocks.back().get(), value.size());
+            }
+            _head = _blocks.back().get();
+            _left = size;
+        }
+        char* data = _head;
+        std::memcpy(data, value.data(), value.size());
+        _head += value.size();
+        _left -= value.size();
+        _size += value.size();
+        return boost::string_view(data, value.size());
+    }
+
+    ///
+    /// \brief intern
+    /// \return the copy of `value` owned by the arena, stored once for all the
+    /// calls with the same value
+    ///
+    inline boost::string_view intern(boost::string_view value) {
+        const auto it = _interned.find(value);
+        if (it != _interned.end()) {
+            return *it;
+        }
+        return *_interned.insert(store(value)).first;
+    }
+
+    /// \return the number of characters stored
+    inline std::size_t size() const { return _size; }
+
+    /// \return the number of characters allocated
+    inline std::size_t capacity() const { return _capacity; }
+
+private:
+    std::vector<std::unique_ptr<char[]>> _blocks;
+    char* _head = nullptr;
+    std::size_t _left = 0;
+    std::size_t _size = 0;
+    std::size_t _capacity = 0;
+    std::unordered_set<boost::string_view, boost::hash<boost::string_view>> _interned;
+};
+
 }  // namespace utils
 }  // namespace MVD
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <functional>
+
 #include <mvdtool/mvd_generic.hpp>
 #include <pybind11/pybind11.h>
 #include <pybind11/numpy.h>
@@ -109,41 +112,116 @@ template <typename T>
 using pyarray = py::array_t<T, py::array::c_style | py::array::forcecast>;
 
 
-/// Generic routine to copy data item
-template <typename T>
-inline void copy_element(T& dst, const T& src) {
-    dst = src;
+/**
+ * Cells at the given indices, in any order and possibly repeated. The backends
+ * read the unique sorted indices in one go, and the results are expanded back
+ * to the order and multiplicity of the request
+ */
+class IndexSelection {
+public:
+    inline explicit IndexSelection(const pyarray<size_t>& idx)
+        : _requested(idx.data(), idx.data() + idx.size())
+        , _in_order(std::adjacent_find(_requested.begin(), _requested.end(),
+                                       std::greater_equal<size_t>()) == _requested.end()) {
+        if (_in_order) {
+            _selection = Selection::fromIndices(_requested);
+            return;
+        }
+        std::vector<size_t> unique(_requested);
+        std::sort(unique.begin(), unique.end());
+        unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+        _selection = Selection::fromIndices(unique);
+        for (auto& index: _requested) {
+            index = static_cast<size_t>(std::lower_bound(unique.begin(), unique.end(), index) -
+                                        unique.begin());
+        }
+    }
+
+    inline const Selection& selection() const { return _selection; }
+
+    template <typename T>
+    inline std::vector<T> expand(std::vector<T> values) const {
+        if (_in_order) {
+            return values;
+        }
+        std::vector<T> out;
+        out.reserve(_requested.size());
+        for (const auto row: _requested) {
+            out.push_back(values[row]);
+        }
+        return out;
+    }
+
+    /// Rows of a Positions or Rotations block, as a (n, width) numpy array
+    inline py::array expandRows(const boost::multi_array<double, 2>& values,
+                                size_t width) const {
+        if (_in_order) {
+            return py::array({values.shape()[0], width}, values.data());
+        }
+        std::vector<double> out;
+        out.reserve(_requested.size() * width);
+        for (const auto row: _requested) {
+            out.insert(out.end(), values[row].begin(), values[row].end());
+        }
+        return py::array({_requested.size(), width}, out.data());
+    }
+
+private:
+    // The requested indices, then their rows among the unique ones when not in order
+    std::vector<size_t> _requested;
+    bool _in_order;
+    Selection _selection;
+};
+
+
+/**
+ * Values of a column at the given indices, in the order of the request
+ */
+struct ExpandColumn : boost::static_visitor<TypedColumn> {
+    explicit ExpandColumn(const IndexSelection& indices)
+        : _indices(indices) {}
+
+    template <typename T>
+    TypedColumn operator()(std::vector<T>& values) const {
+        return TypedColumn(_indices.expand(std::move(values)));
+    }
+
+    const IndexSelection& _indices;
+};
+
+
+/**
+ * Hands the values of a column over to numpy, in their stored dtype and
+ * without copy. Strings become an array of Python objects
+ */
+struct TypedArray : boost::static_visitor<py::array> {
+    template <typename T>
+    py::array operator()(std::vector<T>& values) const {
+        auto owned = new std::vector<T>(std::move(values));
+        py::capsule release(owned, [](void* p) { delete static_cast<std::vector<T>*>(p); });
+        return py::array_t<T>(owned->size(), owned->data(), release);
+    }
+
+    py::array operator()(std::vector<std::string>& values) const {
+        return py::array(py::cast(values));
+    }
+};
+
+inline py::array _typed_array(TypedColumn column) {
+    return boost::apply_visitor(TypedArray(), column.values());
 }
 
-/// Copy routine for boost multi_array view to std::array
-template <typename T, size_t Width, typename T2, typename = decltype(&T2::origin)>
-inline void copy_element(std::array<T, Width>& dst, const T2& src) {
-    std::memcpy(dst.data(), src.origin(), sizeof(T) * Width);
+inline py::array _typed_array(TypedColumn column, const IndexSelection& indices) {
+    return _typed_array(boost::apply_visitor(ExpandColumn(indices), column.values()));
 }
 
+
 /**
- * Extract several elements given their indices from a function accepting a range
- * NOTE: Indexes must be in ascending order
+ * Getter of a string field of the tsv entries, viewed in the strings of their file
  */
-template <typename T, typename FuncT>
-inline std::vector<T>_atIndices(const FuncT& f,
-                                const size_t n_records,
-                                const pyarray<size_t>& idx) {
-    constexpr size_t CHUNK_SIZE = 128u;  // 1KB of doubles, more for strings
-    const auto indices = idx.template unchecked<1>();
-    const auto count = static_cast<size_t>(indices.size());
-    std::vector<T> out_v(count);
-
-    for (size_t i=0; i < count;) {
-        const size_t offset = indices[i];
-        const auto limit = std::min(CHUNK_SIZE, n_records - offset);
-        const auto& chunk = f(Range(offset, limit));
-        const auto high_i = offset + limit;
-        for(size_t elem_i=offset; i < count && (elem_i=indices[i]) < high_i; ++i) {
-            copy_element(out_v[i], chunk[elem_i - offset]);
-        }
-    }
-    return out_v;
+inline std::function<std::string(const MEComboEntry&)>
+_entry_string(boost::string_view MEComboEntry::* field) {
+    return [field](const MEComboEntry& entry) { return (entry.*field).to_string(); };
 }
 
 } // namespace (unnamed)
@@ -181,10 +259,8 @@ PYBIND11_MODULE(mvdtool, mvd) {
                 return py::array({res.shape()[0], POSITION_WIDTH}, res.data());
              })
         .def("positions", [](const File& f, const pyarray<size_t>& idx) {
-                using position_t = std::array<typename Positions::element, POSITION_WIDTH>;
-                const auto& func = [&f](const MVD::Range& r){return f.getPositions(r);};
-                const auto res = _atIndices<position_t>(func, f.size(), idx);
-                return py::array({res.size(), POSITION_WIDTH}, res.empty()? nullptr: res.front().data());
+                const IndexSelection indices(idx);
+                return indices.expandRows(f.getPositions(indices.selection()), POSITION_WIDTH);
              })
         .def("rotations", [](const File& f) {
                 auto res = f.getRotations(Range::all());
@@ -201,10 +277,8 @@ PYBIND11_MODULE(mvdtool, mvd) {
                 return py::array({res.shape()[0], ROTATION_WIDTH}, res.data());
              })
         .def("rotations", [](const File& f, const pyarray<size_t>& idx) {
-                using rotation_t = std::array<typename Rotations::element, ROTATION_WIDTH>;
-                const auto& func = [&f](const MVD::Range& r){return f.getRotations(r);};
-                const auto res = _atIndices<rotation_t>(func, f.size(), idx);
-                return py::array({res.size(), ROTATION_WIDTH}, res.empty()? nullptr: res.front().data());
+                const IndexSelection indices(idx);
+                return indices.expandRows(f.getRotations(indices.selection()), ROTATION_WIDTH);
              })
         .def("etypes", [](const File& f) {
                 return f.getEtypes(Range::all());
@@ -218,8 +292,8 @@ PYBIND11_MODULE(mvdtool, mvd) {
                 return f.getEtypes(r);
              })
         .def("etypes", [](const File& f, const pyarray<size_t>& idx) {
-                const auto& func = [&f](const MVD::Range& r){return f.getEtypes(r);};
-                return _atIndices<std::string>(func, f.size(), idx);
+                const IndexSelection indices(idx);
+                return indices.expand(f.getEtypes(indices.selection()));
              })
         .def("mtypes", [](const File& f) {
                 return f.getMtypes(Range::all());
@@ -233,8 +307,8 @@ PYBIND11_MODULE(mvdtool, mvd) {
                 return f.getMtypes(r);
              })
         .def("mtypes", [](const File& f, const pyarray<size_t>& idx) {
-                const auto& func = [&f](const MVD::Range& r){return f.getMtypes(r);};
-                return _atIndices<std::string>(func, f.size(), idx);
+                const IndexSelection indices(idx);
+                return indices.expand(f.getMtypes(indices.selection()));
              })
         .def("emodels", [](const File& f) {
                 return f.getEmodels(Range::all());
@@ -248,8 +322,8 @@ PYBIND11_MODULE(mvdtool, mvd) {
                 return f.getEmodels(r);
              })
         .def("emodels", [](const File& f, const pyarray<size_t>& idx) {
-                const auto& func = [&f](const MVD::Range& r){return f.getEmodels(r);};
-                return _atIndices<std::string>(func, f.size(), idx);
+                const IndexSelection indices(idx);
+                return indices.expand(f.getEmodels(indices.selection()));
              })
         .def("threshold_currents", [](const File& f) {
                 auto res = f.getThresholdCurrents(Range::all());
@@ -265,8 +339,8 @@ PYBIND11_MODULE(mvdtool, mvd) {
                 return py::array(res.size(), res.data());
              })
         .def("threshold_currents", [](const File& f, const pyarray<size_t>& idx) {
-                const auto& func = [&f](const MVD::Range& r){return f.getThresholdCurrents(r);};
-                auto values = _atIndices<double>(func, f.size(), idx);
+                const IndexSelection indices(idx);
+                const auto values = indices.expand(f.getThresholdCurrents(indices.selection()));
                 return py::array(values.size(), values.data());
              })
         .def("holding_currents", [](const File& f) {
@@ -283,8 +357,8 @@ PYBIND11_MODULE(mvdtool, mvd) {
                 return py::array(res.size(), res.data());
              })
         .def("holding_currents", [](const File& f, const pyarray<size_t>& idx) {
-                const auto& func = [&f](const MVD::Range& r){return f.getHoldingCurrents(r);};
-                auto values = _atIndices<double>(func, f.size(), idx);
+                const IndexSelection indices(idx);
+                const auto values = indices.expand(f.getHoldingCurrents(indices.selection()));
                 return py::array(values.size(), values.data());
              })
         .def("morphologies", [](const File& f) {
@@ -299,8 +373,8 @@ PYBIND11_MODULE(mvdtool, mvd) {
                 return f.getMorphologies(r);
              })
         .def("morphologies", [](const File& f, const pyarray<size_t>& idx) {
-                const auto& func = [&f](const MVD::Range& r){return f.getMorphologies(r);};
-                return _atIndices<std::string>(func, f.size(), idx);
+                const IndexSelection indices(idx);
+                return indices.expand(f.getMorphologies(indices.selection()));
              })
         .def("synapse_classes", [](const File& f) {
                 return f.getSynapseClass(Range::all());
@@ -314,8 +388,8 @@ PYBIND11_MODULE(mvdtool, mvd) {
                 return f.getSynapseClass(r);
              })
         .def("synapse_classes", [](const File& f, const pyarray<size_t>& idx) {
-                const auto& func = [&f](const MVD::Range& r){return f.getSynapseClass(r);};
-                return _atIndices<std::string>(func, f.size(), idx);
+                const IndexSelection indices(idx);
+                return indices.expand(f.getSynapseClass(indices.selection()));
              })
         .def("exc_mini_frequencies", [](const File& f) {
                 auto res = f.getExcMiniFrequencies(Range::all());
@@ -331,8 +405,8 @@ PYBIND11_MODULE(mvdtool, mvd) {
                 return py::array(res.size(), res.data());
              })
         .def("exc_mini_frequencies", [](const File& f, const pyarray<size_t>& idx) {
-                const auto& func = [&f](const MVD::Range& r){return f.getExcMiniFrequencies(r);};
-                auto values = _atIndices<double>(func, f.size(), idx);
+                const IndexSelection indices(idx);
+                const auto values = indices.expand(f.getExcMiniFrequencies(indices.selection()));
                 return py::array(values.size(), values.data());
              })
         .def("inh_mini_frequencies", [](const File& f) {
@@ -349,8 +423,8 @@ PYBIND11_MODULE(mvdtool, mvd) {
                 return py::array(res.size(), res.data());
              })
         .def("inh_mini_frequencies", [](const File& f, const pyarray<size_t>& idx) {
-                const auto& func = [&f](const MVD::Range& r){return f.getInhMiniFrequencies(r);};
-                auto values = _atIndices<double>(func, f.size(), idx);
+                const IndexSelection indices(idx);
+                const auto values = indices.expand(f.getInhMiniFrequencies(indices.selection()));
                 return py::array(values.size(), values.data());
              })
         .def("regions", [](const File& f) {
@@ -367,8 +441,8 @@ PYBIND11_MODULE(mvdtool, mvd) {
              "offset"_a = 0,
              "count"_a = 0)
         .def("regions", [](const File& f, const pyarray<size_t>& idx) {
-                const auto& func = [&f](const MVD::Range& r){return f.getRegions(r);};
-                return _atIndices<std::string>(func, f.size(), idx);
+                const IndexSelection indices(idx);
+                return indices.expand(f.getRegions(indices.selection()));
              })
         .def("raw_etypes", [](const File& f) {
                 auto res = f.getIndexEtypes(Range::all());
@@ -422,6 +496,7 @@ PYBIND11_MODULE(mvdtool, mvd) {
                 auto res = f.getIndexRegions(r);
                 return py::array(res.size(), res.data());
              })
+        .def("hasRegions", &File::hasRegions)
         .def("hasMiniFrequencies", &File::hasMiniFrequencies)
         .def("hasCurrents", &File::hasCurrents)
         .def_property_readonly("rotated", &File::hasRotations)
@@ -434,6 +509,15 @@ PYBIND11_MODULE(mvdtool, mvd) {
 
     py::class_<MVD3File, std::shared_ptr<MVD3File>>(mvd3, "File", file)
         .def(py::init<const std::string&>())
+        .def("open_combo_tsv", [](MVD3File& f, const std::string& filename) {
+                f.openComboTsv(filename);
+             })
+        .def("open_combo_tsv", [](MVD3File& f, const std::string& filename,
+                                  const std::string& cache_dir) {
+                f.openComboTsv(filename, cache_dir);
+             }, "filename"_a, "cache_dir"_a)
+        .def_property("tsv_workers", &MVD3File::getTSVWorkers, &MVD3File::setTSVWorkers,
+                      "Threads joining the cells with their TSV entries, 0 for all")
         .def("raw_morphologies", [](const MVD3File& f) {
                 auto res = f.getIndexMorphologies(Range::all());
                 return py::array(res.size(), res.data());
@@ -459,8 +543,8 @@ PYBIND11_MODULE(mvdtool, mvd) {
                 return f.getMECombos(r);
              })
         .def("me_combos", [](const MVD3File& f, const pyarray<size_t>& idx) {
-                const auto& func = [&f](const MVD::Range& r){return f.getMECombos(r);};
-                return _atIndices<std::string>(func, f.size(), idx);
+                const IndexSelection indices(idx);
+                return indices.expand(f.getMECombos(indices.selection()));
              })
         .def("layers", [](const MVD3File& f) {
                 return f.getLayers(Range::all());
@@ -474,8 +558,18 @@ PYBIND11_MODULE(mvdtool, mvd) {
                 return f.getLayers(r);
              })
         .def("layers", [](const MVD3File& f, const pyarray<size_t>& idx) {
-                const auto& func = [&f](const MVD::Range& r){return f.getLayers(r);};
-                return _atIndices<std::string>(func, f.size(), idx);
+                const IndexSelection indices(idx);
+                return indices.expand(f.getLayers(indices.selection()));
+             })
+        .def("getAttribute", [](const MVD3File& f, const std::string& name) {
+                return _typed_array(f.getTypedAttribute(name));
+             })
+        .def("getAttribute", [](const MVD3File& f, const std::string& name, int offset, int count){
+                return _typed_array(f.getTypedAttribute(name, Range(offset, count)));
+             })
+        .def("getAttribute", [](const MVD3File& f, const std::string& name, const pyarray<size_t>& idx) {
+                const IndexSelection indices(idx);
+                return _typed_array(f.getTypedAttribute(name, indices.selection()), indices);
              })
         .def_property_readonly("all_morphologies", &MVD3File::listAllMorphologies)
         ;
@@ -494,68 +588,80 @@ PYBIND11_MODULE(mvdtool, mvd) {
                 return f.getLayers(r);
              })
         .def("layers", [](const SonataFile& f, const pyarray<size_t>& idx) {
-                const auto& func = [&f](const MVD::Range& r){return f.getLayers(r);};
-                return _atIndices<std::string>(func, f.size(), idx);
+                const IndexSelection indices(idx);
+                return indices.expand(f.getLayers(indices.selection()));
              })
         .def_property_readonly("all_layers", &SonataFile::listAllLayers)
         .def("hasAttribute", [](const SonataFile& f, const std::string& name){
                 return f.hasAttribute(name) || f.hasDynamicsAttribute(name);
              })
         .def("getAttribute", [](const SonataFile& f, const std::string& name) {
-                const std::string dtype = f.getAttributeDataType(name);
-                if (dtype == "double" || dtype == "float") {
-                    auto res = f.getAttribute<double>(name);
-                    return py::array(res.size(), res.data());
-                } else if (dtype == "string") {
-                    auto res = f.getAttribute<std::string>(name);
-                    return py::array(py::cast(res));
-                } else {
-                    auto res = f.getAttribute<size_t>(name);
-                    return py::array(res.size(), res.data());
-                }
+                return _typed_array(f.getTypedAttribute(name));
              })
         .def("getAttribute", [](const SonataFile& f, const std::string& name, int offset, int count){
-                const std::string dtype = f.getAttributeDataType(name);
-                Range r(offset, count);
-                if (dtype == "string") {
-                    auto res = f.getAttribute<std::string>(name, r);
-                    return py::array(py::cast(res));
-                } else if (dtype == "double" || dtype == "float") {
-                    auto res = f.getAttribute<double>(name, r);
-                    return py::array(res.size(), res.data());
-                } else {
-                    auto res = f.getAttribute<int>(name, r);
-                    return py::array(res.size(), res.data());
-                }
+                return _typed_array(f.getTypedAttribute(name, Range(offset, count)));
              })
         .def("getAttribute", [](const SonataFile& f, const std::string& name, const pyarray<size_t>& idx) {
-                const std::string dtype = f.getAttributeDataType(name);
-                if (dtype == "string") {
-                    const auto& func = [&f, &name](const MVD::Range& r) {return f.getAttribute<std::string>(name, r);};
-                    auto res = _atIndices<std::string>(func, f.size(), idx);
-                    return py::array(py::cast(res));
-                } else if (dtype == "double" || dtype == "float") {
-                    const auto& func = [&f, &name](const MVD::Range& r) {return f.getAttribute<double>(name, r);};
-                    auto res = _atIndices<double>(func, f.size(), idx);
-                    return py::array(res.size(), res.data());
-                } else {
-                    const auto& func = [&f, &name](const MVD::Range& r) {return f.getAttribute<size_t>(name, r);};
-                    auto res = _atIndices<size_t>(func, f.size(), idx);
-                    return py::array(res.size(), res.data());
-                }
+                const IndexSelection indices(idx);
+                return _typed_array(f.getTypedAttribute(name, indices.selection()), indices);
+             })
+        ;
+
+    sonata.def("write",
+               [](const File& source, const std::string& filename, const std::string& population,
+                  size_t offset, size_t count, size_t stride, unsigned compression) {
+                   return writeSonata(source, filename, population, Range(offset, count),
+                                      stride, compression);
+               },
+               "source"_a, "filename"_a, "population"_a = "default", "offset"_a = 0,
+               "count"_a = 0, "stride"_a = 1, "compression"_a = 0);
+
+    py::class_<MultiPopulationFile, std::shared_ptr<MultiPopulationFile>>(
+        sonata, "MultiPopulationFile", file)
+        .def(py::init<const std::string&>())
+        .def(py::init<const std::vector<std::string>&>())
+        .def_property_readonly("populations", &MultiPopulationFile::getPopulationNames)
+        .def_property_readonly("offsets", [](const MultiPopulationFile& f) {
+                const auto& offsets = f.getPopulationOffsets();
+                return py::array(offsets.size(), offsets.data());
              })
+        .def("locate", &MultiPopulationFile::locate, "cell"_a)
         ;
+
+    py::class_<Query>(mvd, "Query")
+        .def(py::init<size_t>(), "chunk_size"_a = size_t(Query::DEFAULT_CHUNK_SIZE))
+        .def("isin", [](Query& q, const std::string& column, std::vector<std::string> values)
+                -> Query& { return q.in(column, std::move(values)); },
+             "column"_a, "values"_a, py::return_value_policy::reference_internal)
+        .def("equals", [](Query& q, const std::string& column, const std::string& value)
+                -> Query& { return q.equals(column, value); },
+             "column"_a, "value"_a, py::return_value_policy::reference_internal)
+        .def("equals", [](Query& q, const std::string& column, double value)
+                -> Query& { return q.equals(column, value); },
+             "column"_a, "value"_a, py::return_value_policy::reference_internal)
+        .def("between", &Query::between,
+             "column"_a, "min"_a, "max"_a, py::return_value_policy::reference_internal)
+        .def("select", [](const Query& q, const File& f) {
+                const auto res = q.select(f).flatten();
+                return py::array(res.size(), res.data());
+             })
+        .def("select", [](const Query& q, const File& f, const pyarray<size_t>& idx) {
+                const auto res = q.select(f, IndexSelection(idx).selection()).flatten();
+                return py::array(res.size(), res.data());
+             })
+        ;
+
     py::class_<TSVFile, std::shared_ptr<TSVFile>>(tsv, "File", file)
         .def(py::init<const std::string&>())
         ;
     py::class_<MEComboEntry>(tsv, "MEComboEntry")
         .def(py::init<>())
-        .def_readonly("morphologyName", &MEComboEntry::morphologyName)
-        .def_readonly("layer", &MEComboEntry::layer)
-        .def_readonly("fullMType", &MEComboEntry::fullMType)
-        .def_readonly("eType", &MEComboEntry::eType)
-        .def_readonly("eModel", &MEComboEntry::eModel)
-        .def_readonly("comboName", &MEComboEntry::comboName)
+        .def_property_readonly("morphologyName", _entry_string(&MEComboEntry::morphologyName))
+        .def_property_readonly("layer", _entry_string(&MEComboEntry::layer))
+        .def_property_readonly("fullMType", _entry_string(&MEComboEntry::fullMType))
+        .def_property_readonly("eType", _entry_string(&MEComboEntry::eType))
+        .def_property_readonly("eModel", _entry_string(&MEComboEntry::eModel))
+        .def_property_readonly("comboName", _entry_string(&MEComboEntry::comboName))
         .def_readonly("thresholdCurrent", &MEComboEntry::thresholdCurrent)
         .def_readonly("holdingCurrent", &MEComboEntry::holdingCurrent)
         ;
@@ -59,6 +59,16 @@ def test_position_indices(circuit):
     assert numpy.allclose(posics_multi[3], posics[997])
 
 
+def test_duplicate_indices(circuit):
+    posics = circuit.positions()
+    assert numpy.allclose(circuit.positions([3, 3, 7]), posics[[3, 3, 7]])
+    assert numpy.allclose(circuit.positions([7, 3, 7]), posics[[7, 3, 7]])
+    rotations = circuit.rotations()
+    assert numpy.allclose(circuit.rotations([20, 0, 20]), rotations[[20, 0, 20]])
+    etypes = circuit.etypes()
+    assert circuit.etypes([20, 20, 0]) == [etypes[20], etypes[20], etypes[0]]
+
+
 def test_position_value(circuit):
     posic_0 = circuit.positions(0)
     assert posic_0.shape[0] == 1
@@ -485,3 +495,23 @@ def test_query_arbitrary_parameters(circuit_new_sonata):
                              [10,  8,  8])
     assert circuit_new_sonata.getAttribute("holding_current")[0] == pytest.approx(0.00582906)
     assert circuit_new_sonata.getAttribute("threshold_current")[0] == pytest.approx(0.33203125)
+
+
+def test_attribute_native_dtype(circuit_new_sonata):
+    assert circuit_new_sonata.getAttribute("mtype").dtype == numpy.uint32
+    assert circuit_new_sonata.getAttribute("x", 2, 5).dtype == numpy.float64
+    mvd3 = mt.open(path.join(_dir, "circuit.mvd3"))
+    assert mvd3.getAttribute("hypercolumn").dtype == numpy.int32
+    assert numpy.array_equal(mvd3.getAttribute("hypercolumn", [0, 100]),
+                             mvd3.getAttribute("hypercolumn")[[0, 100]])
+    assert numpy.array_equal(mvd3.getAttribute("hypercolumn", [100, 0, 100]),
+                             mvd3.getAttribute("hypercolumn")[[100, 0, 100]])
+
+
+def test_query(circuit_new_sonata):
+    mtypes = numpy.array(circuit_new_sonata.mtypes())
+    wanted = (mtypes == mtypes[0]) | (mtypes == mtypes[1000])
+    gids = mt.Query().isin("mtype", [mtypes[0], mtypes[1000]]).select(circuit_new_sonata)
+    assert numpy.array_equal(gids, numpy.flatnonzero(wanted))
+    gids = mt.Query().equals("mtype", mtypes[0]).select(circuit_new_sonata, [0, 1, 1000])
+    assert numpy.array_equal(gids, [i for i in [0, 1, 1000] if mtypes[i] == mtypes[0]])
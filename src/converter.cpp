@@ -19,7 +19,6 @@
 #include "converter.hpp"
 
 #include <cmath>
-#include <map>
 #include <mvdtool/mvd2.hpp>
 
 #pragma GCC diagnostic push
@@ -37,119 +36,6 @@ static size_t step = 0;
     std::cout << step++ << ": " << msg << std::endl;
 }
 
-struct MVD2Infos{
-    inline MVD2Infos(const size_t n_neurons) :
-        neuron_line(0),
-        vec_xyzr(n_neurons),
-        prop_hypercolumn(n_neurons),
-        prop_minicolumn(n_neurons),
-        prop_layer(n_neurons),
-        prop_mtype(n_neurons),
-        prop_etype(n_neurons),
-        morphologies(n_neurons),
-        me_combos(n_neurons),
-        seeds(4,0)
-    {
-        for(std::vector< std::vector<double> >::iterator it = vec_xyzr.begin(); it < vec_xyzr.end(); ++it){
-            it->resize(4);
-        }
-    }
-
-
-    int operator()(MVD2::DataSet type, const char* line){
-        using namespace MVD2;
-        switch(type){
-            case NeuronLoaded:{
-                    parseNeuron(line);
-                }
-                break;
-            case ElectroTypes:{
-                parseElectro(line);
-            }
-            break;
-            case MorphTypes:{
-                parseMorphType(line);
-
-            }
-            break;
-            case CircuitSeeds:{
-                MVD2::parseSeedInitLine(line, seeds[0], seeds[1], seeds[2]);
-            }
-                break;
-            default:
-                break;
-        }
-        return 0;
-    }
-
-    void parseNeuron(const char* line){
-        assert(neuron_line < vec_xyzr.size());
-        int unused, hypercolumn, minicolumn, layer, mtype, etype;
-        std::string morpho_name, me_combo;
-        std::vector<double> xyzr;
-
-        MVD2::parseNeuronLine(line,
-                              morpho_name,
-                              unused,
-                              hypercolumn,
-                              minicolumn,
-                              layer,
-                              mtype,
-                              etype,
-                              xyzr,
-                              me_combo);
-
-        prop_hypercolumn[neuron_line] = hypercolumn;
-        prop_minicolumn[neuron_line] = minicolumn;
-        prop_layer[neuron_line] = 1 + layer;
-        prop_mtype[neuron_line] = mtype;
-        prop_etype[neuron_line] = etype;
-        morphologies[neuron_line].swap(morpho_name);
-        me_combos[neuron_line].swap(me_combo);
-        vec_xyzr[neuron_line].swap(xyzr);
-
-        neuron_line +=1;
-    }
-
-    void parseElectro(const char* line){
-        std::string eletro_type;
-        MVD2::parseElectroTypeLine(line, eletro_type);
-        etypes.push_back(eletro_type);
-    }
-
-    void parseMorphType(const char* line){
-        std::string mtype_name, morph_class, synapse_class;
-        MVD2::parseMorphTypeLine(line, mtype_name, morph_class, synapse_class);
-        mtype_names.push_back(mtype_name);
-        mtype_mclass.push_back(morph_class);
-        mtype_syn_class.push_back(synapse_class);
-    }
-
-    // counter
-    size_t neuron_line;
-
-    // mvd2 infos
-    std::vector< std::vector<double> > vec_xyzr;
-    std::vector<int> prop_hypercolumn;
-    std::vector<int> prop_minicolumn;
-    std::vector<int> prop_layer;
-    std::vector<size_t> prop_mtype;
-    std::vector<size_t> prop_etype;
-    std::vector<std::string> morphologies;
-    std::vector<std::string> me_combos;
-
-    std::vector<double> seeds;
-
-    // etypes
-    std::vector<std::string> etypes;
-
-    // mtypes
-    std::vector<std::string> mtype_names;
-    std::vector<std::string> mtype_mclass;
-    std::vector<std::string> mtype_syn_class;
-};
-
-
 struct MVD3Infos{
 
     void setSize(const size_t n_neurons){
@@ -202,103 +88,52 @@ struct MVD3Infos{
 };
 
 
-void move_coordinates(MVD2Infos & infos, MVD3Infos & result){
-    for(size_t i = 0; i < infos.vec_xyzr.size(); ++i){
+void move_coordinates(const MVD2::NeuronColumns & columns, MVD3Infos & result){
+    for(size_t i = 0; i < result.position.size(); ++i){
+        const double* xyzr = &columns.xyzr[4 * i];
         for(int j =0; j < 3; ++j){
-            result.position[i][j] = infos.vec_xyzr[i][j];
+            result.position[i][j] = xyzr[j];
         }
 
         // MVD2 gives only rotation angle on axe Y and in degree
         // convert to rad and construct quaternion
         const double deg_rad_r = boost::math::constants::pi<double>() / 180.0;
-        const double angle_y = infos.vec_xyzr[i][3]*deg_rad_r;
+        const double angle_y = xyzr[3]*deg_rad_r;
 
         // quaternion order  (x,y,z,w)
         result.rotation[i][0] = result.rotation[i][2] = 0;
         result.rotation[i][1] = sin(angle_y/2);
         result.rotation[i][3] = cos(angle_y/2);
     }
-    infos.vec_xyzr.clear();
 }
 
-template<typename Input, typename OutputIndex, typename ValueVector>
-void hdf5_index_create(const Input & input_data, OutputIndex & index, ValueVector & vec_value){
-    typedef typename std::map<typename Input::value_type, size_t> MapIndexType;
-    MapIndexType mapIndex;
-
-    for(size_t i = 0; i < input_data.size(); ++i){
-        typename MapIndexType::iterator elem = mapIndex.insert(std::make_pair(input_data[i], vec_value.size())).first;
-        index[i] = elem->second;
-        if(vec_value.size() == elem->second){
-            vec_value.push_back(elem->first);
-        }
-    }
-}
-
-void move_morphologies(MVD2Infos & infos, MVD3Infos & result){
-    hdf5_index_create(infos.morphologies, result.prop_morpho, result.morphologies);
-    infos.morphologies.clear();
-}
-
-void move_me_combos(MVD2Infos & infos, MVD3Infos & result){
-    hdf5_index_create(infos.me_combos, result.prop_me_combo, result.me_combos);
-    infos.me_combos.clear();
-}
-
-void move_etype(MVD2Infos & infos, MVD3Infos & result){
-    result.etypes.swap(infos.etypes);
-    result.prop_etype.swap(infos.prop_etype);
-}
-
-
-void move_mtype_all(MVD2Infos & infos, MVD3Infos & result){
-    result.mtypes.swap(infos.mtype_names);
-    result.prop_mtype.swap(infos.prop_mtype);
-
-    std::vector<size_t> index_mtype_to_mclass(infos.mtype_mclass.size());
-    hdf5_index_create(infos.mtype_mclass, index_mtype_to_mclass, result.morph_class);
-
-    std::vector<size_t> index_mtype_to_syn_class(infos.mtype_syn_class.size());
-    hdf5_index_create(infos.mtype_syn_class, index_mtype_to_syn_class, result.synapse_class);
-
-    result.prop_mclass.resize(result.prop_mtype.size(), 0);
-    result.prop_synclass.resize(result.prop_mtype.size(), 0);
-
-    for(size_t i = 0; i < result.prop_mtype.size(); ++i){
-        const size_t index = result.prop_mtype[i];
-        assert(index < index_mtype_to_mclass.size());
-        assert(index < index_mtype_to_syn_class.size());
-        result.prop_mclass[i] = index_mtype_to_mclass[index];
-        result.prop_synclass[i] = index_mtype_to_syn_class[index];
-    }
-
-    infos.mtype_mclass.clear();
-    infos.mtype_syn_class.clear();
-}
-
-void move_int_props(MVD2Infos & infos, MVD3Infos & result){
-    result.prop_hypercolumn.swap(infos.prop_hypercolumn);
-    result.prop_minicolumn.swap(infos.prop_minicolumn);
-    result.prop_layer.swap(infos.prop_layer);
-}
-
-
-void transform(MVD2Infos & infos, MVD3Infos & result){
-    result.setSize(infos.vec_xyzr.size());
-
-    move_coordinates(infos, result);
-
-    move_morphologies(infos, result);
-
-    move_me_combos(infos, result);
-
-    move_int_props(infos, result);
-
-    move_etype(infos, result);
-
-    move_mtype_all(infos, result);
-
-    result.seeds = infos.seeds;
+// Names are dictionary-encoded by MVD2File in order of first appearance,
+// as the MVD3 libraries are
+void transform(const MVD2::NeuronColumns & columns, MVD3Infos & result){
+    result.setSize(columns.layers.size());
+
+    move_coordinates(columns, result);
+
+    result.prop_hypercolumn.assign(columns.hypercolumns.begin(), columns.hypercolumns.end());
+    result.prop_minicolumn.assign(columns.minicolumns.begin(), columns.minicolumns.end());
+    result.prop_layer.assign(columns.layers.begin(), columns.layers.end());
+
+    result.prop_morpho.assign(columns.morphologies.begin(), columns.morphologies.end());
+    result.prop_me_combo.assign(columns.me_combos.begin(), columns.me_combos.end());
+    result.prop_etype.assign(columns.etypes.begin(), columns.etypes.end());
+    result.prop_mtype.assign(columns.mtypes.begin(), columns.mtypes.end());
+    result.prop_mclass.assign(columns.morph_classes.begin(), columns.morph_classes.end());
+    result.prop_synclass.assign(columns.synapse_class.begin(), columns.synapse_class.end());
+
+    result.morphologies = *columns.morphology_names;
+    result.me_combos = *columns.me_combo_names;
+    result.etypes = *columns.etype_names;
+    result.mtypes = *columns.mtype_names;
+    result.morph_class = *columns.morph_class_names;
+    result.synapse_class = *columns.synapse_class_names;
+
+    result.seeds = columns.seeds;
+    result.seeds.resize(4, 0);
 }
 
 void converter(const std::string & mvd2, const std::string & mvd3){
@@ -315,12 +150,11 @@ void converter(const std::string & mvd2, const std::string & mvd3){
         std::ostringstream ss;
         ss << "Contains " << n_neuron << " neurons";
         converter_log(ss.str());
-        MVD2Infos mvd2_content(n_neuron);
-
         converter_log("Parse MVD2");
-        file.parse(mvd2_content);
+        file.setParseWorkers(0);
+        const MVD2::NeuronColumns & columns = file.getColumns();
         converter_log("Transform data layout");
-        transform(mvd2_content, mvd3_content);
+        transform(columns, mvd3_content);
     }
 
     {
@@ -54,25 +54,30 @@ void print_csv(const std::string & filename){
 
     MVD3File file(filename);
 
-    const size_t n_neuron = file.getNbNeuron();
-
     std::cout << "GID; POSITION_X; POSITION_Y; POSITION_Z; ROTATION_Q0; ROTATION_Q1; ROTATION_Q2; ROTATION_Q3;";
     std::cout << " MORPHO; MTYPE; ETYPE; SYNCLASS;" << "\n";
 
-    size_t offset=0, size_read=0;
+    // circuits without orientations get empty rotation fields
+    const bool rotated = file.hasRotations();
+    const unsigned columns = MVD::CellColumn::Positions
+                             | (rotated ? MVD::CellColumn::Rotations : MVD::CellColumn::None)
+                             | MVD::CellColumn::Morphologies
+                             | MVD::CellColumn::Mtypes
+                             | MVD::CellColumn::Etypes
+                             | MVD::CellColumn::SynapseClass;
     size_t gid=0;
-    while(offset < n_neuron){
-        size_read = std::min(n_neuron-offset, size_t(200));
-        const Range read_range = Range(offset, size_read);
-        const Positions positions = file.getPositions(read_range);
-        const Rotations rotations = file.getRotations(read_range);
-        const std::vector<std::string> morphos = file.getMorphologies(read_range);
-        const std::vector<std::string> mtypes = file.getMtypes(read_range);
-        const std::vector<std::string> etypes = file.getEtypes(read_range);
-        const std::vector<std::string> syn_class = file.getSynapseClass(read_range);
+    // the next chunk is read while the current one is printed
+    for (const MVD::CellBatch& batch : file.chunks(200, columns)) {
+        const size_t size_read = batch.size();
+        const Positions& positions = batch.positions;
+        const Rotations& rotations = batch.rotations;
+        const MVD::Categorical& morphos = batch.morphologies;
+        const MVD::Categorical& mtypes = batch.mtypes;
+        const MVD::Categorical& etypes = batch.etypes;
+        const MVD::Categorical& syn_class = batch.synapse_class;
 
         assert( size_read == positions.shape()[0]
-                && size_read == rotations.shape()[0]
+                && (!rotated || size_read == rotations.shape()[0])
                 && size_read == morphos.size()
                 && size_read == mtypes.size()
                 && size_read == etypes.size()
@@ -84,7 +89,10 @@ void print_csv(const std::string & filename){
                 std::cout << positions[i][j] << delim;
             }
             for(size_t j=0; j < 4; ++j){
-               std::cout << rotations[i][j] << delim;
+               if(rotated){
+                   std::cout << rotations[i][j];
+               }
+               std::cout << delim;
             }
             std::cout << morphos[i] << delim;
             std::cout << mtypes[i] << delim;
@@ -94,7 +102,6 @@ void print_csv(const std::string & filename){
             ++gid;
 
         }
-        offset += size_read;
     }
 }
 
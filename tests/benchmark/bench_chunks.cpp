@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include <chrono>
+#include <thread>
+
+#include <mvdtool/mvd_generic.hpp>
+
+#include "bench_utils.hpp"
+
+namespace {
+
+// Stands for the work done by the caller on each chunk
+inline double process(const MVD::CellBatch& batch, size_t compute_us) {
+    const auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(compute_us);
+    double sum = 0.;
+    for (size_t i = 0; i < batch.positions.num_elements(); ++i) {
+        sum += batch.positions.data()[i];
+    }
+    while (std::chrono::steady_clock::now() < until) {
+        std::this_thread::yield();
+    }
+    return sum;
+}
+
+}  // namespace
+
+///
+/// Full circuit streaming, with and without background prefetch
+///
+/// Usage: bench_chunks [circuit_file] [chunk_size] [compute_us_per_chunk] [n_iter]
+///
+int main(int argc, char** argv) {
+    const std::string filename = bench::arg(argc, argv, 1, std::string(MVD3_FILENAME));
+    const size_t chunk_size = bench::arg(argc, argv, 2, size_t(256));
+    const size_t compute_us = bench::arg(argc, argv, 3, size_t(200));
+    const size_t n_iter = bench::arg(argc, argv, 4, size_t(10));
+
+    const auto file = MVD::open(filename);
+    const size_t n_cells = file->size();
+    const size_t aligned_chunk_size = file->chunks(chunk_size).chunkSize();
+
+    std::cout << filename << ": " << n_cells << " cells, chunks of " << aligned_chunk_size
+              << " (storage chunks of " << file->storageChunkSize() << "), " << compute_us
+              << " us of work per chunk\n";
+
+    double sum = 0.;
+    const auto report = [&](const std::string& name, double us_per_cell) {
+        std::cout << "    " << name << ": " << std::fixed << 1e6 / us_per_cell
+                  << " cells/s\n";
+    };
+
+    report("sequential", bench::measure("read then process, one chunk at a time", n_iter, n_cells, [&]() {
+        for (size_t offset = 0; offset < n_cells; offset += aligned_chunk_size) {
+            const MVD::Range range(offset, std::min(aligned_chunk_size, n_cells - offset));
+            sum += process(file->read(range), compute_us);
+        }
+    }));
+
+    report("prefetched", bench::measure("File::chunks, next chunk read in background", n_iter, n_cells, [&]() {
+        for (const auto& batch: file->chunks(aligned_chunk_size)) {
+            sum += process(batch, compute_us);
+        }
+    }));
+
+    return sum == 0. ? 0 : 0;
+}
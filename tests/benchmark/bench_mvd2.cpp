@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+#include <mvdtool/mvd2.hpp>
+
+#include "bench_utils.hpp"
+
+namespace {
+
+// A MVD2 file of `n_neurons` neurons, in the layout of BlueBuilder exports
+void write_mvd2(const std::string& filename, size_t n_neurons) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> coordinate(-100., 2000.);
+    std::uniform_real_distribution<double> angle(-180., 180.);
+
+    std::ofstream out(filename);
+    out << " Application:'BlueBuilderExport'   git rev:'d0e1a14'\n/morphologies/h5\n/unknown/\n"
+        << "Neurons Loaded\n";
+    out.setf(std::ios::fixed);
+    out.precision(6);
+    for (size_t i = 0; i < n_neurons; ++i) {
+        const std::string morphology = "sm090227a1-2_idC_" + std::to_string(i % 10000);
+        out << morphology << " 0 " << i % 10 << ' ' << i % 100 << ' ' << i % 6 << ' ' << i % 9
+            << ' ' << i % 2 << ' ' << coordinate(gen) << ' ' << coordinate(gen) << ' '
+            << coordinate(gen) << ' ' << angle(gen) << " cACint2090_L1_SLAC_1_" << morphology
+            << '\n';
+    }
+    out << "MiniColumnsPosition\n43.373 1003.174 51.306\nCircuitSeeds\n"
+        << "837632.000000 2906729.000000 4236279.000000\n"
+        << "MorphTypes\n";
+    for (size_t i = 0; i < 9; ++i) {
+        out << 'L' << i % 6 + 1 << "_MTYPE_" << i << (i % 3 ? " PYR EXC\n" : " INT INH\n");
+    }
+    out << "ElectroTypes\ncACint\ncADpyr\n";
+}
+
+// The neuron lines as MVD2File::parse and parseNeuronLine read them before
+// the memory mapping: fgets in a 1024 bytes buffer, sscanf into 1KB buffers
+size_t fgets_sscanf_parse(const std::string& filename, double& checksum) {
+    FILE* data = std::fopen(filename.c_str(), "r");
+    char line[1025] = {0};
+    if (std::fgets(line, 255, data) == NULL || std::fgets(line, 255, data) == NULL) {
+        throw std::runtime_error("Invalid header");
+    }
+    size_t n_neurons = 0;
+    bool neurons = false;
+    while (std::fgets(line, 1024, data) != NULL) {
+        if (std::strncmp("Neurons Loaded", line, 14) == 0) {
+            neurons = true;
+            continue;
+        }
+        if (std::strncmp("MiniColumnsPosition", line, 19) == 0) {
+            neurons = false;
+        }
+        if (!neurons) {
+            continue;
+        }
+        char name_str[1025] = "";
+        char metype_str[1024] = "?";
+        int database, column, minicolumn, layer, morphologytype, electrophysiology_type;
+        std::vector<double> xyzr(4);
+        if (std::sscanf(line, "%s %d %d %d %d %d %d %lf %lf %lf %lf %s", name_str, &database,
+                        &column, &minicolumn, &layer, &morphologytype, &electrophysiology_type,
+                        &xyzr[0], &xyzr[1], &xyzr[2], &xyzr[3], metype_str) != 12) {
+            throw std::runtime_error(std::string("Invalid neuron line ") + line);
+        }
+        const std::string name = name_str, metype = metype_str;
+        checksum += xyzr[0] + double(name.size() + metype.size());
+        ++n_neurons;
+    }
+    std::fclose(data);
+    return n_neurons;
+}
+
+// Same work as a boost::string_view callback of MVD2File::parse
+struct ViewParser {
+    int operator()(MVD2::DataSet type, boost::string_view line) {
+        if (type == MVD2::NeuronLoaded) {
+            boost::string_view name, metype;
+            int database, column, minicolumn, layer, morphologytype, electrophysiology_type;
+            MVD2::parseNeuronLine(line, name, database, column, minicolumn, layer, morphologytype,
+                                  electrophysiology_type, xyzr, metype);
+            checksum += xyzr[0] + double(name.size() + metype.size());
+            ++n_neurons;
+        }
+        return 0;
+    }
+
+    std::vector<double> xyzr;
+    double checksum = 0.;
+    size_t n_neurons = 0;
+};
+
+// And as a const char* callback, getting a copy of each line
+struct CStringParser {
+    int operator()(MVD2::DataSet type, const char* line) {
+        if (type == MVD2::NeuronLoaded) {
+            std::string name, metype;
+            int database, column, minicolumn, layer, morphologytype, electrophysiology_type;
+            MVD2::parseNeuronLine(line, name, database, column, minicolumn, layer, morphologytype,
+                                  electrophysiology_type, xyzr, metype);
+            checksum += xyzr[0] + double(name.size() + metype.size());
+            ++n_neurons;
+        }
+        return 0;
+    }
+
+    std::vector<double> xyzr;
+    double checksum = 0.;
+    size_t n_neurons = 0;
+};
+
+}  // namespace
+
+///
+/// Parsing the neurons of a generated MVD2 file, and reading a range of
+/// them through the line index and from the columns of the File interface
+///
+/// Usage: bench_mvd2 [n_neurons] [n_iter] [mvd2_file]
+///
+int main(int argc, char** argv) {
+    const size_t n_neurons = bench::arg(argc, argv, 1, size_t(1000000));
+    const size_t n_iter = bench::arg(argc, argv, 2, size_t(1));
+    const std::string filename = bench::arg(argc, argv, 3, std::string("bench_mvd2.mvd2"));
+
+    write_mvd2(filename, n_neurons);
+    std::cout << filename << ": " << n_neurons << " neurons\n";
+
+    double expected = 0.;
+    const double legacy = bench::measure("fgets, sscanf", n_iter, n_neurons, [&]() {
+        expected = 0.;
+        if (fgets_sscanf_parse(filename, expected) != n_neurons) {
+            throw std::runtime_error("Legacy parser missed neurons");
+        }
+    });
+
+    const MVD2::MVD2File file(filename);
+    const double mapped = bench::measure("MVD2File::parse, string_view callback", n_iter,
+                                         n_neurons, [&]() {
+        ViewParser parser;
+        file.parse(parser);
+        if (parser.n_neurons != n_neurons || parser.checksum != expected) {
+            throw std::runtime_error("Parsers disagree on the neurons");
+        }
+    });
+
+    bench::measure("MVD2File::parse, const char* callback", n_iter, n_neurons, [&]() {
+        CStringParser parser;
+        file.parse(parser);
+        if (parser.n_neurons != n_neurons || parser.checksum != expected) {
+            throw std::runtime_error("Parsers disagree on the neurons");
+        }
+    });
+
+    bench::measure("MVD2File::getPositions", n_iter, n_neurons, [&]() {
+        file.getPositions();
+    });
+
+    // The last cells, as getPositions(range) read them before the line
+    // index: a counting pass, then every line parsed up to the range
+    const MVD::Range last_cells(n_neurons - std::min(n_neurons, size_t(1000)), 1000);
+    const double scanned = bench::measure("last 1000 positions, parsed from the start", n_iter,
+                                          1, [&]() {
+        const MVD2::MVD2File fresh(filename);
+        MVD::Positions positions(boost::extents[last_cells.count][3]);
+        MVD2::PositionData reader(positions, last_cells);
+        fresh.getNbNeuron();
+        fresh.parse(reader);
+    });
+
+    const double indexed = bench::measure("last 1000 positions, line index", n_iter, 1, [&]() {
+        file.getPositions(last_cells);
+    });
+
+    bench::measure("line index, scanned", n_iter, n_neurons, [&]() {
+        MVD2::MVD2File(filename).getLineIndex();
+    });
+
+    MVD2::MVD2File::openCached(filename, ".");
+    bench::measure("line index, read from the index file", n_iter, n_neurons, [&]() {
+        MVD2::MVD2File::openCached(filename, ".").getLineIndex();
+    });
+
+    // The File interface: one columnar load, then slices of the columns
+    bench::measure("columnar load, first getMtypes", n_iter, n_neurons, [&]() {
+        MVD2::MVD2File(filename).getMtypes(MVD::Range(0, 1));
+    });
+
+    const double serial_load = bench::measure("columnar load, calling thread", n_iter, n_neurons,
+                                              [&]() {
+        MVD2::MVD2File(filename).getColumns();
+    });
+
+    size_t n_workers = 0;
+    const double parallel_load = bench::measure("columnar load, one worker per hardware thread",
+                                                n_iter, n_neurons, [&]() {
+        MVD2::MVD2File file(filename);
+        file.setParseWorkers(0);
+        n_workers = file.getParseWorkers();
+        file.getColumns();
+    });
+
+    const MVD2::MVD2File columnar(filename);
+
+    const double sliced = bench::measure("last 1000 mtypes and positions, columns", n_iter, 1,
+                                         [&]() {
+        columnar.getMtypes(last_cells);
+        columnar.getPositions(last_cells);
+    });
+
+    bench::measure("categorical morphologies, columns", n_iter, n_neurons, [&]() {
+        columnar.getCategoricalMorphologies();
+    });
+
+    std::cout << "speedup: " << std::setprecision(1) << legacy / mapped << "x parsing, "
+              << scanned / indexed << "x reading a range, " << scanned / sliced
+              << "x from columns, " << serial_load / parallel_load << "x loading on " << n_workers
+              << " workers\n";
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include <mvdtool/mvd3.hpp>
+
+#include "bench_utils.hpp"
+
+///
+/// Chunked reads of a MVD3 file
+///
+/// Usage: bench_mvd3 [mvd3_file] [chunk_size] [n_iter]
+///
+int main(int argc, char** argv) {
+    using namespace MVD3;
+
+    const std::string filename = bench::arg(argc, argv, 1, std::string(MVD3_FILENAME));
+    const size_t chunk_size = bench::arg(argc, argv, 2, size_t(256));
+    const size_t n_iter = bench::arg(argc, argv, 3, size_t(10));
+
+    MVD3File file(filename);
+    HighFive::File raw_file(filename);
+    const size_t n_neurons = file.getNbNeuron();
+    const size_t n_chunks = (n_neurons + chunk_size - 1) / chunk_size;
+
+    std::cout << filename << ": " << n_neurons << " cells, " << n_chunks << " chunks of "
+              << chunk_size << "\n";
+
+    // Lookup cost alone: what every getter used to pay before doing any I/O
+    bench::measure("dataset lookup (getDataSet + extent)", n_iter, n_chunks, [&]() {
+        for (size_t i = 0; i < n_chunks; ++i) {
+            const auto set = raw_file.getDataSet("/cells/positions");
+            (void) set.getDataType();
+            (void) set.getSpace().getDimensions();
+        }
+    });
+
+    bench::measure("positions, dataset opened per call", n_iter, n_chunks, [&]() {
+        Positions res;
+        for (size_t offset = 0; offset < n_neurons; offset += chunk_size) {
+            const auto set = raw_file.getDataSet("/cells/positions");
+            const auto size = set.getSpace().getDimensions()[0];
+            const Range range(offset, std::min(chunk_size, n_neurons - offset));
+            set.select({range.offset, 0}, {range.adjust_count(size), 3}).read(res);
+        }
+    });
+
+    bench::measure("positions, MVD3File::getPositions", n_iter, n_chunks, [&]() {
+        for (size_t offset = 0; offset < n_neurons; offset += chunk_size) {
+            file.getPositions(Range(offset, std::min(chunk_size, n_neurons - offset)));
+        }
+    });
+
+    bench::measure("positions, MVD3File::readPositions into buffer", n_iter, n_chunks, [&]() {
+        std::vector<double> buffer(chunk_size * 3);
+        for (size_t offset = 0; offset < n_neurons; offset += chunk_size) {
+            file.readPositions(Range(offset, std::min(chunk_size, n_neurons - offset)),
+                               buffer.data());
+        }
+    });
+
+    bench::measure("hypercolumns, dataset opened per call", n_iter, n_chunks, [&]() {
+        std::vector<int32_t> res;
+        for (size_t offset = 0; offset < n_neurons; offset += chunk_size) {
+            const auto set = raw_file.getDataSet("/cells/properties/hypercolumn");
+            const auto size = set.getSpace().getDimensions()[0];
+            const Range range(offset, std::min(chunk_size, n_neurons - offset));
+            set.select({range.offset}, {range.adjust_count(size)}).read(res);
+        }
+    });
+
+    bench::measure("hypercolumns, MVD3File::getHyperColumns", n_iter, n_chunks, [&]() {
+        for (size_t offset = 0; offset < n_neurons; offset += chunk_size) {
+            file.getHyperColumns(Range(offset, std::min(chunk_size, n_neurons - offset)));
+        }
+    });
+
+    bench::measure("morphologies, MVD3File::getMorphologies", n_iter, n_chunks, [&]() {
+        for (size_t offset = 0; offset < n_neurons; offset += chunk_size) {
+            file.getMorphologies(Range(offset, std::min(chunk_size, n_neurons - offset)));
+        }
+    });
+
+    return 0;
+}
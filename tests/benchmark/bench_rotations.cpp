@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include <cmath>
+#include <random>
+
+#include <boost/math/quaternion.hpp>
+
+#include <mvdtool/sonata.hpp>
+
+#include "bench_utils.hpp"
+
+namespace {
+
+// A single population of `n_cells`, rotated around the three axes
+void write_angular_circuit(const std::string& filename, size_t n_cells) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+
+    HighFive::File file(filename, HighFive::File::Overwrite);
+    file.createDataSet("/nodes/default/node_type_id", std::vector<int64_t>(n_cells, -1));
+    for (const char* axis : {"x", "y", "z"}) {
+        std::vector<double> angles(n_cells);
+        for (auto& a : angles) {
+            a = angle(gen);
+        }
+        file.createDataSet(std::string("/nodes/default/0/rotation_angle_") + axis + "axis",
+                           angles);
+    }
+}
+
+// What SonataFile did before converting in bulk: three single element
+// reads per cell
+void per_cell_rotations(const bbp::sonata::NodePopulation& pop, size_t offset, size_t count) {
+    using Quaternion = boost::math::quaternion<double>;
+    volatile double sink = 0.;
+    for (size_t i = offset; i < offset + count; ++i) {
+        const bbp::sonata::Selection cell({{i, i + 1}});
+        Quaternion rot{1., 0., 0., 0.};
+        double halfangle = pop.getAttribute<double>("rotation_angle_zaxis", cell)[0] * .5;
+        rot *= Quaternion{std::cos(halfangle), 0., 0., std::sin(halfangle)};
+        halfangle = pop.getAttribute<double>("rotation_angle_yaxis", cell)[0] * .5;
+        rot *= Quaternion{std::cos(halfangle), 0., std::sin(halfangle), 0.};
+        halfangle = pop.getAttribute<double>("rotation_angle_xaxis", cell)[0] * .5;
+        rot *= Quaternion{std::cos(halfangle), std::sin(halfangle), 0., 0.};
+        sink = sink + rot.R_component_1();
+    }
+}
+
+}  // namespace
+
+///
+/// Angular rotations of a generated SONATA circuit
+///
+/// Usage: bench_rotations [n_cells] [per_cell_sample] [n_iter] [h5_file]
+///
+int main(int argc, char** argv) {
+    using namespace MVD;
+
+    const size_t n_cells = bench::arg(argc, argv, 1, size_t(1000000));
+    const size_t sample = std::min(n_cells, bench::arg(argc, argv, 2, size_t(10000)));
+    const size_t n_iter = bench::arg(argc, argv, 3, size_t(3));
+    const std::string filename = bench::arg(argc, argv, 4, std::string("bench_rotations.h5"));
+
+    write_angular_circuit(filename, n_cells);
+
+    SonataFile file(filename);
+    bbp::sonata::NodePopulation pop(filename, "", "default");
+    std::cout << filename << ": " << file.getNbNeuron() << " cells with angular rotations\n";
+
+    const double per_cell = bench::measure("per cell reads and conversion", n_iter, sample,
+                                           [&]() { per_cell_rotations(pop, 0, sample); });
+
+    const double bulk = bench::measure("SonataFile::getRotations, all cells", n_iter, n_cells,
+                                       [&]() { file.getRotations(); });
+
+    std::vector<double> buffer(4 * n_cells);
+    bench::measure("SonataFile::readRotations into buffer", n_iter, n_cells, [&]() {
+        file.readRotations(Range(0, n_cells), buffer.data());
+    });
+
+    std::cout << "speedup per cell: " << std::setprecision(1) << per_cell / bulk << "x\n";
+    return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+#include <mvdtool/mvd_generic.hpp>
+
+#include "bench_utils.hpp"
+
+namespace {
+
+// The former python _atIndices approach: read a chunk of 128 cells around
+// each requested index and pick the selected ones
+template <typename T, typename FuncT>
+std::vector<T> chunk_around(const FuncT& f, size_t n_records, const std::vector<size_t>& indices) {
+    constexpr size_t CHUNK_SIZE = 128u;
+    std::vector<T> out(indices.size());
+    for (size_t i = 0; i < indices.size();) {
+        const size_t offset = indices[i];
+        const auto limit = std::min(CHUNK_SIZE, n_records - offset);
+        const auto chunk = f(MVD::Range(offset, limit));
+        for (; i < indices.size() && indices[i] < offset + limit; ++i) {
+            out[i] = chunk[indices[i] - offset];
+        }
+    }
+    return out;
+}
+
+}  // namespace
+
+///
+/// Random sampling of a fraction of the cells of a circuit
+///
+/// Usage: bench_selection [circuit_file] [sampled_per_mille] [n_iter]
+///
+int main(int argc, char** argv) {
+    const std::string filename = bench::arg(argc, argv, 1, std::string(SONATA_FILENAME));
+    const size_t per_mille = bench::arg(argc, argv, 2, size_t(10));
+    const size_t n_iter = bench::arg(argc, argv, 3, size_t(10));
+
+    const auto file = MVD::open(filename);
+    const size_t n_cells = file->size();
+
+    std::vector<size_t> indices(n_cells);
+    std::iota(indices.begin(), indices.end(), 0);
+    std::mt19937 rng(42);
+    std::shuffle(indices.begin(), indices.end(), rng);
+    indices.resize(std::max<size_t>(1, n_cells * per_mille / 1000));
+    std::sort(indices.begin(), indices.end());
+    const auto selection = MVD::Selection::fromIndices(indices);
+
+    std::cout << filename << ": " << n_cells << " cells, sampling " << indices.size() << " ("
+              << selection.ranges().size() << " ranges)\n";
+
+    bench::measure("mtypes, chunk around each index", n_iter, 1, [&]() {
+        chunk_around<std::string>([&](const MVD::Range& r) { return file->getMtypes(r); },
+                                  n_cells,
+                                  indices);
+    });
+    bench::measure("mtypes, Selection", n_iter, 1, [&]() { file->getMtypes(selection); });
+
+    bench::measure("synapse classes, chunk around each index", n_iter, 1, [&]() {
+        chunk_around<std::string>([&](const MVD::Range& r) { return file->getSynapseClass(r); },
+                                  n_cells,
+                                  indices);
+    });
+    bench::measure("synapse classes, Selection", n_iter, 1, [&]() {
+        file->getSynapseClass(selection);
+    });
+
+    bench::measure("positions, chunk around each index", n_iter, 1, [&]() {
+        std::vector<double> xs(indices.size());
+        size_t i = 0;
+        while (i < indices.size()) {
+            const size_t offset = indices[i];
+            const auto limit = std::min<size_t>(128, n_cells - offset);
+            const auto chunk = file->getPositions(MVD::Range(offset, limit));
+            for (; i < indices.size() && indices[i] < offset + limit; ++i) {
+                xs[i] = chunk[indices[i] - offset][0];
+            }
+        }
+    });
+    bench::measure("positions, Selection", n_iter, 1, [&]() { file->getPositions(selection); });
+
+    return 0;
+}
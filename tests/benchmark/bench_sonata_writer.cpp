@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+#include <mvdtool/sonata_writer.hpp>
+
+#include "bench_utils.hpp"
+
+namespace {
+
+const char* const enumerations[] = {"morphology", "etype", "mtype", "region", "synapse_class"};
+
+// One block of generated cells, written again for each block of the population
+struct Block {
+    MVD::Positions positions;
+    MVD::Rotations rotations;
+    MVD::Categorical categories;
+
+    explicit Block(size_t n_cells) {
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<double> coordinate(0., 2000.);
+        std::uniform_int_distribution<MVD::Categorical::code_type> category(0, 59);
+
+        positions.resize(boost::extents[n_cells][3]);
+        rotations.resize(boost::extents[n_cells][4]);
+        std::vector<MVD::Categorical::code_type> codes(n_cells);
+        for (size_t i = 0; i < n_cells; ++i) {
+            for (size_t k = 0; k < 3; ++k) {
+                positions[i][k] = coordinate(gen);
+            }
+            rotations[i][0] = rotations[i][1] = rotations[i][2] = 0.;
+            rotations[i][3] = 1.;
+            codes[i] = category(gen);
+        }
+        auto dictionary = std::make_shared<MVD::Categorical::Dictionary>();
+        for (size_t i = 0; i < 60; ++i) {
+            dictionary->push_back("value_" + std::to_string(i));
+        }
+        categories = MVD::Categorical(std::move(codes), std::move(dictionary));
+    }
+};
+
+// What tests/mvd2sonata.py does: whole columns in memory, one contiguous
+// dataset each
+size_t write_whole_columns(const std::string& filename, const Block& block, size_t n_cells) {
+    const size_t block_size = block.positions.shape()[0];
+    const auto column = [&](const boost::multi_array<double, 2>& rows, size_t k) {
+        std::vector<double> values(n_cells);
+        for (size_t i = 0; i < n_cells; ++i) {
+            values[i] = rows[i % block_size][k];
+        }
+        return values;
+    };
+
+    HighFive::File file(filename, HighFive::File::Overwrite);
+    const std::string group = "/nodes/default/0/";
+    file.createDataSet("/nodes/default/node_type_id", std::vector<int64_t>(n_cells, -1));
+    file.createDataSet("/nodes/default/node_group_id", std::vector<uint64_t>(n_cells, 0));
+    for (size_t k = 0; k < 3; ++k) {
+        file.createDataSet(group + "xyz"[k], column(block.positions, k));
+    }
+    for (size_t k = 0; k < 4; ++k) {
+        file.createDataSet(group + "orientation_" + "xyzw"[k], column(block.rotations, k));
+    }
+    for (const char* name: enumerations) {
+        std::vector<MVD::Categorical::code_type> codes(n_cells);
+        for (size_t i = 0; i < n_cells; ++i) {
+            codes[i] = block.categories.codes()[i % block_size];
+        }
+        file.createDataSet(group + name, codes);
+        file.createDataSet(group + "@library/" + name, block.categories.dictionary());
+    }
+    return n_cells * sizeof(double);
+}
+
+size_t write_chunked(const std::string& filename,
+                     const Block& block,
+                     size_t n_cells,
+                     unsigned compression) {
+    std::remove(filename.c_str());
+    const size_t block_size = block.positions.shape()[0];
+    MVD::SonataWriter writer(filename, n_cells, "default", compression, block_size);
+    for (size_t offset = 0; offset < n_cells; offset += block_size) {
+        const size_t count = std::min(block_size, n_cells - offset);
+        if (count < block_size) {
+            // Partial last block
+            const MVD::Positions positions =
+                block.positions[boost::indices[MVD::Positions::index_range(0, count)]
+                                              [MVD::Positions::index_range()]];
+            const MVD::Rotations rotations =
+                block.rotations[boost::indices[MVD::Rotations::index_range(0, count)]
+                                              [MVD::Rotations::index_range()]];
+            writer.writePositions(positions, offset);
+            writer.writeRotations(rotations, offset);
+            const MVD::Categorical categories(
+                std::vector<MVD::Categorical::code_type>(block.categories.codes().begin(),
+                                                         block.categories.codes().begin() + count),
+                block.categories.sharedDictionary());
+            for (const char* name: enumerations) {
+                writer.writeEnumeration(name, categories, offset);
+            }
+            continue;
+        }
+        writer.writePositions(block.positions, offset);
+        writer.writeRotations(block.rotations, offset);
+        for (const char* name: enumerations) {
+            writer.writeEnumeration(name, block.categories, offset);
+        }
+    }
+    writer.close();
+    return block_size * sizeof(double);
+}
+
+size_t file_size(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    return static_cast<size_t>(file.tellg());
+}
+
+}  // namespace
+
+///
+/// Writing a generated SONATA population: whole contiguous columns against
+/// SonataWriter blocks, with and without compression
+///
+/// Usage: bench_sonata_writer [n_cells] [chunk_size] [n_iter] [h5_file]
+///
+int main(int argc, char** argv) {
+    const size_t n_cells = bench::arg(argc, argv, 1, size_t(10000000));
+    const size_t chunk_size = bench::arg(argc, argv, 2, size_t(MVD::SonataWriter::DEFAULT_CHUNK_SIZE));
+    const size_t n_iter = bench::arg(argc, argv, 3, size_t(1));
+    const std::string filename = bench::arg(argc, argv, 4, std::string("bench_sonata_writer.h5"));
+
+    const Block block(std::min(chunk_size, n_cells));
+    std::cout << filename << ": " << n_cells << " cells, blocks of " << chunk_size << "\n";
+
+    size_t buffer = 0;
+    const auto report = [&]() {
+        std::cout << "    largest column buffer: " << buffer / 1024 << " KiB, file: "
+                  << file_size(filename) / (1 << 20) << " MiB\n";
+    };
+
+    bench::measure("whole columns, contiguous datasets", n_iter, n_cells, [&]() {
+        buffer = write_whole_columns(filename, block, n_cells);
+    });
+    report();
+
+    bench::measure("SonataWriter, chunked", n_iter, n_cells, [&]() {
+        buffer = write_chunked(filename, block, n_cells, 0);
+    });
+    report();
+
+    bench::measure("SonataWriter, chunked and deflate 4", n_iter, n_cells, [&]() {
+        buffer = write_chunked(filename, block, n_cells, 4);
+    });
+    report();
+    return 0;
+}
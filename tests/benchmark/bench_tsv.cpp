@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include <fstream>
+#include <random>
+#include <regex>
+#include <sstream>
+
+#include <mvdtool/tsv.hpp>
+
+#ifdef __linux__
+#include <malloc.h>
+#endif
+
+#include "bench_utils.hpp"
+
+namespace {
+
+// A mecombo_emodel.tsv of `n_lines` distinct combos
+void write_tsv(const std::string& filename, size_t n_lines) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> current(-0.5, 0.5);
+    const char* const etypes[] = {"bAC", "bIR", "bNAC", "cADpyr", "dSTUT"};
+
+    std::ofstream out(filename);
+    out << "morph_name\tlayer\tfullmtype\tetype\temodel\tcombo_name\t"
+           "threshold_current\tholding_current\n";
+    for (size_t i = 0; i < n_lines; ++i) {
+        const std::string etype = etypes[i % 5];
+        const std::string morphology = "morph_" + std::to_string(i);
+        out << morphology << '\t' << (i % 6) + 1 << "\tL" << (i % 6) + 1 << "_PC\t" << etype
+            << '\t' << etype << '_' << i % 1000 << '\t' << etype << '_' << morphology << '\t'
+            << current(gen) << '\t' << current(gen) << '\n';
+    }
+}
+
+// The entries and table TSVFile held before interning their strings
+struct LegacyEntry {
+    std::string morphologyName;
+    std::string layer;
+    std::string fullMType;
+    std::string eType;
+    std::string eModel;
+    std::string comboName;
+    double thresholdCurrent;
+    double holdingCurrent;
+};
+
+struct legacy_pair_hash {
+    std::size_t operator()(const std::pair<std::string, std::string>& pair) const {
+        return std::hash<std::string>()(pair.first) ^ std::hash<std::string>()(pair.second);
+    }
+};
+
+using LegacyTable =
+    std::unordered_map<std::pair<std::string, std::string>, LegacyEntry, legacy_pair_hash>;
+
+// The parser TSVFile used before reading the file through a memory mapping
+void regex_split_parse(const std::string& filename, LegacyTable& entries) {
+    entries.clear();
+    std::ifstream file(filename);
+    std::string line;
+    std::getline(file, line);
+    while (std::getline(file, line)) {
+        line = std::regex_replace(line, std::regex("^\t+|\t+$"), "");
+        std::stringstream ss(line);
+        std::vector<std::string> fields;
+        std::string item;
+        while (std::getline(ss, item, '\t')) {
+            fields.push_back(item);
+        }
+        entries.insert({{fields[5], fields[0]},
+                        LegacyEntry{fields[0], fields[1], fields[2], fields[3], fields[4],
+                                    fields[5], std::stod(fields[6]), std::stod(fields[7])}});
+    }
+}
+
+// Bytes allocated on the heap and in mappings of large blocks, 0 where glibc is not available
+size_t heap_in_use() {
+#ifdef __GLIBC__
+    const struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+}  // namespace
+
+///
+/// Loading a generated mecombo_emodel.tsv
+///
+/// Usage: bench_tsv [n_lines] [n_iter] [tsv_file]
+///
+int main(int argc, char** argv) {
+    const size_t n_lines = bench::arg(argc, argv, 1, size_t(2000000));
+    const size_t n_iter = bench::arg(argc, argv, 2, size_t(1));
+    const std::string filename = bench::arg(argc, argv, 3, std::string("bench_tsv.tsv"));
+
+    write_tsv(filename, n_lines);
+    std::cout << filename << ": " << n_lines << " lines\n";
+
+    size_t n_entries = 0;
+    size_t legacy_bytes = 0;
+    const double legacy = bench::measure("getline, regex trim, stringstream split", n_iter,
+                                         n_lines, [&]() {
+        const size_t heap = heap_in_use();
+        LegacyTable entries;
+        regex_split_parse(filename, entries);
+        legacy_bytes = heap_in_use() - heap;
+        n_entries = entries.size();
+    });
+
+    size_t mapped_bytes = 0;
+    const double mapped = bench::measure("TSVFile, memory mapped single pass", n_iter, n_lines,
+                                         [&]() {
+        const size_t heap = heap_in_use();
+        const TSV::TSVFile file(filename);
+        mapped_bytes = heap_in_use() - heap;
+        if (file.getAll().size() != n_entries) {
+            throw std::runtime_error("Parsers disagree on the number of entries");
+        }
+    });
+
+    TSV::TSVFile::openCached(filename, ".");
+    bench::measure("TSVFile::openCached, memory mapped cache", n_iter, n_lines, [&]() {
+        const TSV::TSVFile file = TSV::TSVFile::openCached(filename, ".");
+        if (file.getAll().size() != n_entries) {
+            throw std::runtime_error("The cache and the parser disagree on the number of entries");
+        }
+    });
+
+    std::cout << "heap per entry: " << legacy_bytes / n_lines << " bytes before, "
+              << mapped_bytes / n_lines << " bytes interned\n";
+    std::cout << "speedup: " << std::setprecision(1) << legacy / mapped << "x\n";
+    return 0;
+}
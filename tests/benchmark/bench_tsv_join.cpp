@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include <fstream>
+#include <random>
+
+#include <mvdtool/mvd3.hpp>
+
+#include "bench_utils.hpp"
+
+namespace {
+
+// A MVD3 circuit of `n_cells` drawing from `n_combos` me_combos, each with
+// its own morphology, and the mecombo_emodel.tsv of these combos
+void write_circuit(const std::string& mvd3_file,
+                   const std::string& tsv_file,
+                   size_t n_cells,
+                   size_t n_combos) {
+    std::vector<std::string> combos(n_combos), morphologies(n_combos);
+    std::ofstream tsv(tsv_file);
+    tsv << "morph_name\tlayer\tfullmtype\tetype\temodel\tcombo_name\t"
+           "threshold_current\tholding_current\n";
+    for (size_t i = 0; i < n_combos; ++i) {
+        morphologies[i] = "dend-C060114A2_axon-C060114A5_-_Clone_" + std::to_string(i);
+        combos[i] = "cADpyr_" + std::to_string(i % 6 + 1) + "_" + morphologies[i];
+        tsv << morphologies[i] << '\t' << i % 6 + 1 << "\tL" << i % 6 + 1 << "_TPC\tcADpyr\t"
+            << "cADpyr_" << i % 100 << '\t' << combos[i] << "\t0.1\t-0.05\n";
+    }
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<uint32_t> combo(0, uint32_t(n_combos - 1));
+    std::vector<uint32_t> indices(n_cells);
+    for (auto& index: indices) {
+        index = combo(gen);
+    }
+    HighFive::File file(mvd3_file, HighFive::File::Overwrite);
+    file.createDataSet("/cells/positions",
+                       boost::multi_array<double, 2>(boost::extents[n_cells][3]));
+    file.createDataSet("/cells/properties/me_combo", indices);
+    file.createDataSet("/cells/properties/morphology", indices);
+    file.createDataSet("/library/me_combo", combos);
+    file.createDataSet("/library/morphology", morphologies);
+}
+
+}  // namespace
+
+///
+/// Getting TSV columns for the cells of a MVD3 circuit, on the calling
+/// thread and on one worker per hardware thread
+///
+/// Usage: bench_tsv_join [n_cells] [n_combos] [n_iter] [mvd3_file] [tsv_file]
+///
+int main(int argc, char** argv) {
+    using namespace MVD3;
+
+    const size_t n_cells = bench::arg(argc, argv, 1, size_t(1000000));
+    const size_t n_combos = bench::arg(argc, argv, 2, size_t(20000));
+    const size_t n_iter = bench::arg(argc, argv, 3, size_t(1));
+    const std::string mvd3_file = bench::arg(argc, argv, 4, std::string("bench_tsv_join.mvd3"));
+    const std::string tsv_file = bench::arg(argc, argv, 5, std::string("bench_tsv_join.tsv"));
+
+    write_circuit(mvd3_file, tsv_file, n_cells, n_combos);
+    std::cout << mvd3_file << ": " << n_cells << " cells, " << n_combos << " me_combos\n";
+
+    MVD3File file(mvd3_file);
+    const TSV::TSVFile tsv(tsv_file);
+    const MVD::Selection all = MVD::Selection::fromRange(Range::all(), n_cells);
+
+    const double by_names = bench::measure("emodels, me_combo and morphology names", n_iter,
+                                           n_cells, [&]() {
+        // What MVD3File did before joining on library indices
+        MVD::utils::for_each_chunk(all, 256, [&](const MVD::Selection& chunk) {
+            tsv.getEmodels(file.getMECombos(chunk), file.getMorphologies(chunk));
+        });
+    });
+
+    bench::measure("openComboTsv, join table", 1, n_combos, [&]() {
+        file.openComboTsv(tsv_file);
+    });
+
+    const double joined = bench::measure("emodels, joined on library indices", n_iter, n_cells,
+                                         [&]() {
+        file.getEmodels(all);
+    });
+
+    bench::measure("threshold currents, joined on library indices", n_iter, n_cells, [&]() {
+        file.getThresholdCurrents(all);
+    });
+
+    bench::measure("etype, emodel and currents, one getter each", n_iter, n_cells, [&]() {
+        file.getEtypes(all);
+        file.getEmodels(all);
+        file.getThresholdCurrents(all);
+        file.getHoldingCurrents(all);
+    });
+
+    bench::measure("etype, emodel and currents, getTSVColumns", n_iter, n_cells, [&]() {
+        file.getTSVColumns(all,
+                           TSV::ColumnMask::EType | TSV::ColumnMask::EModel |
+                               TSV::ColumnMask::ThresholdCurrent |
+                               TSV::ColumnMask::HoldingCurrent);
+    });
+
+    file.setTSVWorkers(0);
+    const double parallel = bench::measure("emodels, joined on " +
+                                               std::to_string(file.getTSVWorkers()) + " workers",
+                                           n_iter, n_cells, [&]() {
+        file.getEmodels(all);
+    });
+
+    bench::measure("threshold currents, joined on " + std::to_string(file.getTSVWorkers()) +
+                       " workers",
+                   n_iter, n_cells, [&]() {
+        file.getThresholdCurrents(all);
+    });
+
+    std::cout << "speedup: " << std::setprecision(1) << by_names / joined << "x, "
+              << joined / parallel << "x on workers\n";
+    return 0;
+}
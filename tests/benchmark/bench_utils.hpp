@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace bench {
+
+///
+/// \brief measure
+/// Runs func `n_iter` times (after one warm-up run) and prints the average
+/// duration of a run divided by `calls_per_iter`
+/// \return the average duration per call, in microseconds
+///
+template <typename FuncT>
+inline double measure(const std::string& name,
+                      size_t n_iter,
+                      size_t calls_per_iter,
+                      const FuncT& func) {
+    using clock = std::chrono::steady_clock;
+    func();
+    const auto start = clock::now();
+    for (size_t i = 0; i < n_iter; ++i) {
+        func();
+    }
+    const std::chrono::duration<double, std::micro> elapsed = clock::now() - start;
+    const double per_call = elapsed.count() / double(n_iter * calls_per_iter);
+    std::cout << std::left << std::setw(48) << name << std::right << std::setw(12)
+              << std::fixed << std::setprecision(3) << per_call << " us/call\n";
+    return per_call;
+}
+
+/// Positional command line argument, with a default value
+inline std::string arg(int argc, char** argv, int i, const std::string& default_value) {
+    return (argc > i) ? std::string(argv[i]) : default_value;
+}
+
+inline size_t arg(int argc, char** argv, int i, size_t default_value) {
+    return (argc > i) ? std::strtoul(argv[i], nullptr, 10) : default_value;
+}
+
+}  // namespace bench
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2019, Blue Brain Project, EPFL
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include <mpi.h>
+
+#include <mvdtool/mvd_generic.hpp>
+
+#define BOOST_TEST_MODULE mvdMPI
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+
+using namespace MVD;
+
+
+struct MPIFixture {
+    MPIFixture() { MPI_Init(nullptr, nullptr); }
+    ~MPIFixture() { MPI_Finalize(); }
+};
+
+BOOST_GLOBAL_FIXTURE(MPIFixture);
+
+
+static size_t mpi_rank() {
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    return size_t(rank);
+}
+
+static size_t mpi_size() {
+    int size = 0;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    return size_t(size);
+}
+
+
+BOOST_AUTO_TEST_CASE( balancedBlocks )
+{
+    const auto block = balancedBlock(1000, mpi_rank(), mpi_size());
+    BOOST_REQUIRE_EQUAL(block.ranges().size(), 1);
+
+    // Blocks are contiguous and cover every cell
+    unsigned long bounds[2] = {block.ranges()[0][0], block.ranges()[0][1]};
+    std::vector<unsigned long> all_bounds(2 * mpi_size());
+    MPI_Allgather(bounds, 2, MPI_UNSIGNED_LONG, all_bounds.data(), 2, MPI_UNSIGNED_LONG,
+                  MPI_COMM_WORLD);
+    BOOST_CHECK_EQUAL(all_bounds.front(), 0);
+    BOOST_CHECK_EQUAL(all_bounds.back(), 1000);
+    for (size_t i = 1; i + 1 < all_bounds.size(); i += 2) {
+        BOOST_CHECK_EQUAL(all_bounds[i], all_bounds[i + 1]);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE( collectiveMVD3 )
+{
+    Selection block;
+    Positions positions;
+    std::vector<std::string> mtypes;
+    {
+        auto file = MVD::open(MVD3_FILENAME, MPI_COMM_WORLD);
+        block = balancedBlock(file->size(), mpi_rank(), mpi_size());
+        const auto batch = file->read(block);
+        utils::multi_array_assign(positions, batch.positions);
+        mtypes = batch.mtypes.values();
+    }
+
+    MVD3::MVD3File reference(MVD3_FILENAME);
+    BOOST_CHECK(positions == reference.getPositions(block));
+    const auto expected = reference.getMtypes(block);
+    BOOST_CHECK_EQUAL_COLLECTIONS(mtypes.begin(), mtypes.end(), expected.begin(), expected.end());
+}
+
+
+BOOST_AUTO_TEST_CASE( collectiveSonata )
+{
+    Selection block;
+    Positions positions;
+    std::vector<double> xs;
+    {
+        auto file = MVD::open(SONATA_FILENAME, MPI_COMM_WORLD);
+        block = balancedBlock(file->size(), mpi_rank(), mpi_size());
+        utils::multi_array_assign(positions, file->getPositions(block));
+
+        // Ranks without cells still take part in the collective reads
+        const auto first_only = (mpi_rank() == 0) ? Selection({{0, 10}}) : Selection();
+        BOOST_CHECK_EQUAL(file->getPositions(first_only).shape()[0], first_only.flatSize());
+
+        SonataFile& sonata = dynamic_cast<SonataFile&>(*file);
+        xs = sonata.getAttribute<double>("x", block);
+    }
+
+    SonataFile reference(SONATA_FILENAME);
+    BOOST_CHECK(positions == reference.getPositions(block));
+    BOOST_REQUIRE_EQUAL(xs.size(), block.flatSize());
+    if (!xs.empty()) {
+        BOOST_CHECK_EQUAL(xs.back(), positions[positions.shape()[0] - 1][0]);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE( collectiveMVD3TSV )
+{
+    // Fewer cells than ranks: some blocks are empty and make no TSV join at all
+    const size_t n_cells = mpi_size() - 1;
+    const auto block = balancedBlock(n_cells, mpi_rank(), mpi_size());
+    std::vector<std::string> emodels;
+    std::vector<double> currents;
+    Positions positions;
+    {
+        auto file = MVD::open(MVD3_TSV_FILENAME, MPI_COMM_WORLD);
+        file->openComboTsv(TSV_FILENAME);
+        emodels = file->getEmodels(block);
+        currents = file->getThresholdCurrents(block);
+        // Collective reads after the joins still involve every rank
+        utils::multi_array_assign(positions, file->getPositions(block));
+    }
+
+    MVD3::MVD3File reference(MVD3_TSV_FILENAME);
+    reference.openComboTsv(TSV_FILENAME);
+    const auto expected_emodels = reference.getEmodels(block);
+    BOOST_CHECK_EQUAL_COLLECTIONS(emodels.begin(), emodels.end(),
+                                  expected_emodels.begin(), expected_emodels.end());
+    const auto expected_currents = reference.getThresholdCurrents(block);
+    BOOST_CHECK_EQUAL_COLLECTIONS(currents.begin(), currents.end(),
+                                  expected_currents.begin(), expected_currents.end());
+    BOOST_CHECK(positions == reference.getPositions(block));
+}
+
+
+// A single range, short and long sparse runs, or nothing, depending on the rank
+static Selection shaped_selection(size_t rank) {
+    switch (rank % 4) {
+    case 0:
+        return Selection({{0, 10}});
+    case 1:
+        return Selection({{1, 2}, {5, 6}, {9, 10}, {500, 501}});
+    case 2:
+        return Selection({{0, 100}, {300, 400}});
+    default:
+        return Selection();
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE( collectiveShapedSelections )
+{
+    // Every rank makes the same collective calls, whatever its selection
+    const auto selection = shaped_selection(mpi_rank());
+    Positions mvd3_positions, sonata_positions;
+    std::vector<std::string> mtypes;
+    std::vector<double> xs;
+    {
+        auto mvd3 = MVD::open(MVD3_FILENAME, MPI_COMM_WORLD);
+        utils::multi_array_assign(mvd3_positions, mvd3->getPositions(selection));
+        mtypes = mvd3->getCategoricalMtypes(selection).values();
+
+        auto sonata = MVD::open(SONATA_FILENAME, MPI_COMM_WORLD);
+        utils::multi_array_assign(sonata_positions, sonata->getPositions(selection));
+        xs = sonata->getTypedAttribute("x", selection).get<double>();
+    }
+
+    MVD3::MVD3File mvd3_reference(MVD3_FILENAME);
+    BOOST_CHECK(mvd3_positions == mvd3_reference.getPositions(selection));
+    const auto expected_mtypes = mvd3_reference.getMtypes(selection);
+    BOOST_CHECK_EQUAL_COLLECTIONS(mtypes.begin(), mtypes.end(),
+                                  expected_mtypes.begin(), expected_mtypes.end());
+
+    SonataFile sonata_reference(SONATA_FILENAME);
+    BOOST_CHECK(sonata_positions == sonata_reference.getPositions(selection));
+    BOOST_REQUIRE_EQUAL(xs.size(), selection.flatSize());
+    for (size_t i = 0; i < xs.size(); ++i) {
+        BOOST_CHECK_EQUAL(xs[i], sonata_positions[i][0]);
+    }
+}
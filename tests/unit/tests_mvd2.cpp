@@ -16,8 +16,11 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  *
  */
+#include <fstream>
+
 #include <mvdtool/mvd_base.hpp>
 #include <mvdtool/mvd2.hpp>
+#include <mvdtool/mvd_generic.hpp>
 
 
 #define BOOST_TEST_MODULE mvd2Parser
@@ -149,6 +152,83 @@ BOOST_AUTO_TEST_CASE( inputDataMVD2Parsing )
 
 
 
+struct MVD2ViewChecker{
+    int operator ()(MVD2::DataSet type, boost::string_view line){
+        using namespace MVD2;
+        if(type == NeuronLoaded){
+            boost::string_view name, metype;
+            int database, column, minicolumn, layer, morph, elec;
+            parseNeuronLine(line, name, database, column, minicolumn, layer, morph, elec, xyzr, metype);
+            names.push_back(name.to_string());
+            metypes.push_back(metype.to_string());
+        }
+        return 0;
+    }
+
+    std::vector<double> xyzr;
+    std::vector<std::string> names, metypes;
+};
+
+
+BOOST_AUTO_TEST_CASE( inputDataMVD2ParsingViews )
+{
+    using namespace MVD2;
+
+    MVD2File file(MVD2_FILENAME);
+    MVD2ViewChecker checker;
+    file.parse(checker);
+
+    BOOST_REQUIRE_EQUAL(checker.names.size(), 1000);
+    BOOST_CHECK_EQUAL(checker.names[146], "sm101103b1-2_INT_idC");
+    BOOST_CHECK_EQUAL(checker.metypes[146], "cACint2090_L23_MC_2_sm101103b1-2_INT_idC");
+    BOOST_CHECK_EQUAL(checker.names.size(), file.getNbNeuron());
+}
+
+
+BOOST_AUTO_TEST_CASE( longLinesMVD2Parsing )
+{
+    using namespace MVD2;
+
+    // Names longer than the 1024 bytes lines used to be read by
+    const std::string filename = "test_long_lines.mvd2";
+    const std::string name(2000, 'n');
+    {
+        std::ofstream out(filename);
+        out << " Application:'test'\n/morphologies\n/unknown/\nNeurons Loaded\n"
+            << name << " 0 0 1 2 3 4 1.5 -2.5e1 +3 -0.25 " << name << "_metype\r\n"
+            << "short 0 0 1 2 3 4 0 0 0 0 metype\n";
+    }
+    MVD2File file(filename);
+    BOOST_CHECK_EQUAL(file.getNbNeuron(), 2);
+    BOOST_CHECK_EQUAL(file.getNbMorpho(), 2);
+    BOOST_CHECK_EQUAL(file.getUniqueMorphologies().count(name), 1);
+
+    const MVD::Positions positions = file.getPositions();
+    BOOST_CHECK_EQUAL(positions[0][0], 1.5);
+    BOOST_CHECK_EQUAL(positions[0][1], -25.);
+    BOOST_CHECK_EQUAL(positions[0][2], 3.);
+    BOOST_CHECK_EQUAL(file.getRotationAngles()[0], -0.25);
+
+    std::string name_str, metype;
+    int database, column, minicolumn, layer, morph, elec;
+    std::vector<float> xyzr;
+    parseNeuronLine((name + " 0 0 1 2 3 4 1.5 -2.5e1 +3 -0.25 " + name + "_metype\n").c_str(),
+                    name_str, database, column, minicolumn, layer, morph, elec, xyzr, metype);
+    BOOST_CHECK_EQUAL(name_str, name);
+    BOOST_CHECK_EQUAL(metype, name + "_metype");
+    BOOST_CHECK_EQUAL(elec, 4);
+
+    // Numbers span their whole field
+    BOOST_CHECK_THROW(parseNeuronLine("name 0 0 1x 2 3 4 0 0 0 0 metype", name_str, database, column,
+                                      minicolumn, layer, morph, elec, xyzr, metype),
+                      MVDParserException);
+    BOOST_CHECK_THROW(parseNeuronLine("name 0 0 1 2 3 4 0 0 0 0", name_str, database, column,
+                                      minicolumn, layer, morph, elec, xyzr, metype),
+                      MVDParserException);
+}
+
+
+
 ////////////////////////////////////////////////////
 /// New common API
 ////////////////////////////////////////////////////
@@ -194,12 +274,19 @@ BOOST_AUTO_TEST_CASE( basicTestRotations )
 
     MVD2File file(MVD2_FILENAME);
 
-    MVD::Positions neurons_pos = file.getRotations();
+    const std::vector<double> angles = file.getRotationAngles();
 
-    BOOST_CHECK_EQUAL(neurons_pos.shape()[0], 1000);
-    BOOST_CHECK_EQUAL(neurons_pos[0][0], -1.146572);
-    BOOST_CHECK_EQUAL(neurons_pos[146][0], -125.718090);
+    BOOST_CHECK_EQUAL(angles.size(), 1000);
+    BOOST_CHECK_EQUAL(angles[0], -1.146572);
+    BOOST_CHECK_EQUAL(angles[146], -125.718090);
 
+    // Quaternions around y, as converted to MVD3
+    const MVD::Rotations rotations = file.getRotations();
+    BOOST_CHECK_EQUAL(rotations.shape()[0], 1000);
+    BOOST_CHECK_EQUAL(rotations[146][0], 0.);
+    BOOST_CHECK_EQUAL(rotations[146][2], 0.);
+    BOOST_CHECK_CLOSE(rotations[146][1], std::sin(-125.718090 * M_PI / 360), 1e-9);
+    BOOST_CHECK_CLOSE(rotations[146][3], std::cos(-125.718090 * M_PI / 360), 1e-9);
 }
 
 
@@ -209,10 +296,154 @@ BOOST_AUTO_TEST_CASE( basicTestRotationsRange )
 
     MVD2File file(MVD2_FILENAME);
 
-    MVD::Positions neurons_pos = file.getRotations(MVD::Range(100, 50));
+    const std::vector<double> angles = file.getRotationAngles(MVD::Range(100, 50));
+
+    BOOST_CHECK_EQUAL(angles.size(), 50);
+    BOOST_CHECK_EQUAL(angles[46], -125.718090);
+
+    const MVD::Rotations rotations = file.getRotations(MVD::Range(100, 50));
+    BOOST_CHECK_EQUAL(rotations.shape()[0], 50);
+    BOOST_CHECK_EQUAL(rotations[46][1], file.getRotations()[146][1]);
+}
 
-    BOOST_CHECK_EQUAL(neurons_pos.shape()[0], 50);
-    BOOST_CHECK_EQUAL(neurons_pos[46][0], -125.718090);
 
+BOOST_AUTO_TEST_CASE( fileInterface )
+{
+    const auto file = MVD::open(MVD2_FILENAME);
+    BOOST_REQUIRE_EQUAL(file->size(), 1000);
+
+    BOOST_CHECK_EQUAL(file->getMorphologies()[0], "sm090227a1-2_idC");
+    BOOST_CHECK_EQUAL(file->getMtypes()[0], "L1_SLAC");
+    BOOST_CHECK_EQUAL(file->getSynapseClass()[0], "INH");
+    BOOST_CHECK_EQUAL(file->getEtypes()[0], "cACint");
+    BOOST_CHECK_EQUAL(file->getPositions()[0][0], 40.821401);
+    BOOST_CHECK_EQUAL(file->listAllMtypes().size(), 9);
+    BOOST_CHECK_EQUAL(file->listAllEtypes().size(), 2);
+
+    const MVD2::MVD2File& mvd2 = dynamic_cast<const MVD2::MVD2File&>(*file);
+    BOOST_CHECK_EQUAL(mvd2.getMECombos()[0], "cACint2090_L1_SLAC_1_sm090227a1-2_idC");
+    BOOST_CHECK_EQUAL(mvd2.getLayers()[0], "1");
+    BOOST_CHECK_EQUAL(mvd2.getHyperColumns()[0], 0);
+    BOOST_CHECK_EQUAL(mvd2.getMiniColumns()[0], 1);
+    BOOST_CHECK_EQUAL(mvd2.listAllMorphologies().size(), 52);
+    const std::vector<double> seeds{837632, 2906729, 4236279};
+    const std::vector<double> circuit_seeds = mvd2.getCircuitSeeds();
+    BOOST_CHECK_EQUAL_COLLECTIONS(circuit_seeds.begin(), circuit_seeds.end(),
+                                  seeds.begin(), seeds.end());
+
+    // Selections are slices of the same columns as ranges
+    const MVD::Selection selection({{10, 20}, {500, 505}});
+    const std::vector<std::string> mtypes = file->getMtypes(selection);
+    const std::vector<std::string> mtypes_range = file->getMtypes(MVD::Range(500, 5));
+    BOOST_REQUIRE_EQUAL(mtypes.size(), 15);
+    BOOST_CHECK_EQUAL_COLLECTIONS(mtypes.begin() + 10, mtypes.end(),
+                                  mtypes_range.begin(), mtypes_range.end());
+    const MVD::Categorical morphologies = file->getCategoricalMorphologies(selection);
+    BOOST_CHECK_EQUAL(morphologies.values()[0], file->getMorphologies()[10]);
+    BOOST_CHECK_EQUAL(file->getRotations(selection)[14][3], file->getRotations()[504][3]);
+    BOOST_CHECK_THROW(file->getMtypes(MVD::Selection({{990, 1001}})), MVDException);
+
+    // No regions nor mini frequencies in MVD2
+    BOOST_CHECK(file->hasRotations());
+    BOOST_CHECK(!file->hasMiniFrequencies());
+    BOOST_CHECK(!file->hasCurrents());
+    BOOST_CHECK_THROW(file->getRegions(), MVDException);
+    const MVD::CellBatch batch = file->read(selection);
+    BOOST_CHECK_EQUAL(batch.size(), 15);
+    BOOST_CHECK_EQUAL(batch.regions.size(), 0);
+    BOOST_CHECK_EQUAL(batch.mtypes[0], mtypes[0]);
+}
+
+
+
+BOOST_AUTO_TEST_CASE( parallelColumns )
+{
+    using namespace MVD2;
+
+    MVD2File serial(MVD2_FILENAME);
+    MVD2File parallel(MVD2_FILENAME);
+    parallel.setParseWorkers(7);
+    BOOST_CHECK_EQUAL(parallel.getParseWorkers(), 7);
+
+    // Chunks are concatenated in gid order, with the names of the first
+    // chunks encoded first
+    const NeuronColumns& expected = serial.getColumns();
+    const NeuronColumns& columns = parallel.getColumns();
+    BOOST_CHECK(columns.xyzr == expected.xyzr);
+    BOOST_CHECK(columns.layers == expected.layers);
+    BOOST_CHECK(columns.morphologies == expected.morphologies);
+    BOOST_CHECK(columns.me_combos == expected.me_combos);
+    BOOST_CHECK(columns.synapse_class == expected.synapse_class);
+    BOOST_CHECK(*columns.morphology_names == *expected.morphology_names);
+    BOOST_CHECK(*columns.me_combo_names == *expected.me_combo_names);
+    BOOST_CHECK(*columns.mtype_names == *expected.mtype_names);
+    BOOST_CHECK(columns.seeds == expected.seeds);
+
+    // Errors of any chunk reach the caller, as do types missing from the
+    // sections after the neurons
+    const std::string filename = "test_parallel_columns.mvd2";
+    for (const char* invalid_neuron: {"0 0 1x 0 0 0", "0 0 1 0 5 0"}) {
+        {
+            std::ofstream out(filename);
+            out << " Application:'test'\n/morphologies\n/unknown/\nNeurons Loaded\n";
+            for (int i = 0; i < 100; ++i) {
+                out << "morph_" << i << ' ' << (i == 90 ? invalid_neuron : "0 0 1 0 0 0")
+                    << " 0 0 0 0 metype\n";
+            }
+            out << "MorphTypes\nL1_SLAC INT INH\nElectroTypes\ncACint\n";
+        }
+        MVD2File invalid(filename);
+        invalid.setParseWorkers(4);
+        BOOST_CHECK_THROW(invalid.getColumns(), MVDParserException);
+    }
 }
 
+
+BOOST_AUTO_TEST_CASE( lineIndex )
+{
+    using namespace MVD2;
+
+    MVD2File file(MVD2_FILENAME);
+    const LineIndex& index = file.getLineIndex();
+    BOOST_CHECK_EQUAL(index.neurons.size(), 1000);
+    BOOST_CHECK_EQUAL(index.countLines(MorphTypes), 9);
+    BOOST_CHECK_EQUAL(index.countLines(ElectroTypes), 2);
+
+    // Ranges are read from their first line, up to the last neuron
+    const MVD::Positions all_neurons_pos = file.getPositions();
+    const MVD::Positions last_pos = file.getPositions(MVD::Range(990, 10));
+    BOOST_REQUIRE_EQUAL(last_pos.shape()[0], 10);
+    for (size_t i = 0; i < 10; ++i) {
+        BOOST_CHECK_EQUAL_COLLECTIONS(last_pos[i].begin(), last_pos[i].end(),
+                                      all_neurons_pos[i + 990].begin(), all_neurons_pos[i + 990].end());
+    }
+    BOOST_CHECK_EQUAL(file.getRotationAngles(MVD::Range(999, 1))[0], file.getRotationAngles()[999]);
+
+    // Through the index saved next to a copy of the file, twice to read it
+    const std::string filename = "test_line_index.mvd2";
+    {
+        std::ifstream in(MVD2_FILENAME);
+        std::ofstream out(filename);
+        out << in.rdbuf();
+    }
+    const std::string index_filename = MVD2File::indexFilename(filename);
+    std::remove(index_filename.c_str());
+    for (int i = 0; i < 2; ++i) {
+        MVD2File cached = MVD2File::openCached(filename);
+        BOOST_CHECK(std::ifstream(index_filename).good());
+        BOOST_CHECK_EQUAL(cached.getNbNeuron(), 1000);
+        BOOST_CHECK_EQUAL(cached.getNbMorphoType(), 9);
+        BOOST_CHECK_EQUAL(cached.getNbMorpho(), 52);
+        BOOST_CHECK_EQUAL(cached.getNbColumns(), 10);
+        BOOST_CHECK_EQUAL(cached.getPositions(MVD::Range(146, 1))[0][2], all_neurons_pos[146][2]);
+    }
+
+    // A corrupt index is scanned and written again
+    {
+        std::ofstream out(index_filename, std::ios::binary | std::ios::in);
+        out.seekp(-1, std::ios::end);
+        out.put('#');
+    }
+    BOOST_CHECK_EQUAL(MVD2File::openCached(filename).getPositions(MVD::Range(146, 1))[0][2],
+                      all_neurons_pos[146][2]);
+}
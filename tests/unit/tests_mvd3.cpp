@@ -16,6 +16,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  *
  */
+#include <fstream>
+
 #include <mvdtool/mvd_generic.hpp>
 
 #define BOOST_TEST_MODULE mvd3Parser
@@ -160,6 +162,331 @@ BOOST_AUTO_TEST_CASE( basicTestMorphologiesRange )
 
 
 
+BOOST_AUTO_TEST_CASE( basicTestMorphologiesChunked )
+{
+    using namespace MVD3;
+
+    MVD3File file(MVD3_FILENAME);
+
+    // Library is decoded once and reused by every chunk
+    const std::vector<std::string> all_morpho = file.getMorphologies();
+    for (size_t offset = 0; offset < all_morpho.size(); offset += 7) {
+        const auto morpho = file.getMorphologies(Range(offset, std::min<size_t>(7, all_morpho.size() - offset)));
+        BOOST_CHECK_EQUAL_COLLECTIONS(morpho.begin(), morpho.end(),
+                                      all_morpho.begin() + offset, all_morpho.begin() + offset + morpho.size());
+    }
+    BOOST_CHECK_EQUAL(file.listAllMorphologies().size(), 52);
+}
+
+
+
+BOOST_AUTO_TEST_CASE( basicTestCategorical )
+{
+    using namespace MVD3;
+
+    MVD3File file(MVD3_FILENAME);
+
+    const auto morpho = file.getCategoricalMorphologies(Range(10, 20));
+    const auto values = file.getMorphologies(Range(10, 20));
+    BOOST_CHECK_EQUAL(morpho.size(), 20);
+    const auto decoded = morpho.values();
+    BOOST_CHECK_EQUAL_COLLECTIONS(decoded.begin(), decoded.end(),
+                                  values.begin(), values.end());
+    BOOST_CHECK_EQUAL(morpho.dictionary().size(), 52);
+    BOOST_CHECK_EQUAL(morpho.code(values[0]), morpho.codes()[0]);
+    BOOST_CHECK_EQUAL(morpho.code("not-a-morphology"), MVD::Categorical::npos);
+
+    // The /library table is shared, codes are comparable across calls
+    const auto morpho_all = file.getCategoricalMorphologies();
+    BOOST_CHECK_EQUAL(&morpho_all.dictionary(), &morpho.dictionary());
+    BOOST_CHECK_EQUAL(morpho_all.codes()[10], morpho.codes()[0]);
+
+    BOOST_CHECK(file.hasRegions());
+    const auto regions = file.getCategoricalRegions();
+    BOOST_CHECK_EQUAL(regions[1], "L1");
+    BOOST_CHECK_EQUAL(regions[15], "L23");
+    const auto syn_class = file.getCategoricalSynapseClass();
+    BOOST_CHECK_EQUAL(syn_class.dictionary().size(), file.listAllSynapseClass().size());
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestCellBatch )
+{
+    using namespace MVD3;
+
+    MVD3File file(MVD3_FILENAME);
+
+    const auto batch = file.read(Range(990, 0));
+    BOOST_CHECK_EQUAL(batch.size(), 10);
+    BOOST_CHECK_EQUAL(batch.positions.shape()[0], 10);
+    BOOST_CHECK_EQUAL(batch.rotations.shape()[0], 10);
+    BOOST_CHECK(batch.positions == file.getPositions(Range(990, 10)));
+    BOOST_CHECK(batch.rotations == file.getRotations(Range(990, 10)));
+    BOOST_CHECK_EQUAL(batch.morphologies[3], file.getMorphologies(Range(993, 1))[0]);
+    BOOST_CHECK_EQUAL(batch.mtypes[9], file.getMtypes(Range(999, 1))[0]);
+    BOOST_CHECK_EQUAL(batch.synapse_class.size(), 10);
+
+    const auto partial = file.read(Range(0, 5), MVD::CellColumn::Etypes | MVD::CellColumn::Regions);
+    BOOST_CHECK_EQUAL(partial.positions.num_elements(), 0);
+    BOOST_CHECK_EQUAL(partial.morphologies.size(), 0);
+    BOOST_CHECK_EQUAL(partial.etypes.size(), 5);
+    BOOST_CHECK_EQUAL(partial.regions[1], "L1");
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestSelection )
+{
+    using namespace MVD3;
+
+    MVD3File file(MVD3_FILENAME);
+    const auto all_positions = file.getPositions();
+    const auto all_mtypes = file.getMtypes();
+
+    // few scattered cells: point selection
+    const auto sparse = MVD::Selection::fromIndices(std::vector<size_t>{2, 995, 996, 997});
+    BOOST_CHECK_EQUAL(sparse.ranges().size(), 2);
+    BOOST_CHECK_EQUAL(sparse.flatSize(), 4);
+
+    const auto positions = file.getPositions(sparse);
+    BOOST_CHECK_EQUAL(positions.shape()[0], 4);
+    BOOST_CHECK_EQUAL(positions.shape()[1], 3);
+    BOOST_CHECK_EQUAL(positions[0][1], all_positions[2][1]);
+    BOOST_CHECK_EQUAL(positions[3][2], all_positions[997][2]);
+
+    const auto mtypes = file.getMtypes(sparse);
+    BOOST_CHECK_EQUAL(mtypes[0], all_mtypes[2]);
+    BOOST_CHECK_EQUAL(mtypes[1], all_mtypes[995]);
+    BOOST_CHECK_EQUAL(file.getHyperColumns(sparse)[3], file.getHyperColumns(Range(997, 1))[0]);
+
+    // long runs: one hyperslab per range
+    const MVD::Selection runs({{0, 100}, {500, 700}});
+    const auto morphologies = file.getMorphologies(runs);
+    const auto head = file.getMorphologies(Range(0, 100));
+    const auto tail = file.getMorphologies(Range(500, 200));
+    BOOST_REQUIRE_EQUAL(morphologies.size(), 300);
+    BOOST_CHECK_EQUAL_COLLECTIONS(morphologies.begin(), morphologies.begin() + 100,
+                                  head.begin(), head.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(morphologies.begin() + 100, morphologies.end(),
+                                  tail.begin(), tail.end());
+    BOOST_CHECK(file.getRotations(runs)[150] == file.getRotations(Range(550, 1))[0]);
+
+    const auto batch = file.read(sparse);
+    BOOST_CHECK_EQUAL(batch.size(), 4);
+    BOOST_CHECK(batch.positions == positions);
+    BOOST_CHECK_EQUAL(batch.mtypes[2], all_mtypes[996]);
+
+    BOOST_CHECK_EQUAL(file.getPositions(MVD::Selection()).shape()[0], 0);
+    BOOST_CHECK_EQUAL(file.getEtypes(MVD::Selection()).size(), 0);
+
+    BOOST_CHECK_THROW(MVD::Selection({{10, 5}}), MVDException);
+    BOOST_CHECK_THROW(MVD::Selection({{0, 10}, {5, 20}}), MVDException);
+    BOOST_CHECK_THROW(MVD::Selection::fromIndices(std::vector<size_t>{3, 3}), MVDException);
+    BOOST_CHECK_THROW(file.getMtypes(MVD::Selection({{990, 1001}})), MVDException);
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestReadInto )
+{
+    using namespace MVD3;
+
+    MVD3File file(MVD3_FILENAME);
+
+    // Positions interleaved with a 4th value owned by the caller
+    std::vector<double> buffer(10 * 4, -1.);
+    file.readPositions(Range(990, 10), buffer.data(), 4);
+    const auto positions = file.getPositions(Range(990, 10));
+    for (size_t i = 0; i < 10; ++i) {
+        BOOST_CHECK_EQUAL(buffer[i * 4], positions[i][0]);
+        BOOST_CHECK_EQUAL(buffer[i * 4 + 2], positions[i][2]);
+        BOOST_CHECK_EQUAL(buffer[i * 4 + 3], -1.);
+    }
+
+    std::vector<double> rotations(5 * 4);
+    file.readRotations(Range(0, 5), rotations.data());
+    BOOST_CHECK_EQUAL(rotations[4 * 4 - 1], file.getRotations(Range(3, 1))[0][3]);
+
+    std::vector<int32_t> hypercolumns(10);
+    file.readAttribute("hypercolumn", Range(100, 10), hypercolumns.data());
+    const auto expected = file.getHyperColumns(Range(100, 10));
+    BOOST_CHECK_EQUAL_COLLECTIONS(hypercolumns.begin(), hypercolumns.end(),
+                                  expected.begin(), expected.end());
+
+    std::vector<double> converted(10);
+    file.readAttribute("hypercolumn", Range(100, 10), converted.data());
+    BOOST_CHECK_EQUAL(converted[7], double(expected[7]));
+
+    BOOST_CHECK_THROW(file.readAttribute("unknown", Range(0, 1), converted.data()), MVDException);
+    BOOST_CHECK_THROW(file.readPositions(Range(0, 1), buffer.data(), 2), MVDException);
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestChunks )
+{
+    using namespace MVD3;
+
+    MVD3File file(MVD3_FILENAME);
+    const auto all_positions = file.getPositions();
+    const auto all_mtypes = file.getMtypes();
+
+    // Chunks are only prefetched on another thread with a thread-safe HDF5
+    BOOST_CHECK_EQUAL(file.concurrentReads(), MVD::utils::library_is_threadsafe());
+    auto chunks = file.chunks(300, MVD::CellColumn::Positions | MVD::CellColumn::Mtypes);
+    BOOST_CHECK_LE(chunks.chunkSize(), 300);
+    if (file.storageChunkSize() > 0 && file.storageChunkSize() <= 300) {
+        BOOST_CHECK_EQUAL(chunks.chunkSize() % file.storageChunkSize(), 0);
+    }
+
+    size_t offset = 0, n_chunks = 0;
+    for (const auto& batch: chunks) {
+        BOOST_REQUIRE_EQUAL(batch.selection.ranges()[0][0], offset);
+        BOOST_CHECK_EQUAL(batch.positions[0][1], all_positions[offset][1]);
+        BOOST_CHECK_EQUAL(batch.mtypes[batch.size() - 1], all_mtypes[offset + batch.size() - 1]);
+        BOOST_CHECK_EQUAL(batch.rotations.num_elements(), 0);
+        offset += batch.size();
+        ++n_chunks;
+    }
+    BOOST_CHECK_EQUAL(offset, 1000);
+    BOOST_CHECK_EQUAL(n_chunks, chunks.size());
+    BOOST_CHECK(chunks.begin() == chunks.end());
+
+    BOOST_CHECK_THROW(file.chunks(0), MVDException);
+
+    // Never rounded above the requested size
+    BOOST_CHECK_EQUAL(MVD::utils::align_chunk_size(200, 100000), 200);
+    BOOST_CHECK_EQUAL(MVD::utils::align_chunk_size(250000, 100000), 200000);
+    BOOST_CHECK_EQUAL(MVD::utils::align_chunk_size(100000, 100000), 100000);
+    BOOST_CHECK_EQUAL(MVD::utils::align_chunk_size(300, 0), 300);
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestLibraryGather )
+{
+    using namespace MVD3;
+
+    const auto index = MVD3File(MVD3_FILENAME).getIndexMorphologies();
+    const auto all_morphologies = MVD3File(MVD3_FILENAME).getMorphologies();
+    const size_t n_morphologies = MVD3File(MVD3_FILENAME).listAllMorphologies().size();
+
+    // Two cells using library entries far apart: only those two are read
+    const auto low = std::min_element(index.begin(), index.end()) - index.begin();
+    const auto high = std::find_if(index.begin(), index.end(), [&](size_t i) {
+        return i > index[low] + 16 && (i - index[low] + 1) * 4 < n_morphologies * 3;
+    }) - index.begin();
+    BOOST_REQUIRE(size_t(high) < index.size());
+
+    MVD3File file(MVD3_FILENAME);
+    const auto sparse = file.getMorphologies(
+        MVD::Selection::fromIndices(std::vector<size_t>{size_t(std::min(low, high)),
+                                                        size_t(std::max(low, high))}));
+    BOOST_CHECK_EQUAL(sparse[low < high ? 0 : 1], all_morphologies[low]);
+    BOOST_CHECK_EQUAL(sparse[low < high ? 1 : 0], all_morphologies[high]);
+    BOOST_CHECK_EQUAL(file.getLibraryGatherStats().points, 1);
+
+    // A single entry is read as a span
+    BOOST_CHECK_EQUAL(file.getMorphologies(Range(low, 1))[0], all_morphologies[low]);
+    BOOST_CHECK_EQUAL(file.getLibraryGatherStats().span, 1);
+
+    // All the cells read the whole table, which serves the later calls
+    const auto morphologies = file.getMorphologies();
+    BOOST_CHECK_EQUAL_COLLECTIONS(morphologies.begin(), morphologies.end(),
+                                  all_morphologies.begin(), all_morphologies.end());
+    BOOST_CHECK_EQUAL(file.getMorphologies(Range(low, 1))[0], all_morphologies[low]);
+    const auto stats = file.getLibraryGatherStats();
+    BOOST_CHECK_EQUAL(stats.full_table, 1);
+    BOOST_CHECK_EQUAL(stats.cached, 1);
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestSchema )
+{
+    using namespace MVD3;
+
+    MVD3File file(MVD3_FILENAME);
+    const auto& schema = file.getSchema();
+
+    const auto& positions = schema.get("/cells/positions");
+    BOOST_CHECK_EQUAL(positions.dtype, "double");
+    BOOST_CHECK_EQUAL(positions.dims.size(), 2);
+    BOOST_CHECK_EQUAL(positions.rows(), file.getNbNeuron());
+    BOOST_CHECK_EQUAL(positions.chunk_rows, file.storageChunkSize());
+
+    const auto& morphologies = schema.get("/cells/properties/morphology");
+    BOOST_CHECK(morphologies.enumeration);
+    BOOST_CHECK_EQUAL(schema.get("/library/morphology").rows(),
+                      file.listAllMorphologies().size());
+    BOOST_CHECK_EQUAL(schema.get("/library/morphology").dtype, "string");
+    BOOST_CHECK(!schema.get("/cells/properties/layer").enumeration);
+    BOOST_CHECK_EQUAL(schema.get("/cells/properties/hypercolumn").dtype, "int32_t");
+
+    BOOST_CHECK_EQUAL(file.hasRotations(), schema.has("/cells/orientations"));
+    BOOST_CHECK(file.hasMiniFrequencies());
+    BOOST_CHECK_EQUAL(&file.getSchema(), &schema);
+    BOOST_CHECK_THROW(schema.get("/cells/unknown"), MVDException);
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestTypedAttribute )
+{
+    using namespace MVD3;
+
+    MVD3File file(MVD3_FILENAME);
+
+    const auto hypercolumns = file.getTypedAttribute("hypercolumn", Range(10, 20));
+    BOOST_CHECK_EQUAL(hypercolumns.dtype(), "int32_t");
+    BOOST_CHECK(hypercolumns.get<int32_t>() == file.getHyperColumns(Range(10, 20)));
+
+    const auto etypes = file.getTypedAttribute("etype", MVD::Selection({{0, 2}, {500, 502}}));
+    BOOST_CHECK_EQUAL(etypes.dtype(), "uint64_t");
+    BOOST_CHECK_EQUAL(etypes.size(), 4);
+    BOOST_CHECK_EQUAL(etypes.get<uint64_t>()[3], file.getIndexEtypes(Range(501, 1))[0]);
+
+    BOOST_CHECK_THROW(etypes.get<double>(), MVDException);
+    BOOST_CHECK_THROW(file.getTypedAttribute("unknown"), MVDException);
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestQuery )
+{
+    using namespace MVD3;
+
+    MVD3File file(MVD3_FILENAME);
+
+    const auto mtypes = file.getMtypes();
+    const auto regions = file.getRegions();
+    const auto layers = file.getTypedAttribute("layer").get<int32_t>();
+    const auto positions = file.getPositions();
+
+    const auto query = MVD::Query(100)
+                           .in("mtype", {mtypes[0], mtypes[500], "unknown"})
+                           .equals("region", regions[0])
+                           .between("layer", 1, layers[0])
+                           .between("x", -1e9, positions[0][0]);
+
+    std::vector<size_t> expected;
+    for (size_t i = 0; i < mtypes.size(); ++i) {
+        if ((mtypes[i] == mtypes[0] || mtypes[i] == mtypes[500]) && regions[i] == regions[0] &&
+            layers[i] >= 1 && layers[i] <= layers[0] && positions[i][0] <= positions[0][0]) {
+            expected.push_back(i);
+        }
+    }
+    BOOST_CHECK(!expected.empty());
+    BOOST_CHECK(query.select(file).flatten() == expected);
+
+    // Restricted to a selection
+    const MVD::Selection cells({{0, 1}, {200, 700}});
+    std::vector<size_t> expected_cells;
+    std::copy_if(expected.begin(), expected.end(), std::back_inserter(expected_cells),
+                 [](size_t i) { return i == 0 || (i >= 200 && i < 700); });
+    BOOST_CHECK(query.select(file, cells).flatten() == expected_cells);
+
+    BOOST_CHECK(MVD::Query().equals("mtype", "unknown").select(file).empty());
+    BOOST_CHECK_EQUAL(MVD::Query().in("morph_class", {"INT", "PYR"}).select(file).flatSize(),
+                      1000);
+    BOOST_CHECK_THROW(MVD::Query().equals("layer", "5").select(file), MVDException);
+    BOOST_CHECK_THROW(MVD::Query().equals("unknown", 1).select(file), MVDException);
+}
+
+
 BOOST_AUTO_TEST_CASE( basicTestEtype )
 {
     using namespace MVD3;
@@ -469,6 +796,22 @@ BOOST_AUTO_TEST_CASE( mvdTsvEmodels )
 }
 
 
+BOOST_AUTO_TEST_CASE( mvdTsvSelection )
+{
+    using namespace MVD3;
+
+    MVD3File file(MVD3_TSV_FILENAME);
+    file.openComboTsv(TSV_FILENAME);
+
+    const auto eModels = file.getEmodels(MVD::Selection::fromIndices(std::vector<size_t>{0, 9, 33}));
+
+    BOOST_REQUIRE_EQUAL(eModels.size(), 3);
+    BOOST_CHECK_EQUAL(eModels[0], "bAC_327962063");
+    BOOST_CHECK_EQUAL(eModels[1], "dSTUT_321707905");
+    BOOST_CHECK_EQUAL(eModels[2], "L6_cADpyr_471819401");
+}
+
+
 BOOST_AUTO_TEST_CASE( mvdTsvLayers )
 {
     using namespace MVD3;
@@ -483,6 +826,101 @@ BOOST_AUTO_TEST_CASE( mvdTsvLayers )
     BOOST_CHECK_EQUAL(layers[33], "6");
 }
 
+BOOST_AUTO_TEST_CASE( mvdTsvJoin )
+{
+    using namespace MVD3;
+
+    MVD3File file(MVD3_TSV_FILENAME);
+    file.openComboTsv(TSV_FILENAME);
+
+    // Joined on library indices as looked up by names
+    const TSV::TSVFile tsv(TSV_FILENAME);
+    const auto expected = tsv.get(file.getMECombos(), file.getMorphologies());
+    const auto infos = file.getTSVInfo();
+    BOOST_REQUIRE_EQUAL(infos.size(), expected.size());
+    for (size_t i = 0; i < infos.size(); ++i) {
+        BOOST_CHECK_EQUAL(infos[i].get().comboName, expected[i].get().comboName);
+        BOOST_CHECK_EQUAL(infos[i].get().morphologyName, expected[i].get().morphologyName);
+    }
+
+    // Through the binary cache of the TSV file, twice to read it
+    for (int i = 0; i < 2; ++i) {
+        file.openComboTsv(TSV_FILENAME, ".");
+        BOOST_CHECK_EQUAL(file.getTSVInfo()[9].get().comboName, expected[9].get().comboName);
+    }
+
+    // Neurons missing from the TSV file
+    const std::string filename = "test_mvd3_join.tsv";
+    {
+        std::ifstream in(TSV_FILENAME);
+        std::ofstream out(filename);
+        std::string line;
+        for (int i = 0; i < 3 && std::getline(in, line); ++i) {
+            out << line << '\n';
+        }
+    }
+    file.openComboTsv(filename);
+    BOOST_CHECK_THROW(file.getEmodels(), TSVException);
+    BOOST_CHECK_THROW(file.getThresholdCurrents(), TSVException);
+}
+
+BOOST_AUTO_TEST_CASE( mvdTsvColumns )
+{
+    using namespace MVD3;
+
+    MVD3File file(MVD3_TSV_FILENAME);
+    BOOST_CHECK_THROW(file.getTSVColumns(), MVDException);
+    file.openComboTsv(TSV_FILENAME);
+
+    const auto columns = file.getTSVColumns(Range::all(),
+                                            TSV::ColumnMask::EType | TSV::ColumnMask::EModel |
+                                                TSV::ColumnMask::ThresholdCurrent |
+                                                TSV::ColumnMask::HoldingCurrent);
+    BOOST_CHECK(columns.eTypes == file.getEtypes());
+    BOOST_CHECK(columns.eModels == file.getEmodels());
+    BOOST_CHECK(columns.thresholdCurrents == file.getThresholdCurrents());
+    BOOST_CHECK(columns.holdingCurrents == file.getHoldingCurrents());
+    BOOST_CHECK(columns.layers.empty());
+
+    const auto selected = file.getTSVColumns(
+        MVD::Selection::fromIndices(std::vector<size_t>{0, 9, 33}), TSV::ColumnMask::EModel);
+    BOOST_REQUIRE_EQUAL(selected.eModels.size(), 3);
+    BOOST_CHECK_EQUAL(selected.eModels[1], "dSTUT_321707905");
+}
+
+BOOST_AUTO_TEST_CASE( mvdTsvWorkers )
+{
+    using namespace MVD3;
+
+    MVD3File file(MVD3_TSV_FILENAME);
+    file.openComboTsv(TSV_FILENAME);
+    BOOST_CHECK_EQUAL(file.getTSVWorkers(), 1);
+    const auto emodels = file.getEmodels();
+    const auto currents = file.getThresholdCurrents();
+
+    file.setTSVWorkers(0);
+    BOOST_CHECK_GE(file.getTSVWorkers(), 1);
+    file.setTSVWorkers(4);
+    BOOST_CHECK_EQUAL(file.getTSVWorkers(), 4);
+    BOOST_CHECK(file.getEmodels() == emodels);
+    BOOST_CHECK(file.getThresholdCurrents() == currents);
+    BOOST_CHECK(file.getTSVColumns(Range(5, 20), TSV::ColumnMask::EModel).eModels ==
+                std::vector<std::string>(emodels.begin() + 5, emodels.begin() + 25));
+
+    // Misses are still resolved by name, after the joins
+    const std::string filename = "test_mvd3_workers.tsv";
+    {
+        std::ifstream in(TSV_FILENAME);
+        std::ofstream out(filename);
+        std::string line;
+        for (int i = 0; i < 3 && std::getline(in, line); ++i) {
+            out << line << '\n';
+        }
+    }
+    file.openComboTsv(filename);
+    BOOST_CHECK_THROW(file.getEmodels(), TSVException);
+}
+
 BOOST_AUTO_TEST_CASE( mvdTsvFilesWithTabs )
 {
     using namespace MVD3;
@@ -17,6 +17,7 @@
  *
  */
 #include <mvdtool/mvd_generic.hpp>
+#include <boost/math/quaternion.hpp>
 
 #define BOOST_TEST_MODULE mvd3Parser
 #define BOOST_TEST_MAIN
@@ -110,6 +111,43 @@ BOOST_AUTO_TEST_CASE( basicTestRotationsConverted )
 }
 
 
+BOOST_AUTO_TEST_CASE( basicTestRotationsConvertedExact )
+{
+    using Quaternion = boost::math::quaternion<double>;
+
+    SonataFile file(SONATA_FILENAME_ALTERNATIVE);
+    bbp::sonata::NodePopulation pop(SONATA_FILENAME_ALTERNATIVE, "", "default");
+    const auto attrs = pop.attributeNames();
+
+    // Reference: cell by cell composition
+    const auto angle = [&](const std::string& name, size_t i) {
+        return pop.getAttribute<double>(name, bbp::sonata::Selection({{i, i + 1}}))[0];
+    };
+    const auto rotations = file.getRotations();
+    const auto sparse = file.getRotations(Selection({{3, 5}, {700, 702}}));
+    for (size_t i = 0; i < file.size(); ++i) {
+        Quaternion rot{1., 0., 0., 0.};
+        if (attrs.count("rotation_angle_zaxis")) {
+            const auto halfangle = angle("rotation_angle_zaxis", i) * .5;
+            rot *= Quaternion{cos(halfangle), 0., 0., sin(halfangle)};
+        }
+        if (attrs.count("rotation_angle_yaxis")) {
+            const auto halfangle = angle("rotation_angle_yaxis", i) * .5;
+            rot *= Quaternion{cos(halfangle), 0., sin(halfangle), 0.};
+        }
+        if (attrs.count("rotation_angle_xaxis")) {
+            const auto halfangle = angle("rotation_angle_xaxis", i) * .5;
+            rot *= Quaternion{cos(halfangle), sin(halfangle), 0., 0.};
+        }
+        BOOST_REQUIRE_EQUAL(rotations[i][0], rot.R_component_2());
+        BOOST_REQUIRE_EQUAL(rotations[i][1], rot.R_component_3());
+        BOOST_REQUIRE_EQUAL(rotations[i][2], rot.R_component_4());
+        BOOST_REQUIRE_EQUAL(rotations[i][3], rot.R_component_1());
+    }
+    BOOST_CHECK(sparse[1] == rotations[4]);
+    BOOST_CHECK(sparse[2] == rotations[700]);
+}
+
 BOOST_AUTO_TEST_CASE( basicTestRotationRange )
 {
     SonataFile file(SONATA_FILENAME);
@@ -388,3 +426,390 @@ BOOST_AUTO_TEST_CASE( newSonataTestAllLayers )
     BOOST_CHECK_EQUAL(allLayers[1], "SP");
     BOOST_CHECK_EQUAL(allLayers[2], "SO");
 }
+
+BOOST_AUTO_TEST_CASE( newSonataTestCategorical )
+{
+    SonataFile file(SONATA_FILENAME_NEW_FORMAT);
+
+    // mtype is an @library enumeration
+    const auto mtypes = file.getCategoricalMtypes();
+    const auto mtype_values = file.getMtypes();
+    BOOST_CHECK_EQUAL(mtypes.size(), 2616);
+    const auto mtypes_decoded = mtypes.values();
+    BOOST_CHECK_EQUAL_COLLECTIONS(mtypes_decoded.begin(), mtypes_decoded.end(),
+                                  mtype_values.begin(), mtype_values.end());
+    const auto all_mtypes = file.listAllMtypes();
+    BOOST_CHECK_EQUAL_COLLECTIONS(mtypes.dictionary().begin(), mtypes.dictionary().end(),
+                                  all_mtypes.begin(), all_mtypes.end());
+    BOOST_CHECK_EQUAL(&file.getCategoricalMtypes(Range(3, 5)).dictionary(),
+                      &mtypes.dictionary());
+
+    // region is stored as plain strings and is encoded on read
+    const auto regions = file.getCategoricalRegions();
+    const auto region_values = file.getRegions();
+    const auto regions_decoded = regions.values();
+    BOOST_CHECK_EQUAL_COLLECTIONS(regions_decoded.begin(), regions_decoded.end(),
+                                  region_values.begin(), region_values.end());
+    BOOST_CHECK_EQUAL(regions.codes()[0], 0);
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestCellBatch )
+{
+    auto file = MVD::open(SONATA_FILENAME);
+
+    const auto batch = file->read(Range(100, 20));
+    BOOST_CHECK_EQUAL(batch.size(), 20);
+    BOOST_CHECK(batch.positions == file->getPositions(Range(100, 20)));
+    BOOST_CHECK(batch.rotations == file->getRotations(Range(100, 20)));
+    const auto mtypes = file->getMtypes(Range(100, 20));
+    const auto batch_mtypes = batch.mtypes.values();
+    BOOST_CHECK_EQUAL_COLLECTIONS(batch_mtypes.begin(), batch_mtypes.end(),
+                                  mtypes.begin(), mtypes.end());
+
+    // Angular rotations are converted in the batch as well
+    SonataFile alt_file(SONATA_FILENAME_ALTERNATIVE);
+    const auto alt_batch = alt_file.read(Range::all(), CellColumn::Rotations);
+    BOOST_CHECK(alt_batch.rotations == alt_file.getRotations());
+    BOOST_CHECK_EQUAL(alt_batch.morphologies.size(), 0);
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestSelection )
+{
+    SonataFile file(SONATA_FILENAME);
+    const auto all_positions = file.getPositions();
+    const auto all_mtypes = file.getMtypes();
+
+    const auto sparse = Selection::fromIndices(std::vector<size_t>{1, 2, 40, 998});
+    const auto positions = file.getPositions(sparse);
+    BOOST_CHECK_EQUAL(positions.shape()[0], 4);
+    BOOST_CHECK_EQUAL(positions[1][0], all_positions[2][0]);
+    BOOST_CHECK_EQUAL(positions[3][2], all_positions[998][2]);
+
+    const auto mtypes = file.getMtypes(sparse);
+    BOOST_CHECK_EQUAL(mtypes[2], all_mtypes[40]);
+    BOOST_CHECK_EQUAL(file.getCategoricalMtypes(sparse)[3], all_mtypes[998]);
+    BOOST_CHECK(file.getRotations(sparse)[0] == file.getRotations(Range(1, 1))[0]);
+
+    const auto batch = file.read(sparse);
+    BOOST_CHECK_EQUAL(batch.size(), 4);
+    BOOST_CHECK(batch.positions == positions);
+
+    // Angular rotations are gathered per range
+    SonataFile alt_file(SONATA_FILENAME_ALTERNATIVE);
+    const auto rotations = alt_file.getRotations(Selection({{0, 2}, {500, 501}}));
+    BOOST_CHECK_EQUAL(rotations.shape()[0], 3);
+    BOOST_CHECK(rotations[2] == alt_file.getRotations(Range(500, 1))[0]);
+
+    BOOST_CHECK_EQUAL(file.getMorphologies(Selection()).size(), 0);
+    BOOST_CHECK_THROW(file.getPositions(Selection({{999, 1001}})), MVDException);
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestReadInto )
+{
+    SonataFile file(SONATA_FILENAME);
+
+    std::vector<double> buffer(20 * 5, -1.);
+    file.readPositions(Range(10, 20), buffer.data(), 5);
+    const auto positions = file.getPositions(Range(10, 20));
+    for (size_t i = 0; i < 20; ++i) {
+        BOOST_CHECK_EQUAL(buffer[i * 5], positions[i][0]);
+        BOOST_CHECK_EQUAL(buffer[i * 5 + 1], positions[i][1]);
+        BOOST_CHECK_EQUAL(buffer[i * 5 + 2], positions[i][2]);
+        BOOST_CHECK_EQUAL(buffer[i * 5 + 4], -1.);
+    }
+
+    std::vector<double> rotations(20 * 4);
+    file.readRotations(Range(10, 20), rotations.data());
+    BOOST_CHECK_EQUAL(rotations[5 * 4 + 3], file.getRotations(Range(15, 1))[0][3]);
+
+    std::vector<float> ys(20);
+    file.readAttribute("y", Range(10, 20), ys.data());
+    BOOST_CHECK_EQUAL(ys[19], float(positions[19][1]));
+
+    // Angular rotations are converted, then copied
+    SonataFile alt_file(SONATA_FILENAME_ALTERNATIVE);
+    alt_file.readRotations(Range(0, 20), rotations.data());
+    BOOST_CHECK_EQUAL(rotations[1], alt_file.getRotations(Range(0, 1))[0][1]);
+
+    BOOST_CHECK_THROW(file.readAttribute("unknown", Range(0, 1), ys.data()), MVDException);
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestChunks )
+{
+    auto file = MVD::open(SONATA_FILENAME_NEW_FORMAT);
+    const auto all_mtypes = file->getMtypes();
+
+    size_t offset = 0;
+    for (const auto& batch: file->chunks(1000)) {
+        BOOST_CHECK_EQUAL(batch.positions.shape()[0], batch.size());
+        BOOST_CHECK_EQUAL(batch.mtypes[0], all_mtypes[offset]);
+        offset += batch.size();
+    }
+    BOOST_CHECK_EQUAL(offset, file->size());
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestSchema )
+{
+    SonataFile file(SONATA_FILENAME_NEW_FORMAT);
+    const auto& schema = file.getSchema();
+
+    const auto& x = schema.get("x");
+    BOOST_CHECK_EQUAL(x.dtype, "double");
+    BOOST_CHECK_EQUAL(x.rows(), file.getNbNeuron());
+    BOOST_CHECK_EQUAL(x.chunk_rows, file.storageChunkSize());
+    BOOST_CHECK(!x.enumeration);
+
+    BOOST_CHECK(schema.get("mtype").enumeration);
+    BOOST_CHECK(!schema.get("layer").enumeration);
+    BOOST_CHECK_EQUAL(schema.get("@library/mtype").rows(), file.listAllMtypes().size());
+    BOOST_CHECK(schema.has("dynamics_params/threshold_current"));
+    BOOST_CHECK(schema.find("orientation_x") == nullptr);
+
+    // Capability checks agree with the schema
+    BOOST_CHECK(file.hasRotations());
+    BOOST_CHECK(file.hasCurrents());
+    BOOST_CHECK(file.hasDynamicsAttribute("threshold_current"));
+    BOOST_CHECK(!file.hasAttribute("threshold_current"));
+    BOOST_CHECK(!file.hasAttribute("@library/mtype"));
+    BOOST_CHECK_EQUAL(file.getAttributeDataType("mtype"), "uint32_t");
+    BOOST_CHECK_EQUAL(file.getAttributeDataType("holding_current"), "double");
+    BOOST_CHECK_THROW(file.getAttributeDataType("unknown"), MVDException);
+    BOOST_CHECK_THROW(schema.get("unknown"), MVDException);
+}
+
+
+BOOST_AUTO_TEST_CASE( multiPopulationFile )
+{
+    MultiPopulationFile file(SONATA_FILENAME);
+    SonataFile first(SONATA_FILENAME, "default");
+    SonataFile second(SONATA_FILENAME, "truncated");
+    const size_t n_first = first.getNbNeuron();
+    const size_t n_second = second.getNbNeuron();
+
+    BOOST_CHECK_EQUAL(file.getNbPopulations(), 2);
+    BOOST_CHECK_EQUAL(file.getPopulationNames()[1], "truncated");
+    BOOST_CHECK_EQUAL(file.getNbNeuron(), n_first + n_second);
+    BOOST_CHECK_EQUAL(file.getPopulationOffsets()[1], n_first);
+    BOOST_CHECK(file.locate(n_first + 2) == std::make_pair(size_t(1), size_t(2)));
+    BOOST_CHECK_THROW(file.locate(file.getNbNeuron()), MVDException);
+
+    // A range over both populations is read in one output
+    const Range range(n_first - 3, 6);
+    const auto positions = file.getPositions(range);
+    const auto first_positions = first.getPositions(Range(n_first - 3, 3));
+    const auto second_positions = second.getPositions(Range(0, 3));
+    BOOST_REQUIRE_EQUAL(positions.shape()[0], 6);
+    for (size_t i = 0; i < 3; ++i) {
+        for (size_t j = 0; j < 3; ++j) {
+            BOOST_CHECK_EQUAL(positions[i][j], first_positions[i][j]);
+            BOOST_CHECK_EQUAL(positions[i + 3][j], second_positions[i][j]);
+        }
+    }
+    std::vector<double> rotations(6 * 5, -1.);
+    file.readRotations(range, rotations.data(), 5);
+    BOOST_CHECK_EQUAL(rotations[4 * 5 + 3], second.getRotations(Range(1, 1))[0][3]);
+    BOOST_CHECK_EQUAL(rotations[4 * 5 + 4], -1.);
+
+    // Sparse selections, strings and merged dictionaries
+    const Selection selection({{1, 3}, {n_first - 1, n_first + 2}});
+    const auto mtypes = file.getMtypes(selection);
+    BOOST_REQUIRE_EQUAL(mtypes.size(), 5);
+    BOOST_CHECK_EQUAL(mtypes[0], first.getMtypes(Range(1, 1))[0]);
+    BOOST_CHECK_EQUAL(mtypes[4], second.getMtypes(Range(1, 1))[0]);
+    BOOST_CHECK(file.getCategoricalMtypes(selection).values() == mtypes);
+
+    const auto all_mtypes = file.listAllMtypes();
+    const auto index = file.getIndexMtypes(selection);
+    for (size_t i = 0; i < mtypes.size(); ++i) {
+        BOOST_CHECK_EQUAL(all_mtypes[index[i]], mtypes[i]);
+    }
+
+    // Several files, one after the other
+    const std::vector<std::string> filenames = {SONATA_FILENAME, SONATA_FILENAME_ALTERNATIVE};
+    MultiPopulationFile files(filenames);
+    BOOST_CHECK_EQUAL(files.getNbPopulations(), 3);
+    BOOST_CHECK_EQUAL(files.getNbNeuron(),
+                      file.getNbNeuron() + SonataFile(SONATA_FILENAME_ALTERNATIVE).getNbNeuron());
+    BOOST_CHECK_EQUAL(files.getRotations(Range(file.getNbNeuron(), 1))[0][1],
+                      SonataFile(SONATA_FILENAME_ALTERNATIVE).getRotations(Range(0, 1))[0][1]);
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestTypedAttribute )
+{
+    SonataFile file(SONATA_FILENAME_NEW_FORMAT);
+
+    // Enumerations keep their stored codes
+    const auto etypes = file.getTypedAttribute("etype", Range(10, 20));
+    BOOST_CHECK_EQUAL(etypes.dtype(), "uint32_t");
+    BOOST_REQUIRE(etypes.holds<uint32_t>());
+    const auto& codes = etypes.get<uint32_t>();
+    BOOST_REQUIRE_EQUAL(codes.size(), 20);
+    BOOST_CHECK_EQUAL(codes[5], file.getIndexEtypes(Range(15, 1))[0]);
+    BOOST_CHECK_THROW(etypes.get<uint64_t>(), MVDException);
+
+    const auto xs = file.getTypedAttribute("x", Selection({{0, 2}, {100, 101}}));
+    BOOST_CHECK_EQUAL(xs.size(), 3);
+    BOOST_CHECK_EQUAL(xs.get<double>()[2], file.getPositions(Range(100, 1))[0][0]);
+
+    const auto layers = file.getTypedAttribute("layer", Range(0, 3));
+    BOOST_CHECK_EQUAL(layers.dtype(), "string");
+    BOOST_CHECK(layers.get<std::string>() == file.getLayers(Range(0, 3)));
+
+    const auto currents = file.getTypedAttribute("threshold_current", Range(0, 3));
+    BOOST_CHECK_EQUAL(currents.get<double>()[1], file.getThresholdCurrents(Range(1, 1))[0]);
+
+    SonataFile other(SONATA_FILENAME);
+    BOOST_CHECK_EQUAL(other.getTypedAttribute("region").dtype(), "int32_t");
+    BOOST_CHECK_THROW(other.getTypedAttribute("unknown"), MVDException);
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestQuery )
+{
+    SonataFile file(SONATA_FILENAME_NEW_FORMAT);
+
+    const auto mtypes = file.getMtypes();
+    const auto layers = file.getLayers();
+    const auto currents = file.getThresholdCurrents();
+
+    // Enumerations, plain strings and dynamics, over a multi-range selection
+    const auto query = Query(64)
+                           .in("mtype", {mtypes[0], mtypes[1000]})
+                           .equals("layer", layers[0])
+                           .between("threshold_current", 0., 1e9);
+    const Selection cells({{0, 100}, {900, 2616}});
+
+    std::vector<size_t> expected;
+    for (const size_t i: cells.flatten()) {
+        if ((mtypes[i] == mtypes[0] || mtypes[i] == mtypes[1000]) && layers[i] == layers[0] &&
+            currents[i] >= 0.) {
+            expected.push_back(i);
+        }
+    }
+    BOOST_CHECK(!expected.empty());
+    BOOST_CHECK(query.select(file, cells).flatten() == expected);
+
+    // Through the generic interface
+    auto generic = MVD::open(SONATA_FILENAME_NEW_FORMAT);
+    BOOST_CHECK(Query().in("mtype", {mtypes[0]}).select(*generic).flatSize() ==
+                static_cast<size_t>(std::count(mtypes.begin(), mtypes.end(), mtypes[0])));
+
+    // Positional predicates read the x attribute alone
+    const auto positions = file.getPositions();
+    const double x_max = positions[positions.shape()[0] / 2][0];
+    std::vector<size_t> west;
+    for (size_t i = 0; i < positions.shape()[0]; ++i) {
+        if (positions[i][0] <= x_max) {
+            west.push_back(i);
+        }
+    }
+    BOOST_CHECK(Query().between("x", -1e9, x_max).select(file).flatten() == west);
+
+    BOOST_CHECK_THROW(Query().between("layer", 0, 1).select(file), MVDException);
+    BOOST_CHECK_THROW(Query().equals("x", 0).select(file, Selection({{0, 3000}})),
+                      MVDException);
+}
+
+
+BOOST_AUTO_TEST_CASE( floatTestQuery )
+{
+    const std::string filename = "test_sonata_query.h5";
+    std::remove(filename.c_str());
+    {
+        SonataWriter writer(filename, 4, "float");
+        writer.writeAttribute("exc_mini_frequency", std::vector<float>{.63f, .122f, .63f, .04f});
+        writer.writeAttribute("hypercolumn", std::vector<int32_t>{1, 2, 3, 4});
+        writer.close();
+    }
+
+    // Literals are compared in the stored type: float(.63) != .63
+    SonataFile file(filename, "float");
+    BOOST_CHECK_EQUAL(file.getTypedAttribute("exc_mini_frequency").dtype(), "float");
+    BOOST_CHECK(Query().equals("exc_mini_frequency", .63).select(file).flatten() ==
+                std::vector<size_t>({0, 2}));
+    BOOST_CHECK(Query().between("exc_mini_frequency", .1, .63).select(file).flatten() ==
+                std::vector<size_t>({0, 1, 2}));
+    // Integer bounds are rounded inward
+    BOOST_CHECK(Query().between("hypercolumn", 1.5, 3.5).select(file).flatten() ==
+                std::vector<size_t>({1, 2}));
+    BOOST_CHECK(Query().between("hypercolumn", 1e12, 1e13).select(file).empty());
+}
+
+
+BOOST_AUTO_TEST_CASE( basicTestWriter )
+{
+    const std::string filename = "test_sonata_writer.h5";
+    std::remove(filename.c_str());
+
+    // Every 3rd cell of an MVD3 circuit, compressed, in chunks of 64 cells
+    auto source = MVD::open(MVD3_FILENAME);
+    const size_t n_cells =
+        writeSonata(*source, filename, "strided", Range(10, 900), 3, 4, 64);
+    BOOST_CHECK_EQUAL(n_cells, 300);
+
+    {
+        SonataWriter writer(filename, 5, "manual");
+        writer.writeEnumeration("mtype", Categorical::fromValues({"a", "b"}), 0);
+        writer.writeEnumeration("mtype", Categorical::fromValues({"c", "b", "c"}), 2);
+        writer.writeAttribute("layer", std::vector<std::string>{"1", "2", "3", "4", "5"});
+        writer.writeDynamicsAttribute("threshold_current", std::vector<double>{.5, .25}, 3);
+        BOOST_CHECK_THROW(writer.writeAttribute("x", std::vector<double>(3), 3), MVDException);
+        writer.close();
+        BOOST_CHECK_THROW(writer.writeAttribute("y", std::vector<double>(1)), MVDException);
+    }
+
+    SonataFile strided(filename, "strided");
+    BOOST_REQUIRE_EQUAL(strided.getNbNeuron(), n_cells);
+    const Selection cells = Selection({{10, 11}, {13, 14}, {907, 908}});
+    const std::vector<size_t> written = {0, 1, 299};
+    const auto positions = source->getPositions(cells);
+    const auto rotations = source->getRotations(cells);
+    const auto mtypes = source->getMtypes(cells);
+    const auto regions = source->getRegions(cells);
+    for (size_t i = 0; i < written.size(); ++i) {
+        const Range cell(written[i], 1);
+        BOOST_CHECK_EQUAL(strided.getPositions(cell)[0][1], positions[i][1]);
+        BOOST_CHECK_EQUAL(strided.getRotations(cell)[0][3], rotations[i][3]);
+        BOOST_CHECK_EQUAL(strided.getMtypes(cell)[0], mtypes[i]);
+        BOOST_CHECK_EQUAL(strided.getRegions(cell)[0], regions[i]);
+    }
+    BOOST_CHECK(strided.getSchema().get("mtype").enumeration);
+    BOOST_CHECK_EQUAL(strided.getSchema().get("x").chunk_rows, 64);
+
+    SonataFile manual(filename, "manual");
+    BOOST_CHECK(manual.getMtypes() == std::vector<std::string>({"a", "b", "c", "b", "c"}));
+    BOOST_CHECK_EQUAL(manual.listAllMtypes().size(), 3);
+    BOOST_CHECK_EQUAL(manual.getLayers()[4], "5");
+    BOOST_CHECK_EQUAL(manual.getThresholdCurrents(Range(3, 2))[1], .25);
+
+    BOOST_CHECK_THROW(SonataWriter(filename, 1, "manual"), HighFive::Exception);
+    BOOST_CHECK_THROW(writeSonata(*source, filename, "other", Range::all(), 0), MVDException);
+}
+
+
+BOOST_AUTO_TEST_CASE( mvd2TestWriter )
+{
+    const std::string filename = "test_sonata_writer_mvd2.h5";
+    std::remove(filename.c_str());
+
+    // MVD2 files have no regions: the column is left out
+    auto source = MVD::open(MVD2_FILENAME);
+    BOOST_CHECK(!source->hasRegions());
+    const size_t n_cells = writeSonata(*source, filename, "mvd2");
+    BOOST_CHECK_EQUAL(n_cells, source->size());
+
+    SonataFile written(filename, "mvd2");
+    BOOST_REQUIRE_EQUAL(written.getNbNeuron(), n_cells);
+    BOOST_CHECK(!written.hasRegions());
+    BOOST_CHECK(written.getMorphologies() == source->getMorphologies());
+    BOOST_CHECK(written.getMtypes() == source->getMtypes());
+    BOOST_CHECK(written.getSynapseClass() == source->getSynapseClass());
+    const Range last(n_cells - 1, 1);
+    BOOST_CHECK_EQUAL(written.getPositions(last)[0][2], source->getPositions(last)[0][2]);
+}
@@ -16,8 +16,15 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  *
  */
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
 #include <sstream>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+
 #include <mvdtool/tsv.hpp>
 
 #define BOOST_TEST_MODULE tsvParser
@@ -59,6 +66,35 @@ BOOST_AUTO_TEST_CASE( TSVFileParsing )
 
 }
 
+BOOST_AUTO_TEST_CASE( TSVFileColumns )
+{
+    using namespace TSV;
+
+    TSVFile mecombofile(TSV_FILENAME);
+    const std::vector<std::string> combos = {"dSTUT_1_87dd39e6b0255ec053001f16da85b0e0",
+                                             "dSTUT_1_87dd39e6b0255ec053001f16da85b0e0"};
+    const std::vector<std::string> morphologies = {"87dd39e6b0255ec053001f16da85b0e0",
+                                                   "87dd39e6b0255ec053001f16da85b0e0"};
+
+    const auto columns = mecombofile.getColumns(
+        combos, morphologies, ColumnMask::EModel | ColumnMask::HoldingCurrent);
+    BOOST_CHECK(columns.eModels == mecombofile.getEmodels(combos, morphologies));
+    BOOST_CHECK(columns.holdingCurrents == mecombofile.getHoldingCurrents(combos, morphologies));
+    BOOST_CHECK(columns.eTypes.empty());
+    BOOST_CHECK(columns.thresholdCurrents.empty());
+
+    const auto all = mecombofile.getColumns(combos, morphologies);
+    BOOST_CHECK_EQUAL(all.morphologyNames[1], morphologies[1]);
+    BOOST_CHECK_EQUAL(all.layers[1], "1");
+    BOOST_CHECK_EQUAL(all.fullMTypes[1], "L1_DAC");
+    BOOST_CHECK_EQUAL(all.eTypes[1], "dSTUT");
+    BOOST_CHECK_EQUAL(all.comboNames[1], combos[1]);
+    BOOST_CHECK_EQUAL(all.thresholdCurrents[1], 0);
+
+    BOOST_CHECK_THROW(mecombofile.getColumns({combos[0]}, {"a4dc631127a7bde0adf5f58634397757"}),
+                      TSVException);
+}
+
 BOOST_AUTO_TEST_CASE( ReadTSVFileWithTabs )
 {
     using namespace TSV;
@@ -79,3 +115,143 @@ BOOST_AUTO_TEST_CASE( ReadTSVFileWithTabs )
     BOOST_CHECK_EQUAL(info.holdingCurrent, 0.1);
 
 }
+
+BOOST_AUTO_TEST_CASE( ReadTSVFileFormats )
+{
+    using namespace TSV;
+
+    const std::string filename = "test_tsv_formats.tsv";
+    {
+        std::ofstream out(filename);
+        out << "morph_name\tlayer\tfullmtype\tetype\temodel\tcombo_name\tthreshold_current\t"
+               "holding_current\n"
+            << "m1\t1\tL1_DAC\tbAC\te1\tc1\t1e-3\t-.25\n"
+            << "\t\tm2\t2\tL23_PC\tcADpyr\te2\tc2\t\t\n"
+            << "m1\t1\tL1_DAC\tbAC\te1\tc1\t7\t7\n"
+            << "m3\t3\tL4_SS\tcADpyr\te3\tc3\t0.12345678901234567\t1.5E2";
+    }
+
+    TSVFile mecombofile(filename);
+    BOOST_CHECK_EQUAL(mecombofile.getAll().size(), 3);
+
+    const auto infos = mecombofile.get({"c1", "c2", "c3"}, {"m1", "m2", "m3"});
+    BOOST_CHECK_EQUAL(infos[0].get().thresholdCurrent, 1e-3);
+    BOOST_CHECK_EQUAL(infos[0].get().holdingCurrent, -.25);
+    BOOST_CHECK_EQUAL(infos[1].get().morphologyName, "m2");
+    BOOST_CHECK_EQUAL(infos[1].get().comboName, "c2");
+    BOOST_CHECK_EQUAL(infos[1].get().holdingCurrent, 0.);
+    BOOST_CHECK_EQUAL(infos[2].get().thresholdCurrent, std::stod("0.12345678901234567"));
+    BOOST_CHECK_EQUAL(infos[2].get().holdingCurrent, 150.);
+
+    {
+        std::ofstream out(filename);
+        out << "a\tb\tc\td\te\tf\n"
+            << "m1\t1\tL1_DAC\tbAC\te1\n";
+    }
+    BOOST_CHECK_THROW(TSVFile{filename}, TSVParserException);
+    {
+        std::ofstream out(filename);
+        out << "a\tb\tc\td\te\tf\tg\th\n"
+            << "m1\t1\tL1_DAC\tbAC\te1\tc1\tnone\t0\n";
+    }
+    BOOST_CHECK_THROW(TSVFile{filename}, TSVParserException);
+    BOOST_CHECK_THROW(TSVFile{"missing.tsv"}, TSVException);
+}
+
+BOOST_AUTO_TEST_CASE( TSVFileInternedStrings )
+{
+    using namespace TSV;
+
+    std::unique_ptr<TSVFile> mecombofile(new TSVFile(TSV_FILENAME));
+    const TSVFile copy = *mecombofile;
+    const auto all = mecombofile->getAll();
+    BOOST_CHECK_EQUAL(all.size(), 34);
+
+    // Repeated values are stored once
+    const MEComboEntry& first = all[0];
+    for (const MEComboEntry& entry: all) {
+        if (entry.fullMType == first.fullMType) {
+            BOOST_CHECK(entry.fullMType.data() == first.fullMType.data());
+        }
+    }
+
+    // Copies keep the strings of their entries
+    mecombofile.reset();
+    const MEComboEntry& info = copy.get({"dSTUT_1_87dd39e6b0255ec053001f16da85b0e0"},
+                                        {"87dd39e6b0255ec053001f16da85b0e0"})[0];
+    BOOST_CHECK_EQUAL(info.eModel, "dSTUT_321707905");
+    BOOST_CHECK_EQUAL(copy.getLayers({info.comboName.to_string()},
+                                     {info.morphologyName.to_string()})[0], "1");
+
+    BOOST_CHECK_THROW(TSVFile(TSV_FILENAME, MEComboEntry::HoldingCurrent), TSVException);
+}
+
+BOOST_AUTO_TEST_CASE( TSVFileCache )
+{
+    using namespace TSV;
+
+    const std::string filename = "test_tsv_cache.tsv";
+    const auto write_tsv = [&](const std::string& emodel) {
+        std::ofstream out(filename);
+        out << "morph_name\tlayer\tfullmtype\tetype\temodel\tcombo_name\tthreshold_current\t"
+               "holding_current\n"
+            << "m1\t1\tL1_DAC\tbAC\t" << emodel << "\tc1\t0.5\t-0.25\n"
+            << "m2\t1\tL1_DAC\tbAC\t" << emodel << "\tc2\t1\t2\n";
+    };
+    const auto emodel = [](const TSVFile& file) {
+        return file.getEmodels({"c2"}, {"m2"})[0];
+    };
+    const std::string cache = TSVFile::cacheFilename(filename);
+    BOOST_CHECK_EQUAL(cache, filename + ".cache");
+    std::remove(cache.c_str());
+
+    // Parsed, and the cache written
+    write_tsv("e1");
+    BOOST_CHECK_EQUAL(emodel(TSVFile::openCached(filename)), "e1");
+    BOOST_REQUIRE(std::ifstream(cache).good());
+
+    // Read from the cache while the tsv file keeps its size and time
+    struct stat info;
+    BOOST_REQUIRE_EQUAL(::stat(filename.c_str(), &info), 0);
+    write_tsv("e2");
+    const struct timespec times[2] = {info.st_atim, info.st_mtim};
+    BOOST_REQUIRE_EQUAL(::utimensat(AT_FDCWD, filename.c_str(), times, 0), 0);
+    {
+        const TSVFile file = TSVFile::openCached(filename);
+        BOOST_CHECK_EQUAL(emodel(file), "e1");
+        BOOST_CHECK_EQUAL(file.getAll().size(), 2);
+        BOOST_CHECK_EQUAL(file.getThresholdCurrents({"c1"}, {"m1"})[0], 0.5);
+        BOOST_CHECK_EQUAL(file.getHoldingCurrents({"c1"}, {"m1"})[0], -0.25);
+        BOOST_CHECK_THROW(file.get({"c1"}, {"m2"}), TSVException);
+    }
+
+    // Stale cache, after the tsv file changed
+    write_tsv("e333");
+    BOOST_CHECK_EQUAL(emodel(TSVFile::openCached(filename)), "e333");
+
+    // Corrupt caches
+    {
+        std::fstream out(cache, std::ios::in | std::ios::out | std::ios::binary);
+        out.seekp(-3, std::ios::end);
+        out.put('#');
+    }
+    BOOST_CHECK_EQUAL(emodel(TSVFile::openCached(filename)), "e333");
+    {
+        std::ifstream in(cache, std::ios::binary);
+        const std::string contents((std::istreambuf_iterator<char>(in)),
+                                   std::istreambuf_iterator<char>());
+        std::ofstream out(cache, std::ios::binary);
+        out.write(contents.data(), std::streamsize(contents.size() / 2));
+    }
+    BOOST_CHECK_EQUAL(emodel(TSVFile::openCached(filename)), "e333");
+    BOOST_CHECK_EQUAL(emodel(TSVFile::openCached(filename)), "e333");
+
+    // In a cache directory, named after the tsv file
+    const std::string cache_in_dir = TSVFile::cacheFilename(filename, ".");
+    BOOST_CHECK_EQUAL(cache_in_dir.compare(0, filename.size() + 3, "./" + filename + "."), 0);
+    std::remove(cache_in_dir.c_str());
+    BOOST_CHECK_EQUAL(emodel(TSVFile::openCached(filename, ".")), "e333");
+    BOOST_CHECK(std::ifstream(cache_in_dir).good());
+
+    BOOST_CHECK_THROW(TSVFile::openCached("missing.tsv", "."), TSVException);
+}